@@ -16,31 +16,19 @@ using namespace sph::car;
 
 LaneDetectorService::LaneDetectorService(std::shared_ptr<sph::car::LaneDetector> detector) {
     m_detector = detector;
-}
-
-bool LaneDetectorService::handle_request(const Seraphim::Request &req, Seraphim::Response &res) {
-    if (req.inner().Is<Seraphim::Car::LaneDetector::DetectionRequest>()) {
-        Seraphim::Car::LaneDetector::DetectionRequest inner_req;
-        Seraphim::Car::LaneDetector::DetectionResponse inner_res;
-
-        req.inner().UnpackTo(&inner_req);
-        if (handle_detection_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
-        }
-    }
 
-    return false;
+    register_handler(&LaneDetectorService::handle_detection_request);
 }
 
 bool LaneDetectorService::handle_detection_request(
     const Seraphim::Car::LaneDetector::DetectionRequest &req,
     Seraphim::Car::LaneDetector::DetectionResponse &res) {
     CoreImage image;
+    cv::Mat buffer;
     Polygon<int> polyroi;
     std::vector<Polygon<int>> lanes;
 
-    if (!sph::backend::Image2DtoImage(req.image(), image)) {
+    if (!sph::backend::Image2DtoImage(req.image(), image, buffer)) {
         return false;
     }
 
@@ -22,7 +22,6 @@ class LaneDetectorService : public sph::backend::Service {
 public:
     explicit LaneDetectorService(std::shared_ptr<sph::car::LaneDetector> detector);
 
-    bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) override;
     bool handle_detection_request(const Seraphim::Car::LaneDetector::DetectionRequest &req,
                                   Seraphim::Car::LaneDetector::DetectionResponse &res);
 
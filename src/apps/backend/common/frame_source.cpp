@@ -0,0 +1,31 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "frame_source.h"
+
+using namespace sph::backend;
+
+std::shared_ptr<const sph::ipc::FrameBus> FrameSource::bus(const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_buses.find(name);
+    if (it != m_buses.end() && !it->second->closed()) {
+        return it->second;
+    }
+
+    // readers which still hold the closed bus keep it mapped until they are done
+    auto bus = std::make_shared<sph::ipc::FrameBus>();
+    if (!bus->open(name)) {
+        if (it != m_buses.end()) {
+            m_buses.erase(it);
+        }
+        return nullptr;
+    }
+
+    m_buses[name] = bus;
+    return bus;
+}
@@ -0,0 +1,63 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_BACKEND_FRAME_SOURCE_H
+#define SPH_BACKEND_FRAME_SOURCE_H
+
+#include <memory>
+#include <mutex>
+#include <seraphim/ipc/frame_bus.h>
+#include <string>
+#include <unordered_map>
+
+namespace sph {
+namespace backend {
+
+/**
+ * @brief Frame buses of the cameras on this host.
+ *
+ * Clients may reference a frame on a bus (Seraphim::Types::FrameBusRef) instead of sending its
+ * pixels, so several services can subscribe to the same camera. The buses are opened on first use
+ * and shared by all services.
+ */
+class FrameSource {
+public:
+    /**
+     * @brief Singleton class instance.
+     * @return The single, static instance of this class.
+     */
+    static FrameSource &Instance() {
+        // Guaranteed to be destroyed, instantiated on first use.
+        static FrameSource instance;
+        return instance;
+    }
+
+    // Remove copy and assignment constructors.
+    FrameSource(FrameSource const &) = delete;
+    void operator=(FrameSource const &) = delete;
+
+    /**
+     * @brief Get a bus for reading.
+     *        A bus whose writer closed it (e.g. because the producer restarted) is opened again.
+     * @param name Name of the bus.
+     * @return The bus or nullptr if it does not exist.
+     */
+    std::shared_ptr<const sph::ipc::FrameBus> bus(const std::string &name);
+
+private:
+    FrameSource() = default;
+
+    /// open buses by name
+    std::unordered_map<std::string, std::shared_ptr<sph::ipc::FrameBus>> m_buses;
+    /// protects m_buses
+    std::mutex m_mutex;
+};
+
+} // namespace backend
+} // namespace sph
+
+#endif // SPH_BACKEND_FRAME_SOURCE_H
@@ -5,37 +5,397 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <climits>
 #include <cstring>
+#include <mutex>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <seraphim/image.h>
 #include <seraphim/iop/opencv/mat.h>
+#include <seraphim/ipc/buffer_registry.h>
+#include <vector>
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
 
+#include "frame_source.h"
 #include "utils.h"
 
-bool sph::backend::Image2DtoImage(const Seraphim::Types::Image2D &src, sph::CoreImage &dst) {
-    sph::CoreImage img;
+/// number of decode buffers which are kept around for reuse
+static constexpr size_t DECODE_POOL_SIZE = 16;
+
+/// upper bound for the size of decoded pixel data, the same as the message size limit of the
+/// transports, so a small compressed payload cannot make us allocate huge buffers
+static constexpr uint64_t MAX_DECODED_SIZE = 64 * 1024 * 1024;
+static_assert(MAX_DECODED_SIZE <= INT_MAX, "decode buffers are sized with int");
+
+/**
+ * @brief Get a buffer for decoded pixel data.
+ *        Buffers are handed out as long as nobody else references them, i.e. they return to the
+ *        pool as soon as the last cv::Mat referencing them is gone. Buffers of the requested
+ *        size are preferred, so steady streams of frames do not allocate.
+ * @param rows Number of rows.
+ * @param cols Number of columns.
+ * @param type OpenCV matrix type.
+ * @return The buffer.
+ */
+static cv::Mat pooled_mat(int rows, int cols, int type) {
+    static std::mutex mutex;
+    static std::vector<cv::Mat> pool;
+    std::lock_guard<std::mutex> lock(mutex);
+    cv::Mat *idle = nullptr;
+
+    for (auto &mat : pool) {
+        // the pool holds one reference itself
+        if (mat.u == nullptr || mat.u->refcount > 1) {
+            continue;
+        }
+
+        if (mat.rows == rows && mat.cols == cols && mat.type() == type) {
+            return mat;
+        }
+
+        idle = &mat;
+    }
+
+    if (idle) {
+        idle->create(rows, cols, type);
+        return *idle;
+    }
+
+    cv::Mat mat(rows, cols, type);
+    if (pool.size() < DECODE_POOL_SIZE) {
+        pool.push_back(mat);
+    }
+
+    return mat;
+}
+
+/**
+ * @brief Locate the payload of an image, either inline or in a shared buffer.
+ */
+static bool payload(const Seraphim::Types::Image2D &src, unsigned char *&data, size_t &size) {
+    if (src.has_buffer()) {
+        // the pixel data was shared out-of-band (e.g. in a shared memory segment), so it can be
+        // wrapped in place
+        data = sph::ipc::BufferRegistry::Instance().resolve(
+            sph::ipc::BufferRegistry::current(), src.buffer().region(), src.buffer().offset(),
+            src.buffer().size());
+        size = src.buffer().size();
+    } else {
+        data = const_cast<unsigned char *>(
+            reinterpret_cast<const unsigned char *>(src.data().c_str()));
+        size = src.data().size();
+    }
+
+    return data != nullptr;
+}
+
+/**
+ * @brief Copy a frame from a frame bus.
+ * @param src Input image referencing the frame.
+ * @param format Output parameter for the format of the frame, as if it was sent inline.
+ * @param data Output parameter for the data of the frame.
+ * @param size Output parameter for the size of the data in bytes.
+ */
+static bool read_bus(const Seraphim::Types::Image2D &src, Seraphim::Types::Image2D &format,
+                     cv::Mat &data, size_t &size) {
+    auto bus = sph::backend::FrameSource::Instance().bus(src.bus().bus());
+    sph::ipc::FrameBus::Frame frame;
+
+    if (!bus) {
+        return false;
+    }
+
+    // the writer reuses the slot of the frame soon, so it is copied out instead of being wrapped
+    bool ret = bus->read(src.bus().frame(), frame, [&](const sph::ipc::FrameBus::Frame &f) {
+        if (f.size == 0 || f.size > INT_MAX) {
+            return static_cast<unsigned char *>(nullptr);
+        }
+        data = pooled_mat(1, static_cast<int>(f.size), CV_8UC1);
+        return data.data;
+    });
+    if (!ret || frame.size == 0 || !Seraphim::Types::Image2D::Compression_IsValid(
+                                       static_cast<int>(frame.compression))) {
+        return false;
+    }
+
+    // the client may state the format it expects, e.g. the one of a stream
+    if ((src.width() > 0 && src.width() != frame.width) ||
+        (src.height() > 0 && src.height() != frame.height) ||
+        (src.fourcc() > 0 && src.fourcc() != frame.fourcc) ||
+        (src.compression() != Seraphim::Types::Image2D::NONE &&
+         src.compression() != static_cast<int>(frame.compression))) {
+        return false;
+    }
+
+    format.set_width(frame.width);
+    format.set_height(frame.height);
+    format.set_stride(frame.stride);
+    format.set_fourcc(frame.fourcc);
+    format.set_compression(static_cast<Seraphim::Types::Image2D::Compression>(frame.compression));
+    size = frame.size;
+    return true;
+}
+
+/**
+ * @brief Check whether the decoded pixels of an image may be allocated.
+ *        The dimensions are stated by the client, so they are checked before decoding anything.
+ * @param height Number of rows.
+ * @param stride Number of bytes per row.
+ */
+static bool decodable(uint64_t height, uint64_t stride) {
+    return height > 0 && stride > 0 && stride <= MAX_DECODED_SIZE / height;
+}
+
+/**
+ * @brief Decode a JPEG stream, optionally at reduced scale.
+ */
+static bool decode_jpeg(const Seraphim::Types::Image2D &src, const sph::Pixelformat &pixfmt,
+                        unsigned char *data, size_t size, int reduce, cv::Mat &buffer) {
+    int flags;
+    int type;
+
+    if (pixfmt.pattern == sph::Pixelformat::Pattern::BGR && pixfmt.size == 3) {
+        type = CV_8UC3;
+        flags = cv::IMREAD_COLOR;
+    } else if (pixfmt.pattern == sph::Pixelformat::Pattern::MONO && pixfmt.size == 1) {
+        type = CV_8UC1;
+        flags = cv::IMREAD_GRAYSCALE;
+    } else {
+        return false;
+    }
+
+    if (!decodable(src.height(), src.width() * pixfmt.size) ||
+        size > static_cast<size_t>(INT_MAX)) {
+        return false;
+    }
+
+    switch (reduce) {
+    case 1:
+        break;
+    case 2:
+        flags = type == CV_8UC3 ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_REDUCED_GRAYSCALE_2;
+        break;
+    case 4:
+        flags = type == CV_8UC3 ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_GRAYSCALE_4;
+        break;
+    case 8:
+        flags = type == CV_8UC3 ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_REDUCED_GRAYSCALE_8;
+        break;
+    default:
+        return false;
+    }
+
+    // the decoder scales down by rounding up
+    int rows = (static_cast<int>(src.height()) + reduce - 1) / reduce;
+    int cols = (static_cast<int>(src.width()) + reduce - 1) / reduce;
+
+    // decoding into a buffer of the right size does not allocate
+    buffer = pooled_mat(rows, cols, type);
+    cv::imdecode(cv::Mat(1, static_cast<int>(size), CV_8UC1, data), flags, &buffer);
+
+    // the dimensions must match the message, otherwise coordinates would be off
+    return buffer.rows == rows && buffer.cols == cols && buffer.type() == type;
+}
+
+/**
+ * @brief Decompress losslessly compressed raw pixels.
+ */
+static bool decompress(const Seraphim::Types::Image2D &src, size_t stride, unsigned char *data,
+                       size_t size, cv::Mat &buffer) {
+    size_t expected;
+
+    if (!decodable(src.height(), stride) || size > static_cast<size_t>(INT_MAX)) {
+        return false;
+    }
+    expected = stride * src.height();
+
+#ifdef WITH_ZSTD
+    // zstd frames state their size, unknown sizes and errors are never equal to a valid one
+    if (src.compression() == Seraphim::Types::Image2D::ZSTD &&
+        ZSTD_getFrameContentSize(data, size) != expected) {
+        return false;
+    }
+#endif
+
+    buffer = pooled_mat(static_cast<int>(src.height()), static_cast<int>(stride), CV_8UC1);
+
+    switch (src.compression()) {
+#ifdef WITH_LZ4
+    case Seraphim::Types::Image2D::LZ4: {
+        int ret = LZ4_decompress_safe(reinterpret_cast<const char *>(data),
+                                      reinterpret_cast<char *>(buffer.data),
+                                      static_cast<int>(size), static_cast<int>(expected));
+        return ret >= 0 && static_cast<size_t>(ret) == expected;
+    }
+#endif
+#ifdef WITH_ZSTD
+    case Seraphim::Types::Image2D::ZSTD: {
+        size_t ret = ZSTD_decompress(buffer.data, expected, data, size);
+        return !ZSTD_isError(ret) && ret == expected;
+    }
+#endif
+    default:
+        // unsupported in this build
+        (void)data;
+        (void)size;
+        (void)expected;
+        return false;
+    }
+}
+
+/**
+ * @brief Wrap or decode the payload of an image.
+ */
+static bool decode(const Seraphim::Types::Image2D &src, unsigned char *data, size_t size,
+                   sph::CoreImage &dst, cv::Mat &buffer, int reduce) {
     sph::Pixelformat pixfmt;
-    unsigned char *data;
+    size_t stride;
 
     pixfmt = sph::Pixelformat(src.fourcc());
     if (pixfmt.size == 0) {
         return false;
     }
 
-    data = const_cast<unsigned char *>(reinterpret_cast<const unsigned char *>(src.data().c_str()));
-    dst = sph::CoreImage(data, src.width(), src.height(), pixfmt, src.stride());
+    // a row must hold all pixels of a line, otherwise the last rows would extend beyond the
+    // buffer, no matter whether it is shared or decompressed (JPEG streams ignore the stride)
+    stride = src.width() * pixfmt.size;
+    if (src.stride() > 0 && src.compression() != Seraphim::Types::Image2D::JPEG) {
+        if (src.stride() < stride) {
+            return false;
+        }
+        stride = src.stride();
+    }
+
+    switch (src.compression()) {
+    case Seraphim::Types::Image2D::NONE:
+        // make sure we do not read beyond the end of the buffer
+        if (stride == 0 || src.height() > size / stride) {
+            return false;
+        }
+
+        dst = sph::CoreImage(data, src.width(), src.height(), pixfmt, stride);
+        return true;
+    case Seraphim::Types::Image2D::JPEG:
+        if (!decode_jpeg(src, pixfmt, data, size, reduce, buffer)) {
+            return false;
+        }
+
+        dst = sph::iop::cv::to_image(buffer);
+        return !dst.empty();
+    default:
+        if (!decompress(src, stride, data, size, buffer)) {
+            return false;
+        }
+
+        dst = sph::CoreImage(buffer.data, src.width(), src.height(), pixfmt, stride);
+        return true;
+    }
+}
+
+bool sph::backend::Image2DtoImage(const Seraphim::Types::Image2D &src, sph::CoreImage &dst,
+                                  cv::Mat &buffer, int reduce) {
+    unsigned char *data;
+    size_t size;
+
+    if (src.has_bus()) {
+        Seraphim::Types::Image2D format;
+        cv::Mat frame;
+
+        if (!read_bus(src, format, frame, size)) {
+            return false;
+        }
+
+        // raw frames are wrapped, so the buffer has to keep the copy alive
+        buffer = frame;
+        return decode(format, frame.data, size, dst, buffer, reduce);
+    }
+
+    if (!payload(src, data, size)) {
+        return false;
+    }
+
+    return decode(src, data, size, dst, buffer, reduce);
+}
+
+bool sph::backend::Image2DtoImage(const Seraphim::Types::Image2D &src,
+                                  const Seraphim::Types::Region2D &roi, sph::CoreImage &dst,
+                                  cv::Mat &buffer, int reduce) {
+    sph::CoreImage img;
+    Seraphim::Types::Region2D scaled;
+
+    if (!Image2DtoImage(src, img, buffer, reduce)) {
+        return false;
+    }
+
+    if (img.width() == src.width()) {
+        return ImageRegion(img, roi, dst);
+    }
+
+    // the image was decoded at reduced scale
+    scaled.set_x(roi.x() / reduce);
+    scaled.set_y(roi.y() / reduce);
+    scaled.set_w(roi.w() / reduce);
+    scaled.set_h(roi.h() / reduce);
+    return ImageRegion(img, scaled, dst);
+}
+
+int sph::backend::ImageReduction(const Seraphim::Types::Image2D &src,
+                                 const Seraphim::Types::Region2D &roi, const cv::Size &min_size) {
+    int width = roi.w() > 0 ? roi.w() : static_cast<int>(src.width());
+    int height = roi.h() > 0 ? roi.h() : static_cast<int>(src.height());
+
+    if (src.compression() != Seraphim::Types::Image2D::JPEG || min_size.empty()) {
+        return 1;
+    }
+
+    for (int reduce = 8; reduce > 1; reduce /= 2) {
+        if (width / reduce >= min_size.width && height / reduce >= min_size.height) {
+            return reduce;
+        }
+    }
+
+    return 1;
+}
+
+bool sph::backend::ImageRegion(const sph::CoreImage &src, const Seraphim::Types::Region2D &roi,
+                               sph::CoreImage &dst) {
+    if (roi.w() <= 0 || roi.h() <= 0) {
+        // wrap instead of assigning, which would copy the pixels
+        dst = sph::CoreImage(src.data(), src.width(), src.height(), src.pixfmt(), src.stride());
+        return true;
+    }
+
+    if (roi.x() < 0 || roi.y() < 0 || static_cast<uint32_t>(roi.x() + roi.w()) > src.width() ||
+        static_cast<uint32_t>(roi.y() + roi.h()) > src.height()) {
+        return false;
+    }
+
+    dst = sph::CoreImage(src.data(static_cast<size_t>(roi.y())) +
+                             static_cast<size_t>(roi.x()) * src.pixfmt().size,
+                         static_cast<uint32_t>(roi.w()), static_cast<uint32_t>(roi.h()),
+                         src.pixfmt(), src.stride());
     return true;
 }
 
 bool sph::backend::Image2DtoMat(const Seraphim::Types::Image2D &src, cv::Mat &dst) {
     // create intermediate wrapper
     sph::CoreImage img;
+    cv::Mat buffer;
 
-    if (!Image2DtoImage(src, img)) {
+    if (!Image2DtoImage(src, img, buffer)) {
         return false;
     }
 
     dst = sph::iop::cv::from_image(img);
+    if (!buffer.empty()) {
+        // the wrapper must not outlive the decoded pixels
+        dst = dst.clone();
+    }
+
     return !dst.empty();
 }
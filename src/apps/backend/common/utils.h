@@ -17,16 +17,64 @@ namespace backend {
 
 /**
  * @brief Image2DtoImage Convert arbitrary image data to our internal image representation.
+ *        Pixel data which is referenced by the message (see sph::ipc::BufferRegistry) is wrapped
+ *        in place instead of being copied. Compressed payloads (see
+ *        Seraphim::Types::Image2D::Compression) are decoded into a pooled buffer. Frames on a
+ *        frame bus (see FrameSource) are copied into a pooled buffer first.
  * @param src Input image from an IPC message.
  * @param dst Output image type that wraps the image data.
+ * @param buffer Holds the decoded pixels of compressed images, dst is only valid as long as the
+ *               buffer is kept.
+ * @param reduce Scale denominator (1, 2, 4 or 8) for JPEG images, see @ref ImageReduction.
  * @return True on success, false otherwise.
  */
-bool Image2DtoImage(const Seraphim::Types::Image2D &src, sph::CoreImage &dst);
+bool Image2DtoImage(const Seraphim::Types::Image2D &src, sph::CoreImage &dst, cv::Mat &buffer,
+                    int reduce = 1);
+
+/**
+ * @brief Image2DtoImage Convert a region of arbitrary image data to our internal image
+ *        representation. The region is wrapped in place, just like the whole image.
+ * @param src Input image from an IPC message.
+ * @param roi Region of interest in full scale coordinates, the whole image is used if it is
+ *            empty.
+ * @param dst Output image type that wraps the image data.
+ * @param buffer Holds the decoded pixels of compressed images, dst is only valid as long as the
+ *               buffer is kept.
+ * @param reduce Scale denominator (1, 2, 4 or 8) for JPEG images, see @ref ImageReduction.
+ * @return True on success, false otherwise (e.g. if the region exceeds the image).
+ */
+bool Image2DtoImage(const Seraphim::Types::Image2D &src, const Seraphim::Types::Region2D &roi,
+                    sph::CoreImage &dst, cv::Mat &buffer, int reduce = 1);
+
+/**
+ * @brief ImageReduction Find the smallest scale at which an image can be decoded.
+ *        JPEG images can be decoded at 1/2, 1/4 or 1/8 of their size for about the same fraction
+ *        of the cost. This is worth it when the consumer scales the image down anyway, e.g. to
+ *        the input size of a neural network.
+ * @param src Input image from an IPC message.
+ * @param roi Region of interest, the whole image is used if it is empty.
+ * @param min_size The region must not become smaller than this, an empty size disables
+ *                 reduction.
+ * @return The scale denominator, always 1 for images which are not JPEG compressed.
+ */
+int ImageReduction(const Seraphim::Types::Image2D &src, const Seraphim::Types::Region2D &roi,
+                   const cv::Size &min_size);
+
+/**
+ * @brief ImageRegion Wrap a region of an image in place.
+ * @param src Input image.
+ * @param roi Region of interest, the whole image is used if it is empty.
+ * @param dst Output image type that wraps the region.
+ * @return True on success, false if the region exceeds the image.
+ */
+bool ImageRegion(const sph::CoreImage &src, const Seraphim::Types::Region2D &roi,
+                 sph::CoreImage &dst);
 
 /**
  * @brief Image2DtoMat Convert arbitrary image data to matrix type.
  * @param src Input image from an IPC message.
- * @param dst Output matrix type that wraps the image data. A deep copy of the buffer is performed.
+ * @param dst Output matrix type that wraps the image data. Compressed images are decoded into a
+ *            buffer which is owned by the matrix.
  * @return True on success, false otherwise.
  */
 bool Image2DtoMat(const Seraphim::Types::Image2D &src, cv::Mat &dst);
@@ -0,0 +1,81 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <utils.h>
+
+#include "face_analysis_service.h"
+#include "facemark_detector_service.h"
+
+using namespace sph;
+using namespace sph::face;
+
+FaceAnalysisService::FaceAnalysisService(
+    std::vector<std::shared_ptr<sph::face::FaceDetector>> face_detectors,
+    std::vector<std::shared_ptr<sph::face::FacemarkDetector>> facemark_detectors,
+    std::shared_ptr<sph::face::FaceRecognizer> face_recognizer)
+    : m_face_detectors(std::move(face_detectors)),
+      m_facemark_detectors(std::move(facemark_detectors)),
+      m_face_recognizer(std::move(face_recognizer)) {
+    // the recognizer guards itself against concurrent use
+    set_concurrent(true);
+
+    register_handler(&FaceAnalysisService::handle_analysis_request);
+}
+
+bool FaceAnalysisService::handle_analysis_request(
+    const Seraphim::Face::FaceAnalyzer::AnalysisRequest &req,
+    Seraphim::Face::FaceAnalyzer::AnalysisResponse &res) {
+    CoreImage image;
+    cv::Mat buffer;
+    std::vector<Polygon<int>> faces;
+    std::vector<sph::face::FacemarkDetector::Facemarks> facemarks;
+    std::vector<sph::face::FaceRecognizer::Prediction> preds;
+
+    if (!sph::backend::Image2DtoImage(req.image(), req.roi(), image, buffer) || image.empty()) {
+        return false;
+    }
+
+    m_face_detectors.acquire()->detect(image, faces);
+    if (req.facemarks() && !faces.empty()) {
+        m_facemark_detectors.acquire()->detect(image, faces, facemarks);
+    }
+    FacemarkDetectorService::set_facemarks(faces, facemarks, req.packed(), res);
+
+    if (!req.recognition()) {
+        return true;
+    }
+
+    for (const auto &poly : faces) {
+        Seraphim::Types::Region2D region;
+        CoreImage face;
+        int label = -1;
+        double distance = 0.0;
+
+        region.set_x(poly.brect().tl().x);
+        region.set_y(poly.brect().tl().y);
+        region.set_w(poly.width());
+        region.set_h(poly.height());
+        if (!sph::backend::ImageRegion(image, region, face)) {
+            return false;
+        }
+
+        // the recognizer does not clear the predictions if it has not been trained yet
+        preds.clear();
+        m_face_recognizer->predict(face, preds);
+        // filter results if a global threshold is set, see FaceRecognizerService
+        if (!preds.empty() &&
+            (req.confidence() <= 0.0 || preds[0].confidence >= req.confidence())) {
+            label = preds[0].label;
+            distance = preds[0].confidence;
+        }
+
+        res.add_labels(label);
+        res.add_distances(distance);
+    }
+
+    return true;
+}
@@ -0,0 +1,56 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_FACE_ANALYSIS_SERVICE_H
+#define SPH_FACE_ANALYSIS_SERVICE_H
+
+#include <FaceAnalyzer.pb.h>
+#include <seraphim/face/face_detector.h>
+#include <seraphim/face/face_recognizer.h>
+#include <seraphim/face/facemark_detector.h>
+
+#include "../instance_pool.h"
+#include "../service.h"
+
+namespace sph {
+namespace face {
+
+/**
+ * @brief Runs the stages of the face services on an image in one request.
+ *
+ * Clients which want faces, landmarks and identities of the same frame would otherwise send it to
+ * every service, each of which decodes it and detects the faces again. Here the image is decoded
+ * and searched for faces once, the landmarks and identities are computed for those faces.
+ */
+class FaceAnalysisService : public sph::backend::Service {
+public:
+    /**
+     * @brief Face analysis service.
+     *        Requests are handled concurrently, the detectors are pooled like in the dedicated
+     *        services.
+     * @param face_detectors Independent face detector instances.
+     * @param facemark_detectors Independent facemark detector instances.
+     * @param face_recognizer Recognizer, shared with the recognizer service which trains it.
+     */
+    FaceAnalysisService(
+        std::vector<std::shared_ptr<sph::face::FaceDetector>> face_detectors,
+        std::vector<std::shared_ptr<sph::face::FacemarkDetector>> facemark_detectors,
+        std::shared_ptr<sph::face::FaceRecognizer> face_recognizer);
+
+    bool handle_analysis_request(const Seraphim::Face::FaceAnalyzer::AnalysisRequest &req,
+                                 Seraphim::Face::FaceAnalyzer::AnalysisResponse &res);
+
+private:
+    sph::backend::InstancePool<sph::face::FaceDetector> m_face_detectors;
+    sph::backend::InstancePool<sph::face::FacemarkDetector> m_facemark_detectors;
+    std::shared_ptr<sph::face::FaceRecognizer> m_face_recognizer;
+};
+
+} // namespace face
+} // namespace sph
+
+#endif // SPH_FACE_ANALYSIS_SERVICE_H
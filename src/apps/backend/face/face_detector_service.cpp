@@ -5,7 +5,7 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <seraphim/iop/opencv/mat.h>
+#include <seraphim/ipc/packed_geometry.h>
 #include <seraphim/polygon.h>
 #include <utils.h>
 
@@ -14,60 +14,72 @@
 using namespace sph;
 using namespace sph::face;
 
-FaceDetectorService::FaceDetectorService(std::shared_ptr<sph::face::FaceDetector> detector) {
-    m_detector = detector;
-}
-
-bool FaceDetectorService::handle_request(const Seraphim::Request &req, Seraphim::Response &res) {
-    if (req.inner().Is<Seraphim::Face::FaceDetector::DetectionRequest>()) {
-        Seraphim::Face::FaceDetector::DetectionRequest inner_req;
-        Seraphim::Face::FaceDetector::DetectionResponse inner_res;
-
-        req.inner().UnpackTo(&inner_req);
-        if (handle_detection_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
+static void set_faces(const std::vector<Polygon<int>> &faces, bool packed,
+                      Seraphim::Face::FaceDetector::DetectionResponse &res) {
+    for (const auto &poly : faces) {
+        if (packed) {
+            sph::ipc::add_region(*res.mutable_packed_faces(), poly.brect().tl().x,
+                                 poly.brect().tl().y, poly.width(), poly.height());
+            continue;
         }
+
+        Seraphim::Types::Region2D *face = res.add_faces();
+        face->set_x(poly.brect().tl().x);
+        face->set_y(poly.brect().tl().y);
+        face->set_w(poly.width());
+        face->set_h(poly.height());
     }
+}
+
+FaceDetectorService::FaceDetectorService(
+    std::vector<std::shared_ptr<sph::face::FaceDetector>> detectors)
+    : m_detectors(std::move(detectors)) {
+    set_concurrent(true);
 
-    return false;
+    register_handler(&FaceDetectorService::handle_detection_request);
+    register_handler(&FaceDetectorService::handle_batch_detection_request);
 }
 
 bool FaceDetectorService::handle_detection_request(
     const Seraphim::Face::FaceDetector::DetectionRequest &req,
     Seraphim::Face::FaceDetector::DetectionResponse &res) {
     CoreImage image;
+    cv::Mat buffer;
     std::vector<Polygon<int>> faces;
-    cv::Mat mat;
-    cv::Rect2i roi;
 
-    if (!sph::backend::Image2DtoMat(req.image(), mat)) {
+    if (!sph::backend::Image2DtoImage(req.image(), req.roi(), image, buffer) || image.empty()) {
         return false;
     }
 
-    roi = cv::Rect2i(0, 0, mat.cols, mat.rows);
+    m_detectors.acquire()->detect(image, faces);
+    set_faces(faces, req.packed(), res);
 
-    if (req.has_roi()) {
-        roi.x = req.roi().x();
-        roi.y = req.roi().y();
-        roi.width = req.roi().w();
-        roi.height = req.roi().h();
+    return true;
+}
+
+bool FaceDetectorService::handle_batch_detection_request(
+    const Seraphim::Face::FaceDetector::BatchDetectionRequest &req,
+    Seraphim::Face::FaceDetector::BatchDetectionResponse &res) {
+    std::vector<CoreImage> images(static_cast<size_t>(req.requests_size()));
+    std::vector<cv::Mat> buffers(images.size());
+    std::vector<std::vector<Polygon<int>>> faces;
+
+    for (int i = 0; i < req.requests_size(); i++) {
+        const Seraphim::Face::FaceDetector::DetectionRequest &request = req.requests(i);
+        CoreImage &image = images[static_cast<size_t>(i)];
+        if (!sph::backend::Image2DtoImage(request.image(), request.roi(), image,
+                                          buffers[static_cast<size_t>(i)]) ||
+            image.empty()) {
+            return false;
+        }
     }
 
-    mat = mat(roi);
-    image = sph::iop::cv::to_image(mat);
-    if (image.empty()) {
+    if (!m_detectors.acquire()->detect(images, faces) || faces.size() != images.size()) {
         return false;
     }
 
-    m_detector->detect(image, faces);
-
-    for (const auto &poly : faces) {
-        Seraphim::Types::Region2D *face = res.add_faces();
-        face->set_x(poly.brect().tl().x);
-        face->set_y(poly.brect().tl().y);
-        face->set_w(poly.width());
-        face->set_h(poly.height());
+    for (int i = 0; i < req.requests_size(); i++) {
+        set_faces(faces[static_cast<size_t>(i)], req.requests(i).packed(), *res.add_responses());
     }
 
     return true;
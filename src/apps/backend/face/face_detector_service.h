@@ -11,6 +11,7 @@
 #include <FaceDetector.pb.h>
 #include <seraphim/face/face_detector.h>
 
+#include "../instance_pool.h"
 #include "../service.h"
 
 namespace sph {
@@ -18,14 +19,22 @@ namespace face {
 
 class FaceDetectorService : public sph::backend::Service {
 public:
-    explicit FaceDetectorService(std::shared_ptr<sph::face::FaceDetector> detector);
+    /**
+     * @brief Face detector service.
+     *        Requests are handled concurrently, by as many of them as there are detectors.
+     * @param detectors Independent detector instances.
+     */
+    explicit FaceDetectorService(std::vector<std::shared_ptr<sph::face::FaceDetector>> detectors);
 
-    bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) override;
     bool handle_detection_request(const Seraphim::Face::FaceDetector::DetectionRequest &req,
                                   Seraphim::Face::FaceDetector::DetectionResponse &res);
 
+    bool
+    handle_batch_detection_request(const Seraphim::Face::FaceDetector::BatchDetectionRequest &req,
+                                   Seraphim::Face::FaceDetector::BatchDetectionResponse &res);
+
 private:
-    std::shared_ptr<sph::face::FaceDetector> m_detector;
+    sph::backend::InstancePool<sph::face::FaceDetector> m_detectors;
 };
 
 } // namespace face
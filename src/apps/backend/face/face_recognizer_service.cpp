@@ -21,36 +21,15 @@ FaceRecognizerService::FaceRecognizerService(
     m_face_detector = face_detector;
     m_face_recognizer = face_recognizer;
     m_facemark_detector = facemark_detector;
+
+    register_handler(&FaceRecognizerService::handle_training_request);
+    register_handler(&FaceRecognizerService::handle_recognition_request);
 }
 
 FaceRecognizerService::~FaceRecognizerService() {
     // dummy
 }
 
-bool FaceRecognizerService::handle_request(const Seraphim::Request &req, Seraphim::Response &res) {
-    if (req.inner().Is<Seraphim::Face::FaceRecognizer::TrainingRequest>()) {
-        Seraphim::Face::FaceRecognizer::TrainingRequest inner_req;
-        Seraphim::Face::FaceRecognizer::TrainingResponse inner_res;
-
-        req.inner().UnpackTo(&inner_req);
-        if (handle_training_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
-        }
-    } else if (req.inner().Is<Seraphim::Face::FaceRecognizer::PredictionRequest>()) {
-        Seraphim::Face::FaceRecognizer::PredictionRequest inner_req;
-        Seraphim::Face::FaceRecognizer::PredictionResponse inner_res;
-
-        req.inner().UnpackTo(&inner_req);
-        if (handle_recognition_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
-        }
-    }
-
-    return false;
-}
-
 bool FaceRecognizerService::handle_training_request(
     const Seraphim::Face::FaceRecognizer::TrainingRequest &req,
     Seraphim::Face::FaceRecognizer::TrainingResponse &res) {
@@ -25,7 +25,6 @@ public:
                                    std::shared_ptr<sph::face::FaceRecognizer> face_recognizer);
     ~FaceRecognizerService() override;
 
-    bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) override;
     bool handle_training_request(const Seraphim::Face::FaceRecognizer::TrainingRequest &req,
                                  Seraphim::Face::FaceRecognizer::TrainingResponse &res);
     bool handle_recognition_request(const Seraphim::Face::FaceRecognizer::PredictionRequest &req,
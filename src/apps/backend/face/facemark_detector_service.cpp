@@ -5,7 +5,6 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <seraphim/iop/opencv/mat.h>
 #include <utils.h>
 
 #include "facemark_detector_service.h"
@@ -13,107 +12,96 @@
 using namespace sph;
 using namespace sph::face;
 
-FacemarkDetectorService::FacemarkDetectorService(
-    std::shared_ptr<sph::face::FaceDetector> face_detector,
-    std::shared_ptr<sph::face::FacemarkDetector> facemark_detector) {
-    m_face_detector = face_detector;
-    m_facemark_detector = facemark_detector;
-}
-
-bool FacemarkDetectorService::handle_request(const Seraphim::Request &req,
-                                             Seraphim::Response &res) {
-    if (req.inner().Is<Seraphim::Face::FacemarkDetector::DetectionRequest>()) {
-        Seraphim::Face::FacemarkDetector::DetectionRequest inner_req;
-        Seraphim::Face::FacemarkDetector::DetectionResponse inner_res;
-
-        req.inner().UnpackTo(&inner_req);
-        if (handle_detection_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
-        }
+bool FacemarkDetectorService::to_landmark(
+    sph::face::FacemarkDetector::FacemarkType type,
+    Seraphim::Face::FacemarkDetector::Facemarks::Landmark &landmark) {
+    switch (type) {
+    case FacemarkDetector::FacemarkType::JAW:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::JAW;
+        break;
+    case FacemarkDetector::FacemarkType::RIGHT_EYEBROW:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYEBROW;
+        break;
+    case FacemarkDetector::FacemarkType::LEFT_EYEBROW:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYEBROW;
+        break;
+    case FacemarkDetector::FacemarkType::NOSE:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::NOSE;
+        break;
+    case FacemarkDetector::FacemarkType::RIGHT_EYE:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYE;
+        break;
+    case FacemarkDetector::FacemarkType::LEFT_EYE:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYE;
+        break;
+    case FacemarkDetector::FacemarkType::MOUTH:
+        landmark = Seraphim::Face::FacemarkDetector::Facemarks::MOUTH;
+        break;
+    default:
+        // unknown facemark
+        return false;
     }
 
-    return false;
+    return true;
+}
+
+FacemarkDetectorService::FacemarkDetectorService(
+    std::vector<std::shared_ptr<sph::face::FaceDetector>> face_detectors,
+    std::vector<std::shared_ptr<sph::face::FacemarkDetector>> facemark_detectors)
+    : m_face_detectors(std::move(face_detectors)),
+      m_facemark_detectors(std::move(facemark_detectors)) {
+    set_concurrent(true);
+
+    register_handler(&FacemarkDetectorService::handle_detection_request);
+    register_handler(&FacemarkDetectorService::handle_batch_detection_request);
 }
 
 bool FacemarkDetectorService::handle_detection_request(
     const Seraphim::Face::FacemarkDetector::DetectionRequest &req,
     Seraphim::Face::FacemarkDetector::DetectionResponse &res) {
     CoreImage image;
+    cv::Mat buffer;
     std::vector<Polygon<int>> faces;
-    cv::Mat mat;
     std::vector<sph::face::FacemarkDetector::Facemarks> facemarks;
-    cv::Rect2i roi;
 
-    if (!sph::backend::Image2DtoMat(req.image(), mat)) {
+    if (!sph::backend::Image2DtoImage(req.image(), req.roi(), image, buffer) || image.empty()) {
         return false;
     }
 
-    roi = cv::Rect2i(0, 0, mat.cols, mat.rows);
+    m_face_detectors.acquire()->detect(image, faces);
+    m_facemark_detectors.acquire()->detect(image, faces, facemarks);
+    set_facemarks(faces, facemarks, req.packed(), res);
 
-    if (req.has_roi()) {
-        roi.x = req.roi().x();
-        roi.y = req.roi().y();
-        roi.width = req.roi().w();
-        roi.height = req.roi().h();
-    }
+    return true;
+}
 
-    mat = mat(roi);
-    image = sph::iop::cv::to_image(mat);
-    if (image.empty()) {
-        return false;
+bool FacemarkDetectorService::handle_batch_detection_request(
+    const Seraphim::Face::FacemarkDetector::BatchDetectionRequest &req,
+    Seraphim::Face::FacemarkDetector::BatchDetectionResponse &res) {
+    std::vector<CoreImage> images(static_cast<size_t>(req.requests_size()));
+    std::vector<cv::Mat> buffers(images.size());
+    std::vector<std::vector<Polygon<int>>> faces;
+    std::vector<std::vector<sph::face::FacemarkDetector::Facemarks>> facemarks;
+
+    for (int i = 0; i < req.requests_size(); i++) {
+        const Seraphim::Face::FacemarkDetector::DetectionRequest &request = req.requests(i);
+        CoreImage &image = images[static_cast<size_t>(i)];
+        if (!sph::backend::Image2DtoImage(request.image(), request.roi(), image,
+                                          buffers[static_cast<size_t>(i)]) ||
+            image.empty()) {
+            return false;
+        }
     }
 
-    m_face_detector->detect(image, faces);
-    m_facemark_detector->detect(image, faces, facemarks);
-    for (const auto &poly : faces) {
-        Seraphim::Types::Region2D *face = res.add_faces();
-        face->set_x(poly.brect().tl().x);
-        face->set_y(poly.brect().tl().y);
-        face->set_w(poly.width());
-        face->set_h(poly.height());
+    if (!m_face_detectors.acquire()->detect(images, faces) || faces.size() != images.size()) {
+        return false;
     }
 
-    for (const auto &face : facemarks) {
-        for (const auto &landmark : face.landmarks) {
-            Seraphim::Face::FacemarkDetector::Facemarks::Landmark type;
-            switch (landmark.first) {
-            case FacemarkDetector::FacemarkType::JAW:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::JAW;
-                break;
-            case FacemarkDetector::FacemarkType::RIGHT_EYEBROW:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYEBROW;
-                break;
-            case FacemarkDetector::FacemarkType::LEFT_EYEBROW:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYEBROW;
-                break;
-            case FacemarkDetector::FacemarkType::NOSE:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::NOSE;
-                break;
-            case FacemarkDetector::FacemarkType::RIGHT_EYE:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYE;
-                break;
-            case FacemarkDetector::FacemarkType::LEFT_EYE:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYE;
-                break;
-            case FacemarkDetector::FacemarkType::MOUTH:
-                type = Seraphim::Face::FacemarkDetector::Facemarks::MOUTH;
-                break;
-            default:
-                // unknown facemark
-                continue;
-            }
-
-            Seraphim::Face::FacemarkDetector::Facemarks *facemarks_ = res.add_facemarks();
-            Seraphim::Types::PointSet2D *points = facemarks_->add_pointsets();
-
-            for (const auto &landmark_points : landmark.second) {
-                Seraphim::Types::Point2D *point = points->add_points();
-                point->set_x(landmark_points.x);
-                point->set_y(landmark_points.y);
-            }
-            facemarks_->add_landmarks(type);
-        }
+    m_facemark_detectors.acquire()->detect(images, faces, facemarks);
+    facemarks.resize(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        set_facemarks(faces[i], facemarks[i], req.requests(static_cast<int>(i)).packed(),
+                      *res.add_responses());
     }
 
     return true;
@@ -11,7 +11,10 @@
 #include <FacemarkDetector.pb.h>
 #include <seraphim/face/face_detector.h>
 #include <seraphim/face/facemark_detector.h>
+#include <seraphim/ipc/packed_geometry.h>
+#include <seraphim/polygon.h>
 
+#include "../instance_pool.h"
 #include "../service.h"
 
 namespace sph {
@@ -19,16 +22,89 @@ namespace face {
 
 class FacemarkDetectorService : public sph::backend::Service {
 public:
-    FacemarkDetectorService(std::shared_ptr<sph::face::FaceDetector> face_detector,
-                            std::shared_ptr<sph::face::FacemarkDetector> facemark_detector);
+    /**
+     * @brief Facemark detector service.
+     *        Faces and their landmarks are detected by separate pools of instances, so a request
+     *        only holds one instance at a time.
+     * @param face_detectors Independent face detector instances.
+     * @param facemark_detectors Independent facemark detector instances.
+     */
+    FacemarkDetectorService(
+        std::vector<std::shared_ptr<sph::face::FaceDetector>> face_detectors,
+        std::vector<std::shared_ptr<sph::face::FacemarkDetector>> facemark_detectors);
 
-    bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) override;
     bool handle_detection_request(const Seraphim::Face::FacemarkDetector::DetectionRequest &req,
                                   Seraphim::Face::FacemarkDetector::DetectionResponse &res);
 
+    bool handle_batch_detection_request(
+        const Seraphim::Face::FacemarkDetector::BatchDetectionRequest &req,
+        Seraphim::Face::FacemarkDetector::BatchDetectionResponse &res);
+
+    /**
+     * @brief Convert the type of a landmark to its message representation.
+     * @return True on success, false if the type is unknown.
+     */
+    static bool to_landmark(sph::face::FacemarkDetector::FacemarkType type,
+                            Seraphim::Face::FacemarkDetector::Facemarks::Landmark &landmark);
+
+    /**
+     * @brief Fill in the faces and landmarks of a response.
+     *        Works for any response with the fields of
+     *        Seraphim::Face::FacemarkDetector::DetectionResponse.
+     * @param faces The faces.
+     * @param facemarks The landmarks of the faces.
+     * @param packed Whether to use the packed fields.
+     * @param res The response.
+     */
+    template <class Response>
+    static void set_facemarks(const std::vector<sph::Polygon<int>> &faces,
+                              const std::vector<sph::face::FacemarkDetector::Facemarks> &facemarks,
+                              bool packed, Response &res) {
+        for (const auto &poly : faces) {
+            if (packed) {
+                sph::ipc::add_region(*res.mutable_packed_faces(), poly.brect().tl().x,
+                                     poly.brect().tl().y, poly.width(), poly.height());
+                continue;
+            }
+
+            Seraphim::Types::Region2D *face = res.add_faces();
+            face->set_x(poly.brect().tl().x);
+            face->set_y(poly.brect().tl().y);
+            face->set_w(poly.width());
+            face->set_h(poly.height());
+        }
+
+        for (const auto &face : facemarks) {
+            for (const auto &landmark : face.landmarks) {
+                Seraphim::Face::FacemarkDetector::Facemarks::Landmark type;
+                if (!to_landmark(landmark.first, type)) {
+                    continue;
+                }
+
+                if (packed) {
+                    Seraphim::Face::FacemarkDetector::PackedFacemarks *facemarks_ =
+                        res.mutable_packed_facemarks();
+                    facemarks_->add_landmarks(type);
+                    sph::ipc::add_point_set(*facemarks_->mutable_pointsets(), landmark.second);
+                    continue;
+                }
+
+                Seraphim::Face::FacemarkDetector::Facemarks *facemarks_ = res.add_facemarks();
+                Seraphim::Types::PointSet2D *points = facemarks_->add_pointsets();
+
+                for (const auto &landmark_points : landmark.second) {
+                    Seraphim::Types::Point2D *point = points->add_points();
+                    point->set_x(landmark_points.x);
+                    point->set_y(landmark_points.y);
+                }
+                facemarks_->add_landmarks(type);
+            }
+        }
+    }
+
 private:
-    std::shared_ptr<sph::face::FaceDetector> m_face_detector;
-    std::shared_ptr<sph::face::FacemarkDetector> m_facemark_detector;
+    sph::backend::InstancePool<sph::face::FaceDetector> m_face_detectors;
+    sph::backend::InstancePool<sph::face::FacemarkDetector> m_facemark_detectors;
 };
 
 } // namespace face
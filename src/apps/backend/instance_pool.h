@@ -0,0 +1,128 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_INSTANCE_POOL_H
+#define SPH_INSTANCE_POOL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <seraphim/except.h>
+#include <vector>
+
+namespace sph {
+namespace backend {
+
+/**
+ * @brief Pool of independent instances of an algorithm, e.g. detectors which loaded the same model.
+ *
+ * The algorithms are not thread safe, so one instance handles one request at a time. With several
+ * instances, requests are handed to whichever instance is free and run in parallel.
+ *
+ * This class is thread safe.
+ */
+template <class T> class InstancePool {
+public:
+    /**
+     * @brief Exclusive use of an instance, which is returned to the pool on destruction.
+     */
+    class Lease {
+    public:
+        Lease(Lease &&other) noexcept : m_pool(other.m_pool), m_instance(other.m_instance) {
+            other.m_pool = nullptr;
+        }
+
+        ~Lease() {
+            if (m_pool) {
+                m_pool->release(m_instance);
+            }
+        }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease &operator=(Lease &&) = delete;
+
+        T &operator*() const { return *m_instance; }
+        T *operator->() const { return m_instance; }
+
+    private:
+        friend class InstancePool;
+
+        Lease(InstancePool *pool, T *instance) : m_pool(pool), m_instance(instance) {}
+
+        InstancePool *m_pool;
+        T *m_instance;
+    };
+
+    /**
+     * @brief Instance pool.
+     *        Throws sph::InvalidArgumentException if there are no instances.
+     * @param instances The instances. Users outside of the pool rely on the instances to guard
+     *                  themselves against concurrent use.
+     */
+    explicit InstancePool(std::vector<std::shared_ptr<T>> instances)
+        : m_instances(std::move(instances)) {
+        if (m_instances.empty()) {
+            SPH_THROW(InvalidArgumentException, "No instances");
+        }
+
+        for (const auto &instance : m_instances) {
+            m_idle.push_back(instance.get());
+        }
+    }
+
+    InstancePool(const InstancePool &) = delete;
+    InstancePool &operator=(const InstancePool &) = delete;
+
+    /**
+     * @brief Take an instance, waits until one is free.
+     */
+    Lease acquire() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_idle.empty(); });
+
+        // the instance which was used last is the most likely one to still be in the caches
+        T *instance = m_idle.back();
+        m_idle.pop_back();
+        return Lease(this, instance);
+    }
+
+    /**
+     * @brief Get any instance, e.g. to query its configuration.
+     *        It must not be used to handle requests, since it may be leased at the same time.
+     */
+    T &front() const { return *m_instances.front(); }
+
+    /**
+     * @brief Number of instances.
+     */
+    size_t size() const { return m_instances.size(); }
+
+private:
+    void release(T *instance) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_idle.push_back(instance);
+        }
+        m_cv.notify_one();
+    }
+
+    /// all instances, keeps them alive
+    std::vector<std::shared_ptr<T>> m_instances;
+    /// instances which are not leased
+    std::vector<T *> m_idle;
+
+    /// protects the idle instances
+    std::mutex m_mutex;
+    /// signals instances which were returned
+    std::condition_variable m_cv;
+};
+
+} // namespace backend
+} // namespace sph
+
+#endif // SPH_INSTANCE_POOL_H
@@ -5,6 +5,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
 #include <getopt.h>
@@ -25,12 +26,15 @@
 
 #include "car/lane_detector_service.h"
 #include "config_store.h"
+#include "face/face_analysis_service.h"
 #include "face/face_detector_service.h"
 #include "face/face_recognizer_service.h"
 #include "face/facemark_detector_service.h"
 #include "object/detector_service.h"
 #include "shm_server.h"
 #include "tcp_server.h"
+#include "udp_server.h"
+#include "unix_server.h"
 
 using namespace sph::backend;
 using namespace sph::ipc;
@@ -38,19 +42,12 @@ using namespace sph::ipc;
 static bool server_running = false;
 
 static auto lane_detector = std::make_shared<sph::car::LinearLaneDetector>();
-static auto face_detector = std::make_shared<sph::face::LBPFaceDetector>();
 static auto face_recognizer = std::make_shared<sph::face::LBPFaceRecognizer>();
-static auto facemark_detector = std::make_shared<sph::face::LBFFacemarkDetector>();
-static auto object_detector = std::make_shared<sph::object::DNNDetector>();
-
-static auto lane_detector_service = std::make_shared<sph::car::LaneDetectorService>(lane_detector);
-static auto face_detector_service = std::make_shared<sph::face::FaceDetectorService>(face_detector);
-static auto face_recognizer_service = std::make_shared<sph::face::FaceRecognizerService>(
-    face_detector, facemark_detector, face_recognizer);
-static auto facemark_detector_service =
-    std::make_shared<sph::face::FacemarkDetectorService>(face_detector, facemark_detector);
-static auto object_detector_service =
-    std::make_shared<sph::object::DetectorService>(object_detector);
+
+// independent instances of the detectors, see detector_instances in the config
+static std::vector<std::shared_ptr<sph::face::LBPFaceDetector>> face_detectors;
+static std::vector<std::shared_ptr<sph::face::LBFFacemarkDetector>> facemark_detectors;
+static std::vector<std::shared_ptr<sph::object::DNNDetector>> object_detectors;
 
 void signal_handler(int signal) {
     switch (signal) {
@@ -147,15 +144,42 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // every detector instance handles one request at a time, so more instances let requests to
+    // the same service run in parallel at the cost of loading the models several times
+    size_t instances = 1;
+    val = ConfigStore::Instance().get_value("detector_instances");
+    if (!val.empty()) {
+        try {
+            instances = std::max<size_t>(std::stoul(val), 1);
+        } catch (const std::logic_error &) {
+            std::cout << "[WARN] Invalid number of detector instances, using one" << std::endl;
+        }
+    }
+
+    // every service gets its own detectors, so a detector is never leased by one service while
+    // another one uses it: the face detector, facemark and analysis services get a set of
+    // instances each, the face recognizer trains its model, so it gets a single one of everything
+    for (size_t i = 0; i < 3 * instances + 1; i++) {
+        face_detectors.push_back(std::make_shared<sph::face::LBPFaceDetector>());
+    }
+    for (size_t i = 0; i < 2 * instances + 1; i++) {
+        facemark_detectors.push_back(std::make_shared<sph::face::LBFFacemarkDetector>());
+    }
+    for (size_t i = 0; i < instances; i++) {
+        object_detectors.push_back(std::make_shared<sph::object::DNNDetector>());
+    }
+
     // load pretrained models
     val = ConfigStore::Instance().get_value("face_cascade");
     if (val.empty()) {
         std::cout << "[ERROR] Missing conf key: face_cascade" << std::endl;
         return 1;
     } else {
-        if (!face_detector->load_face_cascade(val)) {
-            std::cout << "[ERROR] Failed to load face cascade from: " << val << std::endl;
-            return 1;
+        for (const auto &face_detector : face_detectors) {
+            if (!face_detector->load_face_cascade(val)) {
+                std::cout << "[ERROR] Failed to load face cascade from: " << val << std::endl;
+                return 1;
+            }
         }
     }
 
@@ -164,9 +188,11 @@ int main(int argc, char **argv) {
         std::cout << "[ERROR] Missing conf key: face_facemark_model" << std::endl;
         return 1;
     } else {
-        if (!facemark_detector->load_facemark_model(val)) {
-            std::cout << "[ERROR] Failed to load facemark model from: " << val << std::endl;
-            return 1;
+        for (const auto &facemark_detector : facemark_detectors) {
+            if (!facemark_detector->load_facemark_model(val)) {
+                std::cout << "[ERROR] Failed to load facemark model from: " << val << std::endl;
+                return 1;
+            }
         }
     }
 
@@ -176,10 +202,12 @@ int main(int argc, char **argv) {
         std::cout << "[ERROR] Missing conf key: object_net_model|object_net_config" << std::endl;
         return 1;
     } else {
-        if (!object_detector->read_net(val, val2)) {
-            std::cout << "[ERROR] Failed to load object net from: model: " << val
-                      << ", config: " << val2 << std::endl;
-            return 1;
+        for (const auto &object_detector : object_detectors) {
+            if (!object_detector->read_net(val, val2)) {
+                std::cout << "[ERROR] Failed to load object net from: model: " << val
+                          << ", config: " << val2 << std::endl;
+                return 1;
+            }
         }
     }
 
@@ -199,14 +227,18 @@ int main(int argc, char **argv) {
         if (!lane_detector->set_target(target)) {
             std::cout << "[WARN] Failed to set Lane Detector target to: " << val << std::endl;
         }
-        if (!face_detector->set_target(target)) {
-            std::cout << "[WARN] Failed to set Face Detector target to: " << val << std::endl;
+        for (const auto &face_detector : face_detectors) {
+            if (!face_detector->set_target(target)) {
+                std::cout << "[WARN] Failed to set Face Detector target to: " << val << std::endl;
+            }
         }
         if (!face_recognizer->set_target(target)) {
             std::cout << "[WARN] Failed to set Face Recognizer target to: " << val << std::endl;
         }
-        if (!object_detector->set_target(target)) {
-            std::cout << "[WARN] Failed to set Object Detector target to: " << val << std::endl;
+        for (const auto &object_detector : object_detectors) {
+            if (!object_detector->set_target(target)) {
+                std::cout << "[WARN] Failed to set Object Detector target to: " << val << std::endl;
+            }
         }
     }
 
@@ -223,6 +255,34 @@ int main(int argc, char **argv) {
     params.hough_max_line_len = 30;
     lane_detector->set_parameters(params);
 
+    // sets of detector instances, see above
+    auto face_detector_set = [&](size_t set) {
+        auto begin = face_detectors.begin() + static_cast<ptrdiff_t>(set * instances);
+        return std::vector<std::shared_ptr<sph::face::FaceDetector>>(
+            begin, begin + static_cast<ptrdiff_t>(instances));
+    };
+    auto facemark_detector_set = [&](size_t set) {
+        auto begin = facemark_detectors.begin() + static_cast<ptrdiff_t>(set * instances);
+        return std::vector<std::shared_ptr<sph::face::FacemarkDetector>>(
+            begin, begin + static_cast<ptrdiff_t>(instances));
+    };
+
+    auto lane_detector_service = std::make_shared<sph::car::LaneDetectorService>(lane_detector);
+    auto face_detector_service =
+        std::make_shared<sph::face::FaceDetectorService>(face_detector_set(0));
+    auto face_recognizer_service = std::make_shared<sph::face::FaceRecognizerService>(
+        face_detectors.back(), facemark_detectors.back(), face_recognizer);
+    auto facemark_detector_service = std::make_shared<sph::face::FacemarkDetectorService>(
+        face_detector_set(1), facemark_detector_set(0));
+    auto face_analysis_service = std::make_shared<sph::face::FaceAnalysisService>(
+        face_detector_set(2), facemark_detector_set(1), face_recognizer);
+    auto object_detector_service = std::make_shared<sph::object::DetectorService>(
+        std::vector<std::shared_ptr<sph::object::Detector>>(object_detectors.begin(),
+                                                            object_detectors.end()));
+
+    // compressed images need not be decoded larger than the network input
+    object_detector_service->set_input_size(object_detectors.front()->blob_parameters().size);
+
     // start servers
     server_running = true;
 
@@ -245,20 +305,73 @@ int main(int argc, char **argv) {
         try {
             auto transport = TransportFactory::Instance().create(val);
             auto shared = sph::convert_shared<TCPTransport>(transport);
-            auto server = std::unique_ptr<TCPServer>(new TCPServer(shared));
+            TCPServer::Engine engine = TCPServer::Engine::AUTO;
+            val = ConfigStore::Instance().get_value("tcp_server_engine");
+            if (val == "epoll") {
+                engine = TCPServer::Engine::EPOLL;
+            } else if (val == "io_uring") {
+                engine = TCPServer::Engine::IO_URING;
+            } else if (!val.empty() && val != "auto") {
+                std::cout << "[WARN] Invalid TCP server engine, fallback to auto" << std::endl;
+            }
+            auto server = std::unique_ptr<TCPServer>(new TCPServer(shared, 0, engine));
             servers.emplace_back(std::move(server));
         } catch (const std::exception &e) {
             std::cout << "Failed to create TCP server: " << e.what() << std::endl;
         }
     }
 
+    val = ConfigStore::Instance().get_value("udp_server_uri");
+    if (!val.empty()) {
+        std::cout << "Creating UDP server (uri: " << val << ")" << std::endl;
+        try {
+            auto transport = TransportFactory::Instance().create(val);
+            auto shared = sph::convert_shared<UDPTransport>(transport);
+            auto server = std::unique_ptr<UDPServer>(new UDPServer(shared));
+            servers.emplace_back(std::move(server));
+        } catch (const std::exception &e) {
+            std::cout << "Failed to create UDP server: " << e.what() << std::endl;
+        }
+    }
+
+    val = ConfigStore::Instance().get_value("unix_server_uri");
+    if (!val.empty()) {
+        std::cout << "Creating UNIX server (uri: " << val << ")" << std::endl;
+        try {
+            auto transport = TransportFactory::Instance().create(val);
+            auto shared = sph::convert_shared<UnixTransport>(transport);
+            auto server = std::unique_ptr<UnixServer>(new UnixServer(shared));
+            servers.emplace_back(std::move(server));
+        } catch (const std::exception &e) {
+            std::cout << "Failed to create UNIX server: " << e.what() << std::endl;
+        }
+    }
+
+    // drop requests which waited too long for the services, so results refer to recent frames
+    std::chrono::milliseconds deadline(0);
+    val = ConfigStore::Instance().get_value("request_deadline");
+    if (!val.empty()) {
+        try {
+            deadline = std::chrono::milliseconds(std::stoul(val));
+        } catch (const std::logic_error &) {
+            std::cout << "[WARN] Invalid request deadline, requests never expire" << std::endl;
+        }
+    }
+
     // register the event handlers on all servers
     for (const auto &server : servers) {
+        server->set_deadline(deadline);
+        Server *srv = server.get();
         server->register_event_handler(Server::EVENT_CLIENT_CONNECTED, [](void *) {
             std::cout << "** Client connected" << std::endl;
         });
-        server->register_event_handler(Server::EVENT_CLIENT_DISCONNECTED, [](void *) {
-            std::cout << "** Client disconnected" << std::endl;
+        server->register_event_handler(Server::EVENT_CLIENT_DISCONNECTED, [srv](void *) {
+            sph::ipc::ArenaPool::Stats stats = srv->arena_stats();
+            std::cout << "** Client disconnected" << std::endl
+                      << "   requests=" << stats.leases << std::endl
+                      << "   requests dropped=" << srv->dropped() << std::endl
+                      << "   arena heap blocks=" << stats.heap_blocks << std::endl
+                      << "   arena bytes used=" << stats.bytes_used << std::endl;
         });
         server->register_event_handler(Server::EVENT_MESSAGE_INBOUND, [](void *data) {
             Seraphim::Message *msg = reinterpret_cast<Seraphim::Message *>(data);
@@ -286,6 +399,7 @@ int main(int argc, char **argv) {
         server->register_service(face_detector_service);
         server->register_service(face_recognizer_service);
         server->register_service(facemark_detector_service);
+        server->register_service(face_analysis_service);
         server->register_service(object_detector_service);
     }
 
@@ -5,74 +5,285 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <cstring>
+#include <opencv2/imgproc.hpp>
 #include <seraphim/iop/opencv/mat.h>
+#include <seraphim/ipc/packed_geometry.h>
+#include <seraphim/ipc/tile_delta.h>
 #include <utils.h>
 
 #include "detector_service.h"
 
 using namespace sph::object;
 
-DetectorService::DetectorService(std::shared_ptr<sph::object::Detector> recognizer) {
-    m_recognizer = recognizer;
-}
+/// frames are compared at this resolution to find out whether they changed
+static const cv::Size THUMBNAIL_SIZE(64, 64);
 
-bool DetectorService::handle_request(const Seraphim::Request &req, Seraphim::Response &res) {
-    if (req.inner().Is<Seraphim::Object::Detector::DetectionRequest>()) {
-        Seraphim::Object::Detector::DetectionRequest inner_req;
-        Seraphim::Object::Detector::DetectionResponse inner_res;
+/**
+ * @brief Add predictions to a response.
+ * @param scale Scale denominator the image was decoded at, see sph::backend::ImageReduction().
+ * @param packed Whether the rois are added in the packed encoding.
+ */
+static void set_predictions(const std::vector<sph::object::Detector::Prediction> &predictions,
+                            float confidence, int scale, bool packed,
+                            Seraphim::Object::Detector::DetectionResponse &res) {
+    for (size_t i = 0; i < predictions.size(); i++) {
+        // filter results if a global threshold is set
+        if (confidence > 0.0f && predictions[i].confidence < confidence) {
+            continue;
+        }
 
-        req.inner().UnpackTo(&inner_req);
-        if (handle_detection_request(inner_req, inner_res)) {
-            res.mutable_inner()->PackFrom(inner_res);
-            return true;
+        res.add_labels(predictions[i].class_id);
+        res.add_confidences(predictions[i].confidence);
+        if (packed) {
+            sph::ipc::add_region(*res.mutable_packed_rois(),
+                                 predictions[i].poly.brect().tl().x * scale,
+                                 predictions[i].poly.brect().tl().y * scale,
+                                 predictions[i].poly.width() * scale,
+                                 predictions[i].poly.height() * scale);
+            continue;
         }
+
+        Seraphim::Types::Region2D *roi = res.add_rois();
+        roi->set_x(predictions[i].poly.brect().tl().x * scale);
+        roi->set_y(predictions[i].poly.brect().tl().y * scale);
+        roi->set_w(predictions[i].poly.width() * scale);
+        roi->set_h(predictions[i].poly.height() * scale);
     }
+}
 
-    return false;
+DetectorService::DetectorService(std::vector<std::shared_ptr<sph::object::Detector>> detectors)
+    : m_detectors(std::move(detectors)) {
+    set_concurrent(true);
+
+    register_handler(&DetectorService::handle_detection_request);
+    register_handler(&DetectorService::handle_batch_detection_request);
+    register_handler(&DetectorService::handle_stream_open_request);
+    register_handler(&DetectorService::handle_stream_frame_request);
+    register_handler(&DetectorService::handle_stream_close_request);
 }
 
 bool DetectorService::handle_detection_request(
     const Seraphim::Object::Detector::DetectionRequest &req,
     Seraphim::Object::Detector::DetectionResponse &res) {
     sph::CoreImage image;
-    cv::Mat mat;
-    cv::Rect2i roi;
+    cv::Mat buffer;
     std::vector<sph::object::Detector::Prediction> predictions;
+    int reduce = sph::backend::ImageReduction(req.image(), req.roi(), m_input_size);
 
-    if (!sph::backend::Image2DtoMat(req.image(), mat)) {
+    if (!sph::backend::Image2DtoImage(req.image(), req.roi(), image, buffer, reduce) ||
+        image.empty()) {
         return false;
     }
 
-    roi = cv::Rect2i(0, 0, mat.cols, mat.rows);
+    m_detectors.acquire()->predict(image, predictions);
+    set_predictions(predictions, req.confidence(), reduce, req.packed(), res);
+
+    return true;
+}
+
+bool DetectorService::handle_batch_detection_request(
+    const Seraphim::Object::Detector::BatchDetectionRequest &req,
+    Seraphim::Object::Detector::BatchDetectionResponse &res) {
+    std::vector<sph::CoreImage> images(static_cast<size_t>(req.requests_size()));
+    std::vector<cv::Mat> buffers(images.size());
+    std::vector<int> reduce(images.size());
+    std::vector<std::vector<sph::object::Detector::Prediction>> predictions;
 
-    if (req.has_roi()) {
-        roi.x = req.roi().x();
-        roi.y = req.roi().y();
-        roi.width = req.roi().w();
-        roi.height = req.roi().h();
+    for (size_t i = 0; i < images.size(); i++) {
+        const Seraphim::Object::Detector::DetectionRequest &request =
+            req.requests(static_cast<int>(i));
+        reduce[i] = sph::backend::ImageReduction(request.image(), request.roi(), m_input_size);
+        if (!sph::backend::Image2DtoImage(request.image(), request.roi(), images[i], buffers[i],
+                                          reduce[i]) ||
+            images[i].empty()) {
+            return false;
+        }
     }
 
-    mat = mat(roi);
-    image = sph::iop::cv::to_image(mat);
-    if (image.empty()) {
+    // all images are passed to the detector at once, so batching detectors (e.g. DNNs) only
+    // need a single inference pass
+    if (!m_detectors.acquire()->predict(images, predictions) ||
+        predictions.size() != images.size()) {
         return false;
     }
 
-    m_recognizer->predict(image, predictions);
-    for (size_t i = 0; i < predictions.size(); i++) {
-        // filter results if a global threshold is set
-        if (req.confidence() > 0.0f && predictions[i].confidence < req.confidence()) {
-            continue;
+    for (int i = 0; i < req.requests_size(); i++) {
+        set_predictions(predictions[static_cast<size_t>(i)], req.requests(i).confidence(),
+                        reduce[static_cast<size_t>(i)], req.requests(i).packed(),
+                        *res.add_responses());
+    }
+
+    return true;
+}
+
+bool DetectorService::handle_stream_open_request(
+    const Seraphim::Object::Detector::StreamOpenRequest &req,
+    Seraphim::Object::Detector::StreamOpenResponse &res) {
+    std::shared_ptr<Stream> stream = std::make_shared<Stream>();
+    uint32_t id;
+
+    if (req.width() == 0 || req.height() == 0) {
+        return false;
+    }
+
+    stream->params = req;
+    if (stream->params.keyframe_interval() == 0) {
+        stream->params.set_keyframe_interval(DEFAULT_KEYFRAME_INTERVAL);
+    }
+    if (stream->params.change_threshold() == 0.0f) {
+        stream->params.set_change_threshold(DEFAULT_CHANGE_THRESHOLD);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_streams_mutex);
+        id = m_streams.open(client(), std::move(stream));
+    }
+    if (id == 0) {
+        return false;
+    }
+
+    res.set_stream(id);
+    return true;
+}
+
+bool DetectorService::handle_stream_frame_request(
+    const Seraphim::Object::Detector::StreamFrameRequest &req,
+    Seraphim::Object::Detector::StreamFrameResponse &res) {
+    std::shared_ptr<Stream> stream;
+    sph::CoreImage frame;
+    sph::CoreImage image;
+    cv::Mat buffer;
+    cv::Mat mat;
+    bool changed = true;
+
+    {
+        // the stream stays alive while it is used, even if it is closed meanwhile
+        std::lock_guard<std::mutex> streams_lock(m_streams_mutex);
+        stream = m_streams.find(client(), req.stream());
+        if (!stream) {
+            return false;
         }
+    }
 
-        res.add_labels(predictions[i].class_id);
-        res.add_confidences(predictions[i].confidence);
-        Seraphim::Types::Region2D *roi = res.add_rois();
-        roi->set_x(predictions[i].poly.brect().tl().x);
-        roi->set_y(predictions[i].poly.brect().tl().y);
-        roi->set_w(predictions[i].poly.width());
-        roi->set_h(predictions[i].poly.height());
+    // waiting for the previous frame of this stream must not block the other streams
+    std::lock_guard<std::mutex> lock(stream->mutex);
+    if (stream->closed) {
+        return false;
+    }
+
+    const Seraphim::Object::Detector::StreamOpenRequest &params = stream->params;
+    if (req.image().fourcc() != params.fourcc() || req.image().width() != params.width() ||
+        req.image().height() != params.height()) {
+        return false;
+    }
+
+    if (params.tile_delta()) {
+        if (!update_frame(*stream, req, frame)) {
+            return false;
+        }
+    } else if (req.has_delta() || !sph::backend::Image2DtoImage(req.image(), frame, buffer)) {
+        return false;
+    }
+
+    if (!sph::backend::ImageRegion(frame, params.roi(), image) || image.empty()) {
+        return false;
+    }
+
+    stream->frames++;
+    stream->frames_since_keyframe++;
+
+    if (params.change_threshold() > 0.0f) {
+        mat = sph::iop::cv::from_image(image);
+        if (mat.empty()) {
+            return false;
+        }
+
+        // the buffers of the stream are reused, so this does not allocate once the stream is
+        // running
+        cv::resize(mat, stream->scaled, THUMBNAIL_SIZE, 0, 0, cv::INTER_AREA);
+        if (stream->scaled.channels() == 3) {
+            cv::cvtColor(stream->scaled, stream->thumbnail, cv::COLOR_BGR2GRAY);
+        } else {
+            stream->scaled.copyTo(stream->thumbnail);
+        }
+
+        if (!stream->keyframe.empty() &&
+            stream->frames_since_keyframe < params.keyframe_interval()) {
+            double diff = cv::norm(stream->thumbnail, stream->keyframe, cv::NORM_L1) /
+                          static_cast<double>(stream->thumbnail.total());
+            changed = diff >= static_cast<double>(params.change_threshold());
+        }
+    }
+
+    if (changed) {
+        if (!m_detectors.acquire()->predict(image, stream->predictions)) {
+            return false;
+        }
+
+        stream->frames_since_keyframe = 0;
+        std::swap(stream->keyframe, stream->thumbnail);
+    }
+
+    set_predictions(stream->predictions, params.confidence(), 1, params.packed(),
+                    *res.mutable_detections());
+    res.set_cached(!changed);
+    res.set_frame(stream->frames);
+    return true;
+}
+
+bool DetectorService::handle_stream_close_request(
+    const Seraphim::Object::Detector::StreamCloseRequest &req,
+    Seraphim::Object::Detector::StreamCloseResponse &res) {
+    (void)res;
+
+    std::lock_guard<std::mutex> lock(m_streams_mutex);
+    std::shared_ptr<Stream> stream = m_streams.find(client(), req.stream());
+    if (!stream) {
+        return false;
+    }
+
+    // a frame which is being handled finishes, the last one to use the stream releases it
+    stream->closed = true;
+    return m_streams.close(client(), req.stream());
+}
+
+bool DetectorService::update_frame(Stream &stream,
+                                   const Seraphim::Object::Detector::StreamFrameRequest &req,
+                                   sph::CoreImage &frame) {
+    const Seraphim::Object::Detector::StreamOpenRequest &params = stream.params;
+    sph::Pixelformat pixfmt(params.fourcc());
+    size_t stride = params.width() * pixfmt.size;
+
+    if (pixfmt.size == 0) {
+        return false;
+    }
+
+    if (req.has_delta()) {
+        // a delta is only meaningful on top of the previous frame
+        if (stream.frame.empty()) {
+            return false;
+        }
+
+        if (!sph::ipc::apply_tile_delta(req.delta(), stream.frame.data(), params.width(),
+                                        params.height(), stride, pixfmt.size)) {
+            // the copy may be corrupted now, the client has to start over with a full frame
+            stream.frame.clear();
+            return false;
+        }
+    } else {
+        sph::CoreImage full;
+        cv::Mat buffer;
+        if (!sph::backend::Image2DtoImage(req.image(), full, buffer)) {
+            return false;
+        }
+
+        stream.frame.resize(stride * params.height());
+        for (uint32_t y = 0; y < params.height(); y++) {
+            std::memcpy(&stream.frame[y * stride], full.data(y), stride);
+        }
     }
 
+    frame = sph::CoreImage(stream.frame.data(), params.width(), params.height(), pixfmt, stride);
     return true;
 }
@@ -9,23 +9,105 @@
 #define SPH_OBJECT_DETECTOR_SERVICE_H
 
 #include <ObjectDetector.pb.h>
+#include <atomic>
+#include <mutex>
+#include <opencv2/core/mat.hpp>
 #include <seraphim/object/detector.h>
 
+#include "../instance_pool.h"
 #include "../service.h"
+#include "../session.h"
 
 namespace sph {
 namespace object {
 
 class DetectorService : public sph::backend::Service {
 public:
-    explicit DetectorService(std::shared_ptr<sph::object::Detector> recognizer);
+    /**
+     * @brief Object detector service.
+     *        Requests are handled concurrently, by as many of them as there are detectors. Frames
+     *        of the same stream are handled one after another though.
+     * @param detectors Independent detector instances.
+     */
+    explicit DetectorService(std::vector<std::shared_ptr<sph::object::Detector>> detectors);
+
+    /**
+     * @brief Set the input size of the detector.
+     *        JPEG compressed images are decoded at reduced scale as long as they stay at least
+     *        this large, since the detector would scale them down anyway.
+     * @param size Input size, empty to always decode at full scale.
+     */
+    void set_input_size(const cv::Size &size) { m_input_size = size; }
 
-    bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) override;
     bool handle_detection_request(const Seraphim::Object::Detector::DetectionRequest &req,
                                   Seraphim::Object::Detector::DetectionResponse &res);
 
+    bool
+    handle_batch_detection_request(const Seraphim::Object::Detector::BatchDetectionRequest &req,
+                                   Seraphim::Object::Detector::BatchDetectionResponse &res);
+
+    bool handle_stream_open_request(const Seraphim::Object::Detector::StreamOpenRequest &req,
+                                    Seraphim::Object::Detector::StreamOpenResponse &res);
+
+    bool handle_stream_frame_request(const Seraphim::Object::Detector::StreamFrameRequest &req,
+                                     Seraphim::Object::Detector::StreamFrameResponse &res);
+
+    bool handle_stream_close_request(const Seraphim::Object::Detector::StreamCloseRequest &req,
+                                     Seraphim::Object::Detector::StreamCloseResponse &res);
+
+    /// Inference runs at least this often per stream by default.
+    static constexpr uint32_t DEFAULT_KEYFRAME_INTERVAL = 10;
+
+    /// Default mean absolute pixel difference below which detections are reused.
+    static constexpr float DEFAULT_CHANGE_THRESHOLD = 2.0f;
+
 private:
-    std::shared_ptr<sph::object::Detector> m_recognizer;
+    /**
+     * @brief State of a stream.
+     */
+    struct Stream {
+        /// held while a frame is handled, frames of a stream are handled one after another
+        std::mutex mutex;
+        /// set once the stream was closed, frames which were waiting for it are rejected
+        std::atomic<bool> closed{ false };
+        /// parameters the stream was opened with
+        Seraphim::Object::Detector::StreamOpenRequest params;
+        /// number of frames pushed so far
+        uint64_t frames = 0;
+        /// copy of the last frame, patched by tile deltas (rows are not padded)
+        std::vector<unsigned char> frame;
+        /// frames since the last inference
+        uint32_t frames_since_keyframe = 0;
+        /// downscaled version of the current frame
+        cv::Mat scaled;
+        /// grayscale version of the downscaled frame
+        cv::Mat thumbnail;
+        /// downscaled grayscale version of the last inferred frame
+        cv::Mat keyframe;
+        /// detections of the last inferred frame
+        std::vector<sph::object::Detector::Prediction> predictions;
+    };
+
+    /**
+     * @brief Update the copy of the last frame of a stream which accepts tile deltas.
+     * @param stream The stream.
+     * @param req The frame, either complete or as delta.
+     * @param frame Output parameter wrapping the updated copy.
+     * @return True on success, false otherwise.
+     */
+    static bool update_frame(Stream &stream,
+                             const Seraphim::Object::Detector::StreamFrameRequest &req,
+                             sph::CoreImage &frame);
+
+    sph::backend::InstancePool<sph::object::Detector> m_detectors;
+
+    /// images are not decoded smaller than this
+    cv::Size m_input_size;
+
+    /// open streams
+    sph::backend::SessionStore<Stream> m_streams;
+    /// protects the stream store, but not the streams themselves
+    std::mutex m_streams_mutex;
 };
 
 } // namespace object
@@ -9,8 +9,19 @@
 #define SPH_SERVER_H
 
 #include <Seraphim.pb.h>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <iostream>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <seraphim/except.h>
+#include <seraphim/ipc/arena_pool.h>
+#include <seraphim/ipc/buffer_registry.h>
+#include <seraphim/ipc/latency_tracer.h>
+#include <seraphim/ipc/request_view.h>
+#include <unordered_map>
 
 #include "service.h"
 
@@ -55,9 +66,44 @@ public:
      * A service handles incoming requests and emits appropriate responses.
      * The service that got registered last will take precedence, effectively overriding any
      * services handling the same kind of requests.
+     * Services must be registered before the server is started.
+     * Throws sph::RuntimeException if the type ids of two different request types collide.
      * @param service The service that handles incoming requests.
      */
-    void register_service(std::shared_ptr<Service> service) { m_services.emplace_front(service); }
+    void register_service(std::shared_ptr<Service> service) {
+        for (const auto &handler : service->handlers()) {
+            auto it = m_handlers.find(handler.first);
+            if (it != m_handlers.end() && it->second.name != handler.second.name) {
+                SPH_THROW(RuntimeException,
+                          "Type id collision: " + it->second.name + ", " + handler.second.name);
+            }
+
+            m_handlers[handler.first] = handler.second;
+        }
+
+        m_services.emplace_front(service);
+    }
+
+    /**
+     * @brief Get the usage statistics of the arenas holding request and response messages.
+     */
+    sph::ipc::ArenaPool::Stats arena_stats() const { return m_arenas.stats(); }
+
+    /**
+     * @brief Set the deadline of requests which do not carry one themselves.
+     *        Requests which could not be handled in time are dropped, so clients get results for
+     *        recent frames only, even if the services are overloaded.
+     *        Must be set before the server is started.
+     * @param deadline Time after the arrival of a request in which handling it must begin,
+     *                 0 means no deadline.
+     */
+    void set_deadline(std::chrono::milliseconds deadline) { m_deadline = deadline; }
+
+    /**
+     * @brief Get the number of requests which were dropped because they were superseded or their
+     *        deadline passed.
+     */
+    uint64_t dropped() const { return m_dropped; }
 
 protected:
     Server() = default;
@@ -82,29 +128,240 @@ protected:
     }
 
     /**
-     * @brief Relay a request message to registered services.
-     * @param msg The message that was received by the server.
+     * @brief Newest request of a client for every supersede key (see Seraphim::Request).
+     *        Servers keep one per client and pass it to @ref prepare.
      */
-    void handle_message(Seraphim::Message &msg) {
-        bool handled = false;
-        Seraphim::Response res;
+    struct Latest {
+        /// protects the members below, calls of a client are handled by several threads
+        std::mutex mutex;
+        /// number of the last request of the client
+        uint64_t seq = 0;
+        /// number of the newest request by supersede key, removed once that request was handled
+        std::unordered_map<uint32_t, uint64_t> newest;
+    };
 
-        if (!msg.has_req()) {
-            // not a request
-            msg.mutable_res()->set_status(-1);
+    /**
+     * @brief Request which was parsed and is ready to be handled.
+     *
+     * All messages belonging to the request are allocated from its arena, which is recycled once
+     * the call is destroyed.
+     */
+    struct Call {
+        /// arena holding the messages below
+        std::shared_ptr<google::protobuf::Arena> arena;
+        /// message id of the request and, once handled, the response
+        Seraphim::Message *msg = nullptr;
+        /// handler of the request, nullptr if no service handles it
+        const Service::Handler *handler = nullptr;
+        /// the parsed request
+        google::protobuf::Message *request = nullptr;
+        /// newest requests of the client, nullptr if requests are never superseded
+        std::shared_ptr<Latest> latest;
+        /// supersede key, 0 if the request is never superseded
+        uint32_t supersede = 0;
+        /// number of the request among the ones of the client
+        uint64_t seq = 0;
+        /// point in time by which handling the request must begin
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::time_point::max();
+        /// trace of the request (part of msg), nullptr if the client did not ask for one
+        Seraphim::Trace *trace = nullptr;
+        /// client the request came from, whose shared buffers it may reference (see
+        /// sph::ipc::BufferRegistry) and whose sessions it may use (see Service::client()), 0 if
+        /// the client cannot be told apart from others
+        uint64_t peer = 0;
+    };
+
+    /**
+     * @brief Look up the handler of a request and parse its payload.
+     *        The handler is found by type id in constant time and the payload is parsed exactly
+     *        once, directly from the memory the view points to.
+     * @param view The request.
+     * @param call Output parameter for the parsed request.
+     * @param latest Newest requests of the client, requests are not superseded without.
+     */
+    void prepare(const sph::ipc::RequestView &view, Call &call,
+                 const std::shared_ptr<Latest> &latest = nullptr) {
+        int64_t received = sph::ipc::LatencyTracer::now();
+
+        call.arena = m_arenas.acquire();
+        call.msg = google::protobuf::Arena::CreateMessage<Seraphim::Message>(call.arena.get());
+        call.msg->set_id(view.id());
+        call.handler = nullptr;
+        call.request = nullptr;
+        call.latest = nullptr;
+        call.supersede = 0;
+        call.seq = 0;
+        call.deadline = std::chrono::steady_clock::time_point::max();
+        call.trace = nullptr;
+        call.peer = 0;
+
+        if (!view.is_request()) {
             return;
         }
 
-        for (const auto &service : m_services) {
-            handled = service->handle_request(msg.req(), res);
-            if (handled) {
-                emit_event(EVENT_MESSAGE_HANDLED, &msg);
-                break;
+        // the trace is returned with the response, which replaces the request in the message
+        if (view.has_trace()) {
+            call.trace = call.msg->mutable_trace();
+            if (view.trace(*call.trace)) {
+                call.trace->set_received(received);
+            } else {
+                call.msg->clear_trace();
+                call.trace = nullptr;
+            }
+        }
+
+        // the deadline counts from the arrival, so the clocks of client and server do not matter
+        std::chrono::milliseconds deadline = m_deadline;
+        if (view.deadline() > 0) {
+            deadline = std::chrono::milliseconds(view.deadline());
+        }
+        if (deadline.count() > 0) {
+            call.deadline = std::chrono::steady_clock::now() + deadline;
+        }
+
+        if (latest && view.supersede() != 0) {
+            std::lock_guard<std::mutex> lock(latest->mutex);
+            call.latest = latest;
+            call.supersede = view.supersede();
+            call.seq = ++latest->seq;
+            latest->newest[call.supersede] = call.seq;
+        }
+
+        // event handlers get to see the type, but not the payload
+        call.msg->mutable_req()->set_type(view.type());
+
+        auto it = m_handlers.find(view.type());
+        if (it != m_handlers.end()) {
+            call.request =
+                it->second.parse(view.payload(), view.payload_size(), call.arena.get());
+            if (call.request) {
+                call.handler = &it->second;
+            }
+        }
+
+        if (call.trace) {
+            call.trace->set_parse(sph::ipc::LatencyTracer::now() - received);
+        }
+    }
+
+    /**
+     * @brief Handle a prepared request, its message is replaced by the response.
+     *        May be called by several threads at once, requests to the same service are
+     *        serialized unless the service is concurrent (see Service::concurrent()).
+     *        Exceptions thrown by the service are logged and answered with FAILED.
+     * @param call The request.
+     */
+    void handle_call(Call &call) {
+        bool handled = false;
+        Seraphim::Response *res = call.msg->mutable_res();
+
+        if (call.handler) {
+            // requests pile up while waiting for the service, so check whether they are still
+            // wanted before and after waiting for it
+            bool dropped = stale(call);
+            if (!dropped) {
+                Service *service = call.handler->service;
+                std::unique_lock<std::mutex> lock(service->mutex(), std::defer_lock);
+                if (!service->concurrent()) {
+                    lock.lock();
+                    dropped = stale(call);
+                }
+                if (!dropped) {
+                    int64_t begin = 0;
+                    if (call.trace) {
+                        begin = sph::ipc::LatencyTracer::now();
+                        call.trace->set_queue(begin - call.trace->received() -
+                                              call.trace->parse());
+                    }
+
+                    // buffers and sessions are resolved on behalf of the client only
+                    sph::ipc::BufferRegistry::Scope scope(call.peer);
+
+                    // a failing service must not take down the worker, the client is told
+                    try {
+                        handled =
+                            call.handler->handle(*call.request, *res, call.arena.get());
+                    } catch (const std::exception &e) {
+                        std::cout << "[ERROR] Server: " << call.handler->name << ": " << e.what()
+                                  << std::endl;
+                        res->Clear();
+                        handled = false;
+                    }
+
+                    if (call.trace) {
+                        call.trace->set_handle(sph::ipc::LatencyTracer::now() - begin);
+                    }
+                }
+            }
+
+            if (dropped) {
+                m_dropped++;
+                res->set_status(Seraphim::Response::DROPPED);
+                if (call.trace) {
+                    call.trace->set_replied(sph::ipc::LatencyTracer::now());
+                }
+                retire(call);
+                return;
             }
         }
 
-        msg.mutable_res()->set_status(handled ? 0 : -1);
-        msg.mutable_res()->Swap(&res);
+        res->set_status(handled ? Seraphim::Response::OK : Seraphim::Response::FAILED);
+        if (handled) {
+            emit_event(EVENT_MESSAGE_HANDLED, call.msg);
+        }
+        if (call.trace) {
+            call.trace->set_replied(sph::ipc::LatencyTracer::now());
+        }
+        retire(call);
+    }
+
+    /**
+     * @brief Check whether a request was superseded by a newer one or its deadline passed.
+     */
+    bool stale(const Call &call) {
+        if (std::chrono::steady_clock::now() > call.deadline) {
+            return true;
+        }
+
+        if (call.latest) {
+            // a missing key means a newer request was handled already
+            std::lock_guard<std::mutex> lock(call.latest->mutex);
+            auto it = call.latest->newest.find(call.supersede);
+            return it == call.latest->newest.end() || it->second != call.seq;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Forget the supersede key of a handled request unless a newer request took it over,
+     *        so the keys of a client do not pile up.
+     */
+    void retire(const Call &call) {
+        if (call.latest) {
+            std::lock_guard<std::mutex> lock(call.latest->mutex);
+            auto it = call.latest->newest.find(call.supersede);
+            if (it != call.latest->newest.end() && it->second == call.seq) {
+                call.latest->newest.erase(it);
+            }
+        }
+    }
+
+    /**
+     * @brief Relay a request message to registered services.
+     *        May be called by several threads at once, requests to the same service are
+     *        serialized though.
+     * @param msg The message that was received by the server, replaced by the response.
+     */
+    void handle_message(Seraphim::Message &msg) {
+        sph::ipc::RequestView view;
+        Call call;
+
+        view.parse(msg);
+        prepare(view, call);
+        handle_call(call);
+        msg.CopyFrom(*call.msg);
     }
 
     /// Event handlers.
@@ -112,6 +369,18 @@ protected:
 
     /// Services acting as message handlers.
     std::list<std::shared_ptr<Service>> m_services;
+
+    /// Request handlers of all services by type id.
+    std::unordered_map<uint32_t, Service::Handler> m_handlers;
+
+    /// Arenas for the messages of requests which are being handled.
+    sph::ipc::ArenaPool m_arenas;
+
+    /// Deadline of requests which do not carry one, 0 means none.
+    std::chrono::milliseconds m_deadline{ 0 };
+
+    /// Number of requests which were dropped.
+    std::atomic<uint64_t> m_dropped{ 0 };
 };
 
 } // namespace backend
@@ -9,6 +9,15 @@
 #define SPH_SERVICE_H
 
 #include <Seraphim.pb.h>
+#include <functional>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
+#include <memory>
+#include <mutex>
+#include <seraphim/ipc/buffer_registry.h>
+#include <seraphim/ipc/request_view.h>
+#include <string>
+#include <unordered_map>
 
 namespace sph {
 namespace backend {
@@ -18,13 +27,43 @@ public:
     virtual ~Service() = default;
 
     /**
-     * @brief Handle a request message.
-     * @param req The request.
-     * @param res The response, filled by this method.
-     * @return True on success, false otherwise (e.g. if this service does not handle this kind of
-     * request).
+     * @brief Handler for one kind of request.
      */
-    virtual bool handle_request(const Seraphim::Request &req, Seraphim::Response &res) = 0;
+    struct Handler {
+        /// Full name of the request type.
+        std::string name;
+        /// The service the handler belongs to.
+        Service *service;
+        /// Parse a serialized request into a message allocated from the arena, returns nullptr
+        /// if it is malformed.
+        std::function<google::protobuf::Message *(const void *data, size_t size,
+                                                  google::protobuf::Arena *arena)>
+            parse;
+        /// Handle a parsed request and pack the response, the service lock must be held.
+        /// Temporary messages are allocated from the arena.
+        std::function<bool(const google::protobuf::Message &req, Seraphim::Response &res,
+                           google::protobuf::Arena *arena)>
+            handle;
+    };
+
+    /**
+     * @brief Request handlers of this service by type id (see sph::ipc::type_id()).
+     */
+    const std::unordered_map<uint32_t, Handler> &handlers() const { return m_handlers; }
+
+    /**
+     * @brief Lock which serializes requests to this service.
+     *        Services are shared between servers, which handle requests concurrently, but the
+     *        algorithms behind them are not thread safe.
+     */
+    std::mutex &mutex() { return m_mutex; }
+
+    /**
+     * @brief Whether requests to this service may be handled concurrently.
+     *        Such services guard their state themselves (e.g. with an InstancePool), so the server
+     *        does not serialize their requests with @ref mutex.
+     */
+    bool concurrent() const { return m_concurrent; }
 
 protected:
     Service() = default;
@@ -34,6 +73,57 @@ protected:
     // disallow copy and move assignment
     Service &operator=(const Service &) = delete;
     Service &operator=(Service &&) = delete;
+
+    /**
+     * @brief Declare whether the handlers of this service are thread safe, see @ref concurrent.
+     */
+    void set_concurrent(bool concurrent) { m_concurrent = concurrent; }
+
+    /**
+     * @brief Get the client whose request the calling thread is handling, e.g. to bind state to
+     *        it (see SessionStore). Every connection of a client counts as a client of its own.
+     * @return The client, 0 if it cannot be told apart from others (e.g. over UDP).
+     */
+    static uint64_t client() { return sph::ipc::BufferRegistry::current(); }
+
+    /**
+     * @brief Register a handler for one kind of request.
+     *        Derived classes call this in their constructors, the request type is deduced from
+     *        the handler signature.
+     * @param fn Member function handling the request.
+     */
+    template <class S, class Req, class Res>
+    void register_handler(bool (S::*fn)(const Req &, Res &)) {
+        Handler handler;
+        S *self = static_cast<S *>(this);
+
+        handler.name = Req::descriptor()->full_name();
+        handler.service = this;
+        handler.parse = [](const void *data, size_t size, google::protobuf::Arena *arena) {
+            Req *req = google::protobuf::Arena::CreateMessage<Req>(arena);
+            // the arena frees the message, even if parsing failed
+            return req->ParseFromArray(data, static_cast<int>(size)) ? req : nullptr;
+        };
+        handler.handle = [self, fn](const google::protobuf::Message &req, Seraphim::Response &res,
+                                    google::protobuf::Arena *arena) {
+            Res *inner_res = google::protobuf::Arena::CreateMessage<Res>(arena);
+            if (!(self->*fn)(static_cast<const Req &>(req), *inner_res)) {
+                return false;
+            }
+
+            res.mutable_inner()->PackFrom(*inner_res);
+            return true;
+        };
+
+        m_handlers[sph::ipc::type_id(handler.name)] = std::move(handler);
+    }
+
+private:
+    std::mutex m_mutex;
+    bool m_concurrent = false;
+
+    /// request handlers by type id
+    std::unordered_map<uint32_t, Handler> m_handlers;
 };
 
 } // namespace backend
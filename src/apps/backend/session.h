@@ -0,0 +1,147 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_SESSION_H
+#define SPH_SESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace sph {
+namespace backend {
+
+/**
+ * @brief Per-stream state of a service.
+ *
+ * Streaming clients open a session once with the parameters which apply to all of their frames
+ * and refer to it by id afterwards, so the service can keep buffers, cached conversions and past
+ * results around for the lifetime of the stream.
+ *
+ * Every session belongs to the client which opened it (see Service::client()), other clients can
+ * neither use nor close it. Clients which cannot be told apart from others cannot open sessions at
+ * all. The number of sessions per client is limited, so a single client cannot use up the store.
+ *
+ * Clients may disappear without closing their sessions, so sessions which have not been used for
+ * a while expire. The store is not thread safe, services guard it with their own lock (see
+ * Service::mutex()) or, if they are concurrent, with a lock of the store. The state is shared, so
+ * concurrent services can use it without holding that lock; it is released by whoever drops the
+ * last reference, even if the session was closed or expired meanwhile.
+ */
+template <class State> class SessionStore {
+public:
+    /**
+     * @brief Session store.
+     * @param capacity Maximum number of open sessions.
+     * @param per_client Maximum number of open sessions of a single client.
+     * @param timeout Idle time after which a session may expire.
+     */
+    explicit SessionStore(size_t capacity = 64, size_t per_client = 4,
+                          std::chrono::milliseconds timeout = std::chrono::seconds(30))
+        : m_capacity(capacity), m_per_client(per_client), m_timeout(timeout) {}
+
+    /**
+     * @brief Open a new session.
+     *        Expired sessions are removed first.
+     * @param client The client opening the session, see Service::client().
+     * @param state The initial state of the session.
+     * @return The session id (never 0) or 0 if the client cannot be told apart from others or too
+     *         many sessions are open.
+     */
+    uint32_t open(uint64_t client, std::shared_ptr<State> state) {
+        auto now = std::chrono::steady_clock::now();
+        size_t owned = 0;
+
+        if (client == 0) {
+            return 0;
+        }
+
+        for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+            if (now - it->second.last_used > m_timeout) {
+                it = m_sessions.erase(it);
+            } else {
+                owned += it->second.client == client ? 1 : 0;
+                it++;
+            }
+        }
+
+        if (m_sessions.size() >= m_capacity || owned >= m_per_client) {
+            return 0;
+        }
+
+        // 0 is reserved for 'no session'
+        do {
+            m_next_id++;
+        } while (m_next_id == 0 || m_sessions.find(m_next_id) != m_sessions.end());
+
+        m_sessions[m_next_id] = { client, std::move(state), now };
+        return m_next_id;
+    }
+
+    /**
+     * @brief Look up a session of a client and mark it as used.
+     * @param client The client, see Service::client().
+     * @param id The session id.
+     * @return The state of the session or nullptr if it does not exist (anymore) or belongs to
+     *         another client.
+     */
+    std::shared_ptr<State> find(uint64_t client, uint32_t id) {
+        auto it = m_sessions.find(id);
+        if (it == m_sessions.end() || it->second.client != client) {
+            return nullptr;
+        }
+
+        it->second.last_used = std::chrono::steady_clock::now();
+        return it->second.state;
+    }
+
+    /**
+     * @brief Close a session of a client and release its state.
+     * @param client The client, see Service::client().
+     * @param id The session id.
+     * @return True if the session existed and belonged to the client, false otherwise.
+     */
+    bool close(uint64_t client, uint32_t id) {
+        auto it = m_sessions.find(id);
+        if (it == m_sessions.end() || it->second.client != client) {
+            return false;
+        }
+
+        m_sessions.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Number of open sessions, including the ones which already expired.
+     */
+    size_t size() const { return m_sessions.size(); }
+
+private:
+    struct Session {
+        uint64_t client;
+        std::shared_ptr<State> state;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    /// maximum number of sessions
+    size_t m_capacity;
+    /// maximum number of sessions of a single client
+    size_t m_per_client;
+    /// idle time after which sessions expire
+    std::chrono::milliseconds m_timeout;
+
+    /// open sessions by id
+    std::unordered_map<uint32_t, Session> m_sessions;
+    /// last session id that was handed out
+    uint32_t m_next_id = 0;
+};
+
+} // namespace backend
+} // namespace sph
+
+#endif // SPH_SESSION_H
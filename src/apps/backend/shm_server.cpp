@@ -13,43 +13,163 @@ using namespace sph;
 using namespace sph::backend;
 using namespace sph::ipc;
 
-SharedMemoryServer::SharedMemoryServer(std::shared_ptr<SharedMemoryTransport> ptr)
-    : m_transport(ptr), m_running(false) {}
+SharedMemoryServer::SharedMemoryServer(std::shared_ptr<SharedMemoryTransport> ptr, size_t workers)
+    : m_transport(ptr), m_running(false), m_num_workers(workers) {}
 
 SharedMemoryServer::~SharedMemoryServer() {
-    m_running = false;
-    if (m_thread.joinable()) {
-        m_thread.join();
-    }
+    terminate();
 }
 
 bool SharedMemoryServer::run() {
+    // a client which does not read its responses must not block the others forever
+    m_transport->set_tx_timeout(TX_TIMEOUT);
+
+    m_workers = std::unique_ptr<ThreadPool>(new ThreadPool(m_num_workers));
+
     m_running = true;
-    m_thread = std::thread([&]() {
-        while (m_running) {
-            try {
-                m_transport->synchronized()->receive(m_msg);
-                emit_event(EVENT_MESSAGE_INBOUND, &m_msg);
-                handle_message(m_msg);
-                emit_event(EVENT_MESSAGE_OUTBOUND, &m_msg);
-                m_transport->synchronized()->send(m_msg);
-            } catch (const TimeoutException &) {
-                // ignore
-                continue;
-            } catch (const RuntimeException &e) {
-                std::cout << "[ERROR] SharedMemoryServer: " << e.what() << std::endl;
-            }
-        }
-    });
+    m_thread = std::thread([&]() { io_loop(); });
 
     return true;
 }
 
 void SharedMemoryServer::terminate() {
     m_running = false;
-    m_transport->set_rx_timeout(1);
     m_transport->set_tx_timeout(1);
+    // the server thread blocks in poll() until a message arrives, so wake it up
+    m_transport->interrupt();
     if (m_thread.joinable()) {
         m_thread.join();
     }
+
+    // let the workers finish the requests they are processing, the responses are dropped
+    m_workers.reset();
+    m_completed.clear();
+    m_pending.clear();
+    m_in_flight.clear();
+}
+
+void SharedMemoryServer::io_loop() {
+    SharedMemoryTransport::ChannelEvent event;
+    unsigned int channel;
+
+    while (m_running) {
+        try {
+            send_responses();
+
+            event = m_transport->synchronized<SharedMemoryTransport>()->poll(channel);
+            switch (event) {
+            case SharedMemoryTransport::CHANNEL_CONNECTED:
+                emit_event(EVENT_CLIENT_CONNECTED, nullptr);
+                continue;
+            case SharedMemoryTransport::CHANNEL_DISCONNECTED:
+                // responses to requests of the old client must not reach the next one
+                m_generations[channel]++;
+                m_latest.erase(channel);
+                m_pending.erase(channel);
+                // the transport resumed the channel already
+                m_in_flight.erase(channel);
+                emit_event(EVENT_CLIENT_DISCONNECTED, nullptr);
+                continue;
+            case SharedMemoryTransport::CHANNEL_WRITABLE:
+                // the held back responses are sent at the top of the loop
+                continue;
+            case SharedMemoryTransport::CHANNEL_REQUEST:
+                break;
+            }
+
+            Completion completion = { channel, m_generations[channel], std::make_shared<Call>() };
+            std::shared_ptr<Latest> &latest = m_latest[channel];
+            bool parsed = false;
+
+            if (!latest) {
+                latest = std::make_shared<Latest>();
+            }
+
+            // the request is parsed exactly once, directly from the queue
+            m_transport->synchronized<SharedMemoryTransport>()->receive(
+                channel, [&](const unsigned char *data, size_t size) {
+                    RequestView view;
+                    parsed = view.parse(data, size);
+                    if (parsed) {
+                        prepare(view, *completion.call, latest);
+                    }
+                });
+            if (!parsed) {
+                SPH_THROW(RuntimeException, "Failed to deserialize message");
+            }
+            completion.call->peer =
+                m_transport->synchronized<SharedMemoryTransport>()->peer(channel);
+
+            m_workers->submit([this, completion]() { process(completion); });
+
+            // leave further requests in the queue until responses were sent
+            if (++m_in_flight[channel] >= MAX_IN_FLIGHT) {
+                m_transport->synchronized<SharedMemoryTransport>()->pause(channel, true);
+            }
+        } catch (const TimeoutException &) {
+            // interrupted by a worker or by terminate()
+            continue;
+        } catch (const RuntimeException &e) {
+            std::cout << "[ERROR] SharedMemoryServer: " << e.what() << std::endl;
+        }
+    }
+}
+
+void SharedMemoryServer::send_responses() {
+    std::deque<Completion> completed;
+
+    {
+        std::lock_guard<std::mutex> lock(m_completed_mutex);
+        completed.swap(m_completed);
+    }
+
+    // responses of a client are sent in order, so new ones queue up behind held back ones
+    // their number is bounded since the requests of a client are paused at MAX_IN_FLIGHT
+    for (auto &completion : completed) {
+        m_pending[completion.channel].emplace_back(std::move(completion));
+    }
+
+    auto it = m_pending.begin();
+    while (it != m_pending.end()) {
+        std::deque<Completion> &pending = it->second;
+        while (!pending.empty()) {
+            const Completion &completion = pending.front();
+            if (completion.generation == m_generations[completion.channel]) {
+                try {
+                    if (!m_transport->synchronized<SharedMemoryTransport>()->try_send(
+                            completion.channel, *completion.call->msg)) {
+                        // the client has to read first, poll() tells us when it did
+                        break;
+                    }
+                } catch (const RuntimeException &e) {
+                    // e.g. a chunked response the client stopped reading, drop this one only
+                    std::cout << "[ERROR] SharedMemoryServer: " << e.what() << std::endl;
+                }
+
+                // there is room for another request of this client now
+                if (m_in_flight[completion.channel]-- == MAX_IN_FLIGHT) {
+                    m_transport->synchronized<SharedMemoryTransport>()->pause(completion.channel,
+                                                                              false);
+                }
+            }
+
+            pending.pop_front();
+        }
+
+        it = pending.empty() ? m_pending.erase(it) : std::next(it);
+    }
+}
+
+void SharedMemoryServer::process(const Completion &completion) {
+    emit_event(EVENT_MESSAGE_INBOUND, completion.call->msg);
+    handle_call(*completion.call);
+    emit_event(EVENT_MESSAGE_OUTBOUND, completion.call->msg);
+
+    {
+        std::lock_guard<std::mutex> lock(m_completed_mutex);
+        m_completed.push_back(completion);
+    }
+
+    // the I/O thread sends the response once it returns from poll()
+    m_transport->interrupt();
 }
@@ -9,28 +9,106 @@
 #define SPH_SHARED_MEMORY_SERVER_H
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <seraphim/ipc/shm_transport.h>
+#include <seraphim/thread_pool.h>
 #include <thread>
+#include <unordered_map>
 
 #include "server.h"
 
 namespace sph {
 namespace backend {
 
+/**
+ * @brief Shared memory server.
+ *
+ * A single thread waits for client activity, receives requests and sends responses, so only that
+ * thread ever touches the transport. Requests are handed to a pool of workers, which means
+ * several requests of a client may be processed at once and completed out of order. Responses
+ * carry the id of the request they belong to.
+ *
+ * Responses are never waited for: if the queue of a client is full, its responses are held back
+ * until it made room, while the other clients are served as usual. Once @ref MAX_IN_FLIGHT
+ * requests of a client are being processed or wait to be sent, its further requests are left in
+ * its queue until responses were sent, so responses are never dropped.
+ */
 class SharedMemoryServer : public sph::backend::Server {
 public:
-    SharedMemoryServer(std::shared_ptr<sph::ipc::SharedMemoryTransport> ptr);
+    /**
+     * @brief Shared memory server.
+     * @param ptr The transport, must be created already.
+     * @param workers Number of worker threads, 0 uses one worker per hardware thread.
+     */
+    SharedMemoryServer(std::shared_ptr<sph::ipc::SharedMemoryTransport> ptr, size_t workers = 0);
     ~SharedMemoryServer() override;
 
     bool run() override;
     void terminate() override;
 
+    /// Time in milliseconds to wait for a client to make room for the next chunk of a response
+    /// which is larger than its queue.
+    static constexpr int TX_TIMEOUT = 1000;
+
+    /// Maximum number of requests of a single client which are processed or wait to be sent at
+    /// once.
+    static constexpr size_t MAX_IN_FLIGHT = 16;
+
 private:
+    /**
+     * @brief Response which is waiting to be sent by the I/O thread.
+     */
+    struct Completion {
+        /// channel of the client
+        unsigned int channel;
+        /// generation of the channel when the request was received
+        uint64_t generation;
+        /// the request and, once handled, the response
+        std::shared_ptr<Call> call;
+    };
+
+    /**
+     * @brief I/O thread main loop.
+     */
+    void io_loop();
+
+    /**
+     * @brief Send the responses completed by the workers, as far as the clients made room for
+     *        them (I/O thread).
+     */
+    void send_responses();
+
+    /**
+     * @brief Process a request and hand the response to the I/O thread (worker thread).
+     */
+    void process(const Completion &completion);
+
     std::shared_ptr<sph::ipc::SharedMemoryTransport> m_transport;
 
     std::thread m_thread;
     std::atomic<bool> m_running;
-    Seraphim::Message m_msg;
+
+    /// number of worker threads
+    size_t m_num_workers;
+    /// workers processing requests
+    std::unique_ptr<sph::ThreadPool> m_workers;
+
+    /// bumped whenever a client releases its channel, so stale responses are dropped (I/O thread)
+    std::unordered_map<unsigned int, uint64_t> m_generations;
+    /// newest requests of the client of every channel (I/O thread)
+    std::unordered_map<unsigned int, std::shared_ptr<Latest>> m_latest;
+
+    /// responses of every channel which were not sent yet, oldest first (I/O thread)
+    std::unordered_map<unsigned int, std::deque<Completion>> m_pending;
+    /// number of requests of every channel which were received, but not answered yet (I/O thread)
+    std::unordered_map<unsigned int, size_t> m_in_flight;
+
+    /// protects m_completed
+    std::mutex m_completed_mutex;
+    /// responses which were not sent yet
+    std::deque<Completion> m_completed;
 };
 
 } // namespace backend
@@ -5,10 +5,16 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <poll.h>
 #include <seraphim/except.h>
 #include <seraphim/ipc/except.h>
 #include <seraphim/ipc/tcp_transport.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include "tcp_server.h"
 
@@ -16,83 +22,599 @@ using namespace sph;
 using namespace sph::backend;
 using namespace sph::ipc;
 
-TCPServer::TCPServer(std::shared_ptr<TCPTransport> ptr) : m_transport(ptr), m_running(false) {}
+/// Maximum number of events handled per epoll_wait() call.
+static constexpr int MAX_EVENTS = 64;
+
+/**
+ * @brief io_uring operations of the I/O thread.
+ *
+ * The user data of an operation holds its type in the upper byte, followed by the id of the
+ * connection (24 bits) and the file descriptor (32 bits).
+ */
+enum Operation : uint64_t { OP_ACCEPT = 1, OP_RECV, OP_POLL, OP_WAKE, OP_CANCEL };
+
+static uint64_t user_data(Operation op, uint32_t id = 0, int fd = 0) {
+    return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(id & 0xFFFFFF) << 32) |
+           static_cast<uint32_t>(fd);
+}
+
+TCPServer::Connection::~Connection() {
+    ::close(stream.fd());
+}
+
+TCPServer::TCPServer(std::shared_ptr<TCPTransport> ptr, size_t workers, Engine engine)
+    : m_transport(ptr), m_running(false), m_num_workers(workers), m_engine(engine),
+      m_io_syscalls(0) {}
 
 TCPServer::~TCPServer() {
+    terminate();
+}
+
+bool TCPServer::run() {
+    struct epoll_event ev = {};
+    int listen_fd;
+    int flags;
+
+    m_transport->synchronized<TCPTransport>()->listen(BACKLOG);
+    listen_fd = m_transport->synchronized<TCPTransport>()->socket().fd();
+
+    // the I/O thread must never block on the listening socket
+    flags = fcntl(listen_fd, F_GETFL);
+    if (flags == -1 || fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return false;
+    }
+
+    if (m_engine != Engine::EPOLL && net::IOUring::supported()) {
+        m_ring = std::unique_ptr<net::IOUring>(new net::IOUring());
+        if (!m_ring->init() || !m_ring->register_buffers(RING_BUFFER_COUNT, RING_BUFFER_SIZE)) {
+            m_ring.reset();
+        }
+    }
+
+    // io_uring completes reads of non-blocking files with -EAGAIN instead of waiting
+    m_event_fd = eventfd(0, m_ring ? EFD_CLOEXEC : EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1) {
+        m_ring.reset();
+        return false;
+    }
+
+    if (m_ring) {
+        m_ring->prep_accept(listen_fd, user_data(OP_ACCEPT));
+        m_ring->prep_read(m_event_fd, &m_event_value, sizeof(m_event_value), user_data(OP_WAKE));
+
+        m_workers = std::unique_ptr<ThreadPool>(new ThreadPool(m_num_workers));
+        m_running = true;
+        m_thread = std::thread([&]() { io_uring_loop(); });
+        return true;
+    }
+
+    if (m_engine == Engine::IO_URING) {
+        std::cout << "[WARN] TCPServer: io_uring not available, fallback to epoll" << std::endl;
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        terminate();
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        terminate();
+        return false;
+    }
+
+    ev.data.fd = m_event_fd;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_event_fd, &ev) == -1) {
+        terminate();
+        return false;
+    }
+
+    m_workers = std::unique_ptr<ThreadPool>(new ThreadPool(m_num_workers));
+
+    m_running = true;
+    m_thread = std::thread([&]() { epoll_loop(); });
+
+    return true;
+}
+
+void TCPServer::terminate() {
     m_running = false;
+    if (m_event_fd != -1) {
+        wake();
+    }
     if (m_thread.joinable()) {
         m_thread.join();
     }
+
+    // closed connections do not schedule any more requests
+    for (const auto &client : m_connections) {
+        std::lock_guard<std::mutex> lock(client.second->mutex);
+        client.second->closed = true;
+        client.second->requests.clear();
+    }
+
+    // let the workers finish the requests they are processing
+    m_workers.reset();
+    m_connections.clear();
+    m_blocked.clear();
+    m_resumed.clear();
+
+    // cancels all operations which are still active
+    m_ring.reset();
+
+    if (m_epoll_fd != -1) {
+        ::close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+    if (m_event_fd != -1) {
+        ::close(m_event_fd);
+        m_event_fd = -1;
+    }
 }
 
-bool TCPServer::run() {
-    m_transport->synchronized<TCPTransport>()->listen(1);
+void TCPServer::wake() {
+    uint64_t val = 1;
+    // the counter cannot overflow in practice, so a failed write means it is signaled already
+    (void)::write(m_event_fd, &val, sizeof(val));
+}
 
-    m_running = true;
-    m_thread = std::thread([&]() {
-        std::vector<int> client_fds;
-        std::vector<struct pollfd> poll_fds;
-
-        while (m_running) {
-            poll_fds.resize(client_fds.size() + 1);
-
-            poll_fds[0].fd = m_transport->synchronized<TCPTransport>()->socket().fd();
-            poll_fds[0].events = POLLIN;
-            for (size_t i = 0; i < client_fds.size(); i++) {
-                poll_fds[i + 1].fd = client_fds[i];
-                poll_fds[i + 1].events = POLLIN;
+void TCPServer::epoll_loop() {
+    struct epoll_event events[MAX_EVENTS];
+    int listen_fd = m_transport->synchronized<TCPTransport>()->socket().fd();
+    int count;
+
+    while (m_running) {
+        count = epoll_wait(m_epoll_fd, events, MAX_EVENTS, 1000);
+        m_io_syscalls++;
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == listen_fd) {
+                accept_clients();
+                continue;
             }
 
-            if (::poll(poll_fds.data(), poll_fds.size() + 1, 1000) <= 0) {
+            if (fd == m_event_fd) {
+                uint64_t val;
+                (void)::read(m_event_fd, &val, sizeof(val));
+                m_io_syscalls++;
+                watch_blocked();
+                resume_clients();
                 continue;
             }
 
-            // check which client got input
-            if (poll_fds[0].revents == POLLIN) {
-                // add a new client
-                int client = m_transport->synchronized<TCPTransport>()->accept(nullptr, nullptr);
-                if (client == -1) {
-                    continue;
-                }
-                emit_event(EVENT_CLIENT_CONNECTED, nullptr);
-                client_fds.push_back(client);
+            auto client = m_connections.find(fd);
+            if (client == m_connections.end()) {
                 continue;
             }
 
-            for (size_t i = 0; i < client_fds.size(); i++) {
-                if (poll_fds[i + 1].revents != POLLIN) {
-                    continue;
-                }
+            // keep the connection alive even if it is closed while handling the event
+            std::shared_ptr<Connection> conn = client->second;
+            if (conn->paused && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                // the socket is not read while paused, so the hangup would be reported forever
+                close_client(fd);
+                continue;
+            }
 
-                // get data from client
-                try {
-                    m_transport->synchronized<TCPTransport>()->receive(client_fds[i], m_msg);
-                    emit_event(EVENT_MESSAGE_INBOUND, &m_msg);
-                    handle_message(m_msg);
-                    emit_event(EVENT_MESSAGE_OUTBOUND, &m_msg);
-                    m_transport->synchronized<TCPTransport>()->send(client_fds[i], m_msg);
-                } catch (const TimeoutException &) {
-                    // ignore
-                    continue;
-                } catch (const PeerDisconnectedException &) {
-                    emit_event(EVENT_CLIENT_DISCONNECTED, nullptr);
-                    client_fds.erase(client_fds.begin() + i);
-                    continue;
-                } catch (const RuntimeException &e) {
-                    std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+            try {
+                if ((events[i].events & EPOLLOUT) && write_client(conn)) {
+                    // everything was sent, stop waiting for the socket to become writable
+                    watch_client(conn);
+                    resume_client(conn);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    read_client(conn);
                 }
+            } catch (const PeerDisconnectedException &) {
+                close_client(fd);
+            } catch (const RuntimeException &e) {
+                std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+                close_client(fd);
+            }
+        }
+    }
+}
+
+void TCPServer::io_uring_loop() {
+    net::IOUring::Completion completion;
+
+    while (m_running) {
+        // submitting the operations queued by the last batch and waiting for the next one is a
+        // single system call
+        try {
+            m_ring->submit(1, 1000);
+        } catch (const RuntimeException &e) {
+            std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+            break;
+        }
+
+        while (m_ring->next(completion)) {
+            handle_completion(completion);
+        }
+
+        m_io_syscalls = m_ring->stats().enters;
+    }
+}
+
+void TCPServer::handle_completion(const net::IOUring::Completion &completion) {
+    auto op = static_cast<Operation>(completion.user_data >> 56);
+    auto id = static_cast<uint32_t>((completion.user_data >> 32) & 0xFFFFFF);
+    auto fd = static_cast<int>(completion.user_data & 0xFFFFFFFF);
+    int listen_fd;
+
+    switch (op) {
+    case OP_ACCEPT:
+        if (completion.res >= 0) {
+            add_client(completion.res);
+        } else if (completion.res != -ECANCELED) {
+            std::cout << "[ERROR] TCPServer: " << strerror(-completion.res) << std::endl;
+        }
+        if (!completion.more && m_running) {
+            listen_fd = m_transport->synchronized<TCPTransport>()->socket().fd();
+            m_ring->prep_accept(listen_fd, user_data(OP_ACCEPT));
+        }
+        return;
+    case OP_WAKE:
+        watch_blocked();
+        resume_clients();
+        if (m_running) {
+            m_ring->prep_read(m_event_fd, &m_event_value, sizeof(m_event_value),
+                              user_data(OP_WAKE));
+        }
+        return;
+    case OP_CANCEL:
+        return;
+    case OP_RECV:
+    case OP_POLL:
+        break;
+    }
+
+    auto client = m_connections.find(fd);
+    if (client == m_connections.end() || (client->second->id & 0xFFFFFF) != id) {
+        // the connection was closed before the operation completed
+        if (completion.has_buffer) {
+            m_ring->recycle(completion.buffer);
+        }
+        return;
+    }
+
+    // keep the connection alive even if it is closed while handling the completion
+    std::shared_ptr<Connection> conn = client->second;
+    try {
+        if (op == OP_POLL) {
+            if (completion.res < 0) {
+                SPH_THROW(RuntimeException, strerror(-completion.res));
+            }
+            if (write_client(conn)) {
+                resume_client(conn);
+            } else {
+                m_ring->prep_poll(fd, POLLOUT, completion.user_data);
             }
+            return;
+        }
+
+        if (completion.res > 0) {
+            conn->stream.append(m_ring->buffer(completion.buffer),
+                                static_cast<size_t>(completion.res));
+            m_ring->recycle(completion.buffer);
+            dispatch(conn);
+        } else if (completion.res == 0) {
+            SPH_THROW(PeerDisconnectedException);
+        } else if (completion.res != -ENOBUFS && completion.res != -ECANCELED) {
+            SPH_THROW(RuntimeException, strerror(-completion.res));
+        }
+
+        // the receive operation ends if the kernel ran out of buffers, they were recycled by now,
+        // or if it was cancelled because the client was paused
+        if (!completion.more) {
+            conn->receiving = !conn->paused;
+            if (conn->receiving) {
+                m_ring->prep_recv(fd, completion.user_data);
+            }
+        }
+    } catch (const PeerDisconnectedException &) {
+        close_client(fd);
+    } catch (const RuntimeException &e) {
+        std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+        close_client(fd);
+    }
+}
+
+void TCPServer::accept_clients() {
+    struct epoll_event ev = {};
+    int fd;
+
+    for (;;) {
+        try {
+            fd = m_transport->synchronized<TCPTransport>()->accept(nullptr, nullptr,
+                                                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+        } catch (const RuntimeException &e) {
+            std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+            return;
+        }
+
+        if (fd == -1) {
+            // no more pending connections
+            return;
         }
-    });
 
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        m_io_syscalls += 2;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            ::close(fd);
+            continue;
+        }
+
+        add_client(fd);
+    }
+}
+
+void TCPServer::add_client(int fd) {
+    // connections accepted by io_uring do not pass through TCPSocket::accept()
+    try {
+        m_transport->synchronized<TCPTransport>()->socket().apply_nodelay(fd);
+    } catch (const RuntimeException &e) {
+        std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+        ::close(fd);
+        return;
+    }
+
+    auto conn = std::make_shared<Connection>(fd, m_next_id++ & 0xFFFFFF);
+    conn->stream.set_max_message_size(
+        m_transport->synchronized<TCPTransport>()->max_message_size());
+
+    if (m_ring) {
+        m_ring->prep_recv(fd, user_data(OP_RECV, conn->id, fd));
+        conn->receiving = true;
+    }
+
+    m_connections[fd] = conn;
+    emit_event(EVENT_CLIENT_CONNECTED, nullptr);
+}
+
+void TCPServer::read_client(const std::shared_ptr<Connection> &conn) {
+    // drain the socket, read() throws when the client disconnected
+    while (!conn->paused) {
+        m_io_syscalls++;
+        if (!conn->stream.read()) {
+            return;
+        }
+
+        // requests are parsed right away, the data is only valid until the next read
+        dispatch(conn);
+    }
+}
+
+void TCPServer::dispatch(const std::shared_ptr<Connection> &conn) {
+    RequestView view;
+    const uint8_t *data;
+    size_t size;
+
+    // requests which arrive while the client is paused stay in the receive buffer
+    while (!conn->paused && conn->stream.next(data, size)) {
+        if (!view.parse(data, size)) {
+            SPH_THROW(RuntimeException, "Failed to deserialize message");
+        }
+
+        Call call;
+        prepare(view, call, conn->latest);
+        call.peer = conn->peer;
+
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            conn->requests.emplace_back(std::move(call));
+            schedule(conn);
+            conn->paused = backlogged(*conn);
+        }
+
+        if (conn->paused) {
+            pause_client(conn);
+        }
+    }
+}
+
+bool TCPServer::write_client(const std::shared_ptr<Connection> &conn) {
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    if (!conn->stream.flush()) {
+        return false;
+    }
+
+    conn->writing = false;
     return true;
 }
 
-void TCPServer::terminate() {
-    m_running = false;
-    m_transport->set_rx_timeout(1);
-    m_transport->set_tx_timeout(1);
-    if (m_thread.joinable()) {
-        m_thread.join();
+void TCPServer::watch_blocked() {
+    std::vector<std::shared_ptr<Connection>> blocked;
+    {
+        std::lock_guard<std::mutex> lock(m_blocked_mutex);
+        blocked.swap(m_blocked);
+    }
+
+    for (const auto &conn : blocked) {
+        int fd = conn->stream.fd();
+        auto client = m_connections.find(fd);
+        if (client == m_connections.end() || client->second != conn) {
+            continue;
+        }
+
+        if (m_ring) {
+            m_ring->prep_poll(fd, POLLOUT, user_data(OP_POLL, conn->id, fd));
+        } else {
+            watch_client(conn);
+        }
+    }
+}
+
+void TCPServer::watch_client(const std::shared_ptr<Connection> &conn) {
+    struct epoll_event ev = {};
+    bool writing;
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        writing = conn->writing;
+    }
+
+    ev.events = 0;
+    if (!conn->paused) {
+        ev.events |= EPOLLIN;
+    }
+    if (writing) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = conn->stream.fd();
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, ev.data.fd, &ev);
+    m_io_syscalls++;
+}
+
+void TCPServer::pause_client(const std::shared_ptr<Connection> &conn) {
+    int fd = conn->stream.fd();
+
+    if (!m_ring) {
+        watch_client(conn);
+        return;
+    }
+
+    // the receive operation completes with -ECANCELED and is not re-armed while paused, data
+    // which was received before is buffered
+    if (conn->receiving) {
+        m_ring->prep_cancel_op(user_data(OP_RECV, conn->id, fd), user_data(OP_CANCEL));
+    }
+}
+
+void TCPServer::resume_client(const std::shared_ptr<Connection> &conn) {
+    int fd = conn->stream.fd();
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        conn->resuming = false;
+        if (!conn->paused || backlogged(*conn)) {
+            return;
+        }
+        conn->paused = false;
+    }
+
+    // handle the requests which were buffered while paused first, this may pause again
+    dispatch(conn);
+    if (conn->paused) {
+        return;
+    }
+
+    if (!m_ring) {
+        watch_client(conn);
+    } else if (!conn->receiving) {
+        m_ring->prep_recv(fd, user_data(OP_RECV, conn->id, fd));
+        conn->receiving = true;
+    }
+}
+
+void TCPServer::resume_clients() {
+    std::vector<std::shared_ptr<Connection>> resumed;
+    {
+        std::lock_guard<std::mutex> lock(m_blocked_mutex);
+        resumed.swap(m_resumed);
+    }
+
+    for (const auto &conn : resumed) {
+        int fd = conn->stream.fd();
+        auto client = m_connections.find(fd);
+        if (client == m_connections.end() || client->second != conn) {
+            continue;
+        }
+
+        try {
+            resume_client(conn);
+        } catch (const RuntimeException &e) {
+            std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+            close_client(fd);
+        }
+    }
+}
+
+void TCPServer::close_client(int fd) {
+    auto client = m_connections.find(fd);
+    if (client == m_connections.end()) {
+        return;
+    }
+
+    if (m_ring) {
+        // the operations reference the socket, it is not closed until they are cancelled
+        m_ring->prep_cancel(fd, user_data(OP_CANCEL));
+        try {
+            m_ring->submit();
+        } catch (const RuntimeException &e) {
+            std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+        }
+    } else {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        m_io_syscalls++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(client->second->mutex);
+        client->second->closed = true;
+        client->second->requests.clear();
+    }
+
+    // the socket is closed once no worker references the connection anymore
+    m_connections.erase(client);
+    emit_event(EVENT_CLIENT_DISCONNECTED, nullptr);
+}
+
+void TCPServer::schedule(const std::shared_ptr<Connection> &conn) {
+    while (!conn->closed && conn->in_flight < MAX_IN_FLIGHT && !conn->requests.empty()) {
+        // std::function must be copyable, so the request is shared instead of moved
+        auto call = std::make_shared<Call>(std::move(conn->requests.front()));
+        conn->requests.pop_front();
+
+        conn->in_flight++;
+        m_workers->submit([this, conn, call]() { process(conn, *call); });
     }
 }
+
+bool TCPServer::backlogged(const Connection &conn) {
+    return conn.requests.size() >= MAX_QUEUED || conn.stream.unsent() >= MAX_UNSENT;
+}
+
+void TCPServer::process(const std::shared_ptr<Connection> &conn, Call &call) {
+    emit_event(EVENT_MESSAGE_INBOUND, call.msg);
+    handle_call(call);
+    emit_event(EVENT_MESSAGE_OUTBOUND, call.msg);
+
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    conn->in_flight--;
+    if (conn->closed) {
+        return;
+    }
+
+    // there is room for another request of this client now
+    schedule(conn);
+
+    try {
+        conn->stream.queue(*call.msg);
+        if (!conn->writing && !conn->stream.flush()) {
+            // the socket buffer is full, let the I/O thread send the rest
+            conn->writing = true;
+            std::lock_guard<std::mutex> blocked_lock(m_blocked_mutex);
+            m_blocked.push_back(conn);
+        } else if (conn->paused && !conn->resuming && !backlogged(*conn)) {
+            // the I/O thread stopped reading from the client, it may continue now
+            conn->resuming = true;
+            std::lock_guard<std::mutex> blocked_lock(m_blocked_mutex);
+            m_resumed.push_back(conn);
+        } else {
+            return;
+        }
+    } catch (const PeerDisconnectedException &) {
+        // the I/O thread notices as well and cleans up
+        return;
+    } catch (const RuntimeException &e) {
+        std::cout << "[ERROR] TCPServer: " << e.what() << std::endl;
+        return;
+    }
+
+    wake();
+}
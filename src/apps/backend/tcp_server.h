@@ -9,28 +9,260 @@
 #define SPH_TCP_SERVER_H
 
 #include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <seraphim/ipc/net/io_uring.h>
 #include <seraphim/ipc/tcp_transport.h>
+#include <seraphim/thread_pool.h>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "server.h"
 
 namespace sph {
 namespace backend {
 
+/**
+ * @brief TCP server.
+ *
+ * A single thread waits for socket events and performs all reads, so a slow request of one client
+ * does not delay receiving the requests of others. Complete requests are handed to a pool of
+ * workers which run the services and write the responses. Up to @ref MAX_IN_FLIGHT requests of a
+ * client are processed at once, so responses may be sent out of order. Every response carries the
+ * id of the request it belongs to.
+ *
+ * A client which sends requests faster than it reads the responses is not read from anymore once
+ * @ref MAX_QUEUED of its requests wait for a worker or @ref MAX_UNSENT bytes of its responses
+ * wait to be sent. Reading resumes once the backlog drained.
+ *
+ * The I/O thread uses either epoll or io_uring, see @ref Engine. With io_uring, every client is
+ * read by a multishot receive operation, so the thread only enters the kernel once per batch of
+ * completions instead of once per event and read.
+ */
 class TCPServer : public sph::backend::Server {
 public:
-    TCPServer(std::shared_ptr<sph::ipc::TCPTransport> ptr);
+    /**
+     * @brief I/O engine of the I/O thread.
+     */
+    enum class Engine {
+        /// io_uring if available, epoll otherwise
+        AUTO,
+        /// readiness notifications with epoll and a read per notification
+        EPOLL,
+        /// asynchronous I/O with io_uring, falls back to epoll if not available
+        IO_URING
+    };
+
+    /**
+     * @brief TCP server.
+     * @param ptr The transport, must be bound already.
+     * @param workers Number of worker threads, 0 uses one worker per hardware thread.
+     * @param engine I/O engine.
+     */
+    TCPServer(std::shared_ptr<sph::ipc::TCPTransport> ptr, size_t workers = 0,
+              Engine engine = Engine::AUTO);
     ~TCPServer() override;
 
     bool run() override;
     void terminate() override;
 
+    /**
+     * @brief Get the I/O engine in use, known once the server runs.
+     */
+    Engine engine() const { return m_ring ? Engine::IO_URING : Engine::EPOLL; }
+
+    /**
+     * @brief Get the number of system calls the I/O thread made to wait for events, accept
+     *        clients and receive requests. Responses are written by the workers and not counted.
+     */
+    uint64_t io_syscalls() const { return m_io_syscalls; }
+
+    /// Maximum number of pending client connections.
+    static constexpr int BACKLOG = 128;
+
+    /// Maximum number of requests of a single client which are processed at once.
+    static constexpr size_t MAX_IN_FLIGHT = 16;
+
+    /// Maximum number of requests of a single client which wait for a worker.
+    static constexpr size_t MAX_QUEUED = 64;
+
+    /// Number of response bytes of a single client which may wait to be sent before the client is
+    /// not read from anymore.
+    static constexpr size_t MAX_UNSENT = 4 * 1024 * 1024;
+
+    /// Number of receive buffers registered with io_uring, shared by all clients.
+    static constexpr unsigned int RING_BUFFER_COUNT = 512;
+
+    /// Size of a receive buffer registered with io_uring.
+    static constexpr size_t RING_BUFFER_SIZE = 16 * 1024;
+
 private:
+    /**
+     * @brief Client connection.
+     *
+     * Only the I/O thread receives, so receiving does not need to be synchronized.
+     */
+    struct Connection {
+        Connection(int fd, uint32_t id) : stream(fd), id(id) {}
+        ~Connection();
+
+        /// framed message stream
+        sph::ipc::net::TCPConnection stream;
+        /// tells connections apart whose sockets had the same file descriptor (io_uring only)
+        uint32_t id;
+        /// identity of the client, see Call::peer
+        uint64_t peer = sph::ipc::BufferRegistry::new_peer();
+        /// newest requests of the client, older ones are dropped
+        std::shared_ptr<Latest> latest = std::make_shared<Latest>();
+        /// whether a receive operation is active (io_uring only)
+        bool receiving = false;
+
+        /// protects the members below and sending on the stream
+        std::mutex mutex;
+        /// requests which were received, but not processed yet
+        std::deque<Call> requests;
+        /// number of requests which are being processed by workers
+        size_t in_flight = 0;
+        /// whether the I/O thread waits for the socket to become writable
+        bool writing = false;
+        /// whether the I/O thread stopped reading from the client, only set by the I/O thread
+        bool paused = false;
+        /// whether the connection was handed to the I/O thread to resume reading
+        bool resuming = false;
+        /// set once the client disconnected
+        bool closed = false;
+    };
+
+    /**
+     * @brief I/O thread main loop using epoll.
+     */
+    void epoll_loop();
+
+    /**
+     * @brief I/O thread main loop using io_uring.
+     */
+    void io_uring_loop();
+
+    /**
+     * @brief Handle a completed io_uring operation (I/O thread).
+     */
+    void handle_completion(const sph::ipc::net::IOUring::Completion &completion);
+
+    /**
+     * @brief Accept all pending client connections (I/O thread).
+     */
+    void accept_clients();
+
+    /**
+     * @brief Start tracking a new client connection (I/O thread).
+     */
+    void add_client(int fd);
+
+    /**
+     * @brief Read from a client and schedule its requests (I/O thread).
+     */
+    void read_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Parse the requests buffered by a client and schedule them (I/O thread).
+     */
+    void dispatch(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Send buffered responses once a client socket became writable (I/O thread).
+     * @return True if everything was sent, false if the socket is full again.
+     */
+    bool write_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Wait for the sockets of clients whose responses could not be written by the workers
+     *        to become writable (I/O thread).
+     */
+    void watch_blocked();
+
+    /**
+     * @brief Update the epoll events a client is watched for (I/O thread).
+     */
+    void watch_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Stop reading from a client which does not keep up with its responses (I/O thread).
+     */
+    void pause_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Continue reading from a paused client if its backlog drained (I/O thread).
+     */
+    void resume_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Resume the clients whose backlog was drained by the workers (I/O thread).
+     */
+    void resume_clients();
+
+    /**
+     * @brief Forget about a client connection (I/O thread).
+     */
+    void close_client(int fd);
+
+    /**
+     * @brief Hand queued requests of a client to the workers, the connection must be locked.
+     */
+    void schedule(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Check whether a client has too many requests or responses pending, the connection
+     *        must be locked.
+     */
+    static bool backlogged(const Connection &conn);
+
+    /**
+     * @brief Process a request of a client and send the response (worker thread).
+     */
+    void process(const std::shared_ptr<Connection> &conn, Call &call);
+
+    /**
+     * @brief Wake up the I/O thread.
+     */
+    void wake();
+
     std::shared_ptr<sph::ipc::TCPTransport> m_transport;
 
     std::thread m_thread;
     std::atomic<bool> m_running;
-    Seraphim::Message m_msg;
+
+    /// number of worker threads
+    size_t m_num_workers;
+    /// workers processing requests
+    std::unique_ptr<sph::ThreadPool> m_workers;
+
+    /// requested I/O engine
+    Engine m_engine;
+    /// number of system calls made by the I/O thread
+    std::atomic<uint64_t> m_io_syscalls;
+
+    /// epoll instance watching the listening socket, all clients and the wakeup event
+    int m_epoll_fd = -1;
+    /// io_uring instance, replaces epoll if available
+    std::unique_ptr<sph::ipc::net::IOUring> m_ring;
+    /// used to wake up the I/O thread
+    int m_event_fd = -1;
+    /// value read from the wakeup event by io_uring
+    uint64_t m_event_value = 0;
+    /// id of the next client connection
+    uint32_t m_next_id = 0;
+
+    /// connected clients (I/O thread only)
+    std::unordered_map<int, std::shared_ptr<Connection>> m_connections;
+
+    /// protects m_blocked and m_resumed
+    std::mutex m_blocked_mutex;
+    /// connections whose responses could not be written completely by a worker
+    std::vector<std::shared_ptr<Connection>> m_blocked;
+    /// paused connections whose backlog was drained by a worker
+    std::vector<std::shared_ptr<Connection>> m_resumed;
 };
 
 } // namespace backend
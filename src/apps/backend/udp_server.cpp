@@ -0,0 +1,79 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <poll.h>
+#include <seraphim/except.h>
+#include <seraphim/ipc/udp_transport.h>
+
+#include "udp_server.h"
+
+using namespace sph;
+using namespace sph::backend;
+using namespace sph::ipc;
+
+UDPServer::UDPServer(std::shared_ptr<UDPTransport> ptr) : m_transport(ptr), m_running(false) {}
+
+UDPServer::~UDPServer() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool UDPServer::run() {
+    m_running = true;
+    m_thread = std::thread([&]() {
+        struct pollfd poll_fd;
+        UDPTransport::Endpoint peer;
+
+        // only this thread performs I/O on the transport
+        poll_fd.fd = m_transport->socket().fd();
+        poll_fd.events = POLLIN;
+
+        while (m_running) {
+            // read even if the poll timed out, so incomplete messages expire
+            ::poll(&poll_fd, 1, 100);
+
+            try {
+                if (!m_transport->read(false)) {
+                    continue;
+                }
+
+                while (m_transport->pending()) {
+                    m_transport->receive(m_msg, peer);
+                    emit_event(EVENT_MESSAGE_INBOUND, &m_msg);
+                    handle_message(m_msg);
+                    emit_event(EVENT_MESSAGE_OUTBOUND, &m_msg);
+                    m_transport->send(peer, m_msg);
+                }
+            } catch (const TimeoutException &) {
+                // ignore
+                continue;
+            } catch (const RuntimeException &e) {
+                std::cout << "[ERROR] UDPServer: " << e.what() << std::endl;
+            }
+        }
+    });
+
+    return true;
+}
+
+void UDPServer::terminate() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    UDPTransport::Stats stats = m_transport->stats();
+    std::cout << "** UDP server stopped" << std::endl
+              << "   messages received=" << stats.messages_received << std::endl
+              << "   messages lost=" << stats.messages_lost << std::endl
+              << "   messages expired=" << stats.messages_expired << std::endl
+              << "   messages late=" << stats.messages_late << std::endl
+              << "   max reassembly time=" << stats.max_reassembly_time.count() << "us"
+              << std::endl;
+}
@@ -0,0 +1,51 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_UDP_SERVER_H
+#define SPH_UDP_SERVER_H
+
+#include <atomic>
+#include <seraphim/ipc/udp_transport.h>
+#include <thread>
+
+#include "server.h"
+
+namespace sph {
+namespace backend {
+
+/**
+ * @brief UDP server.
+ *
+ * Requests are answered at the address they came from. There are no connections, so clients
+ * never connect or disconnect as far as the event handlers are concerned. Requests which were
+ * lost or completed too late are never answered, clients must not wait for them forever.
+ */
+class UDPServer : public sph::backend::Server {
+public:
+    UDPServer(std::shared_ptr<sph::ipc::UDPTransport> ptr);
+    ~UDPServer() override;
+
+    bool run() override;
+    void terminate() override;
+
+    /**
+     * @brief Get the loss and latency counters of the transport.
+     */
+    sph::ipc::UDPTransport::Stats transport_stats() const { return m_transport->stats(); }
+
+private:
+    std::shared_ptr<sph::ipc::UDPTransport> m_transport;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    Seraphim::Message m_msg;
+};
+
+} // namespace backend
+} // namespace sph
+
+#endif // SPH_UDP_SERVER_H
@@ -0,0 +1,244 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <poll.h>
+#include <seraphim/except.h>
+#include <seraphim/ipc/except.h>
+#include <seraphim/ipc/request_view.h>
+#include <seraphim/ipc/unix_transport.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "unix_server.h"
+
+using namespace sph;
+using namespace sph::backend;
+using namespace sph::ipc;
+
+UnixServer::UnixServer(std::shared_ptr<UnixTransport> ptr, size_t workers)
+    : m_transport(ptr), m_running(false), m_num_workers(workers) {}
+
+UnixServer::~UnixServer() {
+    terminate();
+}
+
+bool UnixServer::run() {
+    m_transport->synchronized<UnixTransport>()->listen(BACKLOG);
+
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1) {
+        return false;
+    }
+
+    m_workers = std::unique_ptr<ThreadPool>(new ThreadPool(m_num_workers));
+
+    m_running = true;
+    m_thread = std::thread([&]() { io_loop(); });
+
+    return true;
+}
+
+void UnixServer::terminate() {
+    m_running = false;
+    if (m_event_fd != -1) {
+        wake();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    // let the workers finish the requests they are processing, the responses are dropped
+    m_workers.reset();
+    for (const auto &completion : m_completed) {
+        finish(completion);
+    }
+    m_completed.clear();
+
+    for (const auto &client : m_connections) {
+        m_transport->synchronized<UnixTransport>()->disconnect(client.first);
+    }
+    m_connections.clear();
+
+    if (m_event_fd != -1) {
+        ::close(m_event_fd);
+        m_event_fd = -1;
+    }
+}
+
+void UnixServer::wake() {
+    uint64_t val = 1;
+    // the counter cannot overflow in practice, so a failed write means it is signaled already
+    (void)::write(m_event_fd, &val, sizeof(val));
+}
+
+void UnixServer::io_loop() {
+    int listen_fd = m_transport->synchronized<UnixTransport>()->socket().fd();
+    std::vector<std::shared_ptr<Connection>> clients;
+    std::vector<struct pollfd> poll_fds;
+
+    while (m_running) {
+        send_responses();
+
+        clients.clear();
+        poll_fds.resize(2);
+        poll_fds[0].fd = listen_fd;
+        poll_fds[0].events = POLLIN;
+        poll_fds[1].fd = m_event_fd;
+        poll_fds[1].events = POLLIN;
+        for (const auto &client : m_connections) {
+            // clients with too many requests in flight have to wait for their responses first
+            if (client.second->in_flight < MAX_IN_FLIGHT) {
+                clients.push_back(client.second);
+                poll_fds.push_back({ client.first, POLLIN, 0 });
+            }
+        }
+
+        if (::poll(poll_fds.data(), poll_fds.size(), 1000) <= 0) {
+            continue;
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            accept_client();
+        }
+
+        if (poll_fds[1].revents & POLLIN) {
+            uint64_t val;
+            (void)::read(m_event_fd, &val, sizeof(val));
+        }
+
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (poll_fds[i + 2].revents != 0) {
+                read_client(clients[i]);
+            }
+        }
+    }
+}
+
+void UnixServer::accept_client() {
+    struct timeval timeout = { IO_TIMEOUT / 1000, (IO_TIMEOUT % 1000) * 1000 };
+    int fd;
+
+    try {
+        fd = m_transport->synchronized<UnixTransport>()->accept();
+    } catch (const RuntimeException &e) {
+        std::cout << "[ERROR] UnixServer: " << e.what() << std::endl;
+        return;
+    }
+
+    // a client which stalls in the middle of a message must not block the others forever
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1) {
+        ::close(fd);
+        return;
+    }
+
+    m_connections[fd] = std::make_shared<Connection>(fd);
+    emit_event(EVENT_CLIENT_CONNECTED, nullptr);
+}
+
+void UnixServer::read_client(const std::shared_ptr<Connection> &conn) {
+    Completion completion = { conn, std::make_shared<Call>(), {} };
+    bool parsed = false;
+
+    // get data from client, hangups are reported as disconnects by receive()
+    try {
+        // the request is parsed exactly once, directly from the receive buffer
+        completion.buffers = m_transport->synchronized<UnixTransport>()->receive(
+            conn->fd, [&](const unsigned char *data, size_t size) {
+                RequestView view;
+                parsed = view.parse(data, size);
+                if (parsed) {
+                    prepare(view, *completion.call, conn->latest);
+                }
+            });
+    } catch (const PeerDisconnectedException &) {
+        close_client(conn);
+        return;
+    } catch (const RuntimeException &e) {
+        // includes timeouts, the connection is out of sync either way
+        std::cout << "[ERROR] UnixServer: " << e.what() << std::endl;
+        close_client(conn);
+        return;
+    }
+
+    if (!parsed) {
+        std::cout << "[ERROR] UnixServer: Failed to deserialize message" << std::endl;
+        m_transport->synchronized<UnixTransport>()->release_buffers(conn->fd, completion.buffers);
+        return;
+    }
+
+    completion.call->peer = m_transport->synchronized<UnixTransport>()->peer(conn->fd);
+    conn->in_flight++;
+    m_workers->submit([this, completion]() { process(completion); });
+}
+
+void UnixServer::close_client(const std::shared_ptr<Connection> &conn) {
+    if (conn->closed) {
+        return;
+    }
+
+    conn->closed = true;
+    m_connections.erase(conn->fd);
+    emit_event(EVENT_CLIENT_DISCONNECTED, nullptr);
+
+    // buffers of requests which are still being processed must stay mapped
+    if (conn->in_flight == 0) {
+        m_transport->synchronized<UnixTransport>()->disconnect(conn->fd);
+    }
+}
+
+void UnixServer::send_responses() {
+    std::deque<Completion> completed;
+
+    {
+        std::lock_guard<std::mutex> lock(m_completed_mutex);
+        completed.swap(m_completed);
+    }
+
+    for (const auto &completion : completed) {
+        const std::shared_ptr<Connection> &conn = completion.conn;
+        if (!conn->closed) {
+            try {
+                m_transport->synchronized<UnixTransport>()->send(conn->fd, *completion.call->msg);
+            } catch (const PeerDisconnectedException &) {
+                close_client(conn);
+            } catch (const RuntimeException &e) {
+                // includes timeouts, the response may have been sent partially
+                std::cout << "[ERROR] UnixServer: " << e.what() << std::endl;
+                close_client(conn);
+            }
+        }
+
+        finish(completion);
+    }
+}
+
+void UnixServer::finish(const Completion &completion) {
+    const std::shared_ptr<Connection> &conn = completion.conn;
+    auto transport = m_transport->synchronized<UnixTransport>();
+
+    transport->release_buffers(conn->fd, completion.buffers);
+    conn->in_flight--;
+    if (conn->closed && conn->in_flight == 0) {
+        transport->disconnect(conn->fd);
+    }
+}
+
+void UnixServer::process(const Completion &completion) {
+    emit_event(EVENT_MESSAGE_INBOUND, completion.call->msg);
+    handle_call(*completion.call);
+    emit_event(EVENT_MESSAGE_OUTBOUND, completion.call->msg);
+
+    {
+        std::lock_guard<std::mutex> lock(m_completed_mutex);
+        m_completed.push_back(completion);
+    }
+
+    // the I/O thread sends the response once it returns from poll()
+    wake();
+}
@@ -0,0 +1,156 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_UNIX_SERVER_H
+#define SPH_UNIX_SERVER_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <seraphim/ipc/unix_transport.h>
+#include <seraphim/thread_pool.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "server.h"
+
+namespace sph {
+namespace backend {
+
+/**
+ * @brief UNIX domain socket server.
+ *
+ * A single thread waits for client activity, receives requests and sends responses, so only that
+ * thread ever touches the transport. Requests are handed to a pool of workers, up to
+ * @ref MAX_IN_FLIGHT per client, so responses may be sent out of order. Every response carries the
+ * id of the request it belongs to.
+ *
+ * Buffers shared by a client stay mapped until the response to the request referencing them was
+ * sent, even if the client disconnects in the meantime.
+ */
+class UnixServer : public sph::backend::Server {
+public:
+    /**
+     * @brief UNIX domain socket server.
+     * @param ptr The transport, must be bound already.
+     * @param workers Number of worker threads, 0 uses one worker per hardware thread.
+     */
+    UnixServer(std::shared_ptr<sph::ipc::UnixTransport> ptr, size_t workers = 0);
+    ~UnixServer() override;
+
+    bool run() override;
+    void terminate() override;
+
+    /// Maximum number of pending client connections.
+    static constexpr int BACKLOG = 16;
+
+    /// Maximum number of requests of a single client which are processed at once.
+    static constexpr size_t MAX_IN_FLIGHT = 16;
+
+    /// Time in milliseconds to wait for a client to send the rest of a request or to make room
+    /// for a response, the client is disconnected afterwards.
+    static constexpr int IO_TIMEOUT = 1000;
+
+private:
+    /**
+     * @brief Client connection (I/O thread only).
+     */
+    struct Connection {
+        explicit Connection(int fd) : fd(fd) {}
+
+        /// file descriptor of the connection
+        int fd;
+        /// newest requests of the client, older ones are dropped
+        std::shared_ptr<Latest> latest = std::make_shared<Latest>();
+        /// number of requests which are being processed by workers
+        size_t in_flight = 0;
+        /// set once the client disconnected, the connection is closed when no request is left
+        bool closed = false;
+    };
+
+    /**
+     * @brief Request of a client, handed back to the I/O thread once it was processed.
+     */
+    struct Completion {
+        /// the client
+        std::shared_ptr<Connection> conn;
+        /// the request and, once handled, the response
+        std::shared_ptr<Call> call;
+        /// buffers shared by the client for the request
+        std::vector<std::string> buffers;
+    };
+
+    /**
+     * @brief I/O thread main loop.
+     */
+    void io_loop();
+
+    /**
+     * @brief Accept a pending client connection (I/O thread).
+     */
+    void accept_client();
+
+    /**
+     * @brief Receive a request of a client and schedule it (I/O thread).
+     */
+    void read_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Forget about a client connection (I/O thread).
+     */
+    void close_client(const std::shared_ptr<Connection> &conn);
+
+    /**
+     * @brief Send the responses completed by the workers (I/O thread).
+     */
+    void send_responses();
+
+    /**
+     * @brief Release the resources of a request once its response was sent or dropped
+     *        (I/O thread).
+     */
+    void finish(const Completion &completion);
+
+    /**
+     * @brief Process a request and hand the response to the I/O thread (worker thread).
+     */
+    void process(const Completion &completion);
+
+    /**
+     * @brief Wake up the I/O thread.
+     */
+    void wake();
+
+    std::shared_ptr<sph::ipc::UnixTransport> m_transport;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+
+    /// number of worker threads
+    size_t m_num_workers;
+    /// workers processing requests
+    std::unique_ptr<sph::ThreadPool> m_workers;
+
+    /// used to wake up the I/O thread
+    int m_event_fd = -1;
+
+    /// connected clients (I/O thread only)
+    std::unordered_map<int, std::shared_ptr<Connection>> m_connections;
+
+    /// protects m_completed
+    std::mutex m_completed_mutex;
+    /// responses which were not sent yet
+    std::deque<Completion> m_completed;
+};
+
+} // namespace backend
+} // namespace sph
+
+#endif // SPH_UNIX_SERVER_H
@@ -0,0 +1,37 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_BENCH_ECHO_SERVICE_H
+#define SPH_BENCH_ECHO_SERVICE_H
+
+#include <Types.pb.h>
+
+#include "service.h"
+
+namespace sph {
+namespace bench {
+
+/**
+ * @brief Service which returns the images it is sent.
+ *
+ * The service does no work of its own, so the round trip time of a request is spent in the
+ * transport and the server alone.
+ */
+class EchoService : public sph::backend::Service {
+public:
+    EchoService() { register_handler(&EchoService::echo); }
+
+    bool echo(const Seraphim::Types::Image2D &req, Seraphim::Types::Image2D &res) {
+        res.CopyFrom(req);
+        return true;
+    }
+};
+
+} // namespace bench
+} // namespace sph
+
+#endif // SPH_BENCH_ECHO_SERVICE_H
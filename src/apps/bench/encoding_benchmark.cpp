@@ -0,0 +1,134 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <seraphim/ipc/packed_geometry.h>
+#include <string>
+
+#include "encoding_benchmark.h"
+
+using namespace sph::bench;
+using Landmark = Seraphim::Face::FacemarkDetector::Facemarks::Landmark;
+
+EncodingBenchmark::EncodingBenchmark(unsigned int faces) {
+    // landmark groups of the 68 point model
+    const std::pair<Landmark, int> groups[] = {
+        { Seraphim::Face::FacemarkDetector::Facemarks::JAW, 17 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYEBROW, 5 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYEBROW, 5 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::NOSE, 9 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::RIGHT_EYE, 6 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::LEFT_EYE, 6 },
+        { Seraphim::Face::FacemarkDetector::Facemarks::MOUTH, 20 }
+    };
+    uint32_t seed = 1;
+
+    for (unsigned int i = 0; i < faces; i++) {
+        Face face;
+        face.x = static_cast<int32_t>(40 + (i % 8) * 200);
+        face.y = static_cast<int32_t>(40 + (i / 8) * 200);
+        face.w = 160;
+        face.h = 180;
+
+        for (const auto &group : groups) {
+            std::vector<Point> points;
+            for (int j = 0; j < group.second; j++) {
+                // neighbouring landmarks are a few pixels apart
+                seed = seed * 1103515245 + 12345;
+                points.push_back({ face.x + static_cast<int32_t>((seed >> 8) % face.w),
+                                   face.y + static_cast<int32_t>((seed >> 20) % face.h) });
+            }
+            face.landmarks.emplace_back(group.first, std::move(points));
+        }
+
+        m_faces.push_back(std::move(face));
+    }
+}
+
+EncodingBenchmark::Result EncodingBenchmark::run(bool packed, std::chrono::milliseconds duration) {
+    Seraphim::Face::FacemarkDetector::DetectionResponse res;
+    std::string data;
+    Result result;
+    uint64_t n = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    do {
+        res.Clear();
+        encode(packed, res);
+        res.SerializeToString(&data);
+        n++;
+    } while (std::chrono::steady_clock::now() - start < duration);
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    result.encode_us = elapsed.count() / n;
+    result.bytes = data.size();
+
+    n = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+        res.ParseFromString(data);
+        result.checksum = decode(res);
+        n++;
+    } while (std::chrono::steady_clock::now() - start < duration);
+    elapsed = std::chrono::steady_clock::now() - start;
+    result.decode_us = elapsed.count() / n;
+
+    return result;
+}
+
+void EncodingBenchmark::encode(bool packed,
+                               Seraphim::Face::FacemarkDetector::DetectionResponse &res) const {
+    for (const auto &face : m_faces) {
+        if (packed) {
+            sph::ipc::add_region(*res.mutable_packed_faces(), face.x, face.y, face.w, face.h);
+            for (const auto &landmark : face.landmarks) {
+                Seraphim::Face::FacemarkDetector::PackedFacemarks *facemarks =
+                    res.mutable_packed_facemarks();
+                facemarks->add_landmarks(landmark.first);
+                sph::ipc::add_point_set(*facemarks->mutable_pointsets(), landmark.second);
+            }
+            continue;
+        }
+
+        Seraphim::Types::Region2D *region = res.add_faces();
+        region->set_x(face.x);
+        region->set_y(face.y);
+        region->set_w(face.w);
+        region->set_h(face.h);
+        for (const auto &landmark : face.landmarks) {
+            Seraphim::Face::FacemarkDetector::Facemarks *facemarks = res.add_facemarks();
+            Seraphim::Types::PointSet2D *points = facemarks->add_pointsets();
+            for (const auto &point : landmark.second) {
+                Seraphim::Types::Point2D *p = points->add_points();
+                p->set_x(point.x);
+                p->set_y(point.y);
+            }
+            facemarks->add_landmarks(landmark.first);
+        }
+    }
+}
+
+int64_t EncodingBenchmark::decode(const Seraphim::Face::FacemarkDetector::DetectionResponse &res) {
+    int64_t sum = 0;
+
+    for (const auto &face : res.faces()) {
+        sum += face.x() + face.y() + face.w() + face.h();
+    }
+    for (const auto &facemarks : res.facemarks()) {
+        for (const auto &pointset : facemarks.pointsets()) {
+            for (const auto &point : pointset.points()) {
+                sum += point.x() + point.y();
+            }
+        }
+    }
+
+    sph::ipc::unpack_regions(res.packed_faces(), [&](int32_t x, int32_t y, int32_t w, int32_t h) {
+        sum += x + y + w + h;
+    });
+    sph::ipc::unpack_point_sets(res.packed_facemarks().pointsets(),
+                                [&](size_t, int32_t x, int32_t y) { sum += x + y; });
+
+    return sum;
+}
@@ -0,0 +1,84 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_BENCH_ENCODING_BENCHMARK_H
+#define SPH_BENCH_ENCODING_BENCHMARK_H
+
+#include <FacemarkDetector.pb.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sph {
+namespace bench {
+
+/**
+ * @brief Compares the plain and the packed encoding of facemark detection responses.
+ *
+ * Responses are built from synthetic faces with 68 landmarks each, the way the facemark service of
+ * the backend builds them. Encoding covers building and serializing a response, decoding covers
+ * parsing it and reading all coordinates.
+ */
+class EncodingBenchmark {
+public:
+    /**
+     * @brief Measurements of one encoding.
+     */
+    struct Result {
+        /// Size of a serialized response.
+        size_t bytes = 0;
+        /// Time to encode a response in microseconds.
+        double encode_us = 0;
+        /// Time to decode a response in microseconds.
+        double decode_us = 0;
+        /// Sum of all decoded coordinates, the same for every encoding.
+        int64_t checksum = 0;
+    };
+
+    /**
+     * @brief Encoding benchmark.
+     * @param faces Number of faces per response.
+     */
+    explicit EncodingBenchmark(unsigned int faces);
+
+    /**
+     * @brief Encode and decode responses repeatedly.
+     * @param packed Whether to use the packed encoding.
+     * @param duration Time to spend on encoding and on decoding each.
+     */
+    Result run(bool packed, std::chrono::milliseconds duration);
+
+private:
+    struct Point {
+        int32_t x;
+        int32_t y;
+    };
+
+    struct Face {
+        int32_t x, y, w, h;
+        std::vector<std::pair<Seraphim::Face::FacemarkDetector::Facemarks::Landmark,
+                              std::vector<Point>>>
+            landmarks;
+    };
+
+    void encode(bool packed, Seraphim::Face::FacemarkDetector::DetectionResponse &res) const;
+
+    /**
+     * @brief Read all coordinates of a response.
+     * @return Sum of the coordinates.
+     */
+    static int64_t decode(const Seraphim::Face::FacemarkDetector::DetectionResponse &res);
+
+    std::vector<Face> m_faces;
+};
+
+} // namespace bench
+} // namespace sph
+
+#endif // SPH_BENCH_ENCODING_BENCHMARK_H
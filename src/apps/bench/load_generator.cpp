@@ -0,0 +1,154 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <future>
+#include <memory>
+#include <seraphim/except.h>
+#include <seraphim/ipc/transport_factory.h>
+#include <thread>
+
+#include "load_generator.h"
+
+using namespace sph::bench;
+using sph::ipc::LatencyTracer;
+
+void LoadGenerator::Result::merge(const Result &other) {
+    ok += other.ok;
+    failed += other.failed;
+    dropped += other.dropped;
+    errors += other.errors;
+    slo_met += other.slo_met;
+    bytes += other.bytes;
+    rtt.merge(other.rtt);
+    for (size_t i = 0; i < stages.size(); i++) {
+        stages[i].merge(other.stages[i]);
+    }
+}
+
+LoadGenerator::LoadGenerator(const Options &options, std::vector<Seraphim::Message> requests)
+    : m_options(options), m_requests(std::move(requests)) {
+    if (m_options.clients == 0 || m_requests.empty()) {
+        SPH_THROW(InvalidArgumentException, "No clients or no requests");
+    }
+}
+
+LoadGenerator::Result LoadGenerator::run() {
+    std::vector<std::unique_ptr<sph::ipc::Transport>> transports;
+    std::vector<std::future<Result>> clients;
+    Result result;
+
+    // the factory is not thread safe, so all clients connect up front
+    for (unsigned int i = 0; i < m_options.clients; i++) {
+        auto transport = sph::ipc::TransportFactory::Instance().open(m_options.uri);
+        if (!transport) {
+            SPH_THROW(RuntimeException, "Failed to connect to " + m_options.uri);
+        }
+
+        transport->set_rx_timeout(m_options.timeout);
+        transport->set_tx_timeout(m_options.timeout);
+        transports.emplace_back(std::move(transport));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < m_options.clients; i++) {
+        sph::ipc::Transport *transport = transports[i].get();
+        clients.emplace_back(std::async(std::launch::async, [this, transport, i, start]() {
+            return client(*transport, i, start);
+        }));
+    }
+
+    for (auto &client : clients) {
+        result.merge(client.get());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    return result;
+}
+
+LoadGenerator::Result LoadGenerator::client(sph::ipc::Transport &transport, unsigned int index,
+                                            std::chrono::steady_clock::time_point start) {
+    Result result;
+    LatencyTracer tracer;
+    Seraphim::Message response;
+    auto end = start + m_options.duration;
+    auto slo = std::chrono::duration_cast<std::chrono::nanoseconds>(m_options.slo);
+
+    // requests are modified in place, so every client needs its own copies
+    std::vector<Seraphim::Message> requests = m_requests;
+
+    // the clients share the schedule, every one of them sends every n-th request
+    std::chrono::nanoseconds interval(0);
+    auto due = start;
+    if (m_options.rate > 0) {
+        interval = std::chrono::nanoseconds(
+            static_cast<int64_t>(1e9 * m_options.clients / m_options.rate));
+        due += interval * index / m_options.clients;
+    }
+
+    for (uint32_t i = 0;; i++) {
+        if (interval.count() > 0) {
+            if (due >= end) {
+                break;
+            }
+            std::this_thread::sleep_until(due);
+        } else {
+            due = std::chrono::steady_clock::now();
+            if (due >= end) {
+                break;
+            }
+        }
+
+        Seraphim::Message &msg = requests[(i * m_options.clients + index) % requests.size()];
+        msg.set_id(i);
+        tracer.stamp(msg);
+
+        try {
+            transport.send(msg);
+            // a response which arrives after its request timed out belongs to no one
+            do {
+                transport.receive(response);
+            } while (response.id() != msg.id());
+        } catch (const sph::TimeoutException &) {
+            result.errors++;
+            due += interval;
+            continue;
+        } catch (const std::exception &) {
+            // the connection is gone
+            result.errors++;
+            break;
+        }
+
+        auto rtt = std::chrono::steady_clock::now() - due;
+        result.bytes += msg.ByteSizeLong() + response.ByteSizeLong();
+
+        switch (response.res().status()) {
+        case Seraphim::Response::OK:
+            result.ok++;
+            tracer.record(response);
+            result.rtt.add(std::chrono::duration_cast<std::chrono::nanoseconds>(rtt).count());
+            if (slo.count() == 0 || rtt <= slo) {
+                result.slo_met++;
+            }
+            break;
+        case Seraphim::Response::DROPPED:
+            result.dropped++;
+            break;
+        default:
+            result.failed++;
+            break;
+        }
+
+        due += interval;
+    }
+
+    for (size_t i = 0; i < result.stages.size(); i++) {
+        result.stages[i] = tracer.histogram(static_cast<LatencyTracer::Stage>(i));
+    }
+
+    return result;
+}
@@ -0,0 +1,111 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_BENCH_LOAD_GENERATOR_H
+#define SPH_BENCH_LOAD_GENERATOR_H
+
+#include <Seraphim.pb.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <seraphim/ipc/latency_tracer.h>
+#include <seraphim/ipc/transport.h>
+#include <string>
+#include <vector>
+
+namespace sph {
+namespace bench {
+
+/**
+ * @brief Sends requests to a server and measures their round trip times.
+ *
+ * Every client has its own transport and waits for the response to a request before sending the
+ * next one. Without a rate, clients send as fast as they can (closed loop). With a rate, requests
+ * are sent on a fixed schedule (open loop) and their round trip time is measured from the time
+ * they were due, so a server which falls behind is not hidden by clients which wait for it.
+ */
+class LoadGenerator {
+public:
+    /**
+     * @brief Load parameters.
+     */
+    struct Options {
+        /// Transport URI of the server, see sph::ipc::TransportFactory.
+        std::string uri;
+        /// Number of concurrent clients.
+        unsigned int clients = 1;
+        /// Requests per second of all clients together, 0 sends as fast as possible.
+        double rate = 0;
+        /// Time to send requests for.
+        std::chrono::milliseconds duration{ 10000 };
+        /// Transport timeouts in milliseconds.
+        int timeout = 1000;
+        /// Round trip time responses must arrive within, 0 means there is no objective.
+        std::chrono::milliseconds slo{ 0 };
+    };
+
+    /**
+     * @brief Measurements.
+     */
+    struct Result {
+        /// Requests which were handled successfully.
+        uint64_t ok = 0;
+        /// Requests the server failed to handle.
+        uint64_t failed = 0;
+        /// Requests the server dropped, see Seraphim::Response::DROPPED.
+        uint64_t dropped = 0;
+        /// Requests which timed out or failed in the transport.
+        uint64_t errors = 0;
+        /// Successful requests which met the objective, see Options::slo.
+        uint64_t slo_met = 0;
+        /// Bytes of all requests and responses.
+        uint64_t bytes = 0;
+        /// Wall clock time of the run in seconds.
+        double seconds = 0;
+        /// Round trip times of the successful requests.
+        sph::ipc::LatencyHistogram rtt;
+        /// Stages of the successful requests, see sph::ipc::LatencyTracer.
+        std::array<sph::ipc::LatencyHistogram, sph::ipc::LatencyTracer::STAGE_COUNT> stages;
+
+        /**
+         * @brief Add the measurements of another client.
+         */
+        void merge(const Result &other);
+    };
+
+    /**
+     * @brief Load generator.
+     * @param options Load parameters.
+     * @param requests Requests sent by every client in turn, their ids are replaced.
+     */
+    LoadGenerator(const Options &options, std::vector<Seraphim::Message> requests);
+
+    /**
+     * @brief Connect the clients and send requests for the configured duration.
+     *        Throws sph::RuntimeException if a client cannot connect.
+     * @return The measurements of all clients.
+     */
+    Result run();
+
+private:
+    /**
+     * @brief Client main loop.
+     * @param transport The transport of the client.
+     * @param index Index of the client, staggers the schedules of the clients.
+     * @param start Point in time at which all clients start.
+     */
+    Result client(sph::ipc::Transport &transport, unsigned int index,
+                  std::chrono::steady_clock::time_point start);
+
+    Options m_options;
+    std::vector<Seraphim::Message> m_requests;
+};
+
+} // namespace bench
+} // namespace sph
+
+#endif // SPH_BENCH_LOAD_GENERATOR_H
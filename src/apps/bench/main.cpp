@@ -0,0 +1,356 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include <ObjectDetector.pb.h>
+#include <Seraphim.pb.h>
+#include <seraphim/ipc.h>
+#include <seraphim/memory.h>
+#include <seraphim/pixelformat.h>
+
+#include "echo_service.h"
+#include "encoding_benchmark.h"
+#include "load_generator.h"
+#include "shm_server.h"
+#include "tcp_server.h"
+#include "udp_server.h"
+#include "unix_server.h"
+
+using namespace sph::backend;
+using namespace sph::bench;
+using namespace sph::ipc;
+
+static volatile std::sig_atomic_t server_running = 0;
+
+static void signal_handler(int signal) {
+    if (signal == SIGINT) {
+        server_running = 0;
+    }
+}
+
+static struct option long_opts[] = { { "size", required_argument, 0, 's' },
+                                     { "clients", required_argument, 0, 'c' },
+                                     { "rate", required_argument, 0, 'r' },
+                                     { "duration", required_argument, 0, 'd' },
+                                     { "timeout", required_argument, 0, 't' },
+                                     { "slo", required_argument, 0, 'l' },
+                                     { "faces", required_argument, 0, 'f' },
+                                     { "help", no_argument, 0, 'h' },
+                                     { 0, 0, 0, 0 } };
+
+static char const *long_opts_desc[] = {
+    "Payload size of echo requests in bytes (default: 4096)",
+    "Number of concurrent clients (default: 1)",
+    "Requests per second of all clients, 0 sends as fast as possible (default: 0)",
+    "Duration of the run in seconds (default: 10)",
+    "Transport timeout in milliseconds (default: 1000)",
+    "Round trip time objective in milliseconds, 0 means none (default: 0)",
+    "Number of faces per response of the encodings benchmark (default: 16)",
+    "Show help"
+};
+
+static void print_usage() {
+    std::cout << "sph-ipc-bench [flags] serve <uri>" << std::endl
+              << "    Run an echo server on the transport" << std::endl
+              << "sph-ipc-bench [flags] run <uri>" << std::endl
+              << "    Measure round trips to an echo server" << std::endl
+              << "sph-ipc-bench [flags] replay <uri> <frame.jpg>..." << std::endl
+              << "    Send JPEG frames to the object detector of a backend" << std::endl
+              << "sph-ipc-bench [flags] encodings" << std::endl
+              << "    Compare the plain and the packed encoding of facemark responses" << std::endl
+              << std::endl;
+
+    for (size_t i = 0; i < sizeof(long_opts) / sizeof(long_opts[0]) - 1; i++) {
+        std::cout << "    -" << static_cast<char>(long_opts[i].val) << "    --" << std::left
+                  << std::setw(10) << long_opts[i].name << long_opts_desc[i] << std::endl;
+    }
+}
+
+/**
+ * @brief Read the dimensions of a JPEG image from its frame header.
+ * @return True on success, false if the data is no baseline or progressive JPEG image.
+ */
+static bool jpeg_size(const std::string &data, uint32_t &width, uint32_t &height) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+    size_t size = data.size();
+    size_t i = 2;
+
+    if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        return false;
+    }
+
+    // walk the segments up to the start of frame marker
+    while (i + 9 < size) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+
+        unsigned char marker = p[i + 1];
+        size_t length = (static_cast<size_t>(p[i + 2]) << 8) | p[i + 3];
+        bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+                   marker != 0xCC;
+        if (sof) {
+            height = (static_cast<uint32_t>(p[i + 5]) << 8) | p[i + 6];
+            width = (static_cast<uint32_t>(p[i + 7]) << 8) | p[i + 8];
+            return width > 0 && height > 0;
+        }
+
+        i += 2 + length;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Run an echo server until SIGINT is received.
+ */
+static int serve(const std::string &uri) {
+    std::unique_ptr<Server> server;
+    TCPServer *tcp = nullptr;
+
+    std::unique_ptr<Transport> transport;
+    try {
+        transport = TransportFactory::Instance().create(uri);
+    } catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    if (!transport) {
+        std::cout << "Failed to create transport: " << uri << std::endl;
+        return 1;
+    }
+
+    if (uri.rfind("shm://", 0) == 0) {
+        server.reset(new SharedMemoryServer(sph::convert_shared<SharedMemoryTransport>(transport)));
+    } else if (uri.rfind("tcp://", 0) == 0) {
+        tcp = new TCPServer(sph::convert_shared<TCPTransport>(transport));
+        server.reset(tcp);
+    } else if (uri.rfind("udp://", 0) == 0) {
+        server.reset(new UDPServer(sph::convert_shared<UDPTransport>(transport)));
+    } else if (uri.rfind("unix://", 0) == 0) {
+        server.reset(new UnixServer(sph::convert_shared<UnixTransport>(transport)));
+    } else {
+        std::cout << "Unsupported transport: " << uri << std::endl;
+        return 1;
+    }
+
+    server->register_service(std::make_shared<EchoService>());
+    if (!server->run()) {
+        std::cout << "Failed to run server: " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::cout << "Serving on " << uri << ", press Ctrl+C to stop" << std::endl;
+    server_running = 1;
+    while (server_running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    server->terminate();
+
+    ArenaPool::Stats stats = server->arena_stats();
+    std::cout << "requests: " << stats.leases << std::endl
+              << "requests dropped: " << server->dropped() << std::endl
+              << "arena heap blocks: " << stats.heap_blocks << std::endl;
+    if (tcp && stats.leases > 0) {
+        std::cout << "I/O syscalls per request: "
+                  << static_cast<double>(tcp->io_syscalls()) / stats.leases << std::endl;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Print percentiles of a histogram in microseconds.
+ */
+static void print_histogram(const std::string &name, const LatencyHistogram &histogram) {
+    std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed
+              << std::setprecision(1) << " p50=" << std::setw(9)
+              << histogram.percentile(50) / 1e3 << " p99=" << std::setw(9)
+              << histogram.percentile(99) / 1e3 << " p999=" << std::setw(9)
+              << histogram.percentile(99.9) / 1e3 << " max=" << std::setw(9)
+              << histogram.max() / 1e3 << std::endl;
+}
+
+static void print_result(const LoadGenerator::Options &options,
+                         const LoadGenerator::Result &result) {
+    uint64_t total = result.ok + result.failed + result.dropped + result.errors;
+
+    std::cout << "requests: " << total << " (ok=" << result.ok << ", failed=" << result.failed
+              << ", dropped=" << result.dropped << ", errors=" << result.errors << ")"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "throughput: " << result.ok / result.seconds << " req/s, "
+              << result.bytes / result.seconds / (1024 * 1024) << " MiB/s" << std::endl;
+
+    std::cout << "round trip [us]:" << std::endl;
+    print_histogram("total", result.rtt);
+
+    std::cout << "stages [us]:" << std::endl;
+    for (size_t i = 0; i < result.stages.size(); i++) {
+        if (result.stages[i].count() > 0) {
+            print_histogram(LatencyTracer::name(static_cast<LatencyTracer::Stage>(i)),
+                            result.stages[i]);
+        }
+    }
+
+    // requests which were not handled in time or not at all violate the objective as well
+    if (options.slo.count() > 0 && total > 0) {
+        std::cout << "slo (" << options.slo.count() << " ms): " << result.slo_met << "/"
+                  << total << " (" << 100.0 * result.slo_met / total << "%)" << std::endl;
+    }
+}
+
+/**
+ * @brief Compare the encodings of facemark responses.
+ */
+static int encodings(unsigned int faces, std::chrono::milliseconds duration) {
+    EncodingBenchmark benchmark(faces);
+    int64_t checksum = 0;
+    // encoding and decoding of both encodings share the duration
+    duration /= 4;
+
+    std::cout << faces << " faces with 68 landmarks each" << std::endl
+              << "  encoding       bytes  encode [us]  decode [us]" << std::endl;
+    for (bool packed : { false, true }) {
+        EncodingBenchmark::Result result = benchmark.run(packed, duration);
+        std::cout << "  " << std::left << std::setw(8) << (packed ? "packed" : "plain")
+                  << std::right << std::setw(12) << result.bytes << std::fixed
+                  << std::setprecision(2) << std::setw(13) << result.encode_us << std::setw(13)
+                  << result.decode_us << std::endl;
+
+        if (packed && result.checksum != checksum) {
+            std::cout << "Decoded coordinates differ between the encodings" << std::endl;
+            return 1;
+        }
+        checksum = result.checksum;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    LoadGenerator::Options options;
+    size_t size = 4096;
+    unsigned int faces = 16;
+    int index;
+    int c;
+
+    try {
+        while ((c = getopt_long(argc, argv, "s:c:r:d:t:l:f:h", long_opts, &index)) != -1) {
+            switch (c) {
+            case 's':
+                size = std::stoul(optarg);
+                break;
+            case 'c':
+                options.clients = static_cast<unsigned int>(std::stoul(optarg));
+                break;
+            case 'r':
+                options.rate = std::stod(optarg);
+                break;
+            case 'd':
+                options.duration = std::chrono::milliseconds(
+                    static_cast<int64_t>(std::stod(optarg) * 1000));
+                break;
+            case 't':
+                options.timeout = std::stoi(optarg);
+                break;
+            case 'l':
+                options.slo = std::chrono::milliseconds(std::stoul(optarg));
+                break;
+            case 'f':
+                faces = static_cast<unsigned int>(std::stoul(optarg));
+                break;
+            case 'h':
+                print_usage();
+                return 0;
+            default:
+                print_usage();
+                return 1;
+            }
+        }
+    } catch (const std::logic_error &) {
+        std::cout << "Invalid argument: " << optarg << std::endl;
+        return 1;
+    }
+
+    if (argc - optind == 1 && std::string(argv[optind]) == "encodings") {
+        return encodings(faces, options.duration);
+    }
+
+    if (argc - optind < 2) {
+        print_usage();
+        return 1;
+    }
+
+    std::string command = argv[optind];
+    options.uri = argv[optind + 1];
+
+    if (command == "serve") {
+        std::signal(SIGINT, signal_handler);
+        return serve(options.uri);
+    }
+
+    std::vector<Seraphim::Message> requests;
+    if (command == "run") {
+        Seraphim::Types::Image2D img;
+        img.set_data(std::string(size, 'x'));
+        requests.emplace_back();
+        pack_request(img, *requests.back().mutable_req());
+    } else if (command == "replay") {
+        for (int i = optind + 2; i < argc; i++) {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+            Seraphim::Object::Detector::DetectionRequest req;
+            Seraphim::Types::Image2D *img = req.mutable_image();
+
+            uint32_t width, height;
+            if (!jpeg_size(data, width, height)) {
+                std::cout << "Not a JPEG image: " << argv[i] << std::endl;
+                return 1;
+            }
+
+            img->set_width(width);
+            img->set_height(height);
+            img->set_fourcc(sph::fourcc('B', 'G', 'R', '3'));
+            img->set_compression(Seraphim::Types::Image2D::JPEG);
+            img->set_data(std::move(data));
+            requests.emplace_back();
+            pack_request(req, *requests.back().mutable_req());
+        }
+
+        if (requests.empty()) {
+            print_usage();
+            return 1;
+        }
+    } else {
+        print_usage();
+        return 1;
+    }
+
+    try {
+        LoadGenerator generator(options, std::move(requests));
+        print_result(options, generator.run());
+    } catch (const std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <QVideoCaptureStream/QVideoCaptureStream.h>
 #include <seraphim/image.h>
 #include <seraphim/iop.h>
+#include <seraphim/ipc/request_view.h>
 #include <seraphim/ipc/transport_factory.h>
 
 #include <LaneDetector.pb.h>
@@ -216,10 +217,26 @@ void MainWindow::backendWork() {
             return;
         }
 
-        // copy the current frame so we can send its data to the backend
-        framebuffer.resize(mCaptureBuffer.size);
-        std::memcpy(&framebuffer[0], mCaptureBuffer.start, mCaptureBuffer.size);
-        img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
+        // the responses to the last requests were received, so the frame buffer they referenced
+        // can be reused
+        if (mFrameBuffer.size() > 0) {
+            mTransport->release_buffer(mFrameBuffer);
+            mFrameBuffer.Clear();
+        }
+
+        // place the current frame in a buffer shared with the backend if the transport supports
+        // it, so the backend can access it in place, otherwise copy it so we can send its data
+        unsigned char *buffer = mTransport->acquire_buffer(mCaptureBuffer.size, mFrameBuffer);
+
+        if (buffer) {
+            std::memcpy(buffer, mCaptureBuffer.start, mCaptureBuffer.size);
+            img.mutable_buffer()->CopyFrom(mFrameBuffer);
+        } else {
+            mFrameBuffer.Clear();
+            framebuffer.resize(mCaptureBuffer.size);
+            std::memcpy(&framebuffer[0], mCaptureBuffer.start, mCaptureBuffer.size);
+            img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
+        }
         img.set_fourcc(mCaptureBuffer.format.fourcc);
         img.set_width(mCaptureBuffer.format.width);
         img.set_height(mCaptureBuffer.format.height);
@@ -251,7 +268,7 @@ void MainWindow::backendWork() {
         br->set_x(static_cast<int>(img.width()) - 210);
         br->set_y(static_cast<int>(img.height()));
 
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
+        sph::ipc::pack_request(req, *msg.mutable_req());
         try {
             mTransport->send(msg);
             // we still need the image, keep protobuf from deleting it by releasing it manually
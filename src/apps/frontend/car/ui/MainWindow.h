@@ -76,6 +76,8 @@ private:
     std::mutex mOverlayLock;
 
     std::unique_ptr<sph::ipc::Transport> mTransport;
+    // frame buffer shared with the backend (if any) used by the last backend request
+    Seraphim::Types::BufferRef mFrameBuffer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,42 @@
+#include <chrono>
+#include <seraphim/pixelformat.h>
+
+#include <Types.pb.h>
+
+#include "FrameBusPublisher.h"
+
+bool FrameBusPublisher::publish(const ICaptureStream::Buffer &buf) {
+    sph::ipc::FrameBus::Frame frame = {};
+    bool jpeg = buf.format.fourcc == sph::fourcc('M', 'J', 'P', 'G');
+
+    frame.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    frame.width = buf.format.width;
+    frame.height = buf.format.height;
+    if (jpeg) {
+        frame.fourcc = sph::fourcc('B', 'G', 'R', '3');
+        frame.compression = Seraphim::Types::Image2D::JPEG;
+        frame.size = buf.bytesused;
+    } else {
+        frame.fourcc = buf.format.fourcc;
+        frame.stride = buf.format.stride;
+        frame.size = buf.size;
+    }
+
+    if (buf.start == nullptr || frame.size == 0) {
+        return false;
+    }
+
+    // readers reopen the bus once it was closed, so it can simply be replaced
+    if (frame.size > mBus.frame_size()) {
+        mBus.close();
+        mLastFrame = 0;
+        if (!mBus.create(mName, buf.size > frame.size ? buf.size : frame.size)) {
+            return false;
+        }
+    }
+
+    mLastFrame = mBus.publish(frame, buf.start);
+    return true;
+}
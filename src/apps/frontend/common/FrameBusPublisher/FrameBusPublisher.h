@@ -0,0 +1,40 @@
+#ifndef FRAME_BUS_PUBLISHER_H
+#define FRAME_BUS_PUBLISHER_H
+
+#include <cstdint>
+#include <string>
+
+#include <ICaptureStream/ICaptureStream.h>
+#include <seraphim/ipc/frame_bus.h>
+
+/**
+ * @brief Publishes capture stream buffers on a shared memory frame bus.
+ *
+ * Backends on the same host can then be sent a reference to a frame (see
+ * Seraphim::Types::FrameBusRef) instead of its data. The bus is created with the first buffer
+ * and recreated whenever the buffers grow.
+ */
+class FrameBusPublisher {
+public:
+    explicit FrameBusPublisher(const std::string &name) : mName(name) {}
+
+    /**
+     * @brief Publish a capture buffer.
+     *        MJPG buffers are published as JPEG compressed BGR3 frames.
+     * @param buf The buffer holding the frame.
+     * @return True on success, false otherwise.
+     */
+    bool publish(const ICaptureStream::Buffer &buf);
+
+    // name of the bus
+    const std::string &name() const { return mName; }
+    // number of the frame published last, 0 if there is none
+    uint64_t lastFrame() const { return mLastFrame; }
+
+private:
+    std::string mName;
+    sph::ipc::FrameBus mBus;
+    uint64_t mLastFrame = 0;
+};
+
+#endif // FRAME_BUS_PUBLISHER_H
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstring>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -6,11 +7,12 @@
 #include <QPainter>
 #include <seraphim/image.h>
 #include <seraphim/iop.h>
+#include <seraphim/ipc/packed_geometry.h>
+#include <seraphim/ipc/request_view.h>
 #include <seraphim/ipc/transport_factory.h>
 
-#include <FaceDetector.pb.h>
+#include <FaceAnalyzer.pb.h>
 #include <FaceRecognizer.pb.h>
-#include <FacemarkDetector.pb.h>
 #include <Seraphim.pb.h>
 
 #include "MainWindow.h"
@@ -199,20 +201,53 @@ void MainWindow::toggleBackendSync(bool enable) {
 }
 
 bool MainWindow::openTransportSession(QString uri) {
+    mClient.reset();
     mTransport = sph::ipc::TransportFactory::Instance().open(uri.toStdString());
     if (mTransport == nullptr) {
         return false;
     }
 
-    mTransport->set_rx_timeout(1000);
     mTransport->set_tx_timeout(1000);
+    mClient = std::unique_ptr<sph::ipc::AsyncClient>(new sph::ipc::AsyncClient(mTransport));
     return true;
 }
 
+static bool awaitResponse(std::shared_future<Seraphim::Message> &future, Seraphim::Message &msg) {
+    if (future.wait_for(std::chrono::milliseconds(1000)) != std::future_status::ready) {
+        std::cout << "[ERROR] Transport I/O error: Timeout" << std::endl;
+        return false;
+    }
+
+    try {
+        msg = future.get();
+    } catch (std::exception &e) {
+        std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void MainWindow::releaseFrameBuffers() {
+    // buffer space is reused in the order it was acquired, so release the buffers in order too
+    while (!mFrameLeases.empty()) {
+        FrameLease &lease = mFrameLeases.front();
+        for (const auto &response : lease.responses) {
+            if (response.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return;
+            }
+        }
+
+        lease.transport->release_buffer(lease.buffer);
+        mFrameLeases.pop_front();
+    }
+}
+
 void MainWindow::backendWork() {
     Seraphim::Types::Image2D img;
     std::vector<unsigned char> framebuffer;
     QImage overlay(mFrame.size(), QImage::Format_ARGB32);
+    FrameLease lease;
 
     {
         std::lock_guard<std::mutex> lock(mFrameLock);
@@ -222,82 +257,106 @@ void MainWindow::backendWork() {
             return;
         }
 
-        // copy the current frame so we can send its data to the backend
-        framebuffer.resize(mCaptureBuffer.size);
-        std::memcpy(&framebuffer[0], mCaptureBuffer.start, mCaptureBuffer.size);
-        img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
+        // frame buffers whose requests were answered or failed can be reused
+        releaseFrameBuffers();
+
+        // place the current frame in a buffer shared with the backend if the transport supports
+        // it, so the backend can access it in place, otherwise copy it so we can send its data
+        unsigned char *buffer = mTransport->acquire_buffer(mCaptureBuffer.size, lease.buffer);
+
+        if (buffer) {
+            std::memcpy(buffer, mCaptureBuffer.start, mCaptureBuffer.size);
+            img.mutable_buffer()->CopyFrom(lease.buffer);
+            lease.transport = mTransport;
+        } else {
+            framebuffer.resize(mCaptureBuffer.size);
+            std::memcpy(&framebuffer[0], mCaptureBuffer.start, mCaptureBuffer.size);
+            img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
+        }
         img.set_fourcc(mCaptureBuffer.format.fourcc);
         img.set_width(mCaptureBuffer.format.width);
         img.set_height(mCaptureBuffer.format.height);
         img.set_stride(mCaptureBuffer.format.stride);
     }
 
-    if (mFaceDetection) {
+    // send all requests before waiting for the first response, the backend processes them in
+    // parallel
+    // the backend analyzes the frame in one request, so the faces are only detected once no
+    // matter how many of the stages are enabled
+    std::shared_future<Seraphim::Message> analysis;
+    std::shared_future<Seraphim::Message> training;
+    bool failed = false;
+    try {
         Seraphim::Message msg;
-        Seraphim::Face::FaceDetector::DetectionRequest req;
-        req.set_allocated_image(&img);
 
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
-        try {
-            mTransport->send(msg);
+        if (mFaceDetection || mFacemarkDetection || mFaceRecognition) {
+            Seraphim::Face::FaceAnalyzer::AnalysisRequest req;
+            req.set_allocated_image(&img);
+            req.set_facemarks(mFacemarkDetection);
+            req.set_recognition(mFaceRecognition);
+            req.set_packed(true);
+            sph::ipc::pack_request(req, *msg.mutable_req());
             // we still need the image, keep protobuf from deleting it by releasing it manually
             req.release_image();
-            mTransport->receive(msg);
-        } catch (std::exception &e) {
-            std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
-            return;
+            analysis = mClient->request(msg).share();
+            lease.responses.push_back(analysis);
         }
 
-        Seraphim::Face::FaceDetector::DetectionResponse res;
-        if (!msg.res().inner().UnpackTo(&res)) {
-            std::cout << "[ERROR] Failed to deserialize" << std::endl;
-            return;
+        if (mFaceTraining > 0) {
+            Seraphim::Face::FaceRecognizer::TrainingRequest req;
+            req.set_label(mFaceLabel);
+            req.set_allocated_image(&img);
+            req.set_invalidate(mFaceTraining == 10);
+            sph::ipc::pack_request(req, *msg.mutable_req());
+            req.release_image();
+            training = mClient->request(msg).share();
+            lease.responses.push_back(training);
         }
-        std::cout << "Server sent response:" << std::endl
-                  << "  status=" << msg.res().status() << std::endl
-                  << "  faces=" << res.faces_size() << std::endl;
-
-        // clear overlay
-        overlay.fill(Qt::transparent);
+    } catch (std::exception &e) {
+        std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+        failed = true;
+    }
 
-        // draw the new overlay
-        QPainter painter(&overlay);
-        painter.setPen(Qt::red);
-        for (const auto &face : res.faces()) {
-            painter.drawRect(face.x(), face.y(), face.w(), face.h());
-        }
+    // the buffer is released once the backend is done with all requests which were sent
+    if (lease.transport) {
+        mFrameLeases.emplace_back(std::move(lease));
+    }
+    if (failed) {
+        return;
     }
 
-    if (mFacemarkDetection) {
+    if (analysis.valid()) {
         Seraphim::Message msg;
-        Seraphim::Face::FacemarkDetector::DetectionRequest req;
-        req.set_allocated_image(&img);
-
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
-        try {
-            mTransport->send(msg);
-            // we still need the image, keep protobuf from deleting it by releasing it manually
-            req.release_image();
-            mTransport->receive(msg);
-        } catch (std::exception &e) {
-            std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+        if (!awaitResponse(analysis, msg)) {
             return;
         }
 
-        Seraphim::Face::FacemarkDetector::DetectionResponse res;
+        Seraphim::Face::FaceAnalyzer::AnalysisResponse res;
         if (!msg.res().inner().UnpackTo(&res)) {
             std::cout << "[ERROR] Failed to deserialize" << std::endl;
             return;
         }
         std::cout << "Server sent response:" << std::endl
                   << "  status=" << msg.res().status() << std::endl
-                  << "  faces=" << res.faces_size() << std::endl;
+                  << "  faces=" << res.faces_size() + res.packed_faces().values_size() / 4
+                  << std::endl;
 
         // clear overlay
         overlay.fill(Qt::transparent);
 
-        // draw the new overlay
+        // draw the new overlay, servers which do not know the packed encoding send the plain one
         QPainter painter(&overlay);
+        if (mFaceDetection) {
+            painter.setPen(Qt::red);
+            for (const auto &face : res.faces()) {
+                painter.drawRect(face.x(), face.y(), face.w(), face.h());
+            }
+            sph::ipc::unpack_regions(res.packed_faces(),
+                                     [&](int32_t x, int32_t y, int32_t w, int32_t h) {
+                                         painter.drawRect(x, y, w, h);
+                                     });
+        }
+
         painter.setBrush(QBrush(Qt::red));
         for (const auto &facemarks : res.facemarks()) {
             for (const auto &pointset : facemarks.pointsets()) {
@@ -306,46 +365,21 @@ void MainWindow::backendWork() {
                 }
             }
         }
-    }
+        sph::ipc::unpack_point_sets(res.packed_facemarks().pointsets(),
+                                    [&](size_t, int32_t x, int32_t y) {
+                                        painter.drawEllipse(x, y, 10, 10);
+                                    });
 
-    if (mFaceRecognition) {
         QString diagInfo = "";
+        for (int i = 0; i < res.labels_size() && i < res.distances_size(); i++) {
+            int label = res.labels(i);
+            double confidence = res.distances(i);
 
-        int label;
-        double confidence;
-
-        Seraphim::Message msg;
-        Seraphim::Face::FaceRecognizer::PredictionRequest req;
-        req.set_allocated_image(&img);
-
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
-        try {
-            mTransport->send(msg);
-            // we still need the image, keep protobuf from deleting it by releasing it manually
-            req.release_image();
-            mTransport->receive(msg);
-        } catch (std::exception &e) {
-            std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
-            return;
-        }
-
-        Seraphim::Face::FaceRecognizer::PredictionResponse res;
-        if (!msg.res().inner().UnpackTo(&res)) {
-            std::cout << "[ERROR] Failed to deserialize" << std::endl;
-            return;
-        }
-        std::cout << "Server sent response:" << std::endl
-                  << "  status=" << msg.res().status() << std::endl
-                  << "  faces=" << res.labels_size() << std::endl;
-
-        for (int i = 0; i < res.labels_size(); i++) {
-            std::cout << "  label=" << res.labels(0) << std::endl
-                      << "  distance=" << res.distances(0) << std::endl;
-
-            label = res.labels(i);
-            confidence = res.distances(i);
+            std::cout << "  label=" << label << std::endl
+                      << "  distance=" << confidence << std::endl;
             if (label == -1) {
                 std::cout << "Face not recognized.." << std::endl;
+                continue;
             }
 
             diagInfo += "\n";
@@ -361,21 +395,9 @@ void MainWindow::backendWork() {
         }
     }
 
-    if (mFaceTraining > 0) {
+    if (training.valid()) {
         Seraphim::Message msg;
-        Seraphim::Face::FaceRecognizer::TrainingRequest req;
-        req.set_label(mFaceLabel);
-        req.set_allocated_image(&img);
-        req.set_invalidate(mFaceTraining == 10);
-
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
-        try {
-            mTransport->send(msg);
-            // we still need the image, keep protobuf from deleting it by releasing it manually
-            req.release_image();
-            mTransport->receive(msg);
-        } catch (std::exception &e) {
-            std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+        if (!awaitResponse(training, msg)) {
             return;
         }
 
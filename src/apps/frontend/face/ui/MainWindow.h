@@ -6,12 +6,16 @@
 #include <QTimer>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <future>
 #include <mutex>
+#include <vector>
 
 #include <FaceStorage/FaceStorage.h>
 #include <ICaptureStream/ICaptureStream.h>
 #include <QImageProvider/QImageProvider.h>
 
+#include <seraphim/ipc/async_client.h>
 #include <seraphim/ipc/shm_transport.h>
 #include <seraphim/ipc/tcp_transport.h>
 
@@ -76,6 +80,7 @@ private:
 
     // backend worker
     void backendWork();
+    void releaseFrameBuffers();
     std::thread mBackendWorker;
     std::atomic<bool> mBackendWorkerActive;
     std::mutex mBackendLock;
@@ -92,7 +97,18 @@ private:
     QImage mOverlay;
     std::mutex mOverlayLock;
 
-    std::unique_ptr<sph::ipc::Transport> mTransport;
+    std::shared_ptr<sph::ipc::Transport> mTransport;
+    // issues the requests of a frame at once, so the backend can process them in parallel
+    std::unique_ptr<sph::ipc::AsyncClient> mClient;
+    // frame buffer shared with the backend, it must not be reused before the backend answered
+    // every request which references it, even if we stopped waiting for the responses
+    struct FrameLease {
+        std::shared_ptr<sph::ipc::Transport> transport;
+        Seraphim::Types::BufferRef buffer;
+        std::vector<std::shared_future<Seraphim::Message>> responses;
+    };
+    // oldest first
+    std::deque<FrameLease> mFrameLeases;
 };
 
 #endif // MAINWINDOW_H
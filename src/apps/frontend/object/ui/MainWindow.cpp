@@ -5,6 +5,9 @@
 #include <QCameraCaptureStream/QCameraCaptureStream.h>
 #include <seraphim/image.h>
 #include <seraphim/iop.h>
+#include <seraphim/ipc/packed_geometry.h>
+#include <seraphim/ipc/request_view.h>
+#include <seraphim/ipc/tile_delta.h>
 #include <seraphim/ipc/transport_factory.h>
 
 #include <ObjectDetector.pb.h>
@@ -34,7 +37,11 @@ static void draw_predictions(QImage &overlay,
     font.setPointSize(20);
     painter.setFont(font);
 
-    for (int i = 0; i < res.labels().size(); i++) {
+    auto draw = [&](int i, int32_t x, int32_t y, int32_t w, int32_t h) {
+        if (i >= res.labels_size() || i >= res.confidences_size()) {
+            return;
+        }
+
         if (res.labels(i) <= 30) {
             color = Qt::red;
         } else if (res.labels(i) <= 60) {
@@ -44,17 +51,28 @@ static void draw_predictions(QImage &overlay,
         }
 
         painter.setPen(color);
-        painter.drawRect(res.rois(i).x(), res.rois(i).y(), res.rois(i).w(), res.rois(i).h());
+        painter.drawRect(x, y, w, h);
         label = std::to_string(static_cast<int>(res.confidences(i) * 100)) + "%";
         if (label_coco(res.labels(i)) != "") {
             label = label_coco(res.labels(i)) + ": " + label;
         }
 
-        painter.drawText(res.rois(i).x(), res.rois(i).y(), QString::fromStdString(label));
+        painter.drawText(x, y, QString::fromStdString(label));
+    };
+
+    // servers which do not know the packed encoding still send the plain one
+    for (int i = 0; i < res.rois_size(); i++) {
+        draw(i, res.rois(i).x(), res.rois(i).y(), res.rois(i).w(), res.rois(i).h());
     }
+
+    int i = 0;
+    sph::ipc::unpack_regions(res.packed_rois(), [&](int32_t x, int32_t y, int32_t w, int32_t h) {
+        draw(i++, x, y, w, h);
+    });
 }
 
-MainWindow::MainWindow(QObject *parent) : QObject(parent) {
+MainWindow::MainWindow(QObject *parent)
+    : QObject(parent), mFrameBus("/seraphim_camera_" + std::to_string(getpid())) {
     // register image provider
     mEngine = new QQmlApplicationEngine(this);
     mMainImageProvider = new QImageProvider(this);
@@ -102,6 +120,10 @@ MainWindow::MainWindow(QObject *parent) : QObject(parent) {
     mBackendWorkerActive = false;
     mBackendFrameReady = false;
     mBackendSync = false;
+    mCaptureFrame = 0;
+    mCaptureTime = 0;
+    mTransportLocal = false;
+    mStream = 0;
 }
 
 MainWindow::~MainWindow() {
@@ -133,6 +155,21 @@ void MainWindow::diagTimeout() {
     QString text;
     text += "Main: " + QString::number(mMainLoopDuration) + "ms";
     text += mDiagBuffer;
+    {
+        // median and 99th percentile of the backend requests since the last update
+        std::lock_guard<std::mutex> lock(mTracerLock);
+        for (int i = 0; i < sph::ipc::LatencyTracer::STAGE_COUNT; i++) {
+            auto stage = static_cast<sph::ipc::LatencyTracer::Stage>(i);
+            const sph::ipc::LatencyHistogram &histogram = mTracer.histogram(stage);
+            if (histogram.count() == 0) {
+                continue;
+            }
+            text += QString("\n") + sph::ipc::LatencyTracer::name(stage) + ": " +
+                    QString::number(histogram.percentile(50) / 1e6, 'f', 1) + "/" +
+                    QString::number(histogram.percentile(99) / 1e6, 'f', 1) + "ms";
+        }
+        mTracer.reset();
+    }
     mDiagBuffer.clear();
 
     emit printDiag(text);
@@ -188,11 +225,19 @@ void MainWindow::updateTimeout() {
 void MainWindow::updateBuffer(const ICaptureStream::Buffer &buf) {
     std::lock_guard<std::mutex> lock(mFrameLock);
     mCaptureBuffer = buf;
+    mCaptureTime = sph::ipc::LatencyTracer::now();
+    mCaptureFrame = mFrameBus.publish(buf) ? mFrameBus.lastFrame() : 0;
 
     // get the QImage wrapper representation
     sph::CoreImage img;
     sph::Pixelformat pixfmt;
 
+    if (buf.format.fourcc == sph::fourcc('M', 'J', 'P', 'G')) {
+        mFrame = QImage::fromData(static_cast<const uchar *>(buf.start),
+                                  static_cast<int>(buf.bytesused), "JPG");
+        return;
+    }
+
     pixfmt = sph::Pixelformat(buf.format.fourcc);
     if (!pixfmt) {
         return;
@@ -221,12 +266,54 @@ bool MainWindow::openTransportSession(QString uri) {
 
     mTransport->set_rx_timeout(1000);
     mTransport->set_tx_timeout(1000);
+    mTransportLocal = uri.startsWith("unix://");
+    // streams belong to the previous backend
+    mStream = 0;
+    return true;
+}
+
+bool MainWindow::openStream(const Seraphim::Types::Image2D &img, bool tileDelta) {
+    Seraphim::Message msg;
+    Seraphim::Object::Detector::StreamOpenRequest req;
+    Seraphim::Object::Detector::StreamOpenResponse res;
+
+    req.set_fourcc(img.fourcc());
+    req.set_width(img.width());
+    req.set_height(img.height());
+    // force at least 0.5 confidence
+    req.set_confidence(0.5f);
+    req.set_tile_delta(tileDelta);
+    req.set_packed(true);
+
+    sph::ipc::pack_request(req, *msg.mutable_req());
+    try {
+        mTransport->send(msg);
+        mTransport->receive(msg);
+    } catch (std::exception &e) {
+        std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+        return false;
+    }
+
+    if (msg.res().status() != 0 || !msg.res().inner().UnpackTo(&res)) {
+        std::cout << "[ERROR] Failed to open detection stream" << std::endl;
+        return false;
+    }
+
+    mStream = res.stream();
+    mStreamFourcc = img.fourcc();
+    mStreamWidth = img.width();
+    mStreamHeight = img.height();
+    mStreamCompression = img.compression();
     return true;
 }
 
 void MainWindow::backendWork() {
     Seraphim::Types::Image2D img;
+    Seraphim::Types::TileDelta delta;
     std::vector<unsigned char> framebuffer;
+    bool reopen;
+    bool jpeg;
+    int64_t captureTime;
     QImage overlay(mFrame.size(), QImage::Format_ARGB32);
 
     {
@@ -237,25 +324,93 @@ void MainWindow::backendWork() {
             return;
         }
 
-        // copy the current frame so we can send its data to the backend
-        framebuffer.resize(mCaptureBuffer.size);
-        std::memcpy(&framebuffer[0], mCaptureBuffer.start, mCaptureBuffer.size);
-        img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
-        img.set_fourcc(mCaptureBuffer.format.fourcc);
+        // the responses to the last requests were received, so the frame buffer they referenced
+        // can be reused
+        if (mFrameBuffer.size() > 0) {
+            mTransport->release_buffer(mFrameBuffer);
+            mFrameBuffer.Clear();
+        }
+
+        captureTime = mCaptureTime;
+
+        // MJPG frames are passed through as they are, the backend decodes them (at reduced
+        // scale if its detector does not need the full resolution anyway)
+        jpeg = mCaptureBuffer.format.fourcc == sph::fourcc('M', 'J', 'P', 'G');
+        size_t size = jpeg ? mCaptureBuffer.bytesused : mCaptureBuffer.size;
+
+        // place the current frame in a buffer shared with the backend if the transport supports
+        // it, so the backend can access it in place, otherwise copy it so we can send its data
+        unsigned char *buffer = nullptr;
+        if (!mTransportLocal || mCaptureFrame == 0) {
+            buffer = mTransport->acquire_buffer(size, mFrameBuffer);
+        }
+
         img.set_width(mCaptureBuffer.format.width);
         img.set_height(mCaptureBuffer.format.height);
-        img.set_stride(mCaptureBuffer.format.stride);
+        if (jpeg) {
+            img.set_fourcc(sph::fourcc('B', 'G', 'R', '3'));
+            img.set_compression(Seraphim::Types::Image2D::JPEG);
+        } else {
+            img.set_fourcc(mCaptureBuffer.format.fourcc);
+            img.set_stride(mCaptureBuffer.format.stride);
+        }
+
+        // the format is fixed for the lifetime of a stream, so it is reopened whenever the
+        // capture format changes
+        reopen = mStream == 0 || img.width() != mStreamWidth || img.height() != mStreamHeight ||
+                 img.fourcc() != mStreamFourcc || img.compression() != mStreamCompression;
+        if (reopen) {
+            mTileEncoder.reset();
+        }
+
+        size_t bpp = sph::Pixelformat(img.fourcc()).size;
+        size_t stride = img.stride() > 0 ? img.stride() : img.width() * bpp;
+        if (mTransportLocal && mCaptureFrame > 0) {
+            // the backend reads the frame from the bus itself, all we send is its number
+            mFrameBuffer.Clear();
+            delta.Clear();
+            img.mutable_bus()->set_bus(mFrameBus.name());
+            img.mutable_bus()->set_frame(mCaptureFrame);
+        } else if (buffer) {
+            std::memcpy(buffer, mCaptureBuffer.start, size);
+            img.mutable_buffer()->CopyFrom(mFrameBuffer);
+        } else if (!jpeg && bpp > 0 &&
+                   mTileEncoder.encode(static_cast<const unsigned char *>(mCaptureBuffer.start),
+                                       img.width(), img.height(), stride, bpp, delta)) {
+            // frames have to be copied into the message, so only send the tiles which changed
+            // since the last frame
+            mFrameBuffer.Clear();
+        } else {
+            mFrameBuffer.Clear();
+            delta.Clear();
+            framebuffer.resize(size);
+            std::memcpy(&framebuffer[0], mCaptureBuffer.start, size);
+            img.set_data(reinterpret_cast<char *>(&framebuffer[0]), framebuffer.size());
+        }
     }
 
     if (mObjectRecognition) {
+        if (reopen && !openStream(img, !img.has_buffer() && !img.has_bus() && !jpeg)) {
+            return;
+        }
+
         Seraphim::Message msg;
-        Seraphim::Object::Detector::DetectionRequest req;
+        Seraphim::Object::Detector::StreamFrameRequest req;
+        req.set_stream(mStream);
         req.set_allocated_image(&img);
+        if (delta.tile_size() > 0) {
+            req.mutable_delta()->Swap(&delta);
+        }
 
-        // force at least 0.5 confidence
-        req.set_confidence(0.5f);
-
-        msg.mutable_req()->mutable_inner()->PackFrom(req);
+        sph::ipc::pack_request(req, *msg.mutable_req());
+        // only the newest frame of the stream matters, and only if its result arrives before we
+        // give up waiting for it
+        msg.mutable_req()->set_supersede(mStream);
+        msg.mutable_req()->set_deadline(1000);
+        {
+            std::lock_guard<std::mutex> lock(mTracerLock);
+            mTracer.stamp(msg, captureTime);
+        }
         try {
             mTransport->send(msg);
             // we still need the image, keep protobuf from deleting it by releasing it manually
@@ -263,16 +418,36 @@ void MainWindow::backendWork() {
             mTransport->receive(msg);
         } catch (std::exception &e) {
             std::cout << "[ERROR] Transport I/O error: " << e.what() << std::endl;
+            // we cannot tell whether the backend got the frame, so send the next one in full
+            mTileEncoder.reset();
             return;
         }
 
-        Seraphim::Object::Detector::DetectionResponse res;
-        if (!msg.res().inner().UnpackTo(&res)) {
+        {
+            std::lock_guard<std::mutex> lock(mTracerLock);
+            mTracer.record(msg);
+        }
+
+        if (msg.res().status() == Seraphim::Response::DROPPED) {
+            // the backend is overloaded, it did not see the frame, so the next one is sent in full
+            mTileEncoder.reset();
+            return;
+        } else if (msg.res().status() != 0) {
+            // the stream may have expired on the backend side, open a new one next time
+            mStream = 0;
+            return;
+        }
+
+        Seraphim::Object::Detector::StreamFrameResponse frame_res;
+        if (!msg.res().inner().UnpackTo(&frame_res)) {
             std::cout << "[ERROR] Failed to deserialize" << std::endl;
             return;
         }
+        const Seraphim::Object::Detector::DetectionResponse &res = frame_res.detections();
         std::cout << "Server sent response:" << std::endl
                   << "  status=" << msg.res().status() << std::endl
+                  << "  frame=" << frame_res.frame() << std::endl
+                  << "  cached=" << frame_res.cached() << std::endl
                   << "  objects=" << res.labels().size() << std::endl;
 
         // clear overlay
@@ -280,6 +455,9 @@ void MainWindow::backendWork() {
 
         // draw the new overlay
         draw_predictions(overlay, res);
+    } else {
+        // the frame was not sent, so it must not serve as reference for the next delta
+        mTileEncoder.reset();
     }
 
     // swap the new overlay into the class buffer
@@ -8,11 +8,14 @@
 #include <condition_variable>
 #include <mutex>
 
+#include <FrameBusPublisher/FrameBusPublisher.h>
 #include <ICaptureStream/ICaptureStream.h>
 #include <QImageProvider/QImageProvider.h>
 
+#include <seraphim/ipc/latency_tracer.h>
 #include <seraphim/ipc/shm_transport.h>
 #include <seraphim/ipc/tcp_transport.h>
+#include <seraphim/ipc/tile_delta.h>
 
 class MainWindow : public QObject {
     Q_OBJECT
@@ -58,6 +61,12 @@ private:
     // capture source
     std::unique_ptr<ICaptureStream> mCaptureStream;
     ICaptureStream::Buffer mCaptureBuffer;
+    // every captured frame is published here, so local backends need not be sent its data
+    FrameBusPublisher mFrameBus;
+    // number of the frame bus frame in mCaptureBuffer, 0 if it was not published
+    uint64_t mCaptureFrame;
+    // time at which mCaptureBuffer arrived, see sph::ipc::LatencyTracer::now()
+    int64_t mCaptureTime;
 
     std::atomic<bool> mObjectRecognition;
 
@@ -76,6 +85,23 @@ private:
     std::mutex mOverlayLock;
 
     std::unique_ptr<sph::ipc::Transport> mTransport;
+    // whether the backend runs on this host and can read frames from the frame bus
+    bool mTransportLocal;
+    // frame buffer shared with the backend (if any) used by the last backend request
+    Seraphim::Types::BufferRef mFrameBuffer;
+    // object detection stream opened with the backend, 0 if there is none
+    uint32_t mStream;
+    uint32_t mStreamFourcc;
+    uint32_t mStreamWidth;
+    uint32_t mStreamHeight;
+    Seraphim::Types::Image2D::Compression mStreamCompression;
+    // open a detection stream for frames in the format of the given image
+    bool openStream(const Seraphim::Types::Image2D &img, bool tileDelta);
+    // tracks the tiles which changed since the last frame sent to the stream
+    sph::ipc::TileEncoder mTileEncoder;
+    // breaks the latency of backend requests down into stages
+    sph::ipc::LatencyTracer mTracer;
+    std::mutex mTracerLock;
 };
 
 #endif // MAINWINDOW_H
@@ -19,6 +19,7 @@
 #include "point.h"
 #include "polygon.h"
 #include "size.h"
+#include "thread_pool.h"
 #include "threading.h"
 
 #endif // SPH_CORE_H
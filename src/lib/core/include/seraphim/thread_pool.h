@@ -0,0 +1,72 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_CORE_THREAD_POOL_H
+#define SPH_CORE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sph {
+
+/**
+ * @brief Fixed size pool of worker threads.
+ *
+ * Jobs are executed in the order they were submitted, but may complete in any order since they
+ * run in parallel. Exceptions thrown by a job are logged and discarded, the worker continues with
+ * the next job.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Start the worker threads.
+     * @param threads Number of workers, 0 uses one worker per hardware thread.
+     */
+    explicit ThreadPool(size_t threads = 0);
+
+    /**
+     * @brief Stop the pool.
+     *        Jobs which were submitted already are executed before the workers are joined.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queue a job for execution by the next idle worker.
+     * @param job The job.
+     */
+    void submit(std::function<void()> job);
+
+    /**
+     * @brief Number of worker threads.
+     */
+    size_t size() const { return m_workers.size(); }
+
+private:
+    /// worker threads
+    std::vector<std::thread> m_workers;
+
+    /// jobs which were not picked up by a worker yet
+    std::deque<std::function<void()>> m_jobs;
+
+    /// protects the job queue
+    std::mutex m_mutex;
+    /// signals new jobs and shutdown to the workers
+    std::condition_variable m_cv;
+    /// set when the pool is being destroyed
+    bool m_stopping = false;
+};
+
+} // namespace sph
+
+#endif // SPH_CORE_THREAD_POOL_H
@@ -0,0 +1,69 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+#include "seraphim/thread_pool.h"
+
+using namespace sph;
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        m_workers.emplace_back([&]() {
+            std::function<void()> job;
+
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+                    if (m_jobs.empty()) {
+                        // stopping and drained
+                        return;
+                    }
+
+                    job = std::move(m_jobs.front());
+                    m_jobs.pop_front();
+                }
+
+                // a failing job must not terminate the process or lose the worker
+                try {
+                    job();
+                } catch (const std::exception &e) {
+                    std::cout << "[ERROR] ThreadPool: " << e.what() << std::endl;
+                } catch (...) {
+                    std::cout << "[ERROR] ThreadPool: Unknown exception in job" << std::endl;
+                }
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.emplace_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
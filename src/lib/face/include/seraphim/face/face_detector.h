@@ -21,6 +21,25 @@ public:
 
     virtual bool detect(const sph::Image &img, std::vector<sph::Polygon<int>> &faces) = 0;
 
+    /**
+     * @brief Detect faces in a batch of images.
+     *        The default implementation calls @ref detect for each image.
+     * @param imgs Input images.
+     * @param faces Output vector containing the faces of each image.
+     * @return Whether detection was successful for all images.
+     */
+    virtual bool detect(const std::vector<sph::CoreImage> &imgs,
+                        std::vector<std::vector<sph::Polygon<int>>> &faces) {
+        bool ret = true;
+
+        faces.resize(imgs.size());
+        for (size_t i = 0; i < imgs.size(); i++) {
+            ret &= detect(imgs[i], faces[i]);
+        }
+
+        return ret;
+    }
+
     float confidence_threshold() const { return m_confidence_threshold; }
     void set_confidence_threshold(float threshold) { m_confidence_threshold = threshold; }
 
@@ -34,6 +34,31 @@ public:
 
     virtual bool detect(const sph::Image &img, const std::vector<sph::Polygon<int>> &faces,
                         std::vector<Facemarks> &facemarks) = 0;
+
+    /**
+     * @brief Detect facemarks in a batch of images.
+     *        The default implementation calls @ref detect for each image.
+     * @param imgs Input images.
+     * @param faces Faces of each image.
+     * @param facemarks Output vector containing the facemarks of each image.
+     * @return Whether detection was successful for all images.
+     */
+    virtual bool detect(const std::vector<sph::CoreImage> &imgs,
+                        const std::vector<std::vector<sph::Polygon<int>>> &faces,
+                        std::vector<std::vector<Facemarks>> &facemarks) {
+        bool ret = true;
+
+        if (imgs.size() != faces.size()) {
+            return false;
+        }
+
+        facemarks.resize(imgs.size());
+        for (size_t i = 0; i < imgs.size(); i++) {
+            ret &= detect(imgs[i], faces[i], facemarks[i]);
+        }
+
+        return ret;
+    }
 };
 
 } // namespace face
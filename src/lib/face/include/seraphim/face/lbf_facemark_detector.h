@@ -30,6 +30,7 @@ public:
 
     bool load_facemark_model(const std::string &path);
 
+    using FacemarkDetector::detect;
     bool detect(const sph::Image &img, const std::vector<sph::Polygon<int>> &faces,
                 std::vector<Facemarks> &facemarks) override;
 
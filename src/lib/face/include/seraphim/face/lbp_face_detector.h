@@ -38,6 +38,7 @@ public:
 
     bool load_face_cascade(const std::string &path);
 
+    using FaceDetector::detect;
     bool detect(const sph::Image &img, std::vector<sph::Polygon<int>> &faces) override;
 
     /**
@@ -0,0 +1,88 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstdlib>
+
+#include "seraphim/ipc/arena_pool.h"
+
+using namespace sph::ipc;
+
+/// Heap blocks allocated by arenas of any pool, the allocation hooks cannot carry any context.
+static std::atomic<uint64_t> heap_blocks{ 0 };
+
+static void *block_alloc(size_t size) {
+    heap_blocks++;
+    return ::operator new(size);
+}
+
+static void block_dealloc(void *block, size_t size) {
+    (void)size;
+    ::operator delete(block);
+}
+
+ArenaPool::ArenaPool(size_t block_size, size_t capacity)
+    : m_block_size(block_size), m_capacity(capacity), m_state(std::make_shared<State>()) {}
+
+std::shared_ptr<google::protobuf::Arena> ArenaPool::acquire() {
+    std::unique_ptr<Slot> slot;
+
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if (!m_state->idle.empty()) {
+            slot = std::move(m_state->idle.back());
+            m_state->idle.pop_back();
+        }
+    }
+
+    if (!slot) {
+        google::protobuf::ArenaOptions options;
+
+        slot = std::unique_ptr<Slot>(new Slot());
+        slot->block = std::unique_ptr<char[]>(new char[m_block_size]);
+        options.initial_block = slot->block.get();
+        options.initial_block_size = m_block_size;
+        options.start_block_size = m_block_size;
+        options.block_alloc = block_alloc;
+        options.block_dealloc = block_dealloc;
+        slot->arena =
+            std::unique_ptr<google::protobuf::Arena>(new google::protobuf::Arena(options));
+    }
+
+    m_state->leases++;
+
+    // the lease keeps the state alive, so it can be returned after the pool is gone
+    std::shared_ptr<State> state = m_state;
+    size_t capacity = m_capacity;
+    Slot *owner = slot.release();
+
+    return std::shared_ptr<google::protobuf::Arena>(
+        owner->arena.get(),
+        [state, capacity, owner](google::protobuf::Arena *) { release(state, capacity, owner); });
+}
+
+ArenaPool::Stats ArenaPool::stats() const {
+    Stats stats = {};
+
+    stats.leases = m_state->leases;
+    stats.heap_blocks = heap_blocks;
+    stats.bytes_used = m_state->bytes_used;
+    return stats;
+}
+
+void ArenaPool::release(const std::shared_ptr<State> &state, size_t capacity, Slot *slot) {
+    std::unique_ptr<Slot> owner(slot);
+
+    state->bytes_used += owner->arena->SpaceUsed();
+
+    // frees all blocks but the initial one
+    owner->arena->Reset();
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->idle.size() < capacity) {
+        state->idle.emplace_back(std::move(owner));
+    }
+}
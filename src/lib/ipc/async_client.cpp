@@ -0,0 +1,140 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <iostream>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/async_client.h"
+#include "seraphim/ipc/except.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+AsyncClient::AsyncClient(std::shared_ptr<Transport> transport) : m_transport(transport) {
+    m_transport->set_rx_timeout(RX_POLL_INTERVAL);
+
+    m_running = true;
+    m_thread = std::thread([&]() { receive_loop(); });
+}
+
+AsyncClient::~AsyncClient() {
+    m_running = false;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    fail_pending("Client destroyed");
+}
+
+std::future<Seraphim::Message> AsyncClient::request(Seraphim::Message &msg) {
+    Pending pending;
+    std::future<Seraphim::Message> future = pending.promise.get_future();
+
+    send(msg, std::move(pending));
+    return future;
+}
+
+void AsyncClient::request(Seraphim::Message &msg, callback_t callback) {
+    Pending pending;
+
+    pending.callback = std::move(callback);
+    send(msg, std::move(pending));
+}
+
+size_t AsyncClient::pending() const {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    return m_pending.size();
+}
+
+void AsyncClient::send(Seraphim::Message &msg, Pending &&pending) {
+    uint32_t id = m_next_id++;
+
+    // 0 means the id was not set, skip it when wrapping around
+    if (id == 0) {
+        id = m_next_id++;
+    }
+    msg.set_id(id);
+
+    // register first, the response may arrive before send() returns
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending[id] = std::move(pending);
+    }
+
+    try {
+        // checked after registering, so the request is either failed here or by the receiver
+        if (!m_running) {
+            SPH_THROW(PeerDisconnectedException, "Peer disconnected");
+        }
+
+        std::lock_guard<std::mutex> lock(m_send_mutex);
+        m_transport->send(msg);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending.erase(id);
+        throw;
+    }
+}
+
+void AsyncClient::receive_loop() {
+    Seraphim::Message msg;
+    Pending pending;
+
+    while (m_running) {
+        try {
+            m_transport->receive(msg);
+        } catch (const TimeoutException &) {
+            continue;
+        } catch (const PeerDisconnectedException &e) {
+            // no response is going to arrive anymore
+            m_running = false;
+            fail_pending(e.what());
+            return;
+        } catch (const RuntimeException &e) {
+            // the response cannot be matched to its request
+            std::cout << "[ERROR] AsyncClient: " << e.what() << std::endl;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_pending_mutex);
+            auto it = m_pending.find(msg.id());
+            if (it == m_pending.end()) {
+                // the request was abandoned
+                continue;
+            }
+
+            pending = std::move(it->second);
+            m_pending.erase(it);
+        }
+
+        if (pending.callback) {
+            pending.callback(msg);
+        } else {
+            pending.promise.set_value(std::move(msg));
+            msg = Seraphim::Message();
+        }
+    }
+}
+
+void AsyncClient::fail_pending(const std::string &reason) {
+    std::unordered_map<uint32_t, Pending> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        pending.swap(m_pending);
+    }
+
+    for (auto &request : pending) {
+        if (request.second.callback) {
+            continue;
+        }
+
+        request.second.promise.set_exception(
+            std::make_exception_ptr(RuntimeException(__FILE__, __LINE__, reason)));
+    }
+}
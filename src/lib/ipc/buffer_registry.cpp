@@ -0,0 +1,75 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <atomic>
+
+#include "seraphim/ipc/buffer_registry.h"
+
+using namespace sph::ipc;
+
+/// peer whose request the thread is handling
+static thread_local uint64_t current_peer = 0;
+
+uint64_t BufferRegistry::new_peer() {
+    static std::atomic<uint64_t> next{ 1 };
+    return next++;
+}
+
+uint64_t BufferRegistry::current() {
+    return current_peer;
+}
+
+BufferRegistry::Scope::Scope(uint64_t peer) : m_previous(current_peer) {
+    current_peer = peer;
+}
+
+BufferRegistry::Scope::~Scope() {
+    current_peer = m_previous;
+}
+
+void BufferRegistry::add(uint64_t peer, const std::string &name, unsigned char *addr, size_t size,
+                         uint64_t origin) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_regions[peer][name] = { addr, size, origin };
+}
+
+void BufferRegistry::remove(uint64_t peer, const std::string &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto regions = m_regions.find(peer);
+    if (regions == m_regions.end()) {
+        return;
+    }
+
+    regions->second.erase(name);
+    if (regions->second.empty()) {
+        m_regions.erase(regions);
+    }
+}
+
+unsigned char *BufferRegistry::resolve(uint64_t peer, const std::string &name, uint64_t offset,
+                                       uint64_t size) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto regions = m_regions.find(peer);
+    if (regions == m_regions.end()) {
+        return nullptr;
+    }
+
+    auto region = regions->second.find(name);
+    if (region == regions->second.end() || offset < region->second.origin) {
+        return nullptr;
+    }
+
+    // careful: offset + size may overflow
+    offset -= region->second.origin;
+    if (offset > region->second.size || size > region->second.size - offset) {
+        return nullptr;
+    }
+
+    return region->second.addr + offset;
+}
@@ -0,0 +1,189 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cstring>
+#include <utility>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/chunk_stream.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+ChunkWriter::ChunkWriter(RingBuffer &queue, uint64_t size, size_t chunk_size, int timeout,
+                         std::function<void()> committed)
+    : m_queue(queue), m_size(size), m_chunk_size(chunk_size), m_timeout(timeout),
+      m_committed(std::move(committed)) {
+    if (m_chunk_size <= sizeof(ChunkHeader)) {
+        SPH_THROW(InvalidArgumentException, "Chunk size too small");
+    }
+}
+
+bool ChunkWriter::Next(void **data, int *size) {
+    unsigned char *chunk;
+
+    if (m_error) {
+        return false;
+    }
+
+    if (m_chunk) {
+        commit(0);
+    }
+
+    // the queue throws on timeouts, which must not unwind through the serialization code
+    try {
+        chunk = m_queue.reserve(m_chunk_size, m_timeout);
+    } catch (...) {
+        m_error = std::current_exception();
+        return false;
+    }
+
+    m_chunk = reinterpret_cast<ChunkHeader *>(chunk);
+    std::memset(m_chunk, 0, sizeof(ChunkHeader));
+    m_chunk->size = m_size;
+    m_used = m_chunk_size - sizeof(ChunkHeader);
+
+    *data = chunk + sizeof(ChunkHeader);
+    *size = static_cast<int>(m_used);
+    m_count += static_cast<int64_t>(m_used);
+    return true;
+}
+
+void ChunkWriter::BackUp(int count) {
+    m_used -= static_cast<size_t>(count);
+    m_count -= count;
+}
+
+void ChunkWriter::commit(uint8_t flags) {
+    m_chunk->flags = flags | (m_first ? ChunkHeader::FIRST : 0);
+    m_queue.commit(sizeof(ChunkHeader) + m_used);
+    m_chunk = nullptr;
+    m_first = false;
+
+    if (m_committed) {
+        m_committed();
+    }
+}
+
+void ChunkWriter::finish() {
+    rethrow();
+
+    // even an empty message needs a chunk
+    if (!m_chunk) {
+        void *data;
+        int size;
+        if (!Next(&data, &size)) {
+            rethrow();
+        }
+        BackUp(size);
+    }
+
+    commit(ChunkHeader::LAST);
+}
+
+void ChunkWriter::rethrow() const {
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+ChunkReader::ChunkReader(RingBuffer &queue, const unsigned char *data, size_t size, int timeout)
+    : m_queue(queue), m_timeout(timeout) {
+    const ChunkHeader *header = ChunkHeader::find(data, size);
+
+    if (!header || !(header->flags & ChunkHeader::FIRST)) {
+        SPH_THROW(RuntimeException, "Not the first chunk of a message");
+    }
+
+    m_held = true;
+    m_size = header->size;
+    m_data = data + sizeof(ChunkHeader);
+    m_length = size - sizeof(ChunkHeader);
+    m_last = header->flags & ChunkHeader::LAST;
+}
+
+bool ChunkReader::Next(const void **data, int *size) {
+    const ChunkHeader *header = nullptr;
+    const unsigned char *chunk;
+    size_t length;
+
+    if (m_error || m_done) {
+        return false;
+    }
+
+    while (m_position == m_length) {
+        // the writer may reuse the space of the chunk as soon as it is released
+        m_queue.pop();
+        m_held = false;
+        if (m_last) {
+            m_done = true;
+            return false;
+        }
+
+        try {
+            chunk = m_queue.front(length, m_timeout);
+            m_held = true;
+            header = ChunkHeader::find(chunk, length);
+            if (!header || (header->flags & ChunkHeader::FIRST)) {
+                // the writer gave up on the message and started the next one, which is lost as
+                // well since its start cannot be handed back to the queue
+                SPH_THROW(RuntimeException, "Incomplete chunked message");
+            }
+        } catch (...) {
+            m_error = std::current_exception();
+            return false;
+        }
+
+        m_data = chunk + sizeof(ChunkHeader);
+        m_length = length - sizeof(ChunkHeader);
+        m_position = 0;
+        m_last = header->flags & ChunkHeader::LAST;
+    }
+
+    *data = m_data + m_position;
+    *size = static_cast<int>(m_length - m_position);
+    m_count += static_cast<int64_t>(m_length - m_position);
+    m_position = m_length;
+    return true;
+}
+
+void ChunkReader::BackUp(int count) {
+    m_position -= static_cast<size_t>(count);
+    m_count -= count;
+}
+
+bool ChunkReader::Skip(int count) {
+    const void *data;
+    int size;
+
+    while (count > 0) {
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+
+    return true;
+}
+
+void ChunkReader::discard() {
+    if (m_held) {
+        m_queue.pop();
+    }
+    m_held = false;
+    m_done = true;
+}
+
+void ChunkReader::rethrow() const {
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
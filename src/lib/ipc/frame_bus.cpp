@@ -0,0 +1,334 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/frame_bus.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+/// Slots and frame data are aligned to cache lines.
+static inline uint64_t align(uint64_t size) {
+    return (size + 63) & ~uint64_t(63);
+}
+
+FrameBus::~FrameBus() {
+    close();
+}
+
+bool FrameBus::create(const std::string &name, size_t frame_size, uint32_t slots) {
+    uint64_t slot_size;
+    uint64_t size;
+
+    if (m_header || frame_size == 0 || slots < 2) {
+        return false;
+    }
+
+    slot_size = align(sizeof(Slot)) + align(frame_size);
+    size = align(sizeof(Header)) + slots * slot_size;
+
+    // readers of a bus whose writer died would wait forever, tell them to reopen it
+    {
+        FrameBus stale;
+        if (stale.open(name)) {
+            stale.m_header->closed.store(1);
+            stale.m_header->futex.fetch_add(1);
+            stale.wake();
+        }
+    }
+    shm_unlink(name.c_str());
+
+    m_fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (m_fd == -1) {
+        return false;
+    }
+
+    m_name = name;
+    m_created = true;
+    if (ftruncate(m_fd, static_cast<off_t>(size)) == -1 || !map(size)) {
+        close();
+        return false;
+    }
+
+    m_header->num_slots = slots;
+    m_header->slots = align(sizeof(Header));
+    m_header->slot_size = slot_size;
+    m_header->frame_size = frame_size;
+    m_header->latest.store(0);
+    m_header->magic.store(MAGIC, std::memory_order_release);
+    return true;
+}
+
+bool FrameBus::open(const std::string &name) {
+    struct stat shm_stat;
+
+    if (m_header) {
+        return false;
+    }
+
+    m_fd = shm_open(name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+    if (m_fd == -1) {
+        return false;
+    }
+
+    m_name = name;
+    if (fstat(m_fd, &shm_stat) == -1 || static_cast<size_t>(shm_stat.st_size) < sizeof(Header) ||
+        !map(static_cast<size_t>(shm_stat.st_size))) {
+        close();
+        return false;
+    }
+
+    // the writer may still be setting up the bus
+    if (m_header->magic.load(std::memory_order_acquire) != MAGIC ||
+        m_header->slots + m_header->num_slots * m_header->slot_size > m_size ||
+        m_header->slot_size < align(sizeof(Slot)) + m_header->frame_size) {
+        close();
+        return false;
+    }
+
+    m_cursor = 0;
+    m_stats = {};
+    return true;
+}
+
+void FrameBus::close() {
+    if (m_header) {
+        if (m_created) {
+            m_header->closed.store(1);
+            m_header->futex.fetch_add(1);
+            wake();
+        }
+        munmap(m_header, m_size);
+        m_header = nullptr;
+        m_size = 0;
+    }
+
+    if (m_created) {
+        shm_unlink(m_name.c_str());
+        m_created = false;
+    }
+
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool FrameBus::map(size_t size) {
+    void *addr;
+
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    m_size = size;
+    m_header = reinterpret_cast<Header *>(addr);
+    return true;
+}
+
+bool FrameBus::closed() const {
+    return !m_header || m_header->closed.load() != 0;
+}
+
+size_t FrameBus::frame_size() const {
+    return m_header ? m_header->frame_size : 0;
+}
+
+FrameBus::Slot &FrameBus::slot(uint64_t seq) const {
+    return *reinterpret_cast<Slot *>(reinterpret_cast<unsigned char *>(m_header) +
+                                     m_header->slots +
+                                     (seq % m_header->num_slots) * m_header->slot_size);
+}
+
+uint64_t FrameBus::publish(Frame &frame, const void *data) {
+    if (!m_header || !m_created) {
+        SPH_THROW(RuntimeException, "Not the writer of the bus");
+    }
+    if (frame.size > m_header->frame_size) {
+        SPH_THROW(InvalidArgumentException, "Frame too large");
+    }
+
+    frame.seq = m_header->latest.load(std::memory_order_relaxed) + 1;
+    Slot &s = slot(frame.seq);
+    uint64_t lock = s.lock.load(std::memory_order_relaxed);
+
+    // readers which copy the slot meanwhile see an odd or changed lock value and retry
+    s.lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(&s.frame, &frame, sizeof(frame));
+    if (frame.size > 0) {
+        std::memcpy(reinterpret_cast<unsigned char *>(&s) + align(sizeof(Slot)), data,
+                    frame.size);
+    }
+
+    s.lock.store(lock + 2, std::memory_order_release);
+    m_header->latest.store(frame.seq, std::memory_order_release);
+
+    m_header->futex.fetch_add(1);
+    if (m_header->waiters.load() > 0) {
+        wake();
+    }
+
+    return frame.seq;
+}
+
+uint64_t FrameBus::latest() const {
+    return m_header ? m_header->latest.load(std::memory_order_acquire) : 0;
+}
+
+bool FrameBus::read(uint64_t seq, Frame &frame,
+                    const std::function<unsigned char *(const Frame &)> &buffer) const {
+    uint64_t retries = 0;
+    return copy(seq, frame, buffer, retries);
+}
+
+bool FrameBus::copy(uint64_t seq, Frame &frame,
+                    const std::function<unsigned char *(const Frame &)> &buffer,
+                    uint64_t &retries) const {
+    if (!m_header) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < MAX_RETRIES; i++) {
+        uint64_t target = seq > 0 ? seq : latest();
+        if (target == 0) {
+            return false;
+        }
+
+        Slot &s = slot(target);
+        uint64_t before = s.lock.load(std::memory_order_acquire);
+        if (before & 1) {
+            retries++;
+            std::this_thread::yield();
+            continue;
+        }
+
+        // the copy may be torn, it is only used once the lock proves it is not
+        std::memcpy(&frame, &s.frame, sizeof(frame));
+        bool valid = frame.seq == target && frame.size <= m_header->frame_size;
+        if (valid) {
+            unsigned char *dst = buffer(frame);
+            if (frame.size > 0) {
+                if (!dst) {
+                    return false;
+                }
+                std::memcpy(dst, reinterpret_cast<unsigned char *>(&s) + align(sizeof(Slot)),
+                            frame.size);
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.lock.load(std::memory_order_relaxed) != before) {
+            retries++;
+            continue;
+        }
+
+        if (valid) {
+            return true;
+        }
+        if (seq > 0) {
+            // the frame was overwritten already or was not published yet
+            return false;
+        }
+        retries++;
+    }
+
+    return false;
+}
+
+bool FrameBus::next(Frame &frame, std::vector<unsigned char> &data, int timeout) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    auto resize = [&](const Frame &f) {
+        data.resize(f.size);
+        return data.data();
+    };
+
+    for (;;) {
+        if (closed()) {
+            SPH_THROW(RuntimeException, "Frame bus closed");
+        }
+
+        uint32_t value = m_header->futex.load(std::memory_order_acquire);
+        if (latest() > m_cursor && copy(0, frame, resize, m_stats.retries)) {
+            if (m_cursor > 0 && frame.seq > m_cursor + 1) {
+                m_stats.skipped += frame.seq - m_cursor - 1;
+            }
+            m_cursor = frame.seq;
+            m_stats.frames++;
+            return true;
+        }
+
+        int remaining = -1;
+        if (timeout >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                return false;
+            }
+            remaining = static_cast<int>(left.count());
+        }
+
+        // announce the waiter before checking again, so the writer either sees it or the reader
+        // sees the new frame
+        m_header->waiters.fetch_add(1);
+        if (latest() <= m_cursor && !closed()) {
+            wait(value, remaining);
+        }
+        m_header->waiters.fetch_sub(1);
+    }
+}
+
+bool FrameBus::wait(uint32_t value, int timeout) const {
+#ifdef __linux__
+    struct timespec ts;
+    struct timespec *pts = nullptr;
+
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        pts = &ts;
+    }
+
+    // the futex is shared with other processes, so it must not be a private one
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_header->futex), FUTEX_WAIT,
+                       value, pts, nullptr, 0);
+    return ret == 0 || errno != ETIMEDOUT;
+#else
+    // no process-shared futex, poll instead
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (m_header->futex.load() == value && m_header->closed.load() == 0) {
+        if (timeout >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+#endif
+}
+
+void FrameBus::wake() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_header->futex), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+#endif
+}
@@ -8,9 +8,21 @@
 #ifndef SPH_IPC_H
 #define SPH_IPC_H
 
+#include <seraphim/ipc/arena_pool.h>
+#include <seraphim/ipc/async_client.h>
+#include <seraphim/ipc/buffer_registry.h>
+#include <seraphim/ipc/chunk_stream.h>
+#include <seraphim/ipc/frame_bus.h>
+#include <seraphim/ipc/latency_tracer.h>
+#include <seraphim/ipc/packed_geometry.h>
+#include <seraphim/ipc/request_view.h>
+#include <seraphim/ipc/ring_buffer.h>
 #include <seraphim/ipc/semaphore.h>
 #include <seraphim/ipc/shm_transport.h>
 #include <seraphim/ipc/tcp_transport.h>
+#include <seraphim/ipc/tile_delta.h>
 #include <seraphim/ipc/transport_factory.h>
+#include <seraphim/ipc/udp_transport.h>
+#include <seraphim/ipc/unix_transport.h>
 
 #endif // SPH_IPC_H
@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_ARENA_POOL_H
+#define SPH_IPC_ARENA_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <google/protobuf/arena.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Pool of recycled protobuf arenas.
+ *
+ * Messages allocated from an arena are carved out of large memory blocks by a bump allocator and
+ * freed all at once when the arena is reset. Every arena of the pool owns an initial block which
+ * is kept across resets, so requests whose messages fit into it do not allocate from the heap at
+ * all. Larger requests make the arena allocate additional blocks, which are counted (see
+ * @ref Stats) and released again when the arena returns to the pool.
+ *
+ * This class is thread safe.
+ */
+class ArenaPool {
+public:
+    /**
+     * @brief Usage statistics.
+     */
+    struct Stats {
+        /// Number of arenas handed out by @ref acquire.
+        uint64_t leases;
+        /// Number of blocks arenas allocated from the heap after their initial block was full.
+        /// The allocation hooks of protobuf cannot carry any context, so this counts the blocks
+        /// of all pools of the process.
+        uint64_t heap_blocks;
+        /// Bytes used by messages, summed over all leases.
+        uint64_t bytes_used;
+    };
+
+    /// Default size of the initial block of every arena.
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    /// Default number of idle arenas kept by the pool.
+    static constexpr size_t DEFAULT_CAPACITY = 32;
+
+    /**
+     * @brief Pool of recycled protobuf arenas.
+     * @param block_size Size of the initial block of every arena.
+     * @param capacity Maximum number of idle arenas, arenas returned beyond that are freed.
+     */
+    explicit ArenaPool(size_t block_size = DEFAULT_BLOCK_SIZE, size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * @brief Get an empty arena.
+     *        The arena is reset and returned to the pool once the last reference is gone, which
+     *        may happen after the pool was destroyed.
+     * @return The arena.
+     */
+    std::shared_ptr<google::protobuf::Arena> acquire();
+
+    /**
+     * @brief Get the usage statistics.
+     */
+    Stats stats() const;
+
+private:
+    /**
+     * @brief Arena along with its initial block.
+     */
+    struct Slot {
+        std::unique_ptr<char[]> block;
+        std::unique_ptr<google::protobuf::Arena> arena;
+    };
+
+    /**
+     * @brief State shared with the leases.
+     */
+    struct State {
+        /// protects idle
+        std::mutex mutex;
+        /// arenas which are not in use
+        std::vector<std::unique_ptr<Slot>> idle;
+
+        std::atomic<uint64_t> leases{ 0 };
+        std::atomic<uint64_t> bytes_used{ 0 };
+    };
+
+    /**
+     * @brief Reset an arena and keep it for later use.
+     */
+    static void release(const std::shared_ptr<State> &state, size_t capacity, Slot *slot);
+
+    size_t m_block_size;
+    size_t m_capacity;
+    std::shared_ptr<State> m_state;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_ARENA_POOL_H
@@ -0,0 +1,135 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_ASYNC_CLIENT_H
+#define SPH_IPC_ASYNC_CLIENT_H
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "transport.h"
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Asynchronous request client.
+ *
+ * Sends requests without waiting for the responses of earlier ones, so a single connection can
+ * carry many requests at once. Every request is tagged with a unique message id, a background
+ * thread receives the responses and matches them by id, so servers may complete requests in any
+ * order.
+ *
+ * The client takes over receiving on the transport: no one else must call receive() on it while
+ * the client exists. Buffers may still be acquired and released through the transport.
+ */
+class AsyncClient {
+public:
+    /// Invoked by the receiver thread with the response to a request.
+    typedef std::function<void(Seraphim::Message &)> callback_t;
+
+    /// Interval in milliseconds in which the receiver thread checks whether it should stop.
+    static constexpr int RX_POLL_INTERVAL = 100;
+
+    /**
+     * @brief Asynchronous request client.
+     *        Sets the RX timeout of the transport to @ref RX_POLL_INTERVAL.
+     * @param transport The transport, must be connected already.
+     */
+    explicit AsyncClient(std::shared_ptr<Transport> transport);
+
+    /**
+     * @brief Stop receiving responses.
+     *        Futures of requests which are still pending fail with sph::RuntimeException, their
+     *        callbacks are not invoked.
+     */
+    ~AsyncClient();
+
+    AsyncClient(const AsyncClient &) = delete;
+    AsyncClient &operator=(const AsyncClient &) = delete;
+
+    /**
+     * @brief Send a request.
+     *        The message id is overwritten with a unique value.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     *        Throws sph::ipc::PeerDisconnectedException when the server disconnected.
+     * @param msg The request.
+     * @return Future which becomes ready once the response arrived. It fails with
+     *         sph::RuntimeException if the transport fails before that.
+     */
+    std::future<Seraphim::Message> request(Seraphim::Message &msg);
+
+    /**
+     * @brief Send a request and invoke a callback with the response.
+     *        The message id is overwritten with a unique value.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     *        Throws sph::ipc::PeerDisconnectedException when the server disconnected.
+     * @param msg The request.
+     * @param callback Invoked by the receiver thread, must not block for long.
+     */
+    void request(Seraphim::Message &msg, callback_t callback);
+
+    /**
+     * @brief Number of requests which are waiting for their responses.
+     */
+    size_t pending() const;
+
+private:
+    /**
+     * @brief Request which is waiting for its response.
+     */
+    struct Pending {
+        /// fulfilled with the response (unless a callback is set)
+        std::promise<Seraphim::Message> promise;
+        /// invoked with the response instead of fulfilling the promise
+        callback_t callback;
+    };
+
+    /**
+     * @brief Register a request and send it.
+     */
+    void send(Seraphim::Message &msg, Pending &&pending);
+
+    /**
+     * @brief Receiver thread main loop.
+     */
+    void receive_loop();
+
+    /**
+     * @brief Fail all pending requests.
+     */
+    void fail_pending(const std::string &reason);
+
+    std::shared_ptr<Transport> m_transport;
+
+    /// serializes senders, receiving happens concurrently
+    std::mutex m_send_mutex;
+
+    /// id of the next request
+    std::atomic<uint32_t> m_next_id{ 1 };
+
+    /// protects m_pending
+    mutable std::mutex m_pending_mutex;
+    /// requests waiting for their responses, by message id
+    std::unordered_map<uint32_t, Pending> m_pending;
+
+    std::thread m_thread;
+    /// cleared when the client is destroyed or the server disconnected
+    std::atomic<bool> m_running{ false };
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_ASYNC_CLIENT_H
@@ -0,0 +1,131 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_BUFFER_REGISTRY_H
+#define SPH_IPC_BUFFER_REGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Registry of memory regions shared with peers.
+ *
+ * Transports which are able to share data out-of-band (e.g. through a shared memory segment)
+ * register the regions here, so message handlers can resolve buffer references
+ * (Seraphim::Types::BufferRef) to memory without copying any data.
+ *
+ * Regions belong to the peer (e.g. the client connection) which shared them and can only be
+ * resolved on its behalf, so a client cannot read the buffers of another one by naming them.
+ */
+class BufferRegistry {
+public:
+    /**
+     * @brief Singleton class instance.
+     * @return The single, static instance of this class.
+     */
+    static BufferRegistry &Instance() {
+        // Guaranteed to be destroyed, instantiated on first use.
+        static BufferRegistry instance;
+        return instance;
+    }
+
+    // Remove copy and assignment constructors.
+    BufferRegistry(BufferRegistry const &) = delete;
+    void operator=(BufferRegistry const &) = delete;
+
+    /**
+     * @brief Get a new peer id, transports use one per client connection or channel.
+     * @return The id, never 0. No regions are registered for 0, so it stands for peers which
+     *         cannot share any.
+     */
+    static uint64_t new_peer();
+
+    /**
+     * @brief Get the peer whose request the calling thread is handling, see @ref Scope.
+     * @return The peer, 0 outside of a scope.
+     */
+    static uint64_t current();
+
+    /**
+     * @brief Marks the calling thread as handling a request of a peer as long as it exists.
+     */
+    class Scope {
+    public:
+        explicit Scope(uint64_t peer);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        /// peer of the enclosing scope
+        uint64_t m_previous;
+    };
+
+    /**
+     * @brief Register a memory region.
+     *        An existing region of the peer with the same name is replaced.
+     * @param peer The peer which shared the region.
+     * @param name Name of the region, unique among the ones of the peer.
+     * @param addr Start of the region.
+     * @param size Size of the region in bytes.
+     * @param origin Offset of the start as seen by the peer, which is used to resolve buffers.
+     */
+    void add(uint64_t peer, const std::string &name, unsigned char *addr, size_t size,
+             uint64_t origin = 0);
+
+    /**
+     * @brief Unregister a memory region.
+     * @param peer The peer which shared the region.
+     * @param name Name of the region.
+     */
+    void remove(uint64_t peer, const std::string &name);
+
+    /**
+     * @brief Resolve a buffer within a registered region.
+     * @param peer The peer referencing the buffer, usually @ref current.
+     * @param name Name of the region.
+     * @param offset Start of the buffer relative to the origin of the region.
+     * @param size Size of the buffer in bytes.
+     * @return Start of the buffer or nullptr if the peer did not register the region or the
+     *         buffer exceeds it.
+     */
+    unsigned char *resolve(uint64_t peer, const std::string &name, uint64_t offset,
+                           uint64_t size) const;
+
+private:
+    BufferRegistry() = default;
+
+    /**
+     * @brief Registered memory region.
+     */
+    struct Region {
+        /// start address
+        unsigned char *addr;
+        /// size in bytes
+        size_t size;
+        /// offset of the start as seen by the peer
+        uint64_t origin;
+    };
+
+    /// registered regions of every peer by name
+    std::unordered_map<uint64_t, std::unordered_map<std::string, Region>> m_regions;
+
+    /// regions are registered and resolved by different threads
+    mutable std::mutex m_mutex;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_BUFFER_REGISTRY_H
@@ -0,0 +1,195 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_CHUNK_STREAM_H
+#define SPH_IPC_CHUNK_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include <seraphim/ipc/ring_buffer.h>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Header of a chunk of a message which is too large for a queue.
+ *
+ * Such messages are split into chunks which are queued one after the other, every chunk is a
+ * queue entry starting with this header. The first byte of a header is always zero, which tells
+ * chunks apart from regular messages: no serialized protobuf message starts with a zero byte.
+ */
+struct ChunkHeader {
+    /// Always 0.
+    uint8_t marker;
+    /// See @ref Flags.
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t reserved2;
+    /// Size of the whole message in bytes.
+    uint64_t size;
+
+    enum Flags : uint8_t {
+        /// The chunk starts a message.
+        FIRST = 1 << 0,
+        /// The chunk ends a message.
+        LAST = 1 << 1
+    };
+
+    /**
+     * @brief Check whether a queue entry is a chunk.
+     * @param data Start of the entry.
+     * @param size Size of the entry in bytes.
+     * @return The header or nullptr if the entry is a regular message.
+     */
+    static const ChunkHeader *find(const unsigned char *data, size_t size) {
+        if (size < sizeof(ChunkHeader) || data[0] != 0) {
+            return nullptr;
+        }
+        return reinterpret_cast<const ChunkHeader *>(data);
+    }
+};
+
+/**
+ * @brief Serialize a message into a queue chunk by chunk.
+ *
+ * The message is written directly into the queue, so memory usage is bounded by the chunk size no
+ * matter how large the message is. The reader has to consume chunks concurrently, otherwise the
+ * writer blocks once the queue is full.
+ *
+ * Errors of the queue are not thrown from within the serialization code, @ref Next fails instead
+ * and @ref rethrow throws them afterwards.
+ */
+class ChunkWriter : public google::protobuf::io::ZeroCopyOutputStream {
+public:
+    /**
+     * @brief Chunk writer.
+     * @param queue The queue, the caller must be its producer.
+     * @param size Size of the whole message in bytes.
+     * @param chunk_size Maximum size of a chunk in bytes, including its header.
+     * @param timeout Time in milliseconds to wait for space for a chunk, 0 means blocking.
+     * @param committed Called whenever a chunk was committed, e.g. to notify the reader.
+     */
+    ChunkWriter(RingBuffer &queue, uint64_t size, size_t chunk_size, int timeout,
+                std::function<void()> committed = nullptr);
+
+    bool Next(void **data, int *size) override;
+    void BackUp(int count) override;
+    int64_t ByteCount() const override { return m_count; }
+
+    /**
+     * @brief Commit the last chunk, must be called once the message was serialized.
+     *        Throws the error which made @ref Next fail, if any.
+     */
+    void finish();
+
+    /**
+     * @brief Throw the error which made @ref Next fail, if any.
+     */
+    void rethrow() const;
+
+private:
+    /**
+     * @brief Commit the current chunk.
+     */
+    void commit(uint8_t flags);
+
+    RingBuffer &m_queue;
+    uint64_t m_size;
+    size_t m_chunk_size;
+    int m_timeout;
+    std::function<void()> m_committed;
+
+    /// header of the current chunk, nullptr if there is none
+    ChunkHeader *m_chunk = nullptr;
+    /// bytes of the current chunk handed out by Next
+    size_t m_used = 0;
+    /// whether the next chunk is the first one
+    bool m_first = true;
+    /// bytes written so far
+    int64_t m_count = 0;
+    /// error raised by the queue
+    std::exception_ptr m_error;
+};
+
+/**
+ * @brief Parse a message from a queue chunk by chunk.
+ *
+ * Every chunk is released as soon as it was parsed, so the writer can reuse its space for the
+ * next one and the message is parsed while it is still being written.
+ *
+ * Errors of the queue are not thrown from within the parsing code, @ref Next fails instead and
+ * @ref rethrow throws them afterwards.
+ */
+class ChunkReader : public google::protobuf::io::ZeroCopyInputStream {
+public:
+    /**
+     * @brief Chunk reader.
+     *        Throws sph::RuntimeException if the entry does not start a message.
+     * @param queue The queue, the caller must be its consumer.
+     * @param data The oldest entry of the queue as returned by RingBuffer::front, it must be the
+     *             first chunk of a message (see @ref ChunkHeader) and is released by the reader.
+     * @param size Size of the entry in bytes.
+     * @param timeout Time in milliseconds to wait for the next chunk, 0 means blocking.
+     */
+    ChunkReader(RingBuffer &queue, const unsigned char *data, size_t size, int timeout);
+
+    bool Next(const void **data, int *size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override { return m_count; }
+
+    /**
+     * @brief Size of the whole message in bytes.
+     */
+    uint64_t size() const { return m_size; }
+
+    /**
+     * @brief Check whether the last chunk was consumed.
+     */
+    bool done() const { return m_done; }
+
+    /**
+     * @brief Release the current chunk if the message is not read to its end, e.g. because it
+     *        is malformed. The remaining chunks have to be skipped by the caller.
+     */
+    void discard();
+
+    /**
+     * @brief Throw the error which made @ref Next fail, if any.
+     */
+    void rethrow() const;
+
+private:
+    RingBuffer &m_queue;
+    int m_timeout;
+    uint64_t m_size = 0;
+
+    /// payload of the current chunk
+    const unsigned char *m_data = nullptr;
+    size_t m_length = 0;
+    /// bytes of the current chunk handed out by Next
+    size_t m_position = 0;
+    /// whether the current chunk is the last one
+    bool m_last = false;
+    /// whether the current chunk was not released yet
+    bool m_held = false;
+    /// whether the last chunk was released
+    bool m_done = false;
+    /// bytes read so far
+    int64_t m_count = 0;
+    /// error raised by the queue or caused by malformed chunks
+    std::exception_ptr m_error;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_CHUNK_STREAM_H
@@ -0,0 +1,245 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_FRAME_BUS_H
+#define SPH_IPC_FRAME_BUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Shared memory frame bus.
+ *
+ * A bus distributes the frames of a single producer (e.g. a camera) to any number of consumers in
+ * other processes, so every consumer reads the same frame from shared memory instead of being
+ * sent its own copy. The instance that creates the bus publishes frames, all instances that open
+ * it read them.
+ *
+ * Frames are written into a small ring of slots. Every slot is protected by a sequence lock: the
+ * writer never waits for readers, readers copy a frame out of its slot and retry if the writer
+ * modified the slot meanwhile. Consumers always read the newest frame, a consumer which falls
+ * behind skips the frames it missed (see @ref next and @ref Stats).
+ *
+ * Readers waiting for a frame sleep on a futex in the segment, the writer only wakes them if
+ * somebody actually waits.
+ */
+class FrameBus {
+public:
+    /**
+     * @brief Frame metadata.
+     */
+    struct Frame {
+        /// Frame number, assigned by @ref publish, starting at 1.
+        uint64_t seq;
+        /// Capture time in nanoseconds, chosen by the producer.
+        int64_t timestamp;
+        /// Format of the image.
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint32_t fourcc;
+        /// Encoding of the data, see Seraphim::Types::Image2D::Compression.
+        uint32_t compression;
+        uint32_t reserved;
+        /// Size of the data in bytes.
+        uint64_t size;
+    };
+
+    /**
+     * @brief Reader statistics.
+     */
+    struct Stats {
+        /// Number of frames read by @ref next.
+        uint64_t frames;
+        /// Number of frames skipped because newer ones were available already.
+        uint64_t skipped;
+        /// Number of reads which were repeated because the writer modified the slot.
+        uint64_t retries;
+    };
+
+    /// Default number of frame slots.
+    static constexpr uint32_t DEFAULT_SLOTS = 4;
+
+    /// Maximum number of attempts to read a frame before giving up.
+    static constexpr unsigned int MAX_RETRIES = 16;
+
+    FrameBus() = default;
+
+    /**
+     * @brief Frame bus destructor.
+     *        Closes the bus for its readers and removes it if it was created by this instance.
+     */
+    ~FrameBus();
+
+    FrameBus(const FrameBus &) = delete;
+    FrameBus &operator=(const FrameBus &) = delete;
+
+    /**
+     * @brief Create a bus (writer).
+     * @param name The unique name of the shared memory segment.
+     * @param frame_size Maximum size of the data of a frame in bytes.
+     * @param slots Number of frame slots, at least two. Readers only have to retry if the writer
+     *              publishes this many frames while they are copying one.
+     * @return True on success, false otherwise.
+     */
+    bool create(const std::string &name, size_t frame_size, uint32_t slots = DEFAULT_SLOTS);
+
+    /**
+     * @brief Open a bus (reader).
+     * @param name The unique name of the shared memory segment.
+     * @return True on success, false otherwise.
+     */
+    bool open(const std::string &name);
+
+    /**
+     * @brief Unmap the bus. A writer closes it for all readers and removes the segment.
+     */
+    void close();
+
+    /**
+     * @brief Check whether the writer closed the bus, readers should open it again.
+     */
+    bool closed() const;
+
+    /**
+     * @brief Maximum size of the data of a frame in bytes.
+     */
+    size_t frame_size() const;
+
+    /**
+     * @brief Publish a frame (writer only).
+     *        Throws sph::InvalidArgumentException if the data is larger than the frame size.
+     * @param frame Frame metadata, the frame number is assigned.
+     * @param data Data of the frame, frame.size bytes.
+     * @return The frame number.
+     */
+    uint64_t publish(Frame &frame, const void *data);
+
+    /**
+     * @brief Get the number of the newest frame, 0 if there is none yet.
+     */
+    uint64_t latest() const;
+
+    /**
+     * @brief Read a frame.
+     *        This is safe to call from several threads at once.
+     * @param seq Frame number, 0 for the newest frame.
+     * @param frame Output parameter for the metadata of the frame.
+     * @param buffer Called with the metadata to get a destination for the data of the frame.
+     *               May be called again if the read has to be repeated.
+     * @return True on success, false if there is no such frame (anymore).
+     */
+    bool read(uint64_t seq, Frame &frame,
+              const std::function<unsigned char *(const Frame &)> &buffer) const;
+
+    /**
+     * @brief Wait for a frame newer than the last one returned and read the newest frame.
+     *        Throws sph::RuntimeException if the writer closed the bus.
+     * @param frame Output parameter for the metadata of the frame.
+     * @param data Output parameter for the data of the frame.
+     * @param timeout Maximum time to wait in milliseconds, negative values wait forever.
+     * @return True on success, false if the timeout expired.
+     */
+    bool next(Frame &frame, std::vector<unsigned char> &data, int timeout = -1);
+
+    /**
+     * @brief Get the reader statistics.
+     */
+    Stats stats() const { return m_stats; }
+
+    /**
+     * @brief Bus control structure at the beginning of the segment, followed by the slots.
+     */
+    struct Header {
+        /// Set once the bus is initialized, see @ref MAGIC.
+        std::atomic<uint32_t> magic;
+        /// Set by the writer when it closes the bus.
+        std::atomic<uint32_t> closed;
+        /// Number of slots.
+        uint32_t num_slots;
+        /// Number of readers waiting for a frame.
+        std::atomic<uint32_t> waiters;
+        /// Incremented for every frame, readers wait on it.
+        std::atomic<uint32_t> futex;
+        uint32_t reserved;
+        /// Offset of the first slot.
+        uint64_t slots;
+        /// Size of a slot including its data.
+        uint64_t slot_size;
+        /// Maximum size of the data of a frame.
+        uint64_t frame_size;
+        /// Number of the newest frame.
+        std::atomic<uint64_t> latest;
+    };
+
+    /**
+     * @brief Frame slot, followed by the data of the frame.
+     */
+    struct Slot {
+        /// Sequence lock, odd while the writer modifies the slot.
+        std::atomic<uint64_t> lock;
+        /// Metadata of the frame in the slot.
+        Frame frame;
+    };
+
+    /// Identifies initialized buses.
+    static constexpr uint32_t MAGIC = 0x53504846;
+
+private:
+    /**
+     * @brief Map the segment.
+     */
+    bool map(size_t size);
+
+    /**
+     * @brief Get a slot.
+     */
+    Slot &slot(uint64_t seq) const;
+
+    /**
+     * @brief Read a frame, see @ref read.
+     * @param retries Incremented for every repeated attempt.
+     */
+    bool copy(uint64_t seq, Frame &frame,
+              const std::function<unsigned char *(const Frame &)> &buffer,
+              uint64_t &retries) const;
+
+    /**
+     * @brief Wait until the futex word changes.
+     * @return False if the timeout expired.
+     */
+    bool wait(uint32_t value, int timeout) const;
+
+    /**
+     * @brief Wake up all waiting readers, the futex word must have been changed before.
+     */
+    void wake();
+
+    std::string m_name;
+    int m_fd = -1;
+    size_t m_size = 0;
+    bool m_created = false;
+
+    /// The mapped segment.
+    Header *m_header = nullptr;
+
+    /// Number of the frame which was returned by @ref next last.
+    uint64_t m_cursor = 0;
+    /// Reader statistics.
+    Stats m_stats = {};
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_FRAME_BUS_H
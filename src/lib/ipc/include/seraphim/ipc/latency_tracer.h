@@ -0,0 +1,201 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_LATENCY_TRACER_H
+#define SPH_IPC_LATENCY_TRACER_H
+
+#include <Seraphim.pb.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Histogram of durations.
+ *
+ * Values are counted in logarithmic buckets which are split into 16 linear sub-buckets each, so
+ * percentiles are accurate to about 6% no matter whether they are in the range of microseconds or
+ * seconds, while adding a value is constant time and the histogram has a fixed size.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Count a value, negative values are counted as 0.
+     * @param value Duration in nanoseconds.
+     */
+    void add(int64_t value);
+
+    /**
+     * @brief Number of values counted.
+     */
+    uint64_t count() const { return m_count; }
+
+    /**
+     * @brief Largest value counted.
+     */
+    int64_t max() const { return m_max; }
+
+    /**
+     * @brief Mean of the values counted.
+     */
+    int64_t mean() const { return m_count > 0 ? static_cast<int64_t>(m_sum / m_count) : 0; }
+
+    /**
+     * @brief Estimate a percentile.
+     * @param percent The percentile, e.g. 99.
+     * @return The upper bound of the bucket the percentile falls into, 0 if nothing was counted.
+     */
+    int64_t percentile(double percent) const;
+
+    /**
+     * @brief Add the values counted by another histogram, e.g. the one of another thread.
+     */
+    void merge(const LatencyHistogram &other);
+
+    /**
+     * @brief Forget all values.
+     */
+    void reset();
+
+private:
+    /// log2 of the number of sub-buckets per power of two
+    static constexpr unsigned int SUB_BITS = 4;
+    /// buckets needed to cover all positive 64 bit values
+    static constexpr size_t BUCKETS = (64 - SUB_BITS) << SUB_BITS;
+
+    static size_t bucket(uint64_t value);
+    static uint64_t upper_bound(size_t bucket);
+
+    std::array<uint64_t, BUCKETS> m_buckets = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    int64_t m_max = 0;
+};
+
+/**
+ * @brief Client side latency tracing.
+ *
+ * Requests are stamped with a trace (see Seraphim::Trace) which the server completes and returns
+ * with the response. Once the response arrives, the time of the request is broken down into
+ * stages and every stage is counted in its own histogram.
+ *
+ * The client and the server take their times from their own clocks. The offset between the clocks
+ * is estimated from the traces themselves like NTP does: the time the request spent on the wire
+ * is assumed to be split evenly between both directions, and of the last few traces the one with
+ * the shortest round trip is trusted most. This is accurate to half of that round trip, which is
+ * why the transport stages of peers on different hosts are estimates, while all other stages are
+ * measured by a single clock.
+ *
+ * This class is not thread safe.
+ */
+class LatencyTracer {
+public:
+    /**
+     * @brief Stages of a request.
+     */
+    enum Stage {
+        /// From the capture of the data to sending the request (copying, encoding, ...).
+        STAGE_CLIENT,
+        /// From sending the request to its arrival at the server.
+        STAGE_UPLINK,
+        /// Parsing the request on the server.
+        STAGE_PARSE,
+        /// Waiting for the service on the server.
+        STAGE_QUEUE,
+        /// Handling the request in the service.
+        STAGE_HANDLE,
+        /// From the response being ready to its arrival at the client.
+        STAGE_DOWNLINK,
+        /// From the capture of the data (or sending the request) to the arrival of the response.
+        STAGE_TOTAL,
+        STAGE_COUNT
+    };
+
+    /// Number of traces the clock offset is estimated from.
+    static constexpr size_t OFFSET_SAMPLES = 8;
+
+    /**
+     * @brief Client side latency tracing.
+     *        Trace ids start at a random value, so the traces of different clients differ.
+     */
+    LatencyTracer();
+
+    /**
+     * @brief Get the name of a stage.
+     */
+    static const char *name(Stage stage);
+
+    /**
+     * @brief Get the current time of the clock traces are based on.
+     * @return Time in nanoseconds.
+     */
+    static int64_t now();
+
+    /**
+     * @brief Add a trace to a request, must be called right before it is sent.
+     * @param msg The request.
+     * @param capture Capture time of the data the request is about (see @ref now), 0 if unknown.
+     */
+    void stamp(Seraphim::Message &msg, int64_t capture = 0);
+
+    /**
+     * @brief Count the stages of a request once its response arrived.
+     * @param msg The response.
+     * @param received Time at which the response arrived.
+     * @return True on success, false if the response carries no trace.
+     */
+    bool record(const Seraphim::Message &msg, int64_t received = now());
+
+    /**
+     * @brief Get the estimated offset of the server clock.
+     * @return Nanoseconds to add to a client time to get the corresponding server time.
+     */
+    int64_t clock_offset() const { return m_offset; }
+
+    /**
+     * @brief Get the histogram of a stage.
+     */
+    const LatencyHistogram &histogram(Stage stage) const { return m_histograms[stage]; }
+
+    /**
+     * @brief Forget all histograms, the clock offset estimation is kept.
+     */
+    void reset();
+
+private:
+    /**
+     * @brief Clock offset observed by a single trace.
+     */
+    struct Sample {
+        /// round trip time minus the time spent in the server
+        int64_t delay;
+        int64_t offset;
+    };
+
+    /**
+     * @brief Update the clock offset estimation.
+     */
+    void synchronize(const Seraphim::Trace &trace, int64_t received);
+
+    /// id of the next trace
+    uint64_t m_next_id;
+
+    /// the most recent samples, m_next_sample is the oldest one once all are used
+    std::array<Sample, OFFSET_SAMPLES> m_samples = {};
+    size_t m_num_samples = 0;
+    size_t m_next_sample = 0;
+    int64_t m_offset = 0;
+
+    std::array<LatencyHistogram, STAGE_COUNT> m_histograms;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_LATENCY_TRACER_H
@@ -0,0 +1,215 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_NET_IO_URING_H
+#define SPH_IPC_NET_IO_URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// defined in <linux/io_uring.h>, which is only included where the engine is implemented
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace sph {
+namespace ipc {
+namespace net {
+
+/**
+ * @brief Asynchronous socket I/O engine based on Linux io_uring.
+ *
+ * Operations are queued with the prep_* methods and handed to the kernel in batches, a single
+ * @ref submit call submits all queued operations and waits for completions at the same time.
+ * Sockets are read with multishot receive operations, which keep delivering data into a ring of
+ * buffers registered with the kernel (see @ref register_buffers) until they are cancelled, so
+ * receiving does not require any system call per read.
+ *
+ * The engine is only available if the library was built with io_uring support and the kernel
+ * supports all required features (multishot accept and receive, provided buffer rings, i.e.
+ * Linux 6.0 or newer), see @ref supported. Callers fall back to epoll otherwise.
+ *
+ * An instance must only be used by a single thread.
+ */
+class IOUring {
+public:
+    /**
+     * @brief Completion of an operation.
+     */
+    struct Completion {
+        /// user data of the operation
+        uint64_t user_data;
+        /// result of the operation, negative errno values indicate errors
+        int32_t res;
+        /// whether the (multishot) operation stays active and will complete again
+        bool more;
+        /// whether a registered buffer was used, see @ref buffer
+        bool has_buffer;
+        /// id of the registered buffer holding the received data
+        uint16_t buffer;
+    };
+
+    /**
+     * @brief Usage statistics.
+     */
+    struct Stats {
+        /// Number of io_uring_enter system calls.
+        uint64_t enters;
+        /// Number of operations submitted.
+        uint64_t submissions;
+        /// Number of completions reaped.
+        uint64_t completions;
+    };
+
+    IOUring() = default;
+    ~IOUring();
+
+    IOUring(const IOUring &) = delete;
+    IOUring &operator=(const IOUring &) = delete;
+
+    /**
+     * @brief Check whether the engine is available on this system.
+     *        The result is probed once and cached.
+     */
+    static bool supported();
+
+    /**
+     * @brief Set up the rings.
+     * @param entries Number of submission queue entries, the completion queue is larger since
+     *                multishot operations complete many times.
+     * @return True on success, false otherwise.
+     */
+    bool init(unsigned int entries = 256);
+
+    /**
+     * @brief Register a ring of buffers which receive operations pick from.
+     * @param count Number of buffers, must be a power of two.
+     * @param size Size of every buffer in bytes.
+     * @return True on success, false otherwise.
+     */
+    bool register_buffers(unsigned int count, size_t size);
+
+    /**
+     * @brief Get a registered buffer.
+     * @param id Buffer id, see @ref Completion::buffer.
+     */
+    const uint8_t *buffer(uint16_t id) const { return m_buffers.data() + id * m_buffer_size; }
+
+    /**
+     * @brief Return a registered buffer to the kernel once its data was consumed.
+     * @param id Buffer id, see @ref Completion::buffer.
+     */
+    void recycle(uint16_t id);
+
+    /**
+     * @brief Accept connections until cancelled. Every connection completes separately, the
+     *        result is the file descriptor of the new (non-blocking) socket.
+     */
+    void prep_accept(int fd, uint64_t user_data);
+
+    /**
+     * @brief Receive data into registered buffers until cancelled, the peer disconnects or the
+     *        buffers run out (-ENOBUFS). The result is the number of bytes received, 0 means the
+     *        peer disconnected.
+     */
+    void prep_recv(int fd, uint64_t user_data);
+
+    /**
+     * @brief Wait until a socket is ready for I/O.
+     * @param events Poll events, e.g. POLLOUT.
+     */
+    void prep_poll(int fd, short events, uint64_t user_data);
+
+    /**
+     * @brief Read from a file descriptor, e.g. an eventfd.
+     */
+    void prep_read(int fd, void *buf, size_t size, uint64_t user_data);
+
+    /**
+     * @brief Cancel all operations on a file descriptor.
+     */
+    void prep_cancel(int fd, uint64_t user_data);
+
+    /**
+     * @brief Cancel a single operation.
+     * @param target User data of the operation to cancel.
+     */
+    void prep_cancel_op(uint64_t target, uint64_t user_data);
+
+    /**
+     * @brief Submit queued operations and wait for completions with a single system call.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param wait Minimum number of completions to wait for.
+     * @param timeout Maximum time to wait in milliseconds.
+     */
+    void submit(unsigned int wait = 0, int timeout = 0);
+
+    /**
+     * @brief Take the next completion.
+     * @param completion Output parameter for the completion.
+     * @return True if there was a completion, false otherwise.
+     */
+    bool next(Completion &completion);
+
+    /**
+     * @brief Get the usage statistics.
+     */
+    Stats stats() const { return m_stats; }
+
+private:
+    /**
+     * @brief Get a free submission queue entry, submitting queued ones if the queue is full.
+     */
+    struct io_uring_sqe *sqe();
+
+    /// ring file descriptor
+    int m_fd = -1;
+
+    /// mapped rings
+    void *m_sq_ring = nullptr;
+    size_t m_sq_ring_size = 0;
+    void *m_cq_ring = nullptr;
+    size_t m_cq_ring_size = 0;
+    struct io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    /// submission queue
+    unsigned int *m_sq_head = nullptr;
+    unsigned int *m_sq_tail = nullptr;
+    unsigned int *m_sq_array = nullptr;
+    unsigned int m_sq_mask = 0;
+    unsigned int m_sq_entries = 0;
+    /// tail including the entries which were not submitted yet
+    unsigned int m_sq_local_tail = 0;
+    /// entries queued, but not submitted yet
+    unsigned int m_sq_queued = 0;
+
+    /// completion queue
+    unsigned int *m_cq_head = nullptr;
+    unsigned int *m_cq_tail = nullptr;
+    struct io_uring_cqe *m_cqes = nullptr;
+    unsigned int m_cq_mask = 0;
+
+    /// provided buffer ring and the buffers it refers to
+    struct io_uring_buf_ring *m_buffer_ring = nullptr;
+    size_t m_buffer_ring_size = 0;
+    std::vector<uint8_t> m_buffers;
+    size_t m_buffer_size = 0;
+    unsigned int m_buffer_count = 0;
+    /// tail of the buffer ring
+    uint16_t m_buffer_tail = 0;
+
+    /// statistics
+    Stats m_stats = {};
+};
+
+} // namespace net
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_NET_IO_URING_H
@@ -29,18 +29,18 @@ class Socket {
 public:
     /**
      * @brief Socket family.
-     *        At the moment, only internet sockets are supported.
      */
     enum class Family {
         /// IPv4
         INET,
         /// IPv6
-        INET6
+        INET6,
+        /// UNIX domain (local)
+        UNIX
     };
 
     /**
      * @brief Socket type.
-     *        TODO: Add UNIX sockets and friends.
      */
     enum class Type {
         /// Stream (connection)
@@ -57,7 +57,9 @@ public:
         /// Transmission Control Protocol
         TCP,
         /// User Datagram Protocol
-        UDP
+        UDP,
+        /// Default protocol of the family (e.g. for UNIX domain sockets)
+        DEFAULT
     };
 
     /**
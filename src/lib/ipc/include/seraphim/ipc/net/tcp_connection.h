@@ -0,0 +1,196 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_NET_TCP_CONNECTION_H
+#define SPH_IPC_NET_TCP_CONNECTION_H
+
+#include <Seraphim.pb.h>
+#include <cstdint>
+#include <vector>
+
+namespace sph {
+namespace ipc {
+namespace net {
+
+/**
+ * @brief Framed message stream on top of a connected TCP socket.
+ *
+ * Every message is preceded by a header holding its size, see @ref MessageHeader. Inbound data is
+ * read into a buffer which is reused for all messages, so a single read may yield several
+ * messages. Outbound messages are serialized into a second buffer and written together with their
+ * headers.
+ *
+ * All I/O operations return instead of blocking when the socket is in non-blocking mode, so a
+ * connection can be driven by an event loop (read when readable, flush when writable). On a
+ * blocking socket, they return false when the socket timeouts expire.
+ *
+ * A connection does not synchronize access. The receiving (@ref read, @ref next) and sending
+ * (@ref queue, @ref flush) state are independent though, so one thread may receive while another
+ * one sends.
+ */
+class TCPConnection {
+public:
+    /**
+     * @brief Message header.
+     *
+     * Used to bring the concept of message boundaries to TCP.
+     */
+    struct MessageHeader {
+        /// Transmission size
+        uint64_t size;
+    } __attribute__((packed));
+
+    /// Initial size of the receive buffer. Larger messages grow the buffer, which shrinks back to
+    /// this size once they were consumed.
+    static constexpr size_t RX_BUFFER_SIZE = 64 * 1024;
+
+    /// Default upper bound for the size of a single message.
+    static constexpr uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+    /// Size of the window through which @ref write streams a message.
+    static constexpr size_t STREAM_WINDOW = 1024 * 1024;
+
+    /**
+     * @brief Framed message stream.
+     * @param fd File descriptor of a connected socket. The connection does not take ownership.
+     */
+    explicit TCPConnection(int fd);
+
+    /**
+     * @brief File descriptor of the socket.
+     */
+    int fd() const { return m_fd; }
+
+    /**
+     * @brief Set the upper bound for the size of a single message.
+     *        Inbound messages which are larger are rejected before any memory is allocated for
+     *        them, outbound ones are never sent.
+     * @param size Maximum message size in bytes, must not exceed INT32_MAX.
+     */
+    void set_max_message_size(uint64_t size) { m_max_message_size = size; }
+
+    /**
+     * @brief Get the upper bound for the size of a single message.
+     */
+    uint64_t max_message_size() const { return m_max_message_size; }
+
+    /**
+     * @brief Get the current size of the receive buffer in bytes.
+     */
+    size_t rx_capacity() const { return m_rx_buffer.size(); }
+
+    /**
+     * @brief Read available data from the socket (a single read operation).
+     *        Throws sph::RuntimeException in case of errors or if the message being received is
+     *        too large.
+     *        Throws sph::ipc::PeerDisconnectedException when the peer disconnected.
+     * @return True if data was read, false if the read would block or timed out.
+     */
+    bool read();
+
+    /**
+     * @brief Add data which was received from the socket by other means, e.g. by an asynchronous
+     *        I/O engine, to the receive buffer.
+     *        Throws sph::RuntimeException if the message being received is too large.
+     * @param data Received data.
+     * @param size Size of the data in bytes.
+     */
+    void append(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Check whether a complete message has been buffered.
+     */
+    bool pending() const;
+
+    /**
+     * @brief Take the next message from the receive buffer.
+     *        Throws sph::RuntimeException if the message cannot be deserialized.
+     * @param msg The message, used as output parameter.
+     * @return True if a message was complete, false if more data must be read first.
+     */
+    bool next(Seraphim::Message &msg);
+
+    /**
+     * @brief Take the next serialized message from the receive buffer without parsing it.
+     * @param data Output parameter for the start of the message, valid until the next @ref read
+     *             or @ref append.
+     * @param size Output parameter for the size of the message in bytes.
+     * @return True if a message was complete, false if more data must be read first.
+     */
+    bool next(const uint8_t *&data, size_t &size);
+
+    /**
+     * @brief Serialize a message into the send buffer.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param msg The message.
+     */
+    void queue(const Seraphim::Message &msg);
+
+    /**
+     * @brief Write buffered messages to the socket.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::ipc::PeerDisconnectedException when the peer disconnected.
+     * @return True if the send buffer was written completely, false if the write would block or
+     *         timed out.
+     */
+    bool flush();
+
+    /**
+     * @brief Serialize a message directly to a blocking socket.
+     *        The message is written through a window of @ref STREAM_WINDOW bytes while it is
+     *        being serialized, so large messages are neither copied into the send buffer as a
+     *        whole nor does the peer have to wait for the serialization to finish. All queued
+     *        messages must have been written before.
+     *        Throws sph::RuntimeException in case of errors or if the socket timeout expires
+     *        after a part of the message was written, the stream is out of sync then.
+     *        Throws sph::ipc::PeerDisconnectedException when the peer disconnected.
+     * @param msg The message.
+     * @return True if the message was written, false if the timeout expired before anything was
+     *         written.
+     */
+    bool write(const Seraphim::Message &msg);
+
+    /**
+     * @brief Check whether all queued messages have been written.
+     */
+    bool flushed() const { return m_tx_begin == m_tx_end; }
+
+    /**
+     * @brief Get the number of queued bytes which have not been written yet.
+     */
+    size_t unsent() const { return m_tx_end - m_tx_begin; }
+
+private:
+    /**
+     * @brief Make room for at least size more bytes and for the whole message which is currently
+     *        being received. A buffer which was grown for a large message is shrunk again once
+     *        the message was consumed.
+     */
+    void reserve(size_t size);
+
+    /// socket file descriptor
+    int m_fd;
+
+    /// upper bound for the size of a single message
+    uint64_t m_max_message_size = MAX_MESSAGE_SIZE;
+
+    /// buffered inbound data, [m_rx_begin, m_rx_end) has not been consumed yet
+    std::vector<uint8_t> m_rx_buffer;
+    size_t m_rx_begin = 0;
+    size_t m_rx_end = 0;
+
+    /// buffered outbound data, [m_tx_begin, m_tx_end) has not been written yet
+    std::vector<uint8_t> m_tx_buffer;
+    size_t m_tx_begin = 0;
+    size_t m_tx_end = 0;
+};
+
+} // namespace net
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_NET_TCP_CONNECTION_H
@@ -29,6 +29,35 @@ class TCPSocket : public Socket {
 public:
     explicit TCPSocket(Family family);
 
+    /**
+     * @brief Connect to another socket.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException if the connection could not be established in time.
+     * @param ipaddr The IPv4 or IPv6 address.
+     * @param port The port number, must be a value between 0 and 65535.
+     * @param timeout Timeout in seconds, 0 blocks until the connection is established.
+     * @return True on success, false otherwise.
+     */
+    bool connect(const std::string &ipaddr, uint16_t port, int timeout = 0);
+
+    /**
+     * @brief Enable or disable Nagle's algorithm.
+     *        When disabled (which is the default), small segments such as message headers are
+     *        sent right away instead of being delayed until outstanding data is acknowledged.
+     *        The setting also applies to connections returned by @ref accept.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param enable Whether to send segments immediately.
+     */
+    void set_nodelay(bool enable);
+
+    /**
+     * @brief Apply the Nagle setting to a connection which was accepted by other means than
+     *        @ref accept, e.g. by io_uring.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param fd File descriptor of the connected peer.
+     */
+    void apply_nodelay(int fd) const;
+
     /**
      * @brief Listen for incoming connection requests.
      *        Throws sph::RuntimeException when the OS socket op fails.
@@ -41,9 +70,11 @@ public:
      *        Throws sph::RuntimeException when the OS socket op fails.
      * @param addr OS socket address.
      * @param addrlen OS socket address length (differs between IPv4 and IPv6).
-     * @return File descriptor of the connected peer.
+     * @param flags Flags for the new socket (e.g. SOCK_NONBLOCK), see accept4().
+     * @return File descriptor of the connected peer or -1 if the socket is non-blocking and no
+     *         connection is pending.
      */
-    int accept(struct sockaddr *addr, socklen_t *addrlen);
+    int accept(struct sockaddr *addr, socklen_t *addrlen, int flags = 0);
 
     using Socket::receive;
     using Socket::receive_msg;
@@ -91,12 +122,17 @@ public:
      * @brief Scattering (vectored transmission) of data.
      *        Throws sph::RuntimeException when the OS socket connection fails.
      *        Throws sph::TimeoutException when the OS socket connection times out.
+     *        Throws sph::ipc::PeerDisconnectedException when a peer disconnects.
      * @param fd Peer file descriptor.
      * @param msg Message structure.
      * @param flags OS socket flags.
      * @return Number of bytes sent.
      */
     ssize_t send_msg(int fd, struct msghdr *msg, int flags = 0);
+
+private:
+    /// Whether Nagle's algorithm is disabled
+    bool m_nodelay = true;
 };
 
 } // namespace net
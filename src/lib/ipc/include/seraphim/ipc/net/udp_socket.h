@@ -11,6 +11,7 @@
 #include <arpa/inet.h>
 #include <cstdint>
 #include <string>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <vector>
 
@@ -28,6 +29,44 @@ namespace net {
 class UDPSocket : public Socket {
 public:
     explicit UDPSocket(Family family);
+
+    /**
+     * @brief Set the size of the kernel receive buffer.
+     *        Datagrams which arrive while the buffer is full are dropped, so peers sending large
+     *        bursts require larger buffers. The kernel caps the value (net.core.rmem_max).
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param bytes Buffer size in bytes.
+     */
+    void set_rx_buffer_size(int bytes);
+
+    /**
+     * @brief Set the size of the kernel send buffer.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param bytes Buffer size in bytes.
+     */
+    void set_tx_buffer_size(int bytes);
+
+    /**
+     * @brief Receive multiple datagrams with a single system call.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     *        Throws sph::TimeoutException when the OS socket op times out.
+     * @param msgs Message structures, one per datagram.
+     * @param vlen Number of message structures.
+     * @param flags OS socket flags (e.g. MSG_WAITFORONE).
+     * @return Number of datagrams received.
+     */
+    int receive_mmsg(struct mmsghdr *msgs, unsigned int vlen, int flags = 0);
+
+    /**
+     * @brief Send multiple datagrams with a single system call.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     *        Throws sph::TimeoutException when the OS socket op times out.
+     * @param msgs Message structures, one per datagram.
+     * @param vlen Number of message structures.
+     * @param flags OS socket flags.
+     * @return Number of datagrams sent, may be less than vlen.
+     */
+    int send_mmsg(struct mmsghdr *msgs, unsigned int vlen, int flags = 0);
 };
 
 } // namespace net
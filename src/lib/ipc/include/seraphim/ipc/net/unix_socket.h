@@ -0,0 +1,118 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_NET_UNIX_SOCKET_H
+#define SPH_IPC_NET_UNIX_SOCKET_H
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "socket.h"
+
+namespace sph {
+namespace ipc {
+namespace net {
+
+/**
+ * @brief UNIX domain stream socket.
+ *
+ * Allows for reliable inter-process communication on the local host. Unlike network sockets, UNIX
+ * domain sockets can pass file descriptors to peers (see SCM_RIGHTS).
+ */
+class UnixSocket : public Socket {
+public:
+    UnixSocket();
+
+    /**
+     * @brief Cleanup the socket, removing the socket file if it was bound.
+     */
+    ~UnixSocket();
+
+    /**
+     * @brief Bind to a path in the file system.
+     *        A stale socket file at the path is removed.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param path The socket file path.
+     * @return True on success, false otherwise.
+     */
+    bool bind(const std::string &path);
+
+    /**
+     * @brief Connect to a socket bound to a path.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param path The socket file path.
+     * @return True on success, false otherwise.
+     */
+    bool connect(const std::string &path);
+
+    /**
+     * @brief Listen for incoming connection requests.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param backlog Number of pending connections allowed.
+     */
+    void listen(int backlog);
+
+    /**
+     * @brief Accept incoming connection requests.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @return File descriptor of the connected peer.
+     */
+    int accept();
+
+    using Socket::receive;
+    using Socket::receive_msg;
+    using Socket::send;
+    using Socket::send_msg;
+
+    /**
+     * @brief Receive an arbitrary number of bytes.
+     *        Throws sph::RuntimeException when the OS socket connection fails.
+     *        Throws sph::TimeoutException when the OS socket connection times out.
+     *        Throws sph::ipc::PeerDisconnectedException when a peer disconnects.
+     * @param fd Peer file descriptor.
+     * @param buf Output buffer.
+     * @param max_len Maximum number of bytes to receive.
+     * @param flags OS socket flags.
+     * @return Number of bytes received.
+     */
+    ssize_t receive(int fd, void *buf, size_t max_len, int flags = 0);
+
+    /**
+     * @brief Gathering (vectored receival) of data and ancillary data such as file descriptors.
+     *        Throws sph::RuntimeException when the OS socket connection fails.
+     *        Throws sph::TimeoutException when the OS socket connection times out.
+     *        Throws sph::ipc::PeerDisconnectedException when a peer disconnects.
+     * @param fd Peer file descriptor.
+     * @param msg Message structure.
+     * @param flags OS socket flags.
+     * @return Number of bytes received.
+     */
+    ssize_t receive_msg(int fd, struct msghdr *msg, int flags = 0);
+
+    /**
+     * @brief Scattering (vectored transmission) of data and ancillary data such as file
+     *        descriptors.
+     *        Throws sph::RuntimeException when the OS socket connection fails.
+     *        Throws sph::TimeoutException when the OS socket connection times out.
+     * @param fd Peer file descriptor.
+     * @param msg Message structure.
+     * @param flags OS socket flags.
+     * @return Number of bytes sent.
+     */
+    ssize_t send_msg(int fd, struct msghdr *msg, int flags = 0);
+
+private:
+    /// Path of the socket file if the socket is bound
+    std::string m_path;
+};
+
+} // namespace net
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_NET_UNIX_SOCKET_H
@@ -0,0 +1,102 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_PACKED_GEOMETRY_H
+#define SPH_IPC_PACKED_GEOMETRY_H
+
+#include <Types.pb.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Append a region to its packed encoding, see Seraphim::Types::PackedRegions2D.
+ */
+void add_region(Seraphim::Types::PackedRegions2D &regions, int32_t x, int32_t y, int32_t w,
+                int32_t h);
+
+/**
+ * @brief Append a point set to its packed encoding, see Seraphim::Types::PackedPointSets2D.
+ * @param points Container of points with x and y members, e.g. std::vector<cv::Point>.
+ */
+template <class Points>
+void add_point_set(Seraphim::Types::PackedPointSets2D &sets, const Points &points) {
+    // differences wrap around like the sums of the decoder do, so no value overflows
+    uint32_t x = 0;
+    uint32_t y = 0;
+
+    sets.add_sizes(static_cast<uint32_t>(points.size()));
+    sets.mutable_coords()->Reserve(sets.coords_size() + 2 * static_cast<int>(points.size()));
+    for (const auto &point : points) {
+        sets.add_coords(static_cast<int32_t>(static_cast<uint32_t>(point.x) - x));
+        sets.add_coords(static_cast<int32_t>(static_cast<uint32_t>(point.y) - y));
+        x = static_cast<uint32_t>(point.x);
+        y = static_cast<uint32_t>(point.y);
+    }
+}
+
+/**
+ * @brief Check whether a packed encoding is complete, i.e. has four values per region.
+ */
+bool is_valid(const Seraphim::Types::PackedRegions2D &regions);
+
+/**
+ * @brief Check whether a packed encoding is complete, i.e. has as many points as its sets claim.
+ */
+bool is_valid(const Seraphim::Types::PackedPointSets2D &sets);
+
+/**
+ * @brief Decode packed regions.
+ * @param fn Called as fn(x, y, w, h) for every region in order.
+ * @return True on success, false if the encoding is not valid (nothing is decoded then).
+ */
+template <class Fn> bool unpack_regions(const Seraphim::Types::PackedRegions2D &regions, Fn fn) {
+    if (!is_valid(regions)) {
+        return false;
+    }
+
+    for (int i = 0; i < regions.values_size(); i += 4) {
+        fn(regions.values(i), regions.values(i + 1), regions.values(i + 2),
+           regions.values(i + 3));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Decode packed point sets.
+ * @param fn Called as fn(set, x, y) for every point in order, where set is the index of the set
+ *           the point belongs to.
+ * @return True on success, false if the encoding is not valid (nothing is decoded then).
+ */
+template <class Fn> bool unpack_point_sets(const Seraphim::Types::PackedPointSets2D &sets, Fn fn) {
+    int coord = 0;
+
+    if (!is_valid(sets)) {
+        return false;
+    }
+
+    for (int set = 0; set < sets.sizes_size(); set++) {
+        uint32_t x = 0;
+        uint32_t y = 0;
+
+        for (uint32_t i = 0; i < sets.sizes(set); i++) {
+            x += static_cast<uint32_t>(sets.coords(coord++));
+            y += static_cast<uint32_t>(sets.coords(coord++));
+            fn(static_cast<size_t>(set), static_cast<int32_t>(x), static_cast<int32_t>(y));
+        }
+    }
+
+    return true;
+}
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_PACKED_GEOMETRY_H
@@ -0,0 +1,121 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_REQUEST_VIEW_H
+#define SPH_IPC_REQUEST_VIEW_H
+
+#include <Seraphim.pb.h>
+#include <cstddef>
+#include <cstdint>
+#include <google/protobuf/message.h>
+#include <string>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Compute the compact type id of a message type.
+ *        The id is the 32 bit FNV-1a hash of the full message name, e.g.
+ *        "Seraphim.Face.FaceDetector.DetectionRequest".
+ * @param full_name Full name of the message type.
+ * @return The type id.
+ */
+uint32_t type_id(const std::string &full_name);
+
+/**
+ * @brief Pack a request in the compact format (see Seraphim::Request::type).
+ *        Servers do not have to compare type URLs and parse the payload exactly once.
+ * @param inner The "real" request.
+ * @param req The request, used as output parameter.
+ */
+void pack_request(const google::protobuf::Message &inner, Seraphim::Request &req);
+
+/**
+ * @brief Read-only view of a request.
+ *
+ * Locates the type and the payload of a request in a serialized Seraphim::Message without
+ * copying anything, so the payload can be parsed exactly once, directly from the receive buffer.
+ * Requests in the compact format as well as requests packed into google.protobuf.Any are
+ * understood.
+ *
+ * The view points into the parsed data and becomes invalid together with it.
+ */
+class RequestView {
+public:
+    /**
+     * @brief Parse a serialized Seraphim::Message.
+     * @param data Start of the serialized message.
+     * @param size Size in bytes.
+     * @return True on success, false if the data is malformed.
+     */
+    bool parse(const void *data, size_t size);
+
+    /**
+     * @brief View a message which was parsed already.
+     * @param msg The message.
+     */
+    void parse(const Seraphim::Message &msg);
+
+    /// Message id.
+    uint32_t id() const { return m_id; }
+
+    /// Whether the message is a request.
+    bool is_request() const { return m_request; }
+
+    /// Type id of the request payload, see @ref type_id.
+    uint32_t type() const { return m_type; }
+
+    /// Start of the serialized request payload.
+    const uint8_t *payload() const { return m_payload; }
+
+    /// Size of the serialized request payload in bytes.
+    size_t payload_size() const { return m_payload_size; }
+
+    /// Key of the requests this one supersedes, see Seraphim::Request::supersede.
+    uint32_t supersede() const { return m_supersede; }
+
+    /// Deadline in milliseconds, see Seraphim::Request::deadline.
+    uint32_t deadline() const { return m_deadline; }
+
+    /// Whether the message carries a trace, see Seraphim::Trace.
+    bool has_trace() const { return m_trace || m_trace_data; }
+
+    /**
+     * @brief Get the trace of the message.
+     * @param trace Output parameter for the trace.
+     * @return True on success, false if the message does not carry a (valid) trace.
+     */
+    bool trace(Seraphim::Trace &trace) const;
+
+private:
+    /**
+     * @brief Parse a serialized Seraphim::Request.
+     */
+    bool parse_request(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Parse a serialized google.protobuf.Any.
+     */
+    bool parse_any(const uint8_t *data, size_t size);
+
+    uint32_t m_id = 0;
+    bool m_request = false;
+    uint32_t m_type = 0;
+    const uint8_t *m_payload = nullptr;
+    size_t m_payload_size = 0;
+    uint32_t m_supersede = 0;
+    uint32_t m_deadline = 0;
+    /// the trace, either still serialized or as part of a parsed message
+    const uint8_t *m_trace_data = nullptr;
+    size_t m_trace_size = 0;
+    const Seraphim::Trace *m_trace = nullptr;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_REQUEST_VIEW_H
@@ -0,0 +1,214 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_RING_BUFFER_H
+#define SPH_IPC_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <seraphim/ipc/semaphore.h>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Single producer, single consumer message queue.
+ *
+ * The queue lives in a caller provided memory area (usually a shared memory segment) and holds up
+ * to depth variable-length messages. Messages are kept in a ring of descriptors pointing into a
+ * circular data area, so every message is stored contiguously and can be serialized and parsed in
+ * place.
+ *
+ * Producer and consumer positions are lock-free atomics. The two sides only block on
+ * process-shared semaphores when the queue is full or empty, so there is no polling involved.
+ *
+ * At most one thread (or process) may act as producer and one as consumer at any time.
+ */
+class RingBuffer {
+public:
+    /**
+     * @brief Location of a message in the data area.
+     */
+    struct Descriptor {
+        /// Offset of the message, relative to the start of the data area.
+        uint64_t offset;
+        /// Size of the message in bytes.
+        uint64_t size;
+    };
+
+    /**
+     * @brief Control block at the beginning of the memory area.
+     *
+     * It is followed by depth descriptors and the data area.
+     */
+    struct Header {
+        /// Sequence number of the next message to be read (consumer owned).
+        std::atomic<uint64_t> head;
+        /// Sequence number of the next message to be written (producer owned).
+        std::atomic<uint64_t> tail;
+        /// Whether the producer waits for free space, see @ref Waiting.
+        std::atomic<uint32_t> producer_waiting;
+        /// Maximum number of messages in the queue.
+        uint32_t depth;
+        /// Size of the data area in bytes.
+        uint64_t capacity;
+        /// End of the last message that was written (producer owned).
+        uint64_t write_offset;
+        /// Number of messages available for reading.
+        sem_t items;
+        /// Signalled by the consumer when the producer is waiting for free space.
+        sem_t space;
+    };
+
+    /**
+     * @brief How the producer waits for free space.
+     */
+    enum Waiting : uint32_t {
+        /// The producer does not wait.
+        WAITING_NONE = 0,
+        /// The producer is blocked in @ref reserve and woken up by the consumer.
+        WAITING_BLOCKED,
+        /// The producer gave up in @ref try_reserve and is told about free space by whoever
+        /// calls @ref pop.
+        WAITING_POLLING
+    };
+
+    RingBuffer() = default;
+
+    // the instance refers to memory it does not own
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    /**
+     * @brief Number of bytes required to hold a queue.
+     * @param depth Maximum number of messages.
+     * @param capacity Size of the data area in bytes.
+     * @return Size of the memory area in bytes.
+     */
+    static size_t footprint(uint32_t depth, size_t capacity);
+
+    /**
+     * @brief Initialize a new queue.
+     * @param addr Start of the memory area, must be 8 byte aligned.
+     * @param size Size of the memory area, see @ref footprint.
+     * @param depth Maximum number of messages.
+     * @return True on success, false otherwise.
+     */
+    bool create(void *addr, size_t size, uint32_t depth);
+
+    /**
+     * @brief Attach to a queue that was initialized by @ref create.
+     * @param addr Start of the memory area.
+     * @return True on success, false otherwise.
+     */
+    bool open(void *addr);
+
+    /**
+     * @brief Maximum size of a single message.
+     * @return Size in bytes.
+     */
+    size_t capacity() const { return m_header ? m_header->capacity : 0; }
+
+    /**
+     * @brief Check whether there are messages waiting to be read (consumer).
+     * @return True if the queue is empty, false otherwise.
+     */
+    bool empty() const {
+        return !m_header || m_header->head.load(std::memory_order_relaxed) ==
+                                m_header->tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Reserve space for a message (producer).
+     *        Blocks until enough space is available.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param size Message size in bytes.
+     * @param timeout Timeout in milliseconds, 0 means blocking.
+     * @return Start of the message area. The message is published by @ref commit.
+     */
+    unsigned char *reserve(size_t size, int timeout = 0);
+
+    /**
+     * @brief Reserve space for a message without waiting for it (producer).
+     *        If there is not enough space, the next @ref pop reports that the producer waits.
+     *        Throws sph::RuntimeException if the message is larger than the data area.
+     * @param size Message size in bytes.
+     * @return Start of the message area or nullptr if the queue is full.
+     */
+    unsigned char *try_reserve(size_t size);
+
+    /**
+     * @brief Check whether the producer gave up in @ref try_reserve and no message was removed
+     *        since (producer).
+     */
+    bool producer_polling() const {
+        return m_header && m_header->producer_waiting.load() == WAITING_POLLING;
+    }
+
+    /**
+     * @brief Publish the message written to the area returned by @ref reserve (producer).
+     * @param size Actual message size, must not exceed the reserved size.
+     */
+    void commit(size_t size);
+
+    /**
+     * @brief Access the oldest message in the queue (consumer).
+     *        Blocks until a message is available. Calling it again before @ref pop returns the
+     *        same message without waiting.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts or if @ref interrupt was called.
+     * @param size Output parameter for the message size.
+     * @param timeout Timeout in milliseconds, 0 means blocking.
+     * @return Start of the message. It stays valid until @ref pop is called.
+     */
+    const unsigned char *front(size_t &size, int timeout = 0);
+
+    /**
+     * @brief Remove the oldest message from the queue and release its space (consumer).
+     * @return True if the producer gave up in @ref try_reserve and should be told that there is
+     *         space now, false otherwise.
+     */
+    bool pop();
+
+    /**
+     * @brief Wake up a consumer blocking in @ref front.
+     */
+    void interrupt();
+
+private:
+    /**
+     * @brief Find a contiguous free region in the data area.
+     * @param size Aligned size of the region.
+     * @param head Consumer position as seen by the producer.
+     * @return Offset of the region or UINT64_MAX if there is no space.
+     */
+    uint64_t allocate(uint64_t size, uint64_t head) const;
+
+    Header *m_header = nullptr;
+    Descriptor *m_descriptors = nullptr;
+    unsigned char *m_data = nullptr;
+
+    Semaphore m_items;
+    Semaphore m_space;
+
+    /// Offset of the last region handed out by @ref reserve.
+    uint64_t m_reserved = 0;
+
+    /// Whether the oldest message was handed out by @ref front and not popped yet.
+    bool m_acquired = false;
+
+    /// Set by @ref interrupt to abort a blocking @ref front.
+    std::atomic<bool> m_interrupted{ false };
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_RING_BUFFER_H
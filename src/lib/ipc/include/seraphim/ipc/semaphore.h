@@ -8,6 +8,7 @@
 #ifndef SPH_IPC_SHM_SHIM
 #define SPH_IPC_SHM_SHIM
 
+#include <chrono>
 #include <fcntl.h>
 #include <string>
 #if defined(__APPLE__) || defined(__unix__)
@@ -96,6 +97,14 @@ public:
      */
     bool trywait();
 
+    /**
+     * @brief POSIX sem_timedwait.
+     *        Interrupted waits (EINTR) are restarted with the same deadline.
+     * @param deadline Point in time at which to give up waiting.
+     * @return True on success, false otherwise (errno is set to ETIMEDOUT if the deadline passed).
+     */
+    bool wait_until(const std::chrono::steady_clock::time_point &deadline);
+
     /**
      * @brief POSIX sem_post.
      * @return True on success, false otherwise.
@@ -8,12 +8,19 @@
 #ifndef SPH_IPC_SHM_TRANSPORT_H
 #define SPH_IPC_SHM_TRANSPORT_H
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <fcntl.h>
-#include <queue>
+#include <functional>
+#include <memory>
 #include <string>
 #include <sys/mman.h>
+#include <vector>
 
 #include "transport.h"
+#include <seraphim/ipc/ring_buffer.h>
 #include <seraphim/ipc/semaphore.h>
 
 namespace sph {
@@ -22,8 +29,31 @@ namespace ipc {
 /**
  * @brief Shared memory message transport.
  *
- * This class uses POSIX shared memory to exchange messages between two or more readers and
- * writers. At the moment, it behaves like a very simple bidirectional pipe.
+ * This class uses POSIX shared memory to exchange messages between a server and its clients. The
+ * instance that creates the segment acts as server, all instances that open it act as clients.
+ *
+ * The segment is divided into a fixed number of channels. Every client claims a free channel when
+ * it opens the segment and releases it again when it is destroyed. A channel consists of a request
+ * and a response queue (see @ref RingBuffer), so a client may send several requests before reading
+ * the first response and clients never see each other's messages.
+ *
+ * Readers and writers block on process-shared semaphores that live inside the segment, so a
+ * message is handed over as soon as it is written and idle peers do not consume any CPU time.
+ *
+ * Every channel also owns a frame area. Clients may place large payloads such as image data there
+ * (see @ref acquire_buffer) and reference them from their messages instead of copying them into
+ * the message. The server registers the frame area of every channel with the @ref BufferRegistry
+ * under the name of the segment and the peer of the channel (see @ref peer), so message handlers
+ * can access those payloads in place, but only on behalf of the client which owns them.
+ *
+ * Messages larger than a queue are streamed through it in chunks (see @ref ChunkWriter), so the
+ * size of the segment does not limit the size of messages. Clients parse such responses while
+ * they are still being written. The server assembles such requests from the chunks which arrived
+ * whenever it polls, so a client which is slow to write its chunks does not hold up the others.
+ * A request is reported once it is complete.
+ *
+ * Segments carrying large frames can be backed by huge pages, pre-faulted and placed on a NUMA
+ * node (see @ref Options), so serving requests neither causes page faults nor TLB thrashing.
  */
 class SharedMemoryTransport : public Transport {
 public:
@@ -40,9 +70,9 @@ public:
     ~SharedMemoryTransport() override;
 
     /**
-     * @brief Open a shared memory region by name.
+     * @brief Open a shared memory region by name and claim a channel (client).
      * @param name The unique name of the file.
-     * @return true on success, false otherwise.
+     * @return true on success, false otherwise (e.g. if all channels are in use).
      */
     bool open(const std::string &name);
 
@@ -53,15 +83,50 @@ public:
     bool close();
 
     /**
-     * @brief Create a shared memory region.
+     * @brief Huge page usage of a segment.
+     */
+    enum class HugePages {
+        /// Regular pages.
+        NONE,
+        /// Ask the kernel to use transparent huge pages where possible (best effort).
+        TRANSPARENT,
+        /// Place the segment on the hugetlbfs mount (see @ref HUGETLBFS), which requires huge
+        /// pages to be reserved. The size is rounded up to a multiple of the huge page size.
+        HUGETLBFS
+    };
+
+    /**
+     * @brief Memory placement of a segment.
+     */
+    struct Options {
+        /// Huge page usage.
+        HugePages huge_pages = HugePages::NONE;
+        /// Fault in the whole segment when mapping it, clients do the same when opening it.
+        bool populate = false;
+        /// NUMA node to allocate the segment on, negative values leave it to the kernel.
+        int numa_node = -1;
+    };
+
+    /**
+     * @brief Create a shared memory region (server).
      * @param name The unique name of the file to be created.
      * @param size The size of the memory region.
+     * @param depth Maximum number of in-flight messages per direction and client.
+     * @param channels Maximum number of simultaneously connected clients.
      * @return true on success, false otherwise.
      */
-    bool create(const std::string &name, long size);
+    bool create(const std::string &name, long size, uint32_t depth = DEFAULT_DEPTH,
+                uint32_t channels = DEFAULT_CHANNELS);
+
+    /**
+     * @brief Create a shared memory region with the given memory placement (server).
+     * @param options Memory placement, the segment is not created if it cannot be applied.
+     */
+    bool create(const std::string &name, long size, uint32_t depth, uint32_t channels,
+                const Options &options);
 
     /**
-     * @brief Remove the shared memory region created by this instance.
+     * @brief Close and remove the shared memory region created by this instance.
      * @return true on success, false otherwise.
      */
     bool remove();
@@ -69,60 +134,215 @@ public:
     void set_rx_timeout(int ms) override { m_rx_timeout = ms; }
     void set_tx_timeout(int ms) override { m_tx_timeout = ms; }
 
+    /**
+     * @brief Set the upper bound for the size of a request which is streamed in chunks (server
+     *        only). Requests are assembled before they are handed out, so larger ones are skipped
+     *        instead, see @ref receive.
+     * @param size Maximum request size in bytes.
+     */
+    void set_max_message_size(uint64_t size) { m_max_message_size = size; }
+
+    /**
+     * @brief Receive a message.
+     *        Clients receive the next response on their channel.
+     *        The server receives the next request of any client, the response is then sent to that
+     *        client by @ref send.
+     */
     void receive(Seraphim::Message &msg) override;
     void send(const Seraphim::Message &msg) override;
 
     /**
-     * @brief Actors perform read/write operations within the shared memory segment (MessageStore).
+     * @brief Events reported by @ref poll.
      */
-    struct MessageStoreActors {
-        /// The current number of active actors.
-        /// An actor must increase this number when opening the message store and decrease it
-        /// once he wishes to no longer use it (aka close it).
-        unsigned int num_actors = 1;
-        /// Resource locking for the @ref num_actors field. Must be acquired before any operation
-        /// is performed on the field.
-        sem_t sem;
+    enum ChannelEvent {
+        /// A client claimed the channel.
+        CHANNEL_CONNECTED,
+        /// A client released the channel or died, its messages were discarded.
+        CHANNEL_DISCONNECTED,
+        /// A request is waiting to be received on the channel.
+        CHANNEL_REQUEST,
+        /// The client made room for the response @ref try_send could not send.
+        CHANNEL_WRITABLE
     };
 
     /**
-     * @brief Message type.
+     * @brief Wait for client activity (server only).
+     *        Channels with pending requests are reported in round-robin order, so a busy client
+     *        cannot starve the others. Requests streamed in chunks are reported once all of their
+     *        chunks arrived, the chunks which are available are consumed without waiting for the
+     *        rest. Requests of paused channels are not reported, see @ref pause.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts or if @ref interrupt was called.
+     * @param channel Output parameter for the channel the event belongs to.
+     * @return The event.
+     */
+    ChannelEvent poll(unsigned int &channel);
+
+    /**
+     * @brief Stop or resume reporting the requests of a channel (server only).
+     *        Requests of a paused channel stay in its queue, so a client which sends more than
+     *        the server is willing to process runs out of room and has to wait. Channels are
+     *        resumed when their client disconnects.
+     * @param channel The channel of the client.
+     * @param paused Whether to stop reporting the requests of the channel.
+     */
+    void pause(unsigned int channel, bool paused);
+
+    /**
+     * @brief Get the peer under which the frame area of a channel is registered with the
+     *        @ref BufferRegistry (server only).
+     *        Every client of a channel gets a new peer, which also tells it apart from the
+     *        previous clients of the channel.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param channel The channel of the client.
+     * @return The peer.
+     */
+    uint64_t peer(unsigned int channel) const;
+
+    /**
+     * @brief Receive a request from a client (server only).
+     *        Requests which were not reported by @ref poll may have to wait for their chunks.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param channel The channel of the client.
+     * @param msg The message, used as output parameter.
+     */
+    void receive(unsigned int channel, Seraphim::Message &msg);
+
+    /**
+     * @brief Receive a serialized request from a client without deserializing it (server only).
+     *        The request is handed to a callback while it is still in the queue, so it can be
+     *        parsed in place. Requests streamed in chunks are assembled first, unless they are
+     *        larger than the limit (see @ref set_max_message_size) or their chunks do not add up
+     *        to their size: their chunks are skipped and the callback gets a message with the id
+     *        of the request only, so the server answers it with a failure. Requests which were
+     *        not reported by @ref poll may have to wait for their chunks.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param channel The channel of the client.
+     * @param consume Called with the serialized request, the data is only valid during the call.
+     */
+    void receive(unsigned int channel,
+                 const std::function<void(const unsigned char *data, size_t size)> &consume);
+
+    /**
+     * @brief Send a response to a client (server only).
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param channel The channel of the client.
+     * @param msg The message.
+     */
+    void send(unsigned int channel, const Seraphim::Message &msg);
+
+    /**
+     * @brief Send a response to a client without waiting for it to make room (server only).
+     *        Once the client read a response, @ref poll reports the channel as writable.
+     *        Responses larger than the queue are streamed in chunks, which waits like @ref send.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param channel The channel of the client.
+     * @param msg The message.
+     * @return True if the response was sent, false if the queue of the client is full.
+     */
+    bool try_send(unsigned int channel, const Seraphim::Message &msg);
+
+    /**
+     * @brief Acquire a buffer in the frame area of the channel (client only).
+     *        Space of a buffer is only reused once all buffers acquired before it have been
+     *        released as well, so buffers should be released in the order they were acquired.
+     */
+    unsigned char *acquire_buffer(size_t size, Seraphim::Types::BufferRef &ref) override;
+    void release_buffer(const Seraphim::Types::BufferRef &ref) override;
+
+    /**
+     * @brief Wake up a thread blocking in @ref receive or @ref poll.
+     *        The interrupted call throws sph::TimeoutException.
+     *        This is safe to call from any thread, even while another thread holds the
+     *        synchronization lock of this instance.
+     */
+    void interrupt();
+
+    /// Default number of in-flight messages per direction.
+    static constexpr uint32_t DEFAULT_DEPTH = 4;
+
+    /// Default number of client channels.
+    static constexpr uint32_t DEFAULT_CHANNELS = 4;
+
+    /// Mount point of hugetlbfs, where segments backed by huge pages are placed.
+    static constexpr const char *HUGETLBFS = "/dev/hugepages";
+
+    /**
+     * @brief Get the NUMA node of the CPU the calling thread runs on.
+     * @return The node, -1 if it is unknown.
      */
-    enum MessageStoreType {
-        MESSAGE_TYPE_UNKNOWN = 0,
-        /// Corresponds to a Seraphim::Message request instance.
-        MESSAGE_TYPE_REQUEST,
-        /// Corresponds to a Seraphim::Message response instance.
-        MESSAGE_TYPE_RESPONSE
+    static int local_numa_node();
+
+    /// Interval in which the server checks whether clients are still alive.
+    static constexpr std::chrono::milliseconds LIVENESS_INTERVAL{ 1000 };
+
+    /// Time after which a channel which was claimed, but never opened by a live client is
+    /// reclaimed.
+    static constexpr std::chrono::milliseconds CLAIM_TIMEOUT{ 1000 };
+
+    /// Default upper bound for the size of a request streamed in chunks.
+    static constexpr uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+    /// Time in milliseconds after which the server drops a request streamed in chunks whose client
+    /// stopped writing it, see @ref ChunkWriter.
+    static constexpr int CHUNK_TIMEOUT = 1000;
+
+    /**
+     * @brief Channel states.
+     */
+    enum ChannelState : uint32_t {
+        /// The channel may be claimed by a client.
+        CHANNEL_FREE = 0,
+        /// A client is about to claim the channel.
+        CHANNEL_CLAIMED,
+        /// A client is using the channel.
+        CHANNEL_OPEN,
+        /// The client released the channel, the server resets its queues before reusing it.
+        CHANNEL_CLOSED
     };
 
     /**
-     * @brief Messages are objects used for reading/writing information within the MessageStore.
-     */
-    struct MessageStoreMessage {
-        /// Source actor ID.
-        unsigned int source;
-        /// Destination actor ID.
-        unsigned int destination;
-        /// Type of the message, allows for multiple concurrent clients talking to a server.
-        int type;
-        /// Current message size
-        int size = 0;
-        /// Resource locking for the message. Must be acquired before performing any read/write
-        /// operation on the message segment.
-        sem_t sem;
+     * @brief Per-client message channel.
+     *
+     * Queue locations are stored as offsets since every process maps the segment at a different
+     * address.
+     */
+    struct MessageStoreChannel {
+        /// Current state, see @ref ChannelState.
+        std::atomic<uint32_t> state;
+        /// Process ID of the client, used to detect clients which died without releasing the
+        /// channel on systems without open file description locks (see @ref alive).
+        int32_t pid;
+        /// Offset of the queue holding messages for the server (requests).
+        uint64_t request_queue;
+        /// Offset of the queue holding messages for the client (responses).
+        uint64_t response_queue;
+        /// Offset of the frame area.
+        uint64_t frames;
+        /// Size of the frame area in bytes.
+        uint64_t frames_size;
     };
 
     /**
      * @brief Shared memory area layout.
      *
-     * Facilitates RX/TX with more than two peers writing and reading simultaneously by keeping
-     * track of read and write stats and holding an unnamed semaphore that must be acquired before
-     * writing to the shared memory area.
+     * The store is located at the beginning of the segment and is followed by the channel table
+     * and the message queues of all channels.
      */
     struct MessageStore {
-        MessageStoreActors actors;
-        MessageStoreMessage msg;
+        /// Number of entries in the channel table.
+        uint32_t num_channels;
+        /// Whether clients should fault in the segment, see @ref Options::populate.
+        uint32_t populate;
+        /// Posted by clients whenever they sent a request or released their channel.
+        sem_t doorbell;
+        /// Offset of the channel table.
+        uint64_t channels;
+        /// Size of the memory area holding the queues of a single channel.
+        uint64_t channel_size;
     };
 
 private:
@@ -132,31 +352,151 @@ private:
      * @return true on success, false otherwise.
      */
     bool map(size_t size);
+    /**
+     * @brief Apply NUMA placement and fault in the mapped region.
+     * @return true on success, false otherwise.
+     */
+    bool place(const Options &options);
     /**
      * @brief Unmap a shared memory region.
      * @return true on success, false otherwise.
      */
     bool unmap();
 
+    /**
+     * @brief Get a channel from the table.
+     */
+    MessageStoreChannel &channel(unsigned int index) const {
+        unsigned char *base = reinterpret_cast<unsigned char *>(m_msgstore);
+        return reinterpret_cast<MessageStoreChannel *>(base + m_msgstore->channels)[index];
+    }
+
+    /**
+     * @brief Reset the queues of a channel and mark it as free (server only).
+     * @return true on success, false otherwise.
+     */
+    bool reset_channel(unsigned int index);
+
+    /**
+     * @brief Check whether a request of a channel can be received without waiting (server only).
+     *        Chunks of a request which are available are consumed and assembled.
+     */
+    bool ready(unsigned int index);
+
+    /**
+     * @brief Detect channel state changes and queue the corresponding events (server only).
+     * @param check_liveness Whether to check if the owners of claimed and open channels are
+     *                       still alive.
+     */
+    void update_channels(bool check_liveness);
+
+    /**
+     * @brief Lock or unlock the byte of the segment file which belongs to a channel (client).
+     *        The lock belongs to the open file description, so the kernel releases it when the
+     *        client dies, independent of threads, process IDs and PID namespaces.
+     * @return True on success, false otherwise (e.g. if another client holds the lock).
+     */
+    bool lock_channel(unsigned int index, bool lock);
+
+    /**
+     * @brief Check whether the client of a channel is alive, i.e. holds the lock of the channel
+     *        (server only).
+     */
+    bool alive(unsigned int index) const;
+
+    /**
+     * @brief Buffer in the frame area handed out by @ref acquire_buffer.
+     */
+    struct FrameBuffer {
+        /// Offset relative to the start of the frame area.
+        uint64_t offset;
+        /// Size in bytes.
+        uint64_t size;
+        /// Whether the client released the buffer.
+        bool released;
+    };
+
+    /**
+     * @brief Request streamed in chunks which is being assembled (server only).
+     */
+    struct Assembly {
+        /// Whether the first chunk arrived.
+        bool active = false;
+        /// Whether the last chunk arrived, the request can be received then.
+        bool complete = false;
+        /// Whether the chunks are skipped, only the id of the request is kept then.
+        bool skipped = false;
+        /// Size of the whole request in bytes.
+        uint64_t size = 0;
+        /// Id of the request.
+        uint32_t id = 0;
+        /// The request assembled so far, a message carrying the id only if it was skipped.
+        std::vector<unsigned char> data;
+        /// Point in time when the last chunk arrived.
+        std::chrono::steady_clock::time_point updated;
+    };
+
+    /**
+     * @brief Process local view of a channel.
+     */
+    struct Channel {
+        RingBuffer requests;
+        RingBuffer responses;
+        /// Whether the server reported the channel as connected.
+        bool connected = false;
+        /// Whether a response could not be sent by try_send (server only).
+        bool blocked = false;
+        /// Whether requests of the channel are not reported by poll (server only).
+        bool paused = false;
+        /// Chunked request of the channel which is being assembled (server only).
+        Assembly assembly;
+        /// Peer the frame area is registered for, see BufferRegistry (server only).
+        uint64_t peer = 0;
+        /// Whether the server saw the channel in the claimed state (server only).
+        bool claimed = false;
+        /// Point in time when the server saw the channel in the claimed state first.
+        std::chrono::steady_clock::time_point claimed_since;
+    };
+
     std::string m_name;
+    /// Path of the hugetlbfs file backing the segment, empty for POSIX shared memory.
+    std::string m_path;
     int m_fd = -1;
     size_t m_size = 0;
     int m_rx_timeout = 0;
+    /// upper bound for the size of a request streamed in chunks
+    uint64_t m_max_message_size = MAX_MESSAGE_SIZE;
     int m_tx_timeout = 0;
     bool m_created = false;
 
-    /// Unique identifier of this instance.
-    unsigned int m_actor_id;
-
     /// The mapped MessageStore object.
     MessageStore *m_msgstore = nullptr;
 
-    /// semaphores for inter-process resource locking
-    Semaphore m_actor_sem;
-    Semaphore m_msg_sem;
+    /// Signals the server about client activity.
+    Semaphore m_doorbell;
+
+    /// Process local view of all channels, clients only attach to the one they claimed.
+    std::unique_ptr<Channel[]> m_channels;
+    /// Queue depth, required to reset channels.
+    uint32_t m_depth = 0;
+
+    /// The channel claimed by this client.
+    unsigned int m_channel = 0;
+    /// Buffers acquired by this client, oldest first.
+    std::deque<FrameBuffer> m_buffers;
+    /// End of the last acquired buffer, relative to the start of the frame area.
+    uint64_t m_buffers_end = 0;
+    /// The channel the last request was received from (server only).
+    unsigned int m_current = 0;
+    /// The channel that was served last, used for round-robin scheduling (server only).
+    unsigned int m_last_served = 0;
+    /// Events which have not been reported by poll yet (server only).
+    std::deque<std::pair<ChannelEvent, unsigned int>> m_events;
+    /// Point in time when client liveness was checked last (server only).
+    std::chrono::steady_clock::time_point m_last_liveness_check;
 
-    /// Type of the message that was sent by this instance
-    int m_last_msg_type = -1;
+    /// Set by @ref interrupt to abort a blocking @ref poll.
+    std::atomic<bool> m_interrupted{ false };
 };
 
 } // namespace ipc
@@ -8,7 +8,10 @@
 #ifndef SPH_IPC_TCP_TRANSPORT_H
 #define SPH_IPC_TCP_TRANSPORT_H
 
+#include <unordered_map>
+
 #include "net/socket.h"
+#include "net/tcp_connection.h"
 #include "net/tcp_socket.h"
 #include "transport.h"
 
@@ -19,7 +22,10 @@ namespace ipc {
  * @brief TCP message transport.
  *
  * This class uses TCP to exchange messages between a server and a client. A single server can
- * handle multiple clients, but their requests will be processed serially.
+ * handle multiple clients, the framing state of every connection is kept separately (see
+ * @ref net::TCPConnection). Blocking calls on the transport are serialized, servers which want to
+ * handle clients concurrently should accept connections here and drive their own
+ * @ref net::TCPConnection instances.
  */
 class TCPTransport : public Transport {
 public:
@@ -30,10 +36,7 @@ public:
      * This way, a sender may send a message and the client may receive that message without any
      * previous knowledge about its structure or size.
      */
-    struct MessageHeader {
-        /// Transmission size
-        uint64_t size;
-    } __attribute__((packed));
+    using MessageHeader = net::TCPConnection::MessageHeader;
 
     /**
      * @brief TCP message transport.
@@ -63,9 +66,7 @@ public:
      * @param port The port number, must be a value between 0 and 65535.
      * @return True on success, false otherwise.
      */
-    bool connect(const std::string &ipaddr, uint16_t port, int timeout = 0) {
-        return m_socket.connect(ipaddr, port, timeout);
-    }
+    bool connect(const std::string &ipaddr, uint16_t port, int timeout = 0);
 
     /**
      * @brief Listen for incoming client connections (must be bound to a port already).
@@ -78,9 +79,39 @@ public:
      * @brief Accept a client connection.
      * @param addr Pointer to an address struct where the client address is stored.
      * @param addrlen Pointer to length of the address struct.
+     * @param flags Flags for the new socket (e.g. SOCK_NONBLOCK), see accept4().
      * @return File descriptor for the new connection on success, -1 otherwise.
      */
-    int accept(struct sockaddr *addr, socklen_t *addrlen) { return m_socket.accept(addr, addrlen); }
+    int accept(struct sockaddr *addr, socklen_t *addrlen, int flags = 0) {
+        return m_socket.accept(addr, addrlen, flags);
+    }
+
+    /**
+     * @brief Close a client connection and discard any data buffered for it.
+     * @param fd File descriptor of the client connection.
+     */
+    void disconnect(int fd);
+
+    /**
+     * @brief Check whether a complete message of a client has been buffered already.
+     *        A single read may return several messages, so callers which wait for input with
+     *        poll() or similar must drain these first.
+     * @param fd File descriptor of the client connection.
+     * @return True if @ref receive will return a message without reading from the socket.
+     */
+    bool pending(int fd) const;
+
+    /**
+     * @brief Set the upper bound for the size of a single message, see
+     *        @ref net::TCPConnection::set_max_message_size. Applies to all connections.
+     * @param size Maximum message size in bytes.
+     */
+    void set_max_message_size(uint64_t size);
+
+    /**
+     * @brief Get the upper bound for the size of a single message.
+     */
+    uint64_t max_message_size() const { return m_max_message_size; }
 
     void set_rx_timeout(int ms) override { m_socket.set_rx_timeout(ms * 1000); }
     void set_tx_timeout(int ms) override { m_socket.set_tx_timeout(ms * 1000); }
@@ -99,6 +130,7 @@ public:
 
     /**
      * @brief Send a message to a client.
+     *        The header and the message are sent with a single system call.
      *        Throws sph::RuntimeException in case of errors.
      *        Throws sph::TimeoutException in case of timeouts.
      * @param fd File descriptor of the client connection.
@@ -107,13 +139,19 @@ public:
     void send(int fd, const Seraphim::Message &msg);
 
 private:
+    /**
+     * @brief Get the state of a connection, creating it if necessary.
+     */
+    net::TCPConnection &connection(int fd);
+
     /// TCP socket OS implementation
     sph::ipc::net::TCPSocket m_socket;
 
-    /// RX buffer used for storing deserialized, inbound messages
-    std::vector<uint8_t> m_rx_buffer;
-    /// TX buffer used for storing serialized, outbound messages
-    std::vector<uint8_t> m_tx_buffer;
+    /// Framing state per connection
+    std::unordered_map<int, net::TCPConnection> m_connections;
+
+    /// upper bound for the size of a single message
+    uint64_t m_max_message_size = net::TCPConnection::MAX_MESSAGE_SIZE;
 };
 
 } // namespace ipc
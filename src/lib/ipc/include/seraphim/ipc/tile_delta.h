@@ -0,0 +1,108 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_TILE_DELTA_H
+#define SPH_IPC_TILE_DELTA_H
+
+#include <Types.pb.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief Hash a rectangular block of pixel data.
+ *        Rows are hashed 16 bytes at a time using SIMD instructions where available, the result
+ *        is the same on all platforms.
+ * @param data Start of the first row.
+ * @param row_size Number of bytes per row which are hashed.
+ * @param rows Number of rows.
+ * @param stride Distance between the start of two rows in bytes.
+ * @return The 64 bit hash.
+ */
+uint64_t tile_hash(const unsigned char *data, size_t row_size, size_t rows, size_t stride);
+
+/**
+ * @brief Delta encoder for the frames of a stream.
+ *
+ * Frames are split into square tiles. The encoder remembers the hash of every tile of the last
+ * frame, so it can tell which tiles changed without keeping a copy of the frame around. Only the
+ * changed tiles are sent, the receiver patches its copy of the previous frame with them (see
+ * @ref apply_tile_delta).
+ *
+ * The encoder assumes that the receiver got every frame it encoded. Call @ref reset whenever a
+ * frame may have been lost, so the next frame is sent in full again.
+ */
+class TileEncoder {
+public:
+    /**
+     * @brief Tile delta encoder.
+     * @param tile_size Edge length of the tiles in pixels.
+     * @param max_ratio Fraction of changed tiles above which the full frame is sent instead.
+     */
+    explicit TileEncoder(uint32_t tile_size = 64, float max_ratio = 0.5f);
+
+    /**
+     * @brief Encode a frame.
+     *        The tile hashes are updated in any case, so the frame becomes the reference for the
+     *        next one no matter how it is sent.
+     * @param data Pixel data.
+     * @param width Width in pixels.
+     * @param height Height in pixels.
+     * @param stride Number of bytes per row.
+     * @param bpp Number of bytes per pixel.
+     * @param delta Output parameter for the changed tiles.
+     * @return True if the delta holds the frame, false if the full frame must be sent (e.g. for
+     *         the first frame, after a format change or if too many tiles changed).
+     */
+    bool encode(const unsigned char *data, uint32_t width, uint32_t height, size_t stride,
+                size_t bpp, Seraphim::Types::TileDelta &delta);
+
+    /**
+     * @brief Forget the previous frame, the next frame will be sent in full.
+     */
+    void reset();
+
+    uint32_t tile_size() const { return m_tile_size; }
+
+private:
+    /// edge length of the tiles in pixels
+    uint32_t m_tile_size;
+    /// fraction of changed tiles above which deltas are not worth it
+    float m_max_ratio;
+
+    /// format of the previous frame
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    size_t m_bpp = 0;
+
+    /// tile hashes of the previous frame, row-major
+    std::vector<uint64_t> m_hashes;
+    /// indices of the changed tiles of the current frame
+    std::vector<uint32_t> m_changed;
+};
+
+/**
+ * @brief Patch a frame with the changed tiles of its successor.
+ * @param delta The changed tiles, see @ref TileEncoder.
+ * @param data Pixel data of the previous frame, patched in place.
+ * @param width Width in pixels.
+ * @param height Height in pixels.
+ * @param stride Number of bytes per row.
+ * @param bpp Number of bytes per pixel.
+ * @return True on success, false if the delta does not fit the frame (the frame may have been
+ *         partially patched then).
+ */
+bool apply_tile_delta(const Seraphim::Types::TileDelta &delta, unsigned char *data, uint32_t width,
+                      uint32_t height, size_t stride, size_t bpp);
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_TILE_DELTA_H
@@ -9,6 +9,7 @@
 #define SPH_IPC_TRANSPORT_H
 
 #include <Seraphim.pb.h>
+#include <Types.pb.h>
 
 #include "seraphim/threading.h"
 
@@ -21,6 +22,10 @@ namespace ipc {
  * Derive from this class to implement a message transport.
  * The interface provides basic send and receive methods that must be implemented and operate on
  * Seraphim messages (which are protobuf messages).
+ *
+ * Clients must support one thread sending while another one receives without further
+ * synchronization, so requests can be pipelined (see @ref AsyncClient). Responses are matched to
+ * their requests by message id since servers may complete requests out of order.
  */
 class Transport : public Synchronizeable<Transport> {
 public:
@@ -55,6 +60,28 @@ public:
      * @param msg The message.
      */
     virtual void send(const Seraphim::Message &msg) = 0;
+
+    /**
+     * @brief Acquire a buffer which is shared with the peer instead of being copied.
+     *        Messages can reference the buffer (see Seraphim::Types::BufferRef), e.g. to pass
+     *        image data. It must be released by @ref release_buffer once the responses to all
+     *        requests referencing it were received.
+     *        Transports which cannot share memory always return nullptr.
+     * @param size Size in bytes.
+     * @param ref Output parameter for the buffer reference.
+     * @return Start of the buffer or nullptr if no buffer is available.
+     */
+    virtual unsigned char *acquire_buffer(size_t size, Seraphim::Types::BufferRef &ref) {
+        (void)size;
+        (void)ref;
+        return nullptr;
+    }
+
+    /**
+     * @brief Release a buffer acquired by @ref acquire_buffer.
+     * @param ref The buffer reference.
+     */
+    virtual void release_buffer(const Seraphim::Types::BufferRef &ref) { (void)ref; }
 };
 
 } // namespace ipc
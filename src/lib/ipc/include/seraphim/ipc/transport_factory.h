@@ -17,10 +17,25 @@ namespace ipc {
  * @brief Transparent IPC transport factory.
  *
  * Allows you to create arbitrary transports by specifying only a string.
- * At the moment, shared memory and tcp based transports are supported.
+ * At the moment, shared memory, tcp, udp and UNIX domain socket based transports are supported.
  *
  * Example: "shm:///seraphim" would create a transport which operates on the shared memory segment
  * in /seraphim (/dev/shm/seraphim on Linux).
+ *
+ * When creating a shared memory transport, the size of the segment must be given as well. The
+ * number of in-flight messages per direction (depth) and the maximum number of simultaneously
+ * connected clients (channels) can optionally be set as query, e.g.
+ * "shm:///seraphim:67108864?depth=8&channels=2". The memory placement of the segment is set the
+ * same way: "hugepages" ("none", "transparent" or "hugetlbfs"), "populate" ("1" to fault in the
+ * segment up front) and "numa" (a node number or "local"), e.g.
+ * "shm:///seraphim:67108864?hugepages=hugetlbfs&populate=1&numa=local".
+ *
+ * UNIX domain socket transports are described by the path of the socket file, e.g.
+ * "unix:///tmp/seraphim.sock".
+ *
+ * UDP transports take the datagram size, the reassembly deadline in milliseconds and the size of
+ * the kernel socket buffers as optional query, e.g.
+ * "udp://127.0.0.1:8004?datagram=8192&deadline=50&buffer=4194304".
  */
 class TransportFactory {
 public:
@@ -65,8 +80,12 @@ private:
 
     std::unique_ptr<Transport> create_shm(const std::string &uri);
     std::unique_ptr<Transport> create_tcp(const std::string &uri);
+    std::unique_ptr<Transport> create_udp(const std::string &uri);
+    std::unique_ptr<Transport> create_unix(const std::string &uri);
     std::unique_ptr<Transport> open_shm(const std::string &uri);
     std::unique_ptr<Transport> open_tcp(const std::string &uri);
+    std::unique_ptr<Transport> open_udp(const std::string &uri);
+    std::unique_ptr<Transport> open_unix(const std::string &uri);
 
     /// internal bookkeeping to cleanup transport instances
     std::vector<Transport *> m_instances;
@@ -0,0 +1,353 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_UDP_TRANSPORT_H
+#define SPH_IPC_UDP_TRANSPORT_H
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+#include "net/udp_socket.h"
+#include "transport.h"
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief UDP message transport.
+ *
+ * This class exchanges messages as datagrams, trading reliability for latency: lost datagrams are
+ * never retransmitted, so a frame which arrives late or incomplete is dropped instead of stalling
+ * the messages behind it.
+ *
+ * Messages larger than a datagram are split into fragments, every fragment carries a
+ * @ref FragmentHeader. The receiver reassembles them and drops messages which are not complete
+ * within the reassembly deadline (see @ref set_deadline). Both directions use sequence numbers
+ * per peer, so the receiver can tell lost messages and messages which were overtaken by newer ones
+ * apart, the latter are dropped as well. See @ref Stats for the counters.
+ *
+ * Datagrams are sent and received in batches (sendmmsg/recvmmsg) to keep the number of system
+ * calls per frame low.
+ *
+ * Servers bind to a port and answer every peer at the address its messages came from. Clients
+ * connect to the server. One thread may send while another one receives.
+ */
+class UDPTransport : public Transport {
+public:
+    /**
+     * @brief Address of a peer.
+     */
+    struct Endpoint {
+        struct sockaddr_storage addr;
+        socklen_t len = 0;
+    };
+
+    /**
+     * @brief Header of every datagram.
+     *        All fields are transmitted in network byte order.
+     */
+    struct FragmentHeader {
+        /// random id of the sender's sequence, a new session means the peer restarted
+        uint32_t session;
+        /// sequence number of the message
+        uint32_t seq;
+        /// size of the serialized message
+        uint32_t size;
+        /// offset of the fragment in the serialized message
+        uint32_t offset;
+        /// index of the fragment
+        uint16_t index;
+        /// number of fragments of the message
+        uint16_t count;
+    } __attribute__((packed));
+
+    /**
+     * @brief Transport statistics.
+     */
+    struct Stats {
+        /// Number of messages sent.
+        uint64_t messages_sent;
+        /// Number of datagrams sent.
+        uint64_t datagrams_sent;
+        /// Number of messages received and delivered.
+        uint64_t messages_received;
+        /// Number of datagrams received, including invalid ones.
+        uint64_t datagrams_received;
+        /// Number of datagrams which were malformed or truncated.
+        uint64_t datagrams_invalid;
+        /// Number of messages which were skipped, inferred from gaps in the sequence numbers.
+        /// Skipped messages which complete later on are counted as late as well.
+        uint64_t messages_lost;
+        /// Number of incomplete messages dropped when their deadline expired.
+        uint64_t messages_expired;
+        /// Number of complete messages dropped because a newer one was delivered already.
+        uint64_t messages_late;
+        /// Time from the first fragment to the completion of a message, summed over all
+        /// delivered messages.
+        std::chrono::microseconds reassembly_time;
+        /// Maximum time from the first fragment to the completion of a message.
+        std::chrono::microseconds max_reassembly_time;
+    };
+
+    /// Default size of a datagram including its header, fits into a standard Ethernet frame.
+    static constexpr size_t DEFAULT_DATAGRAM_SIZE = 1400;
+
+    /// Default upper bound for the size of a single message.
+    static constexpr uint32_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+    /// Default reassembly deadline in milliseconds.
+    static constexpr int DEFAULT_DEADLINE = 100;
+
+    /// Maximum number of datagrams per system call.
+    static constexpr unsigned int BATCH_SIZE = 64;
+
+    /// Maximum number of messages which are reassembled at once, the oldest one is dropped to
+    /// make room for more.
+    static constexpr size_t MAX_PARTIALS = 16;
+
+    /// Sequence numbers further apart than this are taken as a restart of the peer.
+    static constexpr int32_t SEQUENCE_WINDOW = 1024;
+
+    /// Time after which the state of a silent peer is discarded.
+    static constexpr std::chrono::seconds PEER_TIMEOUT = std::chrono::seconds(60);
+
+    /**
+     * @brief UDP message transport.
+     *        Peers must use the same datagram size, larger datagrams are truncated on receipt.
+     * @param family Socket family.
+     * @param datagram_size Size of a datagram including its header.
+     */
+    explicit UDPTransport(net::Socket::Family family,
+                          size_t datagram_size = DEFAULT_DATAGRAM_SIZE);
+
+    /**
+     * @brief Get the socket associated with this transport.
+     */
+    net::UDPSocket &socket() { return m_socket; }
+
+    /**
+     * @brief Bind to a port.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param port The port number, must be a value between 0 and 65535.
+     * @return True on success, false otherwise.
+     */
+    bool bind(uint16_t port) { return m_socket.bind(port); }
+
+    /**
+     * @brief Connect to a server.
+     *        Messages sent by @ref send(const Seraphim::Message &) go to the server afterwards and
+     *        datagrams of other peers are filtered.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param ipaddr IPv4 or IPv6 address of the server.
+     * @param port The port number, must be a value between 0 and 65535.
+     * @return True on success, false otherwise.
+     */
+    bool connect(const std::string &ipaddr, uint16_t port);
+
+    /**
+     * @brief Set the reassembly deadline.
+     * @param ms Time in milliseconds after the first fragment after which an incomplete message
+     *           is dropped.
+     */
+    void set_deadline(int ms) { m_deadline = std::chrono::milliseconds(ms); }
+
+    /**
+     * @brief Set the upper bound for the size of a single message.
+     *        Fragments of larger messages are discarded before any memory is allocated for them,
+     *        larger messages are never sent.
+     * @param size Maximum message size in bytes.
+     */
+    void set_max_message_size(uint32_t size) { m_max_message_size = size; }
+
+    /**
+     * @brief Set the size of the kernel socket buffers.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param bytes Buffer size in bytes, applied to both directions.
+     */
+    void set_buffer_size(int bytes);
+
+    void set_rx_timeout(int ms) override { m_socket.set_rx_timeout(ms * 1000); }
+    void set_tx_timeout(int ms) override { m_socket.set_tx_timeout(ms * 1000); }
+
+    void receive(Seraphim::Message &msg) override;
+    void send(const Seraphim::Message &msg) override;
+
+    /**
+     * @brief Receive a message from any peer.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param msg The message, used as output parameter.
+     * @param peer Output parameter for the address of the sender.
+     */
+    void receive(Seraphim::Message &msg, Endpoint &peer);
+
+    /**
+     * @brief Send a message to a peer.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     * @param peer Address of the receiver.
+     * @param msg The message.
+     */
+    void send(const Endpoint &peer, const Seraphim::Message &msg);
+
+    /**
+     * @brief Read a batch of datagrams (a single receive operation).
+     *        Completed messages are queued for @ref receive, expired ones are dropped.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param block Whether to wait for datagrams (up to the RX timeout) if there are none yet.
+     * @return True if datagrams were read, false if the read would block or timed out.
+     */
+    bool read(bool block = true);
+
+    /**
+     * @brief Check whether a complete message has been queued already.
+     *        A single read may complete several messages, so callers which wait for input with
+     *        poll() or similar must drain these first.
+     */
+    bool pending() const { return !m_ready.empty(); }
+
+    /**
+     * @brief Get the transport statistics.
+     */
+    Stats stats() const;
+
+private:
+    /**
+     * @brief Message which is being reassembled.
+     */
+    struct Partial {
+        /// address of the sender, see @ref key
+        std::string peer;
+        Endpoint endpoint;
+        uint32_t session;
+        uint32_t seq;
+        /// serialized message
+        std::string data;
+        /// fragments which were received already
+        std::vector<bool> received;
+        /// number of fragments which are still missing
+        size_t missing;
+        /// arrival time of the first fragment
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * @brief Complete message waiting for @ref receive.
+     */
+    struct Ready {
+        Endpoint endpoint;
+        std::string data;
+    };
+
+    /**
+     * @brief Sequence state of a peer.
+     */
+    struct Peer {
+        /// whether a message of the peer was delivered already
+        bool synced = false;
+        /// session and sequence number of the last delivered message
+        uint32_t rx_session = 0;
+        uint32_t rx_seq = 0;
+        /// session and sequence number of the next sent message
+        uint32_t tx_session = 0;
+        uint32_t tx_seq = 0;
+        /// last time the peer was heard from or sent to
+        std::chrono::steady_clock::time_point last_seen;
+    };
+
+    /**
+     * @brief Get a key which identifies a peer address.
+     */
+    static std::string key(const Endpoint &endpoint);
+
+    /**
+     * @brief Get the state of a peer, creating it if necessary. Requires the lock.
+     */
+    Peer &peer(const std::string &key, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Send a message to a peer, nullptr for the connected server.
+     */
+    void send(const Endpoint *peer, const Seraphim::Message &msg);
+
+    /**
+     * @brief Handle a received datagram. Requires the lock.
+     */
+    void handle_datagram(const Endpoint &endpoint, const unsigned char *data, size_t size,
+                         std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Hand a complete message to @ref receive, unless a newer one was delivered already.
+     *        Requires the lock.
+     */
+    void deliver(Partial &partial, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Drop messages whose deadline expired and peers which went silent. Requires the
+     *        lock.
+     */
+    void expire(std::chrono::steady_clock::time_point now);
+
+    /// UDP socket OS implementation
+    net::UDPSocket m_socket;
+
+    /// size of a datagram including its header
+    size_t m_datagram_size;
+    /// reassembly deadline
+    std::chrono::milliseconds m_deadline;
+    /// upper bound for the size of a single message
+    uint32_t m_max_message_size = MAX_MESSAGE_SIZE;
+
+    /// connected server, if any
+    Endpoint m_remote;
+    bool m_connected = false;
+
+    /// serialized outbound message
+    std::string m_tx_buffer;
+    /// fragment headers of the outbound message
+    std::vector<FragmentHeader> m_tx_headers;
+    /// I/O vectors of the outbound message, two per datagram
+    std::vector<struct iovec> m_tx_iovecs;
+    /// datagrams of the outbound message
+    std::vector<struct mmsghdr> m_tx_msgs;
+
+    /// inbound datagram buffers
+    std::vector<unsigned char> m_rx_buffer;
+    /// sender addresses of the inbound datagrams
+    std::vector<Endpoint> m_rx_endpoints;
+    std::vector<struct iovec> m_rx_iovecs;
+    std::vector<struct mmsghdr> m_rx_msgs;
+
+    /// messages being reassembled
+    std::vector<Partial> m_partials;
+    /// complete messages
+    std::deque<Ready> m_ready;
+    /// message buffers which can be reused
+    std::vector<std::string> m_spare;
+
+    /// sequence state per peer, shared by the sending and receiving side
+    std::unordered_map<std::string, Peer> m_peers;
+    /// statistics
+    Stats m_stats = {};
+    /// session ids for new peers
+    std::mt19937 m_random;
+    /// guards the peers and statistics
+    mutable std::mutex m_lock;
+    /// last time expired peers were discarded
+    std::chrono::steady_clock::time_point m_last_peer_sweep;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_UDP_TRANSPORT_H
@@ -0,0 +1,287 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPH_IPC_UNIX_TRANSPORT_H
+#define SPH_IPC_UNIX_TRANSPORT_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net/unix_socket.h"
+#include "transport.h"
+
+namespace sph {
+namespace ipc {
+
+/**
+ * @brief UNIX domain socket message transport.
+ *
+ * Messages are framed the same way as for @ref TCPTransport, but never leave the local host.
+ *
+ * Clients may share buffers such as image data with the server instead of copying them into their
+ * messages (see @ref acquire_buffer). Buffers are backed by sealed memory file descriptors
+ * (memfd), which are passed along with every request using SCM_RIGHTS. The server maps them
+ * read-only and registers them with the @ref BufferRegistry for the peer of the connection (see
+ * @ref peer) while the request is being handled, so the pixel data is never copied and the
+ * buffers of a client cannot be accessed on behalf of another one. Buffer sharing is only
+ * available on Linux.
+ *
+ * Buffers are sealed against shrinking and growing, but not against writes: clients keep them
+ * mapped writable to reuse them for later requests, and F_SEAL_WRITE cannot be added while such a
+ * mapping exists. A client may therefore modify a buffer while the server reads it. This race is
+ * accepted, it only corrupts the results of that client's own request, since the size of the
+ * mapping cannot change underneath the server.
+ */
+class UnixTransport : public Transport {
+public:
+    /**
+     * @brief Message header.
+     *
+     * Used to bring the concept of message boundaries to stream sockets.
+     */
+    struct MessageHeader {
+        /// Transmission size
+        uint64_t size;
+    } __attribute__((packed));
+
+    /// Maximum number of buffers which can be attached to a single message.
+    static constexpr size_t MAX_BUFFERS = 8;
+
+    /// Number of buffer mappings the server keeps per connection, so buffers which are sent
+    /// repeatedly do not have to be mapped again for every request.
+    static constexpr size_t MAX_CACHED_BUFFERS = 8;
+
+    /// Default upper bound for the size of a single inbound message.
+    static constexpr uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * @brief UNIX domain socket message transport.
+     */
+    UnixTransport() = default;
+
+    /**
+     * @brief UNIX domain socket message transport destructor.
+     *        Releases all buffers and mappings.
+     */
+    ~UnixTransport() override;
+
+    /**
+     * @brief Get the socket associated with this transport.
+     * @return The socket instance created by this instance.
+     */
+    sph::ipc::net::UnixSocket &socket() { return m_socket; }
+
+    /**
+     * @brief Bind to a path in the file system.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param path The socket file path.
+     * @return True on success, false otherwise.
+     */
+    bool bind(const std::string &path) { return m_socket.bind(path); }
+
+    /**
+     * @brief Connect to a server.
+     *        Throws sph::RuntimeException in case of errors.
+     * @param path The socket file path.
+     * @return True on success, false otherwise.
+     */
+    bool connect(const std::string &path) { return m_socket.connect(path); }
+
+    /**
+     * @brief Listen for incoming client connections (must be bound to a path already).
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @param backlog Number of clients that can simultaneously be connected.
+     */
+    void listen(int backlog) { m_socket.listen(backlog); }
+
+    /**
+     * @brief Accept a client connection.
+     *        Throws sph::RuntimeException when the OS socket op fails.
+     * @return File descriptor for the new connection.
+     */
+    int accept() { return m_socket.accept(); }
+
+    /**
+     * @brief Close a client connection and release the buffer mappings of the client.
+     * @param fd File descriptor of the client connection.
+     */
+    void disconnect(int fd);
+
+    /**
+     * @brief Get the peer under which the buffers of a client are registered with the
+     *        @ref BufferRegistry.
+     * @param fd File descriptor of the client connection.
+     * @return The peer, which stays the same until the client is disconnected.
+     */
+    uint64_t peer(int fd);
+
+    /**
+     * @brief Set the upper bound for the size of inbound messages.
+     *        Larger messages are rejected before any memory is allocated for them.
+     * @param size Maximum message size in bytes.
+     */
+    void set_max_message_size(uint64_t size) { m_max_message_size = size; }
+
+    void set_rx_timeout(int ms) override { m_socket.set_rx_timeout(ms * 1000); }
+    void set_tx_timeout(int ms) override { m_socket.set_tx_timeout(ms * 1000); }
+
+    void receive(Seraphim::Message &msg) override;
+
+    /**
+     * @brief Send a message.
+     *        All buffers which are currently acquired are attached to the message.
+     */
+    void send(const Seraphim::Message &msg) override;
+
+    /**
+     * @brief Receive a message from a client.
+     *        Buffers attached to the message are registered with the @ref BufferRegistry until
+     *        the response is sent or the next message is received.
+     *        Throws sph::RuntimeException in case of errors or if the message is too large, the
+     *        connection is out of sync then.
+     *        Throws sph::TimeoutException in case of timeouts.
+     *        Throws sph::ipc::PeerDisconnectedException when the client disconnected.
+     * @param fd File descriptor of the client connection.
+     * @param msg The message.
+     */
+    void receive(int fd, Seraphim::Message &msg);
+
+    /**
+     * @brief Send a message to a client.
+     *        Throws sph::RuntimeException in case of errors.
+     *        Throws sph::TimeoutException in case of timeouts.
+     *        Throws sph::ipc::PeerDisconnectedException when the client disconnected.
+     * @param fd File descriptor of the client connection.
+     * @param msg The message.
+     */
+    void send(int fd, const Seraphim::Message &msg);
+
+    /**
+     * @brief Receive a message from a client without deserializing it.
+     *        Unlike @ref receive, the buffers attached to the message stay registered with the
+     *        @ref BufferRegistry until they are released by @ref release_buffers, so requests of
+     *        several clients may be handled while further ones are received.
+     *        Throws the same exceptions as @ref receive.
+     * @param fd File descriptor of the client connection.
+     * @param consume Called with the serialized message, which is valid during the call only.
+     * @return Regions of the buffers attached to the message.
+     */
+    std::vector<std::string>
+    receive(int fd, const std::function<void(const unsigned char *, size_t)> &consume);
+
+    /**
+     * @brief Release the buffers of a message received by @ref receive once it was handled.
+     *        Must be called before the client is disconnected.
+     * @param fd File descriptor of the client connection.
+     * @param regions Regions returned by @ref receive.
+     */
+    void release_buffers(int fd, const std::vector<std::string> &regions);
+
+    /**
+     * @brief Acquire a buffer backed by a memory file (client only).
+     *        Released buffers are reused by later calls, so mapping them is cheap.
+     */
+    unsigned char *acquire_buffer(size_t size, Seraphim::Types::BufferRef &ref) override;
+    void release_buffer(const Seraphim::Types::BufferRef &ref) override;
+
+private:
+    /**
+     * @brief Receive a framed message into the RX buffer along with attached file descriptors.
+     * @param fd File descriptor of the connection.
+     * @param fds Output parameter for the received file descriptors.
+     * @return Size of the serialized message.
+     */
+    size_t receive_frame(int fd, std::vector<int> &fds);
+
+    /**
+     * @brief Send a framed message along with file descriptors.
+     * @param fd File descriptor of the connection.
+     * @param msg The message.
+     * @param fds File descriptors to be attached.
+     */
+    void send_frame(int fd, const Seraphim::Message &msg, const std::vector<int> &fds);
+
+    /**
+     * @brief Map a buffer received from a client and register it (server only).
+     *        Buffers which were not sealed against shrinking are ignored, since accessing them
+     *        could fault once the client truncates them.
+     * @param fd File descriptor of the client connection.
+     * @param buffer_fd File descriptor of the buffer, ownership is transferred.
+     * @return Name of the registered region, empty if the buffer was ignored.
+     */
+    std::string register_buffer(int fd, int buffer_fd);
+
+    /**
+     * @brief Remove the buffers of the last request received by @ref receive from the registry
+     *        (server only).
+     */
+    void unregister_buffers();
+
+    /**
+     * @brief Buffer owned by a client.
+     */
+    struct Buffer {
+        /// memory file descriptor
+        int fd;
+        /// mapped memory
+        unsigned char *addr;
+        /// size of the mapping
+        size_t size;
+        /// name of the region, see Seraphim::Types::BufferRef
+        std::string region;
+        /// whether the buffer is acquired
+        bool acquired;
+    };
+
+    /**
+     * @brief Client buffer mapped by the server.
+     */
+    struct Mapping {
+        /// memory file descriptor, held open so the inode number stays unique
+        int fd;
+        /// inode number, identifies the memory file
+        uint64_t ino;
+        /// mapped memory
+        unsigned char *addr;
+        /// size of the mapping
+        size_t size;
+        /// number of requests being handled which reference the buffer, it is registered and
+        /// never unmapped as long as there are any
+        size_t users;
+    };
+
+    /// UNIX domain socket OS implementation
+    sph::ipc::net::UnixSocket m_socket;
+
+    /// RX buffer used for storing deserialized, inbound messages
+    std::vector<uint8_t> m_rx_buffer;
+    /// TX buffer used for storing serialized, outbound messages
+    std::vector<uint8_t> m_tx_buffer;
+
+    /// buffers of this client
+    std::vector<Buffer> m_buffers;
+
+    /// buffer mappings per client connection (server), least recently used first
+    std::unordered_map<int, std::deque<Mapping>> m_mappings;
+    /// peer of every client connection (server)
+    std::unordered_map<int, uint64_t> m_peers;
+    /// upper bound for the size of inbound messages
+    uint64_t m_max_message_size = MAX_MESSAGE_SIZE;
+
+    /// client connection of the last request received by receive(fd, msg) (server)
+    int m_registered_fd = -1;
+    /// regions registered for that request (server)
+    std::vector<std::string> m_registered;
+};
+
+} // namespace ipc
+} // namespace sph
+
+#endif // SPH_IPC_UNIX_TRANSPORT_H
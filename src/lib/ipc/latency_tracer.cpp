@@ -0,0 +1,178 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "seraphim/ipc/latency_tracer.h"
+
+using namespace sph::ipc;
+
+size_t LatencyHistogram::bucket(uint64_t value) {
+    if (value < (1u << SUB_BITS)) {
+        return static_cast<size_t>(value);
+    }
+
+    // the position of the highest bit selects the power of two, the bits below it the sub-bucket
+    unsigned int msb = 63u - static_cast<unsigned int>(__builtin_clzll(value));
+    unsigned int shift = msb - SUB_BITS;
+    return (static_cast<size_t>(shift + 1) << SUB_BITS) +
+           static_cast<size_t>((value >> shift) & ((1u << SUB_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::upper_bound(size_t bucket) {
+    if (bucket < (1u << SUB_BITS)) {
+        return bucket;
+    }
+
+    unsigned int shift = static_cast<unsigned int>(bucket >> SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1u << SUB_BITS) - 1);
+    return (((1u << SUB_BITS) + sub) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::add(int64_t value) {
+    if (value < 0) {
+        value = 0;
+    }
+
+    m_buckets[bucket(static_cast<uint64_t>(value))]++;
+    m_count++;
+    m_sum += static_cast<uint64_t>(value);
+    m_max = std::max(m_max, value);
+}
+
+int64_t LatencyHistogram::percentile(double percent) const {
+    if (m_count == 0) {
+        return 0;
+    }
+
+    auto rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(m_count)));
+    rank = std::min(std::max(rank, uint64_t(1)), m_count);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen >= rank) {
+            return std::min(static_cast<int64_t>(upper_bound(i)), m_max);
+        }
+    }
+
+    return m_max;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::reset() {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+LatencyTracer::LatencyTracer() {
+    std::random_device random;
+    m_next_id = static_cast<uint64_t>(random()) << 32;
+}
+
+const char *LatencyTracer::name(Stage stage) {
+    switch (stage) {
+    case STAGE_CLIENT:
+        return "client";
+    case STAGE_UPLINK:
+        return "uplink";
+    case STAGE_PARSE:
+        return "parse";
+    case STAGE_QUEUE:
+        return "queue";
+    case STAGE_HANDLE:
+        return "handle";
+    case STAGE_DOWNLINK:
+        return "downlink";
+    case STAGE_TOTAL:
+        return "total";
+    default:
+        return "";
+    }
+}
+
+int64_t LatencyTracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void LatencyTracer::stamp(Seraphim::Message &msg, int64_t capture) {
+    Seraphim::Trace *trace = msg.mutable_trace();
+
+    trace->Clear();
+    trace->set_id(m_next_id++);
+    trace->set_capture(capture);
+    trace->set_sent(now());
+}
+
+void LatencyTracer::synchronize(const Seraphim::Trace &trace, int64_t received) {
+    Sample sample;
+
+    sample.delay = (received - trace.sent()) - (trace.replied() - trace.received());
+    sample.offset = ((trace.received() - trace.sent()) + (trace.replied() - received)) / 2;
+
+    m_samples[m_next_sample] = sample;
+    m_next_sample = (m_next_sample + 1) % OFFSET_SAMPLES;
+    m_num_samples = std::min(m_num_samples + 1, OFFSET_SAMPLES);
+
+    // queueing delays only ever make a round trip longer, so the shortest one is the most
+    // symmetric one
+    const Sample *best = &m_samples[0];
+    for (size_t i = 1; i < m_num_samples; i++) {
+        if (m_samples[i].delay < best->delay) {
+            best = &m_samples[i];
+        }
+    }
+    m_offset = best->offset;
+}
+
+bool LatencyTracer::record(const Seraphim::Message &msg, int64_t received) {
+    if (!msg.has_trace()) {
+        return false;
+    }
+
+    const Seraphim::Trace &trace = msg.trace();
+    int64_t start = trace.capture() > 0 ? trace.capture() : trace.sent();
+
+    if (trace.capture() > 0) {
+        m_histograms[STAGE_CLIENT].add(trace.sent() - trace.capture());
+    }
+    m_histograms[STAGE_TOTAL].add(received - start);
+
+    // only the client side stages are known if the server did not complete the trace
+    if (trace.received() == 0 || trace.replied() == 0) {
+        return true;
+    }
+
+    synchronize(trace, received);
+    m_histograms[STAGE_UPLINK].add(trace.received() - m_offset - trace.sent());
+    m_histograms[STAGE_PARSE].add(trace.parse());
+    m_histograms[STAGE_QUEUE].add(trace.queue());
+    m_histograms[STAGE_HANDLE].add(trace.handle());
+    m_histograms[STAGE_DOWNLINK].add(received - (trace.replied() - m_offset));
+    return true;
+}
+
+void LatencyTracer::reset() {
+    for (auto &histogram : m_histograms) {
+        histogram.reset();
+    }
+}
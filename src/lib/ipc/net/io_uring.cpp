@@ -0,0 +1,400 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "seraphim/ipc/net/io_uring.h"
+
+#ifdef SPH_WITH_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "seraphim/except.h"
+
+using namespace sph;
+using namespace sph::ipc::net;
+
+/// id of the registered buffer group, there is only one per ring
+static constexpr uint16_t BUFFER_GROUP = 0;
+
+static inline unsigned int load_acquire(const unsigned int *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned int *p, unsigned int v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+IOUring::~IOUring() {
+    if (m_buffer_ring) {
+        struct io_uring_buf_reg reg = {};
+        reg.bgid = BUFFER_GROUP;
+        syscall(__NR_io_uring_register, m_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(m_buffer_ring, m_buffer_ring_size);
+    }
+    if (m_sqes) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring && m_cq_ring != m_sq_ring) {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring) {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+bool IOUring::supported() {
+    static const bool result = []() {
+        struct utsname name;
+        int major = 0;
+        int minor = 0;
+
+        // multishot receive appeared in Linux 6.0, older kernels reject it only once it is used
+        if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 ||
+            major < 6) {
+            return false;
+        }
+
+        // io_uring may be disabled (e.g. by seccomp policies or kernel.io_uring_disabled)
+        IOUring ring;
+        return ring.init(8) && ring.register_buffers(8, 4096);
+    }();
+
+    return result;
+}
+
+bool IOUring::init(unsigned int entries) {
+    struct io_uring_params params = {};
+    uint8_t *sq;
+    uint8_t *cq;
+
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 8;
+
+    m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd < 0) {
+        m_fd = -1;
+        return false;
+    }
+
+    // waiting with a timeout requires the extended argument
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+        m_sq_ring = nullptr;
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ring = m_sq_ring;
+    } else {
+        m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ring == MAP_FAILED) {
+            m_cq_ring = nullptr;
+            return false;
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    sq = static_cast<uint8_t *>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+    m_sq_array = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+    m_sq_mask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+    m_sq_entries = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_entries);
+    m_sq_local_tail = *m_sq_tail;
+
+    cq = static_cast<uint8_t *>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IOUring::register_buffers(unsigned int count, size_t size) {
+    struct io_uring_buf_reg reg = {};
+
+    if (m_fd == -1 || m_buffer_ring || count == 0 || (count & (count - 1)) != 0 ||
+        count > 32768) {
+        return false;
+    }
+
+    // the ring must be page aligned
+    m_buffer_ring_size = count * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, m_buffer_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(ring, m_buffer_ring_size);
+        return false;
+    }
+
+    m_buffer_ring = static_cast<struct io_uring_buf_ring *>(ring);
+    m_buffers.resize(count * size);
+    m_buffer_size = size;
+    m_buffer_count = count;
+    m_buffer_tail = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        recycle(static_cast<uint16_t>(i));
+    }
+
+    return true;
+}
+
+void IOUring::recycle(uint16_t id) {
+    // the ring tail shares its memory with the first entry, so entries are never cleared. The
+    // entries are not accessed through io_uring_buf_ring::bufs, the empty struct the kernel header
+    // puts in front of the array has a size of one byte in C++ and shifts it.
+    auto *bufs = reinterpret_cast<struct io_uring_buf *>(m_buffer_ring);
+    struct io_uring_buf &buf = bufs[m_buffer_tail & (m_buffer_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(m_buffers.data() + id * m_buffer_size);
+    buf.len = static_cast<uint32_t>(m_buffer_size);
+    buf.bid = id;
+
+    m_buffer_tail++;
+    __atomic_store_n(&m_buffer_ring->tail, m_buffer_tail, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *IOUring::sqe() {
+    if (m_sq_local_tail - load_acquire(m_sq_head) >= m_sq_entries) {
+        submit();
+    }
+
+    unsigned int index = m_sq_local_tail & m_sq_mask;
+    struct io_uring_sqe *entry = &m_sqes[index];
+
+    std::memset(entry, 0, sizeof(*entry));
+    m_sq_array[index] = index;
+    m_sq_local_tail++;
+    m_sq_queued++;
+    return entry;
+}
+
+void IOUring::prep_accept(int fd, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_ACCEPT;
+    entry->fd = fd;
+    entry->ioprio = IORING_ACCEPT_MULTISHOT;
+    entry->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    entry->user_data = user_data;
+}
+
+void IOUring::prep_recv(int fd, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_RECV;
+    entry->fd = fd;
+    entry->ioprio = IORING_RECV_MULTISHOT;
+    entry->flags = IOSQE_BUFFER_SELECT;
+    entry->buf_group = BUFFER_GROUP;
+    entry->user_data = user_data;
+}
+
+void IOUring::prep_poll(int fd, short events, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_POLL_ADD;
+    entry->fd = fd;
+    entry->poll32_events = static_cast<uint16_t>(events);
+    entry->user_data = user_data;
+}
+
+void IOUring::prep_read(int fd, void *buf, size_t size, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_READ;
+    entry->fd = fd;
+    entry->addr = reinterpret_cast<uint64_t>(buf);
+    entry->len = static_cast<uint32_t>(size);
+    entry->user_data = user_data;
+}
+
+void IOUring::prep_cancel(int fd, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->fd = fd;
+    entry->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    entry->user_data = user_data;
+}
+
+void IOUring::prep_cancel_op(uint64_t target, uint64_t user_data) {
+    struct io_uring_sqe *entry = sqe();
+
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->fd = -1;
+    entry->addr = target;
+    entry->user_data = user_data;
+}
+
+void IOUring::submit(unsigned int wait, int timeout) {
+    struct io_uring_getevents_arg arg = {};
+    struct __kernel_timespec ts = {};
+    unsigned int flags = 0;
+    long ret;
+
+    if (m_sq_queued == 0 && wait == 0) {
+        return;
+    }
+
+    store_release(m_sq_tail, m_sq_local_tail);
+
+    if (wait > 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        arg.sigmask_sz = _NSIG / 8;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    do {
+        ret = syscall(__NR_io_uring_enter, m_fd, m_sq_queued, wait, flags, &arg, sizeof(arg));
+        m_stats.enters++;
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        // nothing was submitted and the wait timed out, or the completion queue is full and must
+        // be drained first
+        if (errno == ETIME || errno == EBUSY) {
+            return;
+        }
+        SPH_THROW(RuntimeException, strerror(errno));
+    }
+
+    m_sq_queued -= static_cast<unsigned int>(ret);
+    m_stats.submissions += static_cast<uint64_t>(ret);
+}
+
+bool IOUring::next(Completion &completion) {
+    unsigned int head = *m_cq_head;
+
+    if (head == load_acquire(m_cq_tail)) {
+        return false;
+    }
+
+    const struct io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+    completion.user_data = cqe.user_data;
+    completion.res = cqe.res;
+    completion.more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    completion.has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    completion.buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+    store_release(m_cq_head, head + 1);
+    m_stats.completions++;
+    return true;
+}
+
+#else
+
+using namespace sph::ipc::net;
+
+// built without io_uring support, the engine is never available
+
+IOUring::~IOUring() = default;
+
+bool IOUring::supported() {
+    return false;
+}
+
+bool IOUring::init(unsigned int entries) {
+    (void)entries;
+    return false;
+}
+
+bool IOUring::register_buffers(unsigned int count, size_t size) {
+    (void)count;
+    (void)size;
+    return false;
+}
+
+void IOUring::recycle(uint16_t id) {
+    (void)id;
+}
+
+void IOUring::prep_accept(int fd, uint64_t user_data) {
+    (void)fd;
+    (void)user_data;
+}
+
+void IOUring::prep_recv(int fd, uint64_t user_data) {
+    (void)fd;
+    (void)user_data;
+}
+
+void IOUring::prep_poll(int fd, short events, uint64_t user_data) {
+    (void)fd;
+    (void)events;
+    (void)user_data;
+}
+
+void IOUring::prep_read(int fd, void *buf, size_t size, uint64_t user_data) {
+    (void)fd;
+    (void)buf;
+    (void)size;
+    (void)user_data;
+}
+
+void IOUring::prep_cancel(int fd, uint64_t user_data) {
+    (void)fd;
+    (void)user_data;
+}
+
+void IOUring::prep_cancel_op(uint64_t target, uint64_t user_data) {
+    (void)target;
+    (void)user_data;
+}
+
+void IOUring::submit(unsigned int wait, int timeout) {
+    (void)wait;
+    (void)timeout;
+}
+
+bool IOUring::next(Completion &completion) {
+    (void)completion;
+    return false;
+}
+
+#endif
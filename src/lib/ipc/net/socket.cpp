@@ -28,6 +28,9 @@ Socket::Socket(Family family, Type type, Protocol protocol) {
     case Family::INET6:
         m_family = AF_INET6;
         break;
+    case Family::UNIX:
+        m_family = AF_UNIX;
+        break;
     }
 
     if (m_family == -1) {
@@ -54,6 +57,9 @@ Socket::Socket(Family family, Type type, Protocol protocol) {
     case Protocol::UDP:
         m_protocol = IPPROTO_UDP;
         break;
+    case Protocol::DEFAULT:
+        m_protocol = 0;
+        break;
     }
 
     if (m_protocol == -1) {
@@ -76,7 +82,7 @@ Socket::~Socket() {
 
 void Socket::reset(bool keep_opts) {
     int new_fd;
-    void *opt_val = nullptr;
+    unsigned char opt_val[64];
     socklen_t opt_len;
 
     // cancel pending read/write ops
@@ -97,6 +103,7 @@ void Socket::reset(bool keep_opts) {
     if (keep_opts) {
         // apply current opts
         for (int &opt_name : m_socket_opts) {
+            opt_len = sizeof(opt_val);
             get_opt(SOL_SOCKET, opt_name, opt_val, &opt_len);
             if (setsockopt(new_fd, SOL_SOCKET, opt_name, opt_val, opt_len) == -1) {
                 SPH_THROW(RuntimeException, err_str());
@@ -265,7 +272,7 @@ bool Socket::poll(int timeout) const {
 void Socket::set_rx_timeout(long us) {
     struct timeval timeout;
     time_t secs = us / 1000000;
-    suseconds_t usecs = (us * 1000000 - secs) / 1000000;
+    suseconds_t usecs = us % 1000000;
 
     timeout.tv_sec = secs;
     timeout.tv_usec = usecs;
@@ -276,7 +283,7 @@ void Socket::set_rx_timeout(long us) {
 void Socket::set_tx_timeout(long us) {
     struct timeval timeout;
     time_t secs = us / 1000000;
-    suseconds_t usecs = (us * 1000000 - secs) / 1000000;
+    suseconds_t usecs = us % 1000000;
 
     timeout.tv_sec = secs;
     timeout.tv_usec = usecs;
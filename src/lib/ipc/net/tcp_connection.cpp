@@ -0,0 +1,274 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <sys/socket.h>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/except.h"
+#include "seraphim/ipc/net/tcp_connection.h"
+
+using namespace sph;
+using namespace sph::ipc::net;
+
+/**
+ * @brief Blocking socket output for protobuf streams.
+ *        Errors are remembered instead of thrown, since they must not unwind through the
+ *        serialization code.
+ */
+class SocketOutputStream : public google::protobuf::io::CopyingOutputStream {
+public:
+    explicit SocketOutputStream(int fd) : m_fd(fd) {}
+
+    bool Write(const void *buffer, int size) override {
+        const uint8_t *data = static_cast<const uint8_t *>(buffer);
+        ssize_t ret;
+
+        while (size > 0) {
+            ret = send(m_fd, data, static_cast<size_t>(size), MSG_NOSIGNAL);
+            if (ret == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                return false;
+            }
+
+            data += ret;
+            size -= static_cast<int>(ret);
+            written += static_cast<size_t>(ret);
+        }
+
+        return true;
+    }
+
+    /// errno of the failed write, 0 if there was none
+    int error = 0;
+    /// bytes written so far
+    size_t written = 0;
+
+private:
+    int m_fd;
+};
+
+TCPConnection::TCPConnection(int fd) : m_fd(fd) {}
+
+void TCPConnection::reserve(size_t size) {
+    MessageHeader msghdr = {};
+    size_t buffered = m_rx_end - m_rx_begin;
+    size_t needed = sizeof(msghdr);
+
+    if (m_rx_buffer.empty()) {
+        m_rx_buffer.resize(RX_BUFFER_SIZE);
+    }
+
+    // make sure the message which is currently being received fits into the buffer
+    if (buffered >= sizeof(msghdr)) {
+        std::memcpy(&msghdr, m_rx_buffer.data() + m_rx_begin, sizeof(msghdr));
+        if (msghdr.size > m_max_message_size) {
+            SPH_THROW(RuntimeException, "Message too large");
+        }
+        needed += msghdr.size;
+    }
+
+    // do not hold on to the memory of a large message for the lifetime of the connection
+    if (m_rx_buffer.size() > RX_BUFFER_SIZE && buffered + size <= RX_BUFFER_SIZE &&
+        needed <= RX_BUFFER_SIZE) {
+        std::vector<uint8_t> buffer(RX_BUFFER_SIZE);
+        std::memcpy(buffer.data(), m_rx_buffer.data() + m_rx_begin, buffered);
+        m_rx_buffer.swap(buffer);
+        m_rx_begin = 0;
+        m_rx_end = buffered;
+        return;
+    }
+
+    if (m_rx_buffer.size() - m_rx_end < size || m_rx_buffer.size() - m_rx_begin < needed) {
+        // move the unconsumed data to the front
+        std::memmove(m_rx_buffer.data(), m_rx_buffer.data() + m_rx_begin, buffered);
+        m_rx_begin = 0;
+        m_rx_end = buffered;
+        if (m_rx_buffer.size() < needed) {
+            m_rx_buffer.resize(needed);
+        }
+        if (m_rx_buffer.size() - m_rx_end < size) {
+            m_rx_buffer.resize(m_rx_end + size);
+        }
+    }
+}
+
+bool TCPConnection::read() {
+    ssize_t ret;
+
+    reserve(1);
+
+    // read as much as fits, the peer may have sent several messages
+    do {
+        ret = recv(m_fd, m_rx_buffer.data() + m_rx_end, m_rx_buffer.size() - m_rx_end, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        } else if (errno == ECONNRESET) {
+            SPH_THROW(PeerDisconnectedException);
+        }
+        SPH_THROW(RuntimeException, strerror(errno));
+    } else if (ret == 0) {
+        SPH_THROW(PeerDisconnectedException);
+    }
+
+    m_rx_end += static_cast<size_t>(ret);
+    return true;
+}
+
+void TCPConnection::append(const uint8_t *data, size_t size) {
+    reserve(size);
+    std::memcpy(m_rx_buffer.data() + m_rx_end, data, size);
+    m_rx_end += size;
+}
+
+bool TCPConnection::pending() const {
+    MessageHeader msghdr = {};
+    size_t buffered = m_rx_end - m_rx_begin;
+
+    if (buffered < sizeof(msghdr)) {
+        return false;
+    }
+
+    std::memcpy(&msghdr, m_rx_buffer.data() + m_rx_begin, sizeof(msghdr));
+    return buffered - sizeof(msghdr) >= msghdr.size;
+}
+
+bool TCPConnection::next(Seraphim::Message &msg) {
+    const uint8_t *data;
+    size_t size;
+
+    if (!next(data, size)) {
+        return false;
+    }
+
+    // parse the message in place
+    if (!msg.ParseFromArray(data, static_cast<int>(size))) {
+        SPH_THROW(RuntimeException, "Failed to deserialize message");
+    }
+
+    return true;
+}
+
+bool TCPConnection::next(const uint8_t *&data, size_t &size) {
+    MessageHeader msghdr = {};
+
+    if (!pending()) {
+        return false;
+    }
+
+    std::memcpy(&msghdr, m_rx_buffer.data() + m_rx_begin, sizeof(msghdr));
+
+    // the data stays where it is until the next read
+    data = m_rx_buffer.data() + m_rx_begin + sizeof(msghdr);
+    size = msghdr.size;
+    m_rx_begin += sizeof(msghdr) + msghdr.size;
+    if (m_rx_begin == m_rx_end) {
+        m_rx_begin = 0;
+        m_rx_end = 0;
+    }
+
+    return true;
+}
+
+void TCPConnection::queue(const Seraphim::Message &msg) {
+    MessageHeader msghdr = {};
+
+    // ByteSizeLong() caches the sizes of all submessages, so serialization does not compute them
+    // a second time
+    msghdr.size = msg.ByteSizeLong();
+    if (msghdr.size > m_max_message_size) {
+        SPH_THROW(RuntimeException, "Message too large");
+    }
+
+    if (m_tx_begin > 0) {
+        // move the data which was not written yet to the front
+        std::memmove(m_tx_buffer.data(), m_tx_buffer.data() + m_tx_begin, m_tx_end - m_tx_begin);
+        m_tx_end -= m_tx_begin;
+        m_tx_begin = 0;
+    }
+
+    size_t frame_size = sizeof(msghdr) + msghdr.size;
+    if (m_tx_buffer.size() - m_tx_end < frame_size) {
+        m_tx_buffer.resize(m_tx_end + frame_size);
+    }
+
+    // the header and the message are stored back-to-back, so a single write sends both
+    std::memcpy(m_tx_buffer.data() + m_tx_end, &msghdr, sizeof(msghdr));
+    msg.SerializeWithCachedSizesToArray(m_tx_buffer.data() + m_tx_end + sizeof(msghdr));
+    m_tx_end += frame_size;
+}
+
+bool TCPConnection::flush() {
+    ssize_t ret;
+
+    while (!flushed()) {
+        // do not raise SIGPIPE if the peer is gone
+        ret = send(m_fd, m_tx_buffer.data() + m_tx_begin, m_tx_end - m_tx_begin, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            } else if (errno == EPIPE || errno == ECONNRESET) {
+                SPH_THROW(PeerDisconnectedException);
+            }
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+
+        m_tx_begin += static_cast<size_t>(ret);
+    }
+
+    return true;
+}
+
+bool TCPConnection::write(const Seraphim::Message &msg) {
+    MessageHeader msghdr = {};
+    SocketOutputStream socket(m_fd);
+    bool written;
+
+    if (!flushed()) {
+        SPH_THROW(RuntimeException, "Send buffer not flushed");
+    }
+
+    msghdr.size = msg.ByteSizeLong();
+    if (msghdr.size > m_max_message_size) {
+        SPH_THROW(RuntimeException, "Message too large");
+    }
+
+    {
+        google::protobuf::io::CopyingOutputStreamAdaptor window(&socket, STREAM_WINDOW);
+        {
+            google::protobuf::io::CodedOutputStream stream(&window);
+            stream.WriteRaw(&msghdr, sizeof(msghdr));
+            msg.SerializeWithCachedSizes(&stream);
+        }
+        written = window.Flush();
+    }
+
+    if (written) {
+        return true;
+    }
+
+    if (socket.error == EAGAIN || socket.error == EWOULDBLOCK) {
+        if (socket.written == 0) {
+            return false;
+        }
+        SPH_THROW(RuntimeException, "Timeout while streaming message");
+    } else if (socket.error == EPIPE || socket.error == ECONNRESET) {
+        SPH_THROW(PeerDisconnectedException);
+    }
+    SPH_THROW(RuntimeException, strerror(socket.error));
+}
@@ -7,6 +7,8 @@
 
 #include <errno.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -22,7 +24,33 @@ using namespace sph::ipc::net;
 TCPSocket::TCPSocket(Family family) : Socket(family, Socket::Type::STREAM, Socket::Protocol::TCP) {
     // allow address reuse by default
     int opt_val = 1;
-    set_opt(SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt_val, sizeof(opt_val));
+    set_opt(SOL_SOCKET, SO_REUSEADDR, &opt_val, sizeof(opt_val));
+    set_opt(SOL_SOCKET, SO_REUSEPORT, &opt_val, sizeof(opt_val));
+
+    apply_nodelay(m_fd);
+}
+
+bool TCPSocket::connect(const std::string &ipaddr, uint16_t port, int timeout) {
+    if (!Socket::connect(ipaddr, port, timeout)) {
+        return false;
+    }
+
+    // connect() may have replaced the OS socket, TCP level options are not carried over
+    apply_nodelay(m_fd);
+    return true;
+}
+
+void TCPSocket::set_nodelay(bool enable) {
+    m_nodelay = enable;
+    apply_nodelay(m_fd);
+}
+
+void TCPSocket::apply_nodelay(int fd) const {
+    int opt_val = m_nodelay ? 1 : 0;
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt_val, sizeof(opt_val)) == -1) {
+        SPH_THROW(RuntimeException, strerror(errno));
+    }
 }
 
 void TCPSocket::listen(int backlog) {
@@ -31,14 +59,24 @@ void TCPSocket::listen(int backlog) {
     }
 }
 
-int TCPSocket::accept(struct sockaddr *addr, socklen_t *addrlen) {
+int TCPSocket::accept(struct sockaddr *addr, socklen_t *addrlen, int flags) {
     int fd;
 
-    fd = ::accept(m_fd, addr, addrlen);
+    fd = ::accept4(m_fd, addr, addrlen, flags);
     if (fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return -1;
+        }
         SPH_THROW(RuntimeException, strerror(errno));
     }
 
+    try {
+        apply_nodelay(fd);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
     return fd;
 }
 
@@ -94,10 +132,13 @@ ssize_t TCPSocket::receive_msg(int fd, struct msghdr *msg, int flags) {
 ssize_t TCPSocket::send_msg(int fd, struct msghdr *msg, int flags) {
     ssize_t ret;
 
-    ret = sendmsg(fd, msg, flags);
+    // do not raise SIGPIPE if the peer is gone
+    ret = sendmsg(fd, msg, flags | MSG_NOSIGNAL);
     if (ret == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             SPH_THROW(TimeoutException);
+        } else if (errno == EPIPE || errno == ECONNRESET) {
+            SPH_THROW(PeerDisconnectedException);
         } else {
             SPH_THROW(RuntimeException, strerror(errno));
         }
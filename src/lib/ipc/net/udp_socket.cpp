@@ -12,6 +12,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "seraphim/except.h"
 #include "seraphim/ipc/net/udp_socket.h"
 
 using namespace sph;
@@ -21,5 +22,44 @@ UDPSocket::UDPSocket(Family family)
     : Socket(family, Socket::Type::DATAGRAM, Socket::Protocol::UDP) {
     // allow address reuse by default
     int opt_val = 1;
-    set_opt(SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt_val, sizeof(opt_val));
+    set_opt(SOL_SOCKET, SO_REUSEADDR, &opt_val, sizeof(opt_val));
+    set_opt(SOL_SOCKET, SO_REUSEPORT, &opt_val, sizeof(opt_val));
+}
+
+void UDPSocket::set_rx_buffer_size(int bytes) {
+    set_opt(SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+}
+
+void UDPSocket::set_tx_buffer_size(int bytes) {
+    set_opt(SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+}
+
+int UDPSocket::receive_mmsg(struct mmsghdr *msgs, unsigned int vlen, int flags) {
+    int ret;
+
+    ret = recvmmsg(m_fd, msgs, vlen, flags, nullptr);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SPH_THROW(TimeoutException);
+        } else {
+            SPH_THROW(RuntimeException, err_str());
+        }
+    }
+
+    return ret;
+}
+
+int UDPSocket::send_mmsg(struct mmsghdr *msgs, unsigned int vlen, int flags) {
+    int ret;
+
+    ret = sendmmsg(m_fd, msgs, vlen, flags);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SPH_THROW(TimeoutException);
+        } else {
+            SPH_THROW(RuntimeException, err_str());
+        }
+    }
+
+    return ret;
 }
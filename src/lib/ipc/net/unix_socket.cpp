@@ -0,0 +1,155 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/except.h"
+#include "seraphim/ipc/net/unix_socket.h"
+
+using namespace sph;
+using namespace sph::ipc::net;
+
+/**
+ * @brief Fill a UNIX domain socket address.
+ *        Throws sph::InvalidArgumentException if the path is too long.
+ */
+static struct sockaddr_un make_address(const std::string &path) {
+    struct sockaddr_un addr = {};
+
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        SPH_THROW(InvalidArgumentException, std::string("Invalid socket path: ") + path);
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+UnixSocket::UnixSocket() : Socket(Socket::Family::UNIX, Socket::Type::STREAM,
+                                  Socket::Protocol::DEFAULT) {}
+
+UnixSocket::~UnixSocket() {
+    if (!m_path.empty()) {
+        ::unlink(m_path.c_str());
+    }
+}
+
+bool UnixSocket::bind(const std::string &path) {
+    struct sockaddr_un addr = make_address(path);
+
+    // get a new socket if required
+    if (m_bound || m_connected) {
+        reset(true);
+    }
+
+    // a server which did not shut down cleanly leaves its socket file behind
+    struct stat path_stat;
+    if (::stat(path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+        ::unlink(path.c_str());
+    }
+
+    if (::bind(m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+        // failing to bind is not an 'exceptional' failure
+        return false;
+    }
+
+    m_path = path;
+    m_bound = true;
+    return true;
+}
+
+bool UnixSocket::connect(const std::string &path) {
+    struct sockaddr_un addr = make_address(path);
+
+    // get a new socket if required
+    if (m_bound || m_connected) {
+        reset(true);
+    }
+
+    if (::connect(m_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+        // failing to connect is not an 'exceptional' failure
+        return false;
+    }
+
+    m_connected = true;
+    return true;
+}
+
+void UnixSocket::listen(int backlog) {
+    if (::listen(m_fd, backlog) == -1) {
+        SPH_THROW(RuntimeException, strerror(errno));
+    }
+}
+
+int UnixSocket::accept() {
+    int fd;
+
+    fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd == -1) {
+        SPH_THROW(RuntimeException, strerror(errno));
+    }
+
+    return fd;
+}
+
+ssize_t UnixSocket::receive(int fd, void *buf, size_t max_len, int flags) {
+    ssize_t ret;
+
+    ret = recv(fd, buf, max_len, flags);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SPH_THROW(TimeoutException);
+        } else {
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+    } else if (ret == 0) {
+        SPH_THROW(PeerDisconnectedException);
+    }
+
+    return ret;
+}
+
+ssize_t UnixSocket::receive_msg(int fd, struct msghdr *msg, int flags) {
+    ssize_t ret;
+
+    ret = recvmsg(fd, msg, flags);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SPH_THROW(TimeoutException);
+        } else {
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+    } else if (ret == 0) {
+        SPH_THROW(PeerDisconnectedException);
+    }
+
+    return ret;
+}
+
+ssize_t UnixSocket::send_msg(int fd, struct msghdr *msg, int flags) {
+    ssize_t ret;
+
+    // do not raise SIGPIPE if the peer is gone
+    ret = sendmsg(fd, msg, flags | MSG_NOSIGNAL);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SPH_THROW(TimeoutException);
+        } else if (errno == EPIPE || errno == ECONNRESET) {
+            SPH_THROW(PeerDisconnectedException);
+        } else {
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,30 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "seraphim/ipc/packed_geometry.h"
+
+void sph::ipc::add_region(Seraphim::Types::PackedRegions2D &regions, int32_t x, int32_t y,
+                          int32_t w, int32_t h) {
+    regions.add_values(x);
+    regions.add_values(y);
+    regions.add_values(w);
+    regions.add_values(h);
+}
+
+bool sph::ipc::is_valid(const Seraphim::Types::PackedRegions2D &regions) {
+    return regions.values_size() % 4 == 0;
+}
+
+bool sph::ipc::is_valid(const Seraphim::Types::PackedPointSets2D &sets) {
+    uint64_t points = 0;
+
+    for (uint32_t size : sets.sizes()) {
+        points += size;
+    }
+
+    return points * 2 == static_cast<uint64_t>(sets.coords_size());
+}
@@ -0,0 +1,239 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "seraphim/ipc/request_view.h"
+
+using namespace sph::ipc;
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+/// Field tags of Seraphim.Message, Seraphim.Request and google.protobuf.Any.
+static constexpr uint32_t MESSAGE_ID = WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_VARINT);
+static constexpr uint32_t MESSAGE_REQ =
+    WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+static constexpr uint32_t MESSAGE_TRACE =
+    WireFormatLite::MakeTag(4, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+static constexpr uint32_t REQUEST_INNER =
+    WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+static constexpr uint32_t REQUEST_TYPE =
+    WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_FIXED32);
+static constexpr uint32_t REQUEST_PAYLOAD =
+    WireFormatLite::MakeTag(3, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+static constexpr uint32_t REQUEST_SUPERSEDE =
+    WireFormatLite::MakeTag(4, WireFormatLite::WIRETYPE_VARINT);
+static constexpr uint32_t REQUEST_DEADLINE =
+    WireFormatLite::MakeTag(5, WireFormatLite::WIRETYPE_VARINT);
+static constexpr uint32_t ANY_TYPE_URL =
+    WireFormatLite::MakeTag(1, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+static constexpr uint32_t ANY_VALUE =
+    WireFormatLite::MakeTag(2, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+/**
+ * @brief Locate a length delimited field without copying it.
+ */
+static bool read_bytes(CodedInputStream &in, const uint8_t *base, const uint8_t *&ptr,
+                       size_t &size) {
+    uint32_t len;
+
+    if (!in.ReadVarint32(&len)) {
+        return false;
+    }
+
+    ptr = base + in.CurrentPosition();
+    size = len;
+    return in.Skip(static_cast<int>(len));
+}
+
+/**
+ * @brief Type id of the message a type URL refers to.
+ */
+static uint32_t type_url_id(const char *url, size_t size) {
+    // the name follows the last slash, see google.protobuf.Any
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (url[i] == '/') {
+            start = i + 1;
+        }
+    }
+
+    return type_id(std::string(url + start, size - start));
+}
+
+uint32_t sph::ipc::type_id(const std::string &full_name) {
+    uint32_t hash = 2166136261u;
+
+    for (const char &c : full_name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void sph::ipc::pack_request(const google::protobuf::Message &inner, Seraphim::Request &req) {
+    req.clear_inner();
+    req.set_type(type_id(inner.GetDescriptor()->full_name()));
+    inner.SerializeToString(req.mutable_payload());
+}
+
+bool RequestView::parse(const void *data, size_t size) {
+    const uint8_t *base = static_cast<const uint8_t *>(data);
+    CodedInputStream in(base, static_cast<int>(size));
+    const uint8_t *ptr;
+    size_t len;
+    uint32_t tag;
+
+    *this = RequestView();
+
+    while ((tag = in.ReadTag()) != 0) {
+        switch (tag) {
+        case MESSAGE_ID:
+            if (!in.ReadVarint32(&m_id)) {
+                return false;
+            }
+            break;
+        case MESSAGE_REQ:
+            if (!read_bytes(in, base, ptr, len) || !parse_request(ptr, len)) {
+                return false;
+            }
+            m_request = true;
+            break;
+        case MESSAGE_TRACE:
+            // the trace is small and rarely present, so it is only parsed on demand
+            if (!read_bytes(in, base, m_trace_data, m_trace_size)) {
+                return false;
+            }
+            break;
+        default:
+            // responses and unknown fields
+            if (!WireFormatLite::SkipField(&in, tag)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    return in.ConsumedEntireMessage();
+}
+
+void RequestView::parse(const Seraphim::Message &msg) {
+    *this = RequestView();
+
+    m_id = msg.id();
+    if (msg.has_trace()) {
+        m_trace = &msg.trace();
+    }
+    m_request = msg.has_req();
+    if (!m_request) {
+        return;
+    }
+
+    const Seraphim::Request &req = msg.req();
+    m_supersede = req.supersede();
+    m_deadline = req.deadline();
+    if (req.type() != 0) {
+        m_type = req.type();
+        m_payload = reinterpret_cast<const uint8_t *>(req.payload().data());
+        m_payload_size = req.payload().size();
+    } else if (req.has_inner()) {
+        m_type = type_url_id(req.inner().type_url().data(), req.inner().type_url().size());
+        m_payload = reinterpret_cast<const uint8_t *>(req.inner().value().data());
+        m_payload_size = req.inner().value().size();
+    }
+}
+
+bool RequestView::trace(Seraphim::Trace &trace) const {
+    if (m_trace) {
+        trace.CopyFrom(*m_trace);
+        return true;
+    }
+
+    return m_trace_data && trace.ParseFromArray(m_trace_data, static_cast<int>(m_trace_size));
+}
+
+bool RequestView::parse_request(const uint8_t *data, size_t size) {
+    CodedInputStream in(data, static_cast<int>(size));
+    uint32_t tag;
+
+    while ((tag = in.ReadTag()) != 0) {
+        switch (tag) {
+        case REQUEST_INNER: {
+            const uint8_t *ptr;
+            size_t len;
+
+            if (!read_bytes(in, data, ptr, len) || !parse_any(ptr, len)) {
+                return false;
+            }
+            break;
+        }
+        case REQUEST_TYPE:
+            if (!in.ReadLittleEndian32(&m_type)) {
+                return false;
+            }
+            break;
+        case REQUEST_PAYLOAD:
+            if (!read_bytes(in, data, m_payload, m_payload_size)) {
+                return false;
+            }
+            break;
+        case REQUEST_SUPERSEDE:
+            if (!in.ReadVarint32(&m_supersede)) {
+                return false;
+            }
+            break;
+        case REQUEST_DEADLINE:
+            if (!in.ReadVarint32(&m_deadline)) {
+                return false;
+            }
+            break;
+        default:
+            if (!WireFormatLite::SkipField(&in, tag)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    return in.ConsumedEntireMessage();
+}
+
+bool RequestView::parse_any(const uint8_t *data, size_t size) {
+    CodedInputStream in(data, static_cast<int>(size));
+    const uint8_t *url = nullptr;
+    size_t url_size = 0;
+    uint32_t tag;
+
+    while ((tag = in.ReadTag()) != 0) {
+        switch (tag) {
+        case ANY_TYPE_URL:
+            if (!read_bytes(in, data, url, url_size)) {
+                return false;
+            }
+            break;
+        case ANY_VALUE:
+            if (!read_bytes(in, data, m_payload, m_payload_size)) {
+                return false;
+            }
+            break;
+        default:
+            if (!WireFormatLite::SkipField(&in, tag)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    if (url) {
+        m_type = type_url_id(reinterpret_cast<const char *>(url), url_size);
+    }
+
+    return in.ConsumedEntireMessage();
+}
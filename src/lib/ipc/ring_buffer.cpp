@@ -0,0 +1,261 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/ring_buffer.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "64-bit atomics must be lock-free to be shared between processes");
+
+/// Messages are stored with 8 byte alignment.
+static constexpr uint64_t ALIGNMENT = 8;
+
+static inline uint64_t align(uint64_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static inline size_t header_size() {
+    return static_cast<size_t>(align(sizeof(RingBuffer::Header)));
+}
+
+/**
+ * @brief Acquire a semaphore, honoring a timeout.
+ *        Throws sph::RuntimeException in case of errors.
+ *        Throws sph::TimeoutException in case of timeouts.
+ */
+static void acquire(Semaphore &sem, int timeout,
+                    const std::chrono::steady_clock::time_point &deadline) {
+    if (timeout > 0) {
+        if (sem.wait_until(deadline)) {
+            return;
+        }
+        if (errno == ETIMEDOUT) {
+            SPH_THROW(TimeoutException);
+        }
+        SPH_THROW(RuntimeException, strerror(errno));
+    }
+
+    // blocking wait, restart if we were interrupted by a signal
+    while (!sem.wait()) {
+        if (errno != EINTR) {
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+    }
+}
+
+size_t RingBuffer::footprint(uint32_t depth, size_t capacity) {
+    return header_size() + depth * sizeof(Descriptor) + static_cast<size_t>(align(capacity));
+}
+
+bool RingBuffer::create(void *addr, size_t size, uint32_t depth) {
+    size_t offset = header_size() + depth * sizeof(Descriptor);
+
+    if (depth == 0 || size <= offset + ALIGNMENT) {
+        return false;
+    }
+
+    m_header = new (addr) Header;
+    m_header->head = 0;
+    m_header->tail = 0;
+    m_header->producer_waiting = 0;
+    m_header->depth = depth;
+    m_header->capacity = (size - offset) & ~(ALIGNMENT - 1);
+    m_header->write_offset = 0;
+    m_acquired = false;
+
+    if (!m_items.create(&m_header->items, 0) || !m_space.create(&m_header->space, 0)) {
+        m_header = nullptr;
+        return false;
+    }
+
+    m_descriptors = reinterpret_cast<Descriptor *>(static_cast<unsigned char *>(addr) +
+                                                   header_size());
+    m_data = static_cast<unsigned char *>(addr) + offset;
+    return true;
+}
+
+bool RingBuffer::open(void *addr) {
+    Header *header = static_cast<Header *>(addr);
+
+    if (header->depth == 0 || !m_items.open(&header->items) || !m_space.open(&header->space)) {
+        return false;
+    }
+
+    m_header = header;
+    m_acquired = false;
+    m_descriptors = reinterpret_cast<Descriptor *>(static_cast<unsigned char *>(addr) +
+                                                   header_size());
+    m_data = static_cast<unsigned char *>(addr) + header_size() +
+             m_header->depth * sizeof(Descriptor);
+    return true;
+}
+
+uint64_t RingBuffer::allocate(uint64_t size, uint64_t head) const {
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    uint64_t capacity = m_header->capacity;
+    uint64_t write = m_header->write_offset;
+
+    if (tail - head >= m_header->depth) {
+        // all descriptors are in use
+        return UINT64_MAX;
+    }
+
+    if (head == tail) {
+        // the queue is empty, so we can start over at the beginning of the data area
+        return size <= capacity ? 0 : UINT64_MAX;
+    }
+
+    // the oldest unread message marks the end of the free space
+    uint64_t oldest = m_descriptors[head % m_header->depth].offset;
+
+    if (oldest < write) {
+        // used space is [oldest, write), try to append or wrap around to the beginning
+        if (write + size <= capacity) {
+            return write;
+        }
+        if (size <= oldest) {
+            return 0;
+        }
+    } else if (write + size <= oldest) {
+        // used space is [oldest, capacity) and [0, write)
+        return write;
+    }
+
+    return UINT64_MAX;
+}
+
+unsigned char *RingBuffer::reserve(size_t size, int timeout) {
+    uint64_t aligned = align(size > 0 ? size : 1);
+    uint64_t offset;
+
+    if (!m_header) {
+        SPH_THROW(RuntimeException, "Ring buffer not initialized");
+    }
+
+    if (aligned > m_header->capacity) {
+        SPH_THROW(RuntimeException, std::string("Memory region too small (") +
+                                        std::to_string(m_header->capacity) + std::string(" < ") +
+                                        std::to_string(size) + std::string(")"));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    for (;;) {
+        offset = allocate(aligned, m_header->head.load(std::memory_order_acquire));
+        if (offset != UINT64_MAX) {
+            break;
+        }
+
+        // announce that we are waiting, then check again so we cannot miss a wakeup that
+        // happened in between
+        m_header->producer_waiting.store(WAITING_BLOCKED);
+        offset = allocate(aligned, m_header->head.load());
+        if (offset != UINT64_MAX) {
+            m_header->producer_waiting.store(WAITING_NONE);
+            break;
+        }
+
+        acquire(m_space, timeout, deadline);
+    }
+
+    m_reserved = offset;
+    return m_data + offset;
+}
+
+unsigned char *RingBuffer::try_reserve(size_t size) {
+    uint64_t aligned = align(size > 0 ? size : 1);
+    uint64_t offset;
+
+    if (!m_header) {
+        SPH_THROW(RuntimeException, "Ring buffer not initialized");
+    }
+
+    if (aligned > m_header->capacity) {
+        SPH_THROW(RuntimeException, std::string("Memory region too small (") +
+                                        std::to_string(m_header->capacity) + std::string(" < ") +
+                                        std::to_string(size) + std::string(")"));
+    }
+
+    offset = allocate(aligned, m_header->head.load(std::memory_order_acquire));
+    if (offset == UINT64_MAX) {
+        // same as in reserve(), but the consumer reports the free space instead of waking us up
+        m_header->producer_waiting.store(WAITING_POLLING);
+        offset = allocate(aligned, m_header->head.load());
+        if (offset == UINT64_MAX) {
+            return nullptr;
+        }
+        m_header->producer_waiting.store(WAITING_NONE);
+    }
+
+    m_reserved = offset;
+    return m_data + offset;
+}
+
+void RingBuffer::commit(size_t size) {
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+
+    m_descriptors[tail % m_header->depth].offset = m_reserved;
+    m_descriptors[tail % m_header->depth].size = size;
+    m_header->write_offset = m_reserved + align(size > 0 ? size : 1);
+    m_header->tail.store(tail + 1, std::memory_order_release);
+
+    m_items.post();
+}
+
+const unsigned char *RingBuffer::front(size_t &size, int timeout) {
+    if (!m_header) {
+        SPH_THROW(RuntimeException, "Ring buffer not initialized");
+    }
+
+    // every message is counted once, no matter how often it is accessed
+    if (!m_acquired) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        acquire(m_items, timeout, deadline);
+
+        if (m_interrupted.exchange(false)) {
+            SPH_THROW(TimeoutException);
+        }
+        m_acquired = true;
+    }
+
+    uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    if (head == m_header->tail.load(std::memory_order_acquire)) {
+        SPH_THROW(RuntimeException, "Ring buffer out of sync");
+    }
+
+    const Descriptor &desc = m_descriptors[head % m_header->depth];
+    size = static_cast<size_t>(desc.size);
+    return m_data + desc.offset;
+}
+
+bool RingBuffer::pop() {
+    m_acquired = false;
+    m_header->head.fetch_add(1);
+
+    switch (m_header->producer_waiting.exchange(WAITING_NONE)) {
+    case WAITING_BLOCKED:
+        m_space.post();
+        return false;
+    case WAITING_POLLING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void RingBuffer::interrupt() {
+    m_interrupted = true;
+    m_items.post();
+}
@@ -5,6 +5,10 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <cerrno>
+#include <ctime>
+#include <thread>
+
 #include "seraphim/ipc/semaphore.h"
 
 using namespace sph::ipc;
@@ -105,6 +109,51 @@ bool Semaphore::trywait() {
     return ::sem_trywait(m_sem) == 0;
 }
 
+bool Semaphore::wait_until(const std::chrono::steady_clock::time_point &deadline) {
+#ifdef __APPLE__
+    /*
+     * Darwin does not implement sem_timedwait(), so we have to resort to polling.
+     */
+    while (::sem_trywait(m_sem) != 0) {
+        if (errno != EAGAIN) {
+            return false;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    return true;
+#else
+    int ret;
+
+    do {
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining < std::chrono::steady_clock::duration::zero()) {
+            remaining = std::chrono::steady_clock::duration::zero();
+        }
+
+        // sem_timedwait() expects an absolute CLOCK_REALTIME timestamp, so the deadline has to be
+        // converted on every iteration to honor the remaining time after an interruption
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        ts.tv_sec += static_cast<time_t>(ns / 1000000000);
+        ts.tv_nsec += static_cast<long>(ns % 1000000000);
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        ret = ::sem_timedwait(m_sem, &ts);
+    } while (ret != 0 && errno == EINTR);
+
+    return ret == 0;
+#endif
+}
+
 bool Semaphore::post() {
     return ::sem_post(m_sem) == 0;
 }
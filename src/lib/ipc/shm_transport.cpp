@@ -5,18 +5,87 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <csignal>
 #include <cstring>
-#include <poll.h>
+#include <fstream>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <sys/stat.h>
-#include <thread>
 #include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
 
 #include "seraphim/except.h"
+#include "seraphim/ipc/buffer_registry.h"
+#include "seraphim/ipc/chunk_stream.h"
 #include "seraphim/ipc/shm_transport.h"
 
 using namespace sph;
 using namespace sph::ipc;
+using google::protobuf::internal::WireFormatLite;
+
+/// Structures in the segment are stored with 8 byte alignment.
+static inline uint64_t align(uint64_t size) {
+    return (size + 7) & ~uint64_t(7);
+}
+
+/// Frame buffers are aligned to cache lines.
+static constexpr uint64_t FRAME_ALIGNMENT = 64;
+
+/**
+ * @brief Serialize a message which does not fit into a queue chunk by chunk.
+ *        A quarter of the queue is used per chunk, so the reader can consume one chunk while the
+ *        next ones are written.
+ */
+static void send_chunked(RingBuffer &queue, const Seraphim::Message &msg, size_t size,
+                         int timeout, std::function<void()> committed = nullptr) {
+    ChunkWriter writer(queue, size, (queue.capacity() / 4) & ~size_t(7), timeout,
+                       std::move(committed));
+    {
+        google::protobuf::io::CodedOutputStream stream(&writer);
+        msg.SerializeWithCachedSizes(&stream);
+    }
+    writer.finish();
+}
+
+/**
+ * @brief Get the size of huge pages in bytes, 2 MiB if it cannot be determined.
+ */
+static uint64_t huge_page_size() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    uint64_t size;
+
+    while (meminfo >> key) {
+        if (key == "Hugepagesize:" && meminfo >> size) {
+            return size * 1024;
+        }
+        meminfo.ignore(256, '\n');
+    }
+
+    return 2 * 1024 * 1024;
+}
+
+/**
+ * @brief Get the id of a message from the start of its serialized form.
+ * @return The id, 0 if it is not found.
+ */
+static uint32_t message_id(const unsigned char *data, size_t size) {
+    google::protobuf::io::CodedInputStream in(data, static_cast<int>(size));
+    uint32_t id = 0;
+
+    // fields are serialized in order, so the id comes first
+    if (in.ReadTag() == WireFormatLite::MakeTag(Seraphim::Message::kIdFieldNumber,
+                                                WireFormatLite::WIRETYPE_VARINT)) {
+        in.ReadVarint32(&id);
+    }
+    return id;
+}
 
 SharedMemoryTransport::~SharedMemoryTransport() {
     if (m_msgstore != nullptr) {
@@ -32,8 +101,14 @@ SharedMemoryTransport::~SharedMemoryTransport() {
 
 bool SharedMemoryTransport::open(const std::string &name) {
     struct stat shm_stat;
+    unsigned char *base;
 
+    m_name = name;
     m_fd = shm_open(name.c_str(), O_RDWR, S_IRUSR | S_IWUSR);
+    if (m_fd == -1 && errno == ENOENT) {
+        // the server may have placed the segment on hugetlbfs
+        m_fd = ::open((std::string(HUGETLBFS) + "/" + name).c_str(), O_RDWR);
+    }
     if (m_fd == -1) {
         return false;
     }
@@ -42,32 +117,66 @@ bool SharedMemoryTransport::open(const std::string &name) {
         return false;
     }
 
-    if (!map(static_cast<size_t>(shm_stat.st_size))) {
+    if (static_cast<size_t>(shm_stat.st_size) < sizeof(MessageStore) ||
+        !map(static_cast<size_t>(shm_stat.st_size))) {
+        return false;
+    }
+
+    // page tables are per process, so clients have to fault in the segment themselves
+    if (m_msgstore->populate) {
+        Options options;
+        options.populate = true;
+        place(options);
+    }
+
+    if (!m_doorbell.open(&m_msgstore->doorbell)) {
+        unmap();
         return false;
     }
 
-    if (!m_actor_sem.open(&m_msgstore->actors.sem)) {
+    // claim the first free channel
+    for (m_channel = 0; m_channel < m_msgstore->num_channels; m_channel++) {
+        uint32_t state = CHANNEL_FREE;
+        if (channel(m_channel).state.compare_exchange_strong(state, CHANNEL_CLAIMED)) {
+            break;
+        }
+    }
+
+    if (m_channel == m_msgstore->num_channels) {
         unmap();
         return false;
     }
 
-    if (!m_msg_sem.open(&m_msgstore->actors.sem)) {
+    // the lock tells the server that we are alive from now on
+    MessageStoreChannel &chan = channel(m_channel);
+    if (!lock_channel(m_channel, true)) {
+        chan.state = CHANNEL_FREE;
         unmap();
         return false;
     }
 
-    if (!m_actor_sem.wait()) {
+    base = reinterpret_cast<unsigned char *>(m_msgstore);
+    m_channels.reset(new Channel[m_msgstore->num_channels]);
+    if (!m_channels[m_channel].requests.open(base + chan.request_queue) ||
+        !m_channels[m_channel].responses.open(base + chan.response_queue)) {
+        lock_channel(m_channel, false);
+        chan.state = CHANNEL_FREE;
+        m_channels.reset();
         unmap();
         return false;
     }
 
-    m_msgstore->actors.num_actors++;
-    m_actor_id = m_msgstore->actors.num_actors;
-    if (!m_actor_sem.post()) {
+    // the server reclaims channels which stay claimed for too long, so it may not be ours anymore
+    chan.pid = static_cast<int32_t>(getpid());
+    uint32_t state = CHANNEL_CLAIMED;
+    if (!chan.state.compare_exchange_strong(state, CHANNEL_OPEN)) {
+        lock_channel(m_channel, false);
+        m_channels.reset();
         unmap();
         return false;
     }
 
+    m_doorbell.post();
     return true;
 }
 
@@ -75,66 +184,140 @@ bool SharedMemoryTransport::close() {
     return ::close(m_fd) == 0;
 }
 
-bool SharedMemoryTransport::create(const std::string &name, long size) {
+bool SharedMemoryTransport::create(const std::string &name, long size, uint32_t depth,
+                                   uint32_t channels) {
+    return create(name, size, depth, channels, Options());
+}
+
+bool SharedMemoryTransport::create(const std::string &name, long size, uint32_t depth,
+                                   uint32_t channels, const Options &options) {
     struct stat shm_stat;
+    uint64_t table_size;
+    uint64_t channel_size;
 
-    // shared memory segment size must at least be the size of the controlling structure
-    if (static_cast<size_t>(size) < sizeof(MessageStore)) {
+    if (size < 0 || depth == 0 || channels == 0) {
         return false;
     }
 
-    m_fd = shm_open(name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    // shared memory segment size must at least be the size of the controlling structures, the
+    // queues are checked when they are created
+    table_size = align(sizeof(MessageStore)) + align(channels * sizeof(MessageStoreChannel));
+    if (static_cast<uint64_t>(size) <= table_size) {
+        return false;
+    }
+    channel_size = ((static_cast<uint64_t>(size) - table_size) / channels) & ~uint64_t(7);
+
+    m_name = name;
+    if (options.huge_pages == HugePages::HUGETLBFS) {
+#ifdef __linux__
+        // files on hugetlbfs can only be sized in multiples of the huge page size
+        uint64_t page_size = huge_page_size();
+        size = static_cast<long>((static_cast<uint64_t>(size) + page_size - 1) / page_size *
+                                 page_size);
+
+        // clients look for POSIX shared memory first, so remove a segment left by a previous run
+        shm_unlink(name.c_str());
+        m_path = std::string(HUGETLBFS) + "/" + name;
+        m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+#else
+        return false;
+#endif
+    } else {
+        m_fd = shm_open(name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    }
     if (m_fd == -1) {
         return false;
     }
 
     if (fstat(m_fd, &shm_stat) == -1) {
+        remove();
         return false;
     }
 
     // on Linux, ftruncate() can always be called, but on macOS it fails with -EINVAL after the
     // first time it has been called, so check the segment size before truncating
-    if (shm_stat.st_size == 0 && ftruncate(m_fd, size) == -1) {
+    if (shm_stat.st_size != size && ftruncate(m_fd, size) == -1) {
         remove();
         return false;
     }
 
-    if (!map(static_cast<size_t>(size))) {
+    if (!map(static_cast<size_t>(size)) || !place(options)) {
+        unmap();
         remove();
         return false;
     }
 
-    m_msgstore->actors.num_actors = 1;
-    m_msgstore->msg.source = 0;
-    m_msgstore->msg.destination = 0;
-    m_msgstore->msg.type = MESSAGE_TYPE_UNKNOWN;
-    m_msgstore->msg.size = 0;
-    // create semaphores for the segment
-    if (!m_actor_sem.create(&m_msgstore->actors.sem, 1) ||
-        !m_msg_sem.create(&m_msgstore->msg.sem, 1)) {
+    m_msgstore->num_channels = channels;
+    m_msgstore->populate = options.populate;
+    m_msgstore->channels = align(sizeof(MessageStore));
+    m_msgstore->channel_size = channel_size;
+    if (!m_doorbell.create(&m_msgstore->doorbell, 0)) {
+        unmap();
         remove();
         return false;
     }
 
-    m_name = name;
+    // from here on, unmap() releases what was set up like it does for a server
     m_created = true;
-    m_actor_id = 1;
+
+    // large payloads such as images are meant to be placed in the frame area, but the request
+    // queue should still be able to hold a few inline images, while responses only carry results
+    m_channels.reset(new Channel[channels]);
+    m_depth = depth;
+    for (unsigned int i = 0; i < channels; i++) {
+        MessageStoreChannel &chan = channel(i);
+        chan.request_queue = table_size + i * channel_size;
+        chan.response_queue = chan.request_queue + ((channel_size / 4) & ~uint64_t(7));
+        chan.frames = chan.response_queue + ((channel_size / 8) & ~uint64_t(7));
+        chan.frames_size = chan.request_queue + channel_size - chan.frames;
+
+        if (!reset_channel(i)) {
+            unmap();
+            remove();
+            m_created = false;
+            return false;
+        }
+    }
+
+    m_last_served = channels - 1;
+    m_last_liveness_check = std::chrono::steady_clock::now();
     return true;
 }
 
 bool SharedMemoryTransport::remove() {
     int ret;
 
-    ret = shm_unlink(m_name.c_str());
+    if (m_fd > -1) {
+        close();
+    }
+
+    if (m_path.empty()) {
+        ret = shm_unlink(m_name.c_str());
+    } else {
+        ret = unlink(m_path.c_str());
+        m_path.clear();
+    }
     m_fd = -1;
 
     return ret == 0;
 }
 
+int SharedMemoryTransport::local_numa_node() {
+#ifdef __linux__
+    unsigned int cpu;
+    unsigned int node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+        return static_cast<int>(node);
+    }
+#endif
+    return -1;
+}
+
 bool SharedMemoryTransport::map(size_t size) {
     void *addr;
 
-    addr = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, m_fd, 0);
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
     if (addr == MAP_FAILED) {
         return false;
     }
@@ -144,21 +327,78 @@ bool SharedMemoryTransport::map(size_t size) {
     return true;
 }
 
+bool SharedMemoryTransport::place(const Options &options) {
+    unsigned char *base = reinterpret_cast<unsigned char *>(m_msgstore);
+
+    if (options.huge_pages == HugePages::TRANSPARENT) {
+#ifdef MADV_HUGEPAGE
+        // only a hint, shmem huge pages may be disabled in the kernel
+        madvise(base, m_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    // the policy has to be set before the pages are allocated, i.e. before they are faulted in
+    if (options.numa_node >= 0) {
+#ifdef __linux__
+        constexpr unsigned long bits = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask(static_cast<size_t>(options.numa_node) / bits + 1, 0);
+        mask.back() = 1UL << (static_cast<unsigned long>(options.numa_node) % bits);
+        // the preferred policy falls back to other nodes if the node runs out of memory
+        if (syscall(SYS_mbind, base, m_size, MPOL_PREFERRED, mask.data(), mask.size() * bits,
+                    0) != 0) {
+            return false;
+        }
+#else
+        return false;
+#endif
+    }
+
+    if (options.populate) {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(base, m_size, MADV_POPULATE_WRITE) == 0) {
+            return true;
+        }
+#endif
+        // kernels before 5.14 cannot prefault on request, so touch every page instead, reading
+        // is enough since the mapping is shared and writable
+        long page_size = sysconf(_SC_PAGESIZE);
+        for (size_t offset = 0; offset < m_size; offset += static_cast<size_t>(page_size)) {
+            (void)*reinterpret_cast<volatile unsigned char *>(base + offset);
+        }
+    }
+
+    return true;
+}
+
 bool SharedMemoryTransport::unmap() {
     bool ret;
 
-    m_size = 0;
     if (!m_msgstore) {
         return true;
     }
 
-    if (m_actor_sem.wait()) {
-        if (m_msgstore->actors.num_actors > 0) {
-            m_msgstore->actors.num_actors--;
+    if (!m_created && m_channels) {
+        // release our channel and let the server know so it can reclaim it, the lock goes first
+        // so the next client of the channel can take it
+        lock_channel(m_channel, false);
+        channel(m_channel).state = CHANNEL_CLOSED;
+        m_doorbell.post();
+    }
+
+    if (m_created) {
+        // channels which were never reset have not been registered
+        for (unsigned int i = 0; i < m_msgstore->num_channels; i++) {
+            if (m_channels[i].peer != 0) {
+                BufferRegistry::Instance().remove(m_channels[i].peer, m_name);
+            }
         }
-        m_actor_sem.post();
+        m_doorbell.destroy();
     }
 
+    // the queues refer to the mapped memory, so release them before unmapping it
+    m_channels.reset();
+    m_buffers.clear();
+
     ret = munmap(m_msgstore, m_size) == 0;
     m_msgstore = nullptr;
     m_size = 0;
@@ -166,74 +406,519 @@ bool SharedMemoryTransport::unmap() {
     return ret;
 }
 
-void SharedMemoryTransport::receive(Seraphim::Message &msg) {
-    int elapsed_ms = 0;
-    unsigned char *msg_ptr;
+bool SharedMemoryTransport::reset_channel(unsigned int index) {
+    MessageStoreChannel &chan = channel(index);
+    unsigned char *base = reinterpret_cast<unsigned char *>(m_msgstore);
 
-    if (!m_msgstore) {
-        SPH_THROW(RuntimeException, "Memory region not mapped");
+    // the client is gone, so nobody else accesses the queues until the channel is free again
+    // the frame area is managed by the client, so there is nothing to do for it
+    if (!m_channels[index].requests.create(base + chan.request_queue,
+                                           chan.response_queue - chan.request_queue, m_depth) ||
+        !m_channels[index].responses.create(base + chan.response_queue,
+                                            chan.frames - chan.response_queue, m_depth)) {
+        return false;
+    }
+
+    m_channels[index].blocked = false;
+    m_channels[index].paused = false;
+    m_channels[index].assembly = Assembly();
+
+    // let message handlers resolve references to the frame area, offsets are relative to the
+    // start of the segment
+    // every client of the channel is a peer of its own, so it cannot use what the previous one
+    // left behind, e.g. sessions
+    if (m_channels[index].peer != 0) {
+        BufferRegistry::Instance().remove(m_channels[index].peer, m_name);
     }
+    m_channels[index].peer = BufferRegistry::new_peer();
+    BufferRegistry::Instance().add(m_channels[index].peer, m_name, base + chan.frames,
+                                   chan.frames_size, chan.frames);
+    chan.pid = 0;
+    chan.state = CHANNEL_FREE;
+    return true;
+}
 
-    // block until a message is available
-    while (m_msgstore->msg.type == m_last_msg_type || m_msgstore->msg.destination != m_actor_id) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        elapsed_ms++;
-        if (elapsed_ms < 0) {
-            elapsed_ms = 1;
+bool SharedMemoryTransport::lock_channel(unsigned int index, bool lock) {
+#ifdef F_OFD_SETLK
+    struct flock fl = {};
+    fl.l_type = lock ? F_WRLCK : F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = static_cast<off_t>(index);
+    fl.l_len = 1;
+    return fcntl(m_fd, F_OFD_SETLK, &fl) == 0;
+#else
+    (void)index;
+    (void)lock;
+    return true;
+#endif
+}
+
+bool SharedMemoryTransport::alive(unsigned int index) const {
+#ifdef F_OFD_GETLK
+    struct flock fl = {};
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = static_cast<off_t>(index);
+    fl.l_len = 1;
+    if (fcntl(m_fd, F_OFD_GETLK, &fl) == -1) {
+        // we cannot tell, so do not take the channel away
+        return true;
+    }
+    return fl.l_type != F_UNLCK;
+#else
+    // process IDs are only meaningful within our own PID namespace and may be reused
+    int32_t pid = channel(index).pid;
+    return pid != 0 && !(kill(pid, 0) == -1 && errno == ESRCH);
+#endif
+}
+
+void SharedMemoryTransport::update_channels(bool check_liveness) {
+    auto now = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < m_msgstore->num_channels; i++) {
+        MessageStoreChannel &chan = channel(i);
+        uint32_t state = chan.state.load();
+
+        if (state == CHANNEL_OPEN && check_liveness && !alive(i)) {
+            // the client died without releasing its channel
+            state = CHANNEL_CLOSED;
+        }
+
+        if (state != CHANNEL_CLAIMED) {
+            m_channels[i].claimed = false;
+        } else if (!m_channels[i].claimed) {
+            m_channels[i].claimed = true;
+            m_channels[i].claimed_since = now;
+        } else if (check_liveness && now - m_channels[i].claimed_since >= CLAIM_TIMEOUT &&
+                   !alive(i)) {
+            // the client died before it opened the channel, it was never reported as connected
+            m_channels[i].claimed = false;
+            if (!reset_channel(i)) {
+                SPH_THROW(RuntimeException, "Failed to reset channel " + std::to_string(i));
+            }
+            continue;
         }
 
-        if (m_rx_timeout > 0 && elapsed_ms >= m_rx_timeout) {
+        if (state == CHANNEL_OPEN && !m_channels[i].connected) {
+            m_channels[i].connected = true;
+            m_events.emplace_back(CHANNEL_CONNECTED, i);
+        } else if (state == CHANNEL_CLOSED) {
+            if (!reset_channel(i)) {
+                SPH_THROW(RuntimeException, "Failed to reset channel " + std::to_string(i));
+            }
+
+            // a client may have connected and disconnected before we noticed
+            if (m_channels[i].connected) {
+                m_channels[i].connected = false;
+                m_events.emplace_back(CHANNEL_DISCONNECTED, i);
+            }
+        } else if (m_channels[i].blocked && !m_channels[i].responses.producer_polling()) {
+            // the client read a response since try_send() gave up
+            m_channels[i].blocked = false;
+            m_events.emplace_back(CHANNEL_WRITABLE, i);
+        }
+    }
+}
+
+bool SharedMemoryTransport::ready(unsigned int index) {
+    Channel &chan = m_channels[index];
+    Assembly &assembly = chan.assembly;
+    const ChunkHeader *chunk;
+    const unsigned char *data;
+    size_t size;
+
+    if (assembly.active && !assembly.complete && chan.requests.empty() &&
+        std::chrono::steady_clock::now() - assembly.updated >=
+            std::chrono::milliseconds(CHUNK_TIMEOUT)) {
+        // the client stopped writing the request, its remaining chunks are skipped if they arrive
+        assembly = Assembly();
+    }
+
+    // the queue is not empty, so front() does not wait
+    while (!assembly.complete && !chan.requests.empty()) {
+        data = chan.requests.front(size);
+        chunk = ChunkHeader::find(data, size);
+
+        if (assembly.active && (!chunk || (chunk->flags & ChunkHeader::FIRST))) {
+            // the client gave up on the request and started the next one
+            assembly = Assembly();
+        }
+
+        if (!assembly.active) {
+            if (!chunk) {
+                // regular requests are parsed in place
+                return true;
+            }
+            if (!(chunk->flags & ChunkHeader::FIRST)) {
+                // the rest of a request which was given up on
+                chan.requests.pop();
+                continue;
+            }
+
+            assembly.active = true;
+            assembly.size = chunk->size;
+            assembly.id = message_id(data + sizeof(ChunkHeader), size - sizeof(ChunkHeader));
+            assembly.skipped = assembly.size > m_max_message_size ||
+                               assembly.size > static_cast<uint64_t>(INT_MAX);
+            if (!assembly.skipped) {
+                assembly.data.reserve(static_cast<size_t>(assembly.size));
+            }
+        }
+
+        size -= sizeof(ChunkHeader);
+        if (!assembly.skipped && assembly.data.size() + size > assembly.size) {
+            assembly.skipped = true;
+        }
+        if (!assembly.skipped) {
+            data += sizeof(ChunkHeader);
+            assembly.data.insert(assembly.data.end(), data, data + size);
+        }
+
+        assembly.complete = chunk->flags & ChunkHeader::LAST;
+        assembly.updated = std::chrono::steady_clock::now();
+        // the client may reuse the space for its next chunk now
+        chan.requests.pop();
+    }
+
+    if (assembly.complete && (assembly.skipped || assembly.data.size() != assembly.size)) {
+        // only the id is handed out, so the request is answered with a failure
+        Seraphim::Message msg;
+        msg.set_id(assembly.id);
+        assembly.data.resize(msg.ByteSizeLong());
+        msg.SerializeWithCachedSizesToArray(assembly.data.data());
+        assembly.skipped = true;
+    }
+
+    return assembly.complete;
+}
+
+SharedMemoryTransport::ChannelEvent SharedMemoryTransport::poll(unsigned int &channel) {
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_rx_timeout);
+
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        bool check_liveness = now - m_last_liveness_check >= LIVENESS_INTERVAL;
+        if (check_liveness) {
+            m_last_liveness_check = now;
+        }
+
+        update_channels(check_liveness);
+        if (!m_events.empty()) {
+            ChannelEvent event = m_events.front().first;
+            channel = m_events.front().second;
+            m_events.pop_front();
+            return event;
+        }
+
+        // serve the channels in round-robin order, starting after the one served last
+        for (unsigned int i = 1; i <= m_msgstore->num_channels; i++) {
+            unsigned int index = (m_last_served + i) % m_msgstore->num_channels;
+            if (m_channels[index].connected && !m_channels[index].paused && ready(index)) {
+                m_last_served = index;
+                channel = index;
+                return CHANNEL_REQUEST;
+            }
+        }
+
+        // nothing to do, so wait for the doorbell (or the next liveness check)
+        // every request and every chunk rings it once, but an earlier scan may have served them
+        // already, so spurious wakeups are expected
+        auto wakeup = m_last_liveness_check + LIVENESS_INTERVAL;
+        if (m_rx_timeout > 0 && deadline < wakeup) {
+            wakeup = deadline;
+        }
+
+        if (!m_doorbell.wait_until(wakeup) && errno != ETIMEDOUT) {
+            SPH_THROW(RuntimeException, strerror(errno));
+        }
+
+        if (m_interrupted.exchange(false) ||
+            (m_rx_timeout > 0 && std::chrono::steady_clock::now() >= deadline)) {
             SPH_THROW(TimeoutException);
         }
     }
+}
+
+uint64_t SharedMemoryTransport::peer(unsigned int channel) const {
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    if (channel >= m_msgstore->num_channels) {
+        SPH_THROW(InvalidArgumentException, "Invalid channel: " + std::to_string(channel));
+    }
+
+    return m_channels[channel].peer;
+}
+
+void SharedMemoryTransport::pause(unsigned int channel, bool paused) {
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    if (channel >= m_msgstore->num_channels) {
+        SPH_THROW(InvalidArgumentException, "Invalid channel: " + std::to_string(channel));
+    }
 
-    // read the message
-    msg_ptr = reinterpret_cast<unsigned char *>(m_msgstore) + sizeof(MessageStore);
-    if (!msg.ParseFromArray(msg_ptr, m_msgstore->msg.size)) {
+    m_channels[channel].paused = paused;
+}
+
+unsigned char *SharedMemoryTransport::acquire_buffer(size_t size,
+                                                    Seraphim::Types::BufferRef &ref) {
+    uint64_t aligned = (size + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1);
+    uint64_t offset = UINT64_MAX;
+
+    if (!m_msgstore || m_created) {
+        SPH_THROW(RuntimeException, "Memory region not opened");
+    }
+
+    const MessageStoreChannel &chan = channel(m_channel);
+    if (aligned == 0 || aligned > chan.frames_size) {
+        return nullptr;
+    }
+
+    // same strategy as the message queues: the oldest buffer in use marks the end of the free
+    // space, wrap around to the beginning of the area if the buffer does not fit at the end
+    if (m_buffers.empty()) {
+        offset = 0;
+    } else if (m_buffers.front().offset < m_buffers_end) {
+        if (m_buffers_end + aligned <= chan.frames_size) {
+            offset = m_buffers_end;
+        } else if (aligned <= m_buffers.front().offset) {
+            offset = 0;
+        }
+    } else if (m_buffers_end + aligned <= m_buffers.front().offset) {
+        offset = m_buffers_end;
+    }
+
+    if (offset == UINT64_MAX) {
+        return nullptr;
+    }
+
+    m_buffers.push_back({ offset, aligned, false });
+    m_buffers_end = offset + aligned;
+
+    ref.set_region(m_name);
+    ref.set_offset(chan.frames + offset);
+    ref.set_size(size);
+    return reinterpret_cast<unsigned char *>(m_msgstore) + chan.frames + offset;
+}
+
+void SharedMemoryTransport::release_buffer(const Seraphim::Types::BufferRef &ref) {
+    if (!m_msgstore || m_created) {
+        return;
+    }
+
+    const MessageStoreChannel &chan = channel(m_channel);
+    for (auto &buffer : m_buffers) {
+        if (chan.frames + buffer.offset == ref.offset()) {
+            buffer.released = true;
+            break;
+        }
+    }
+
+    // space can only be reused in order
+    while (!m_buffers.empty() && m_buffers.front().released) {
+        m_buffers.pop_front();
+    }
+}
+
+void SharedMemoryTransport::interrupt() {
+    if (m_created) {
+        m_interrupted = true;
+        m_doorbell.post();
+    } else if (m_channels) {
+        m_channels[m_channel].responses.interrupt();
+    }
+}
+
+void SharedMemoryTransport::receive(unsigned int channel, Seraphim::Message &msg) {
+    bool parsed = false;
+
+    // parse the message in place
+    receive(channel, [&](const unsigned char *data, size_t size) {
+        parsed = msg.ParseFromArray(data, static_cast<int>(size));
+    });
+
+    if (!parsed) {
         SPH_THROW(RuntimeException, "Failed to deserialize message");
     }
 }
 
-void SharedMemoryTransport::send(const Seraphim::Message &msg) {
-    int elapsed_ms = 0;
+void SharedMemoryTransport::receive(
+    unsigned int channel, const std::function<void(const unsigned char *, size_t)> &consume) {
+    const unsigned char *msg_ptr;
+    size_t msg_size;
+
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    if (channel >= m_msgstore->num_channels) {
+        SPH_THROW(InvalidArgumentException, "Invalid channel: " + std::to_string(channel));
+    }
+
+    // requests reported by poll() are ready, others may have to wait for their next chunk
+    RingBuffer &queue = m_channels[channel].requests;
+    while (!ready(channel)) {
+        queue.front(msg_size, m_rx_timeout);
+    }
+
+    if (m_channels[channel].assembly.complete) {
+        // requests are parsed in place, so a chunked one has been assembled before
+        Assembly assembly = std::move(m_channels[channel].assembly);
+        m_channels[channel].assembly = Assembly();
+        consume(assembly.data.data(), assembly.data.size());
+        return;
+    }
+
+    msg_ptr = queue.front(msg_size);
+
+    try {
+        consume(msg_ptr, msg_size);
+    } catch (...) {
+        queue.pop();
+        throw;
+    }
+    queue.pop();
+}
+
+void SharedMemoryTransport::send(unsigned int channel, const Seraphim::Message &msg) {
+    unsigned char *msg_ptr;
+    size_t msg_size;
+
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    if (channel >= m_msgstore->num_channels) {
+        SPH_THROW(InvalidArgumentException, "Invalid channel: " + std::to_string(channel));
+    }
+
+    // serialize the message in place
+    RingBuffer &queue = m_channels[channel].responses;
+    msg_size = msg.ByteSizeLong();
+    if (msg_size > queue.capacity()) {
+        send_chunked(queue, msg, msg_size, m_tx_timeout);
+        return;
+    }
+
+    msg_ptr = queue.reserve(msg_size, m_tx_timeout);
+    msg.SerializeWithCachedSizesToArray(msg_ptr);
+    queue.commit(msg_size);
+}
+
+bool SharedMemoryTransport::try_send(unsigned int channel, const Seraphim::Message &msg) {
+    unsigned char *msg_ptr;
+    size_t msg_size;
+
+    if (!m_msgstore || !m_created) {
+        SPH_THROW(RuntimeException, "Memory region not created");
+    }
+
+    if (channel >= m_msgstore->num_channels) {
+        SPH_THROW(InvalidArgumentException, "Invalid channel: " + std::to_string(channel));
+    }
+
+    RingBuffer &queue = m_channels[channel].responses;
+    msg_size = msg.ByteSizeLong();
+    if (msg_size > queue.capacity()) {
+        send_chunked(queue, msg, msg_size, m_tx_timeout);
+        return true;
+    }
+
+    msg_ptr = queue.try_reserve(msg_size);
+    if (!msg_ptr) {
+        m_channels[channel].blocked = true;
+        return false;
+    }
+
+    msg.SerializeWithCachedSizesToArray(msg_ptr);
+    queue.commit(msg_size);
+    return true;
+}
+
+void SharedMemoryTransport::receive(Seraphim::Message &msg) {
+    const unsigned char *msg_ptr;
+    size_t msg_size;
+    bool parsed;
 
     if (!m_msgstore) {
         SPH_THROW(RuntimeException, "Memory region not mapped");
     }
 
-    if (msg.ByteSizeLong() > m_size - sizeof(MessageStore)) {
-        SPH_THROW(RuntimeException, std::string("Memory region too small (") +
-                                        std::to_string(msg.ByteSizeLong()) + std::string(" < ") +
-                                        std::to_string(m_size - sizeof(MessageStore)) +
-                                        std::string(")"));
+    if (m_created) {
+        // wait for the next request of any client and remember it, so send() can respond
+        unsigned int channel;
+        while (poll(channel) != CHANNEL_REQUEST) {
+        }
+
+        receive(channel, msg);
+        m_current = channel;
+        return;
     }
 
-    // block until a message was read and can thus be overwritten
-    while (m_msgstore->msg.type == m_last_msg_type || m_msgstore->msg.source == m_actor_id ||
-           !m_msg_sem.trywait()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        elapsed_ms++;
-        if (elapsed_ms < 0) {
-            elapsed_ms = 1;
-        }
+    // block until a response is available, then parse it in place
+    RingBuffer &queue = m_channels[m_channel].responses;
+    msg_ptr = queue.front(msg_size, m_rx_timeout);
 
-        if (m_tx_timeout > 0 && elapsed_ms >= m_tx_timeout) {
-            SPH_THROW(TimeoutException);
+    const ChunkHeader *chunk = ChunkHeader::find(msg_ptr, msg_size);
+    while (chunk && !(chunk->flags & ChunkHeader::FIRST)) {
+        // the rest of a response which could not be parsed
+        queue.pop();
+        msg_ptr = queue.front(msg_size, m_rx_timeout);
+        chunk = ChunkHeader::find(msg_ptr, msg_size);
+    }
+
+    if (chunk) {
+        // large responses are parsed while the server is still writing them
+        ChunkReader reader(queue, msg_ptr, msg_size, m_rx_timeout);
+        parsed = msg.ParseFromZeroCopyStream(&reader);
+        reader.discard();
+        reader.rethrow();
+    } else {
+        parsed = msg.ParseFromArray(msg_ptr, static_cast<int>(msg_size));
+        if (queue.pop()) {
+            // the server holds back responses until we made room for them
+            m_doorbell.post();
         }
     }
 
-    if (!msg.SerializeToArray(reinterpret_cast<unsigned char *>(m_msgstore) + sizeof(MessageStore),
-                              msg.ByteSize())) {
-        SPH_THROW(RuntimeException, "Failed to serialize message");
+    if (!parsed) {
+        SPH_THROW(RuntimeException, "Failed to deserialize message");
     }
+}
 
-    // prevent us from reading our own messages in recv() by keeping track of
-    // who sent a message and waiting for the next one
-    m_msgstore->msg.destination = m_actor_id == 1 ? m_msgstore->msg.source : 1;
-    m_msgstore->msg.source = m_actor_id;
-    m_msgstore->msg.size = msg.ByteSize();
+void SharedMemoryTransport::send(const Seraphim::Message &msg) {
+    unsigned char *msg_ptr;
+    size_t msg_size;
+
+    if (!m_msgstore) {
+        SPH_THROW(RuntimeException, "Memory region not mapped");
+    }
+
+    if (m_created) {
+        send(m_current, msg);
+        return;
+    }
+
+    // block until there is enough space in the queue, then serialize in place
+    RingBuffer &queue = m_channels[m_channel].requests;
+    msg_size = msg.ByteSizeLong();
+    if (msg_size > queue.capacity()) {
+        // the server assembles the request from the chunks which arrived whenever it wakes up
+        send_chunked(queue, msg, msg_size, m_tx_timeout, [this]() { m_doorbell.post(); });
+        return;
+    }
 
-    m_msg_sem.post();
+    msg_ptr = queue.reserve(msg_size, m_tx_timeout);
+    msg.SerializeWithCachedSizesToArray(msg_ptr);
+    queue.commit(msg_size);
 
-    m_last_msg_type = msg.has_req() ? MESSAGE_TYPE_REQUEST : MESSAGE_TYPE_RESPONSE;
+    // let the server know there is work to do
+    m_doorbell.post();
 }
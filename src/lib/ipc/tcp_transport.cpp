@@ -5,10 +5,6 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <chrono>
-#include <cstring>
-#include <poll.h>
-#include <thread>
 #include <unistd.h>
 
 #include "seraphim/except.h"
@@ -17,120 +13,78 @@
 using namespace sph;
 using namespace sph::ipc;
 
-void TCPTransport::receive(Seraphim::Message &msg) {
-    MessageHeader msghdr = {};
-    ssize_t read;
-
-    read = m_socket.receive(&msghdr, sizeof(msghdr));
-    if (read != sizeof(MessageHeader)) {
-        SPH_THROW(RuntimeException, "Failed to receive message header");
-    }
-
-    if (m_rx_buffer.size() < msghdr.size) {
-        m_rx_buffer.resize(msghdr.size);
+net::TCPConnection &TCPTransport::connection(int fd) {
+    auto it = m_connections.find(fd);
+    if (it == m_connections.end()) {
+        it = m_connections.emplace(fd, net::TCPConnection(fd)).first;
+        it->second.set_max_message_size(m_max_message_size);
     }
 
-    size_t remaining = msghdr.size;
-    do {
-        // receive() will throw on error
-        read = m_socket.receive(m_rx_buffer.data() + msghdr.size - remaining, msghdr.size);
-        assert(read > 0);
-
-        // calculate the remaining amount of bytes to be read
-        remaining -= static_cast<size_t>(read);
-    } while (remaining > 0);
-
-    if (!msg.ParseFromArray(m_rx_buffer.data(), static_cast<int>(msghdr.size))) {
-        SPH_THROW(RuntimeException, "Failed to deserialize message");
-    }
+    return it->second;
 }
 
-void TCPTransport::send(const Seraphim::Message &msg) {
-    MessageHeader msghdr = {};
-    ssize_t sent;
-
-    msghdr.size = msg.ByteSizeLong();
-    sent = m_socket.send(&msghdr, sizeof(msghdr));
-    if (static_cast<uint64_t>(sent) != sizeof(msghdr)) {
-        SPH_THROW(RuntimeException, "Failed to send message header");
-    }
-
-    if (m_tx_buffer.size() < msg.ByteSizeLong()) {
-        m_tx_buffer.resize(msg.ByteSizeLong());
+void TCPTransport::set_max_message_size(uint64_t size) {
+    m_max_message_size = size;
+    for (auto &conn : m_connections) {
+        conn.second.set_max_message_size(size);
     }
+}
 
-    if (!msg.SerializeToArray(m_tx_buffer.data(), msg.ByteSize())) {
-        SPH_THROW(RuntimeException, "Failed to serialize message");
+bool TCPTransport::connect(const std::string &ipaddr, uint16_t port, int timeout) {
+    // data buffered for the previous connection is meaningless now
+    m_connections.erase(m_socket.fd());
+    if (!m_socket.connect(ipaddr, port, timeout)) {
+        return false;
     }
 
-    size_t remaining = msghdr.size;
-    do {
-        // send() will throw on error
-        sent = m_socket.send(m_tx_buffer.data() + msghdr.size - remaining, remaining);
-        assert(sent > 0);
-
-        // calculate the remaining amount of bytes to be sent
-        remaining -= static_cast<size_t>(sent);
-    } while (remaining > 0);
+    // create the connection state right away, so sending and receiving concurrently never
+    // modifies the map
+    connection(m_socket.fd());
+    return true;
 }
 
-void TCPTransport::receive(int fd, Seraphim::Message &msg) {
-    MessageHeader msghdr = {};
-    ssize_t read;
-
-    read = m_socket.receive(fd, &msghdr, sizeof(msghdr));
-    if (read != sizeof(MessageHeader)) {
-        SPH_THROW(RuntimeException, "Failed to receive message header");
-    }
+void TCPTransport::receive(Seraphim::Message &msg) {
+    receive(m_socket.fd(), msg);
+}
 
-    if (m_rx_buffer.size() < msghdr.size) {
-        m_rx_buffer.resize(msghdr.size);
-    }
+void TCPTransport::send(const Seraphim::Message &msg) {
+    send(m_socket.fd(), msg);
+}
 
-    size_t remaining = msghdr.size;
-    do {
-        // receive() will throw on error
-        read = m_socket.receive(fd, m_rx_buffer.data() + msghdr.size - remaining, msghdr.size);
-        assert(read > 0);
+void TCPTransport::disconnect(int fd) {
+    m_connections.erase(fd);
+    ::close(fd);
+}
 
-        // calculate the remaining amount of bytes to be read
-        remaining -= static_cast<size_t>(read);
-    } while (remaining > 0);
+bool TCPTransport::pending(int fd) const {
+    auto it = m_connections.find(fd);
+    return it != m_connections.end() && it->second.pending();
+}
 
-    if (m_rx_buffer.size() == 0) {
-        SPH_THROW(RuntimeException, "Peer disconnected");
-    }
+void TCPTransport::receive(int fd, Seraphim::Message &msg) {
+    net::TCPConnection &conn = connection(fd);
 
-    if (!msg.ParseFromArray(m_rx_buffer.data(), static_cast<int>(msghdr.size))) {
-        SPH_THROW(RuntimeException, "Failed to deserialize message");
+    // a timeout leaves partially received data in the buffer, the next call continues from there
+    while (!conn.next(msg)) {
+        if (!conn.read()) {
+            SPH_THROW(TimeoutException);
+        }
     }
 }
 
 void TCPTransport::send(int fd, const Seraphim::Message &msg) {
-    MessageHeader msghdr = {};
-    ssize_t sent;
-
-    msghdr.size = msg.ByteSizeLong();
-    sent = m_socket.send(fd, &msghdr, sizeof(msghdr));
-    if (static_cast<uint64_t>(sent) != sizeof(msghdr)) {
-        SPH_THROW(RuntimeException, "Failed to send message header");
+    net::TCPConnection &conn = connection(fd);
+
+    // large messages are written while they are serialized instead of being buffered as a whole
+    if (conn.flushed() && msg.ByteSizeLong() > net::TCPConnection::STREAM_WINDOW) {
+        if (!conn.write(msg)) {
+            SPH_THROW(TimeoutException);
+        }
+        return;
     }
 
-    if (m_tx_buffer.size() < msg.ByteSizeLong()) {
-        m_tx_buffer.resize(msg.ByteSizeLong());
+    conn.queue(msg);
+    if (!conn.flush()) {
+        SPH_THROW(TimeoutException);
     }
-
-    if (!msg.SerializeToArray(m_tx_buffer.data(), msg.ByteSize())) {
-        SPH_THROW(RuntimeException, "Failed to serialize message");
-    }
-
-    size_t remaining = msghdr.size;
-    do {
-        // send() will throw on error
-        sent = m_socket.send(fd, m_tx_buffer.data() + msghdr.size - remaining, remaining);
-        assert(sent > 0);
-
-        // calculate the remaining amount of bytes to be sent
-        remaining -= static_cast<size_t>(sent);
-    } while (remaining > 0);
 }
@@ -0,0 +1,208 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "seraphim/ipc/tile_delta.h"
+
+using namespace sph::ipc;
+
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t KEY_LO = 0xBE4BA423396CFEB8ULL;
+static constexpr uint64_t KEY_HI = 0x1CAD21F72C81017CULL;
+/// added to the key after every 16 byte stripe, so swapping stripes changes the hash
+static constexpr uint64_t KEY_STEP = 0x9FB21C651E98DF25ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v * PRIME64_2;
+    return rotl64(h, 31) * PRIME64_1;
+}
+
+/**
+ * @brief Accumulate the 16 byte stripes of a row into two 64 bit lanes.
+ *        For each lane: acc += lo32(d ^ key) * hi32(d ^ key) + (other lane of d).
+ */
+static void accumulate(const unsigned char *row, size_t stripes, uint64_t acc[2]) {
+#ifdef __SSE2__
+    __m128i vacc = _mm_setzero_si128();
+    __m128i vkey = _mm_set_epi64x(static_cast<long long>(KEY_HI), static_cast<long long>(KEY_LO));
+    const __m128i vstep =
+        _mm_set_epi64x(static_cast<long long>(KEY_STEP), static_cast<long long>(KEY_STEP));
+
+    for (size_t i = 0; i < stripes; i++) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i * 16));
+        __m128i dk = _mm_xor_si128(d, vkey);
+        __m128i prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        vacc = _mm_add_epi64(vacc, _mm_add_epi64(prod, swapped));
+        vkey = _mm_add_epi64(vkey, vstep);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(acc), vacc);
+#else
+    uint64_t key[2] = { KEY_LO, KEY_HI };
+
+    acc[0] = 0;
+    acc[1] = 0;
+    for (size_t i = 0; i < stripes; i++) {
+        uint64_t d[2];
+        std::memcpy(d, row + i * 16, sizeof(d));
+        for (size_t lane = 0; lane < 2; lane++) {
+            uint64_t dk = d[lane] ^ key[lane];
+            acc[lane] += (dk & 0xFFFFFFFFULL) * (dk >> 32) + d[lane ^ 1];
+            key[lane] += KEY_STEP;
+        }
+    }
+#endif
+}
+
+uint64_t sph::ipc::tile_hash(const unsigned char *data, size_t row_size, size_t rows,
+                             size_t stride) {
+    uint64_t h = PRIME64_1 ^ row_size;
+    size_t stripes = row_size / 16;
+    size_t tail = row_size % 16;
+
+    for (size_t y = 0; y < rows; y++) {
+        const unsigned char *row = data + y * stride;
+        uint64_t acc[2];
+
+        accumulate(row, stripes, acc);
+        h = mix(h, acc[0]);
+        h = mix(h, acc[1]);
+
+        if (tail > 0) {
+            uint64_t rest[2] = { 0, 0 };
+            std::memcpy(rest, row + stripes * 16, tail);
+            h = mix(h, rest[0]);
+            h = mix(h, rest[1]);
+        }
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    return h;
+}
+
+TileEncoder::TileEncoder(uint32_t tile_size, float max_ratio)
+    : m_tile_size(tile_size > 0 ? tile_size : 64), m_max_ratio(max_ratio) {}
+
+void TileEncoder::reset() {
+    m_width = 0;
+    m_height = 0;
+    m_bpp = 0;
+    m_hashes.clear();
+}
+
+bool TileEncoder::encode(const unsigned char *data, uint32_t width, uint32_t height,
+                         size_t stride, size_t bpp, Seraphim::Types::TileDelta &delta) {
+    uint32_t cols = (width + m_tile_size - 1) / m_tile_size;
+    uint32_t rows = (height + m_tile_size - 1) / m_tile_size;
+    size_t tiles = static_cast<size_t>(cols) * rows;
+    bool reference = !m_hashes.empty() && width == m_width && height == m_height && bpp == m_bpp;
+    size_t delta_size = 0;
+
+    delta.Clear();
+    m_changed.clear();
+
+    if (!reference) {
+        m_width = width;
+        m_height = height;
+        m_bpp = bpp;
+        m_hashes.assign(tiles, 0);
+    }
+
+    for (uint32_t ty = 0; ty < rows; ty++) {
+        uint32_t y = ty * m_tile_size;
+        uint32_t h = std::min(m_tile_size, height - y);
+        for (uint32_t tx = 0; tx < cols; tx++) {
+            uint32_t x = tx * m_tile_size;
+            uint32_t w = std::min(m_tile_size, width - x);
+            uint32_t index = ty * cols + tx;
+            uint64_t hash = tile_hash(data + y * stride + x * bpp, w * bpp, h, stride);
+
+            if (!reference || hash != m_hashes[index]) {
+                m_hashes[index] = hash;
+                m_changed.push_back(index);
+                delta_size += static_cast<size_t>(w) * h * bpp;
+            }
+        }
+    }
+
+    if (!reference || static_cast<float>(m_changed.size()) > m_max_ratio * tiles) {
+        return false;
+    }
+
+    // copy the changed tiles into the message in one go
+    std::string *out = delta.mutable_data();
+    out->resize(delta_size);
+    char *dst = &(*out)[0];
+
+    delta.set_tile_size(m_tile_size);
+    delta.mutable_tiles()->Reserve(static_cast<int>(m_changed.size()));
+    for (uint32_t index : m_changed) {
+        uint32_t x = (index % cols) * m_tile_size;
+        uint32_t y = (index / cols) * m_tile_size;
+        size_t row_size = std::min(m_tile_size, width - x) * bpp;
+        uint32_t h = std::min(m_tile_size, height - y);
+
+        for (uint32_t i = 0; i < h; i++) {
+            std::memcpy(dst, data + (y + i) * stride + x * bpp, row_size);
+            dst += row_size;
+        }
+
+        delta.add_tiles(index);
+    }
+
+    return true;
+}
+
+bool sph::ipc::apply_tile_delta(const Seraphim::Types::TileDelta &delta, unsigned char *data,
+                                uint32_t width, uint32_t height, size_t stride, size_t bpp) {
+    uint32_t tile_size = delta.tile_size();
+    const char *src = delta.data().data();
+    const char *end = src + delta.data().size();
+
+    if (tile_size == 0) {
+        return false;
+    }
+
+    uint32_t cols = (width + tile_size - 1) / tile_size;
+    uint32_t rows = (height + tile_size - 1) / tile_size;
+
+    for (uint32_t index : delta.tiles()) {
+        if (index >= cols * rows) {
+            return false;
+        }
+
+        uint32_t x = (index % cols) * tile_size;
+        uint32_t y = (index / cols) * tile_size;
+        size_t row_size = std::min(tile_size, width - x) * bpp;
+        uint32_t h = std::min(tile_size, height - y);
+
+        if (static_cast<size_t>(end - src) < row_size * h) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < h; i++) {
+            std::memcpy(data + (y + i) * stride + x * bpp, src, row_size);
+            src += row_size;
+        }
+    }
+
+    return src == end;
+}
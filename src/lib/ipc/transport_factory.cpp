@@ -5,20 +5,186 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <algorithm>
+#include <map>
+
 #include "seraphim/ipc/transport_factory.h"
 #include "seraphim/except.h"
 #include "seraphim/ipc/shm_transport.h"
 #include "seraphim/ipc/tcp_transport.h"
+#include "seraphim/ipc/udp_transport.h"
+#include "seraphim/ipc/unix_transport.h"
 
 using namespace sph;
 using namespace sph::ipc;
 
+/**
+ * @brief Split a URI query (e.g. "depth=8&channels=2") into key value pairs.
+ *        Throws sph::InvalidArgumentException in case of malformed options.
+ */
+static std::map<std::string, std::string> parse_options(const std::string &query) {
+    std::map<std::string, std::string> options;
+    size_t start = 0;
+
+    while (start < query.size()) {
+        size_t end = query.find("&", start);
+        std::string option = query.substr(start, end - start);
+        size_t delim = option.find("=");
+        if (delim == std::string::npos || delim == 0) {
+            SPH_THROW(InvalidArgumentException, std::string("Malformed option: ") + option);
+        }
+
+        options[option.substr(0, delim)] = option.substr(delim + 1);
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    return options;
+}
+
+/**
+ * @brief Parse a positive integer option.
+ *        Throws sph::InvalidArgumentException in case of malformed values.
+ */
+static uint32_t parse_count(const std::string &key, const std::string &value) {
+    long count;
+
+    try {
+        count = std::stol(value);
+    } catch (const std::logic_error &) {
+        SPH_THROW(InvalidArgumentException, std::string("Failed to parse option: ") + key);
+    }
+
+    if (count < 1 || count > UINT32_MAX) {
+        SPH_THROW(InvalidArgumentException, std::string("Option out of range: ") + key);
+    }
+
+    return static_cast<uint32_t>(count);
+}
+
+/**
+ * @brief Parse a non-negative integer option, e.g. an index.
+ *        Throws sph::InvalidArgumentException in case of malformed values.
+ */
+static uint32_t parse_index(const std::string &key, const std::string &value) {
+    // "0" is out of range for counts, but all other values are parsed the same way
+    return value == "0" ? 0 : parse_count(key, value);
+}
+
+/**
+ * @brief Parse a boolean option ("1", "true", "0" or "false").
+ *        Throws sph::InvalidArgumentException in case of malformed values.
+ */
+static bool parse_flag(const std::string &key, const std::string &value) {
+    if (value == "1" || value == "true") {
+        return true;
+    } else if (value == "0" || value == "false") {
+        return false;
+    }
+
+    SPH_THROW(InvalidArgumentException, std::string("Failed to parse option: ") + key);
+}
+
+/**
+ * @brief Parse the address and port of a network URI (e.g. "udp://127.0.0.1:8004").
+ *        Throws sph::InvalidArgumentException in case of malformed URI.
+ */
+static void parse_address(const std::string &uri, std::string &address, uint16_t &port,
+                          net::Socket::Family &family) {
+    int value;
+
+    size_t address_start = uri.rfind("/");
+    size_t port_start = uri.rfind(":");
+    if (address_start == std::string::npos || port_start == std::string::npos ||
+        address_start >= port_start) {
+        SPH_THROW(InvalidArgumentException, "Missing or malformed delimiters (\"/\" and \":\")");
+    }
+
+    // offset positions to capture the actual properties
+    address_start++;
+    port_start++;
+
+    address = uri.substr(address_start, port_start - address_start - 1);
+    try {
+        value = std::stoi(uri.substr(port_start));
+    } catch (const std::logic_error &) {
+        SPH_THROW(InvalidArgumentException, "Failed to parse network port");
+    }
+
+    // port must be a uint16_t
+    if (value < 0 || value > 65535) {
+        SPH_THROW(InvalidArgumentException, "Invalid network port number");
+    }
+    port = static_cast<uint16_t>(value);
+
+    // validate IPv4/6 address
+    struct sockaddr_in sa;
+    struct sockaddr_in6 sa6;
+    if (inet_pton(AF_INET, address.c_str(), &(sa.sin_addr)) == 1) {
+        family = net::Socket::Family::INET;
+    } else if (inet_pton(AF_INET6, address.c_str(), &(sa6.sin6_addr)) == 1) {
+        family = net::Socket::Family::INET6;
+    } else {
+        SPH_THROW(InvalidArgumentException, "Invalid network address");
+    }
+}
+
+/**
+ * @brief Create a UDP transport as described by a URI, including its options.
+ *        Throws sph::InvalidArgumentException in case of malformed URI.
+ */
+static std::unique_ptr<UDPTransport> make_udp(const std::string &uri, std::string &address,
+                                              uint16_t &port) {
+    std::unique_ptr<UDPTransport> instance;
+    net::Socket::Family family;
+    std::string query;
+    size_t datagram_size = UDPTransport::DEFAULT_DATAGRAM_SIZE;
+    int deadline = UDPTransport::DEFAULT_DEADLINE;
+    int buffer_size = 0;
+
+    // split off the optional query (e.g. "?datagram=8192&deadline=50")
+    size_t query_start = uri.find("?");
+    if (query_start != std::string::npos) {
+        query = uri.substr(query_start + 1);
+    }
+
+    parse_address(uri.substr(0, query_start), address, port, family);
+
+    for (const auto &option : parse_options(query)) {
+        if (option.first == "datagram") {
+            datagram_size = parse_count(option.first, option.second);
+        } else if (option.first == "deadline") {
+            deadline = static_cast<int>(std::min<uint32_t>(
+                parse_count(option.first, option.second), INT32_MAX));
+        } else if (option.first == "buffer") {
+            buffer_size = static_cast<int>(std::min<uint32_t>(
+                parse_count(option.first, option.second), INT32_MAX));
+        } else {
+            SPH_THROW(InvalidArgumentException, std::string("Unknown option: ") + option.first);
+        }
+    }
+
+    instance = std::unique_ptr<UDPTransport>(new UDPTransport(family, datagram_size));
+    instance->set_deadline(deadline);
+    if (buffer_size > 0) {
+        instance->set_buffer_size(buffer_size);
+    }
+
+    return instance;
+}
+
 std::unique_ptr<Transport> TransportFactory::create(const std::string &uri) {
     // delegate the real instance creation to helper functions
     if (uri.rfind("shm", 0) == 0) {
         return create_shm(uri);
     } else if (uri.rfind("tcp", 0) == 0) {
         return create_tcp(uri);
+    } else if (uri.rfind("udp", 0) == 0) {
+        return create_udp(uri);
+    } else if (uri.rfind("unix", 0) == 0) {
+        return create_unix(uri);
     }
 
     SPH_THROW(InvalidArgumentException, std::string("Cannot handle URI: ") + uri);
@@ -30,6 +196,10 @@ std::unique_ptr<Transport> TransportFactory::open(const std::string &uri) {
         return open_shm(uri);
     } else if (uri.rfind("tcp", 0) == 0) {
         return open_tcp(uri);
+    } else if (uri.rfind("udp", 0) == 0) {
+        return open_udp(uri);
+    } else if (uri.rfind("unix", 0) == 0) {
+        return open_unix(uri);
     }
 
     SPH_THROW(InvalidArgumentException, std::string("Cannot handle URI: ") + uri);
@@ -38,11 +208,23 @@ std::unique_ptr<Transport> TransportFactory::open(const std::string &uri) {
 std::unique_ptr<Transport> TransportFactory::create_shm(const std::string &uri) {
     std::unique_ptr<SharedMemoryTransport> instance;
     std::string name;
+    std::string path;
+    std::string query;
     long size;
+    uint32_t depth = SharedMemoryTransport::DEFAULT_DEPTH;
+    uint32_t channels = SharedMemoryTransport::DEFAULT_CHANNELS;
+    SharedMemoryTransport::Options placement;
+
+    // split off the optional query (e.g. "?depth=8&channels=2")
+    size_t query_start = uri.find("?");
+    path = uri.substr(0, query_start);
+    if (query_start != std::string::npos) {
+        query = uri.substr(query_start + 1);
+    }
 
     // parse the name and size from the description
-    size_t name_start = uri.rfind("/");
-    size_t size_start = uri.rfind(":");
+    size_t name_start = path.rfind("/");
+    size_t size_start = path.rfind(":");
     if (name_start == std::string::npos || size_start == std::string::npos ||
         name_start >= size_start) {
         SPH_THROW(InvalidArgumentException, "Missing or malformed delimiters (\"/\" and \":\")");
@@ -52,20 +234,47 @@ std::unique_ptr<Transport> TransportFactory::create_shm(const std::string &uri)
     name_start++;
     size_start++;
 
-    name = uri.substr(name_start, size_start - name_start - 1);
+    name = path.substr(name_start, size_start - name_start - 1);
     if (name.empty()) {
         SPH_THROW(InvalidArgumentException, "Failed to parse memory region name");
     }
 
     try {
-        size = std::stol(uri.substr(size_start));
+        size = std::stol(path.substr(size_start));
     } catch (const std::invalid_argument &) {
         SPH_THROW(InvalidArgumentException, "Failed to parse memory region size");
     }
 
+    for (const auto &option : parse_options(query)) {
+        if (option.first == "depth") {
+            depth = parse_count(option.first, option.second);
+        } else if (option.first == "channels") {
+            channels = parse_count(option.first, option.second);
+        } else if (option.first == "hugepages") {
+            if (option.second == "none") {
+                placement.huge_pages = SharedMemoryTransport::HugePages::NONE;
+            } else if (option.second == "transparent") {
+                placement.huge_pages = SharedMemoryTransport::HugePages::TRANSPARENT;
+            } else if (option.second == "hugetlbfs") {
+                placement.huge_pages = SharedMemoryTransport::HugePages::HUGETLBFS;
+            } else {
+                SPH_THROW(InvalidArgumentException, "Invalid huge page mode: " + option.second);
+            }
+        } else if (option.first == "populate") {
+            placement.populate = parse_flag(option.first, option.second);
+        } else if (option.first == "numa") {
+            // "local" picks the node of the CPU the server is created on
+            placement.numa_node = option.second == "local"
+                                      ? SharedMemoryTransport::local_numa_node()
+                                      : static_cast<int>(parse_index(option.first, option.second));
+        } else {
+            SPH_THROW(InvalidArgumentException, std::string("Unknown option: ") + option.first);
+        }
+    }
+
     // actually create the transport instance
     instance = std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport());
-    if (!instance->create(name, size)) {
+    if (!instance->create(name, size, depth, channels, placement)) {
         SPH_THROW(RuntimeException, "Failed to create memory region");
     }
 
@@ -123,12 +332,57 @@ std::unique_ptr<Transport> TransportFactory::create_tcp(const std::string &uri)
     return std::unique_ptr<Transport>(std::move(instance));
 }
 
+std::unique_ptr<Transport> TransportFactory::create_udp(const std::string &uri) {
+    std::unique_ptr<UDPTransport> instance;
+    std::string address;
+    uint16_t port;
+
+    instance = make_udp(uri, address, port);
+
+    // bind() will throw on error
+    if (!instance->bind(port)) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Transport>(std::move(instance));
+}
+
+std::unique_ptr<Transport> TransportFactory::create_unix(const std::string &uri) {
+    std::unique_ptr<UnixTransport> instance;
+    std::string path;
+
+    // the path starts after the scheme, e.g. "unix:///tmp/seraphim.sock" -> "/tmp/seraphim.sock"
+    size_t path_start = uri.find("://");
+    if (path_start == std::string::npos) {
+        SPH_THROW(InvalidArgumentException, "Missing or malformed delimiter (\"://\")");
+    }
+
+    path = uri.substr(path_start + 2);
+    if (path.size() <= 1) {
+        SPH_THROW(InvalidArgumentException, "Failed to parse socket path");
+    }
+
+    // actually create the transport instance
+    instance = std::unique_ptr<UnixTransport>(new UnixTransport());
+
+    // bind() will throw on error
+    if (!instance->bind(path)) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Transport>(std::move(instance));
+}
+
 std::unique_ptr<Transport> TransportFactory::open_shm(const std::string &uri) {
     std::unique_ptr<SharedMemoryTransport> instance;
     std::string name;
+    std::string path;
+
+    // options are only relevant when creating the segment, so ignore them here
+    path = uri.substr(0, uri.find("?"));
 
     // parse the name from the description
-    size_t name_start = uri.rfind("/");
+    size_t name_start = path.rfind("/");
     if (name_start == std::string::npos) {
         SPH_THROW(InvalidArgumentException, "Failed to parse memory region name");
     }
@@ -136,7 +390,7 @@ std::unique_ptr<Transport> TransportFactory::open_shm(const std::string &uri) {
     // offset positions to capture the actual properties
     name_start++;
 
-    name = uri.substr(name_start);
+    name = path.substr(name_start);
 
     // actually create the transport instance
     instance = std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport());
@@ -198,3 +452,44 @@ std::unique_ptr<Transport> TransportFactory::open_tcp(const std::string &uri) {
 
     return std::unique_ptr<Transport>(std::move(instance));
 }
+
+std::unique_ptr<Transport> TransportFactory::open_udp(const std::string &uri) {
+    std::unique_ptr<UDPTransport> instance;
+    std::string address;
+    uint16_t port;
+
+    instance = make_udp(uri, address, port);
+
+    // connect() will throw on error
+    if (!instance->connect(address, port)) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Transport>(std::move(instance));
+}
+
+std::unique_ptr<Transport> TransportFactory::open_unix(const std::string &uri) {
+    std::unique_ptr<UnixTransport> instance;
+    std::string path;
+
+    // the path starts after the scheme, e.g. "unix:///tmp/seraphim.sock" -> "/tmp/seraphim.sock"
+    size_t path_start = uri.find("://");
+    if (path_start == std::string::npos) {
+        SPH_THROW(InvalidArgumentException, "Missing or malformed delimiter (\"://\")");
+    }
+
+    path = uri.substr(path_start + 2);
+    if (path.size() <= 1) {
+        SPH_THROW(InvalidArgumentException, "Failed to parse socket path");
+    }
+
+    // actually create the transport instance
+    instance = std::unique_ptr<UnixTransport>(new UnixTransport());
+
+    // connect() will throw on error
+    if (!instance->connect(path)) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Transport>(std::move(instance));
+}
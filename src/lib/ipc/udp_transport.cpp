@@ -0,0 +1,359 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstring>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/udp_transport.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+UDPTransport::UDPTransport(net::Socket::Family family, size_t datagram_size)
+    : m_socket(family), m_datagram_size(datagram_size),
+      m_deadline(std::chrono::milliseconds(DEFAULT_DEADLINE)), m_random(std::random_device()()) {
+    // 65507 is the maximum UDP payload size over IPv4
+    if (datagram_size <= sizeof(FragmentHeader) || datagram_size > 65507) {
+        SPH_THROW(InvalidArgumentException, "Invalid datagram size");
+    }
+
+    m_rx_buffer.resize(BATCH_SIZE * m_datagram_size);
+    m_rx_endpoints.resize(BATCH_SIZE);
+    m_rx_iovecs.resize(BATCH_SIZE);
+    m_rx_msgs.resize(BATCH_SIZE);
+    m_last_peer_sweep = std::chrono::steady_clock::now();
+}
+
+std::string UDPTransport::key(const Endpoint &endpoint) {
+    return std::string(reinterpret_cast<const char *>(&endpoint.addr), endpoint.len);
+}
+
+UDPTransport::Peer &UDPTransport::peer(const std::string &key,
+                                       std::chrono::steady_clock::time_point now) {
+    auto it = m_peers.find(key);
+    if (it == m_peers.end()) {
+        it = m_peers.emplace(key, Peer()).first;
+        it->second.tx_session = static_cast<uint32_t>(m_random());
+    }
+
+    it->second.last_seen = now;
+    return it->second;
+}
+
+bool UDPTransport::connect(const std::string &ipaddr, uint16_t port) {
+    m_connected = false;
+    if (!m_socket.connect(ipaddr, port)) {
+        return false;
+    }
+
+    m_remote.len = sizeof(m_remote.addr);
+    if (getpeername(m_socket.fd(), reinterpret_cast<struct sockaddr *>(&m_remote.addr),
+                    &m_remote.len) == -1) {
+        SPH_THROW(RuntimeException, m_socket.err_str());
+    }
+
+    m_connected = true;
+    return true;
+}
+
+void UDPTransport::set_buffer_size(int bytes) {
+    m_socket.set_rx_buffer_size(bytes);
+    m_socket.set_tx_buffer_size(bytes);
+}
+
+void UDPTransport::receive(Seraphim::Message &msg) {
+    Endpoint peer;
+    receive(msg, peer);
+}
+
+void UDPTransport::send(const Seraphim::Message &msg) {
+    if (!m_connected) {
+        SPH_THROW(RuntimeException, "Not connected");
+    }
+
+    send(nullptr, msg);
+}
+
+void UDPTransport::send(const Endpoint &peer, const Seraphim::Message &msg) {
+    send(&peer, msg);
+}
+
+void UDPTransport::receive(Seraphim::Message &msg, Endpoint &peer) {
+    // messages which are incomplete when the timeout expires stay buffered until their deadline
+    while (m_ready.empty()) {
+        if (!read()) {
+            SPH_THROW(TimeoutException);
+        }
+    }
+
+    Ready ready = std::move(m_ready.front());
+    m_ready.pop_front();
+
+    peer = ready.endpoint;
+    bool parsed = msg.ParseFromString(ready.data);
+    if (m_spare.size() < MAX_PARTIALS) {
+        m_spare.emplace_back(std::move(ready.data));
+    }
+
+    if (!parsed) {
+        SPH_THROW(RuntimeException, "Failed to deserialize");
+    }
+}
+
+void UDPTransport::send(const Endpoint *peer, const Seraphim::Message &msg) {
+    size_t size = msg.ByteSizeLong();
+    size_t payload = m_datagram_size - sizeof(FragmentHeader);
+    size_t count = size == 0 ? 1 : (size + payload - 1) / payload;
+    uint32_t session;
+    uint32_t seq;
+
+    if (size > m_max_message_size || count > UINT16_MAX) {
+        SPH_THROW(RuntimeException, "Message too large");
+    }
+
+    m_tx_buffer.resize(size);
+    if (!msg.SerializeToArray(&m_tx_buffer[0], static_cast<int>(size))) {
+        SPH_THROW(RuntimeException, "Failed to serialize");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        Peer &state = this->peer(key(peer ? *peer : m_remote), std::chrono::steady_clock::now());
+        session = state.tx_session;
+        seq = state.tx_seq++;
+    }
+
+    m_tx_headers.resize(count);
+    m_tx_iovecs.resize(count * 2);
+    m_tx_msgs.resize(count);
+
+    // every datagram is gathered from its header and a slice of the serialized message
+    for (size_t i = 0; i < count; i++) {
+        size_t offset = i * payload;
+        FragmentHeader &header = m_tx_headers[i];
+        struct msghdr &hdr = m_tx_msgs[i].msg_hdr;
+
+        header.session = htonl(session);
+        header.seq = htonl(seq);
+        header.size = htonl(static_cast<uint32_t>(size));
+        header.offset = htonl(static_cast<uint32_t>(offset));
+        header.index = htons(static_cast<uint16_t>(i));
+        header.count = htons(static_cast<uint16_t>(count));
+
+        m_tx_iovecs[i * 2].iov_base = &header;
+        m_tx_iovecs[i * 2].iov_len = sizeof(header);
+        m_tx_iovecs[i * 2 + 1].iov_base = &m_tx_buffer[0] + offset;
+        m_tx_iovecs[i * 2 + 1].iov_len = std::min(payload, size - offset);
+
+        hdr = {};
+        if (peer) {
+            hdr.msg_name = const_cast<struct sockaddr_storage *>(&peer->addr);
+            hdr.msg_namelen = peer->len;
+        }
+        hdr.msg_iov = &m_tx_iovecs[i * 2];
+        hdr.msg_iovlen = 2;
+    }
+
+    size_t sent = 0;
+    while (sent < count) {
+        unsigned int batch = static_cast<unsigned int>(std::min<size_t>(count - sent, BATCH_SIZE));
+        sent += static_cast<size_t>(m_socket.send_mmsg(&m_tx_msgs[sent], batch));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.messages_sent++;
+    m_stats.datagrams_sent += count;
+}
+
+bool UDPTransport::read(bool block) {
+    int flags = block ? MSG_WAITFORONE : MSG_DONTWAIT;
+    int received;
+
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        struct msghdr &hdr = m_rx_msgs[i].msg_hdr;
+
+        m_rx_iovecs[i].iov_base = &m_rx_buffer[i * m_datagram_size];
+        m_rx_iovecs[i].iov_len = m_datagram_size;
+
+        hdr = {};
+        hdr.msg_name = &m_rx_endpoints[i].addr;
+        hdr.msg_namelen = sizeof(m_rx_endpoints[i].addr);
+        hdr.msg_iov = &m_rx_iovecs[i];
+        hdr.msg_iovlen = 1;
+    }
+
+    // wait for the first datagram, then take whatever else is there already
+    try {
+        received = m_socket.receive_mmsg(m_rx_msgs.data(), BATCH_SIZE, flags);
+    } catch (const TimeoutException &) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        expire(std::chrono::steady_clock::now());
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (size_t i = 0; i < static_cast<size_t>(received); i++) {
+        const struct msghdr &hdr = m_rx_msgs[i].msg_hdr;
+
+        m_stats.datagrams_received++;
+        if (hdr.msg_flags & MSG_TRUNC) {
+            m_stats.datagrams_invalid++;
+            continue;
+        }
+
+        m_rx_endpoints[i].len = hdr.msg_namelen;
+        handle_datagram(m_rx_endpoints[i], &m_rx_buffer[i * m_datagram_size], m_rx_msgs[i].msg_len,
+                        now);
+    }
+
+    expire(now);
+    return true;
+}
+
+void UDPTransport::handle_datagram(const Endpoint &endpoint, const unsigned char *data,
+                                   size_t size, std::chrono::steady_clock::time_point now) {
+    FragmentHeader header;
+
+    if (size < sizeof(header)) {
+        m_stats.datagrams_invalid++;
+        return;
+    }
+
+    std::memcpy(&header, data, sizeof(header));
+    header.session = ntohl(header.session);
+    header.seq = ntohl(header.seq);
+    header.size = ntohl(header.size);
+    header.offset = ntohl(header.offset);
+    header.index = ntohs(header.index);
+    header.count = ntohs(header.count);
+
+    data += sizeof(header);
+    size -= sizeof(header);
+
+    // the fields are chosen by the peer, so they must describe exactly the fragments send()
+    // produces before the size is used for allocating anything
+    uint64_t payload = m_datagram_size - sizeof(header);
+    uint64_t count = header.size == 0 ? 1 : (header.size + payload - 1) / payload;
+    if (header.size > m_max_message_size || header.count != count || header.index >= count) {
+        m_stats.datagrams_invalid++;
+        return;
+    }
+
+    // every fragment but the last one is full, the last one ends with the message
+    uint64_t offset = header.index * payload;
+    if (header.offset != offset || size != std::min<uint64_t>(payload, header.size - offset)) {
+        m_stats.datagrams_invalid++;
+        return;
+    }
+
+    std::string peer = key(endpoint);
+    auto it = std::find_if(m_partials.begin(), m_partials.end(), [&](const Partial &partial) {
+        return partial.seq == header.seq && partial.peer == peer;
+    });
+
+    if (it == m_partials.end()) {
+        if (m_partials.size() >= MAX_PARTIALS) {
+            // make room by dropping the oldest message, newer ones are more likely to complete
+            auto oldest = std::min_element(
+                m_partials.begin(), m_partials.end(),
+                [](const Partial &a, const Partial &b) { return a.start < b.start; });
+            m_stats.messages_expired++;
+            m_partials.erase(oldest);
+        }
+
+        Partial partial;
+        partial.peer = std::move(peer);
+        partial.endpoint = endpoint;
+        partial.session = header.session;
+        partial.seq = header.seq;
+        if (!m_spare.empty()) {
+            partial.data = std::move(m_spare.back());
+            m_spare.pop_back();
+        }
+        partial.data.resize(header.size);
+        partial.received.assign(header.count, false);
+        partial.missing = header.count;
+        partial.start = now;
+        m_partials.emplace_back(std::move(partial));
+        it = m_partials.end() - 1;
+    } else if (it->data.size() != header.size || it->received.size() != header.count ||
+               it->session != header.session) {
+        m_stats.datagrams_invalid++;
+        return;
+    }
+
+    if (it->received[header.index]) {
+        // duplicate
+        return;
+    }
+
+    std::memcpy(&it->data[header.offset], data, size);
+    it->received[header.index] = true;
+    it->missing--;
+
+    if (it->missing == 0) {
+        deliver(*it, now);
+        m_partials.erase(it);
+    }
+}
+
+void UDPTransport::deliver(Partial &partial, std::chrono::steady_clock::time_point now) {
+    Peer &state = peer(partial.peer, now);
+    auto diff = static_cast<int32_t>(partial.seq - state.rx_seq);
+
+    if (!state.synced || partial.session != state.rx_session || diff > SEQUENCE_WINDOW ||
+        diff <= -SEQUENCE_WINDOW) {
+        // first message of the peer or the peer restarted, there is nothing to compare with
+        state.synced = true;
+        state.rx_session = partial.session;
+    } else if (diff <= 0) {
+        m_stats.messages_late++;
+        return;
+    } else {
+        m_stats.messages_lost += static_cast<uint64_t>(diff - 1);
+    }
+
+    state.rx_seq = partial.seq;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - partial.start);
+    m_stats.messages_received++;
+    m_stats.reassembly_time += elapsed;
+    m_stats.max_reassembly_time = std::max(m_stats.max_reassembly_time, elapsed);
+
+    m_ready.push_back({ partial.endpoint, std::move(partial.data) });
+}
+
+void UDPTransport::expire(std::chrono::steady_clock::time_point now) {
+    auto expired = std::remove_if(m_partials.begin(), m_partials.end(), [&](const Partial &p) {
+        return now - p.start > m_deadline;
+    });
+    m_stats.messages_expired += static_cast<uint64_t>(m_partials.end() - expired);
+    m_partials.erase(expired, m_partials.end());
+
+    if (now - m_last_peer_sweep < PEER_TIMEOUT) {
+        return;
+    }
+
+    for (auto it = m_peers.begin(); it != m_peers.end();) {
+        if (now - it->second.last_seen > PEER_TIMEOUT) {
+            it = m_peers.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    m_last_peer_sweep = now;
+}
+
+UDPTransport::Stats UDPTransport::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
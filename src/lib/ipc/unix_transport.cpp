@@ -0,0 +1,504 @@
+/*
+ * (C) Copyright 2019
+ * The Seraphim Project Developers.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "seraphim/except.h"
+#include "seraphim/ipc/buffer_registry.h"
+#include "seraphim/ipc/unix_transport.h"
+
+using namespace sph;
+using namespace sph::ipc;
+
+/// Size of the control message buffer required to pass MAX_BUFFERS file descriptors.
+static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int) * UnixTransport::MAX_BUFFERS);
+
+/**
+ * @brief Name under which a memory file is registered, identical for client and server.
+ */
+static std::string region_name(uint64_t ino) {
+    return std::string("memfd:") + std::to_string(ino);
+}
+
+UnixTransport::~UnixTransport() {
+    unregister_buffers();
+
+    for (const auto &buffer : m_buffers) {
+        munmap(buffer.addr, buffer.size);
+        ::close(buffer.fd);
+    }
+
+    for (const auto &connection : m_mappings) {
+        for (const auto &mapping : connection.second) {
+            if (mapping.users > 0) {
+                BufferRegistry::Instance().remove(peer(connection.first),
+                                                  region_name(mapping.ino));
+            }
+            munmap(mapping.addr, mapping.size);
+            ::close(mapping.fd);
+        }
+    }
+}
+
+void UnixTransport::disconnect(int fd) {
+    if (fd == m_registered_fd) {
+        unregister_buffers();
+    }
+
+    auto connection = m_mappings.find(fd);
+    if (connection != m_mappings.end()) {
+        for (const auto &mapping : connection->second) {
+            if (mapping.users > 0) {
+                BufferRegistry::Instance().remove(peer(fd), region_name(mapping.ino));
+            }
+            munmap(mapping.addr, mapping.size);
+            ::close(mapping.fd);
+        }
+        m_mappings.erase(connection);
+    }
+
+    // the next connection with the same file descriptor is another peer
+    m_peers.erase(fd);
+    ::close(fd);
+}
+
+uint64_t UnixTransport::peer(int fd) {
+    uint64_t &peer = m_peers[fd];
+    if (peer == 0) {
+        peer = BufferRegistry::new_peer();
+    }
+
+    return peer;
+}
+
+void UnixTransport::receive(Seraphim::Message &msg) {
+    std::vector<int> fds;
+    size_t size;
+
+    size = receive_frame(m_socket.fd(), fds);
+
+    // the server never shares buffers with its clients
+    for (const auto &fd : fds) {
+        ::close(fd);
+    }
+
+    if (!msg.ParseFromArray(m_rx_buffer.data(), static_cast<int>(size))) {
+        SPH_THROW(RuntimeException, "Failed to deserialize message");
+    }
+}
+
+void UnixTransport::send(const Seraphim::Message &msg) {
+    std::vector<int> fds;
+
+    for (const auto &buffer : m_buffers) {
+        if (buffer.acquired) {
+            fds.push_back(buffer.fd);
+        }
+    }
+
+    send_frame(m_socket.fd(), msg, fds);
+}
+
+void UnixTransport::receive(int fd, Seraphim::Message &msg) {
+    std::vector<int> fds;
+    size_t size;
+
+    // buffers of the previous request must not be accessed anymore
+    unregister_buffers();
+
+    size = receive_frame(fd, fds);
+
+    m_registered_fd = fd;
+    for (const auto &buffer_fd : fds) {
+        std::string region = register_buffer(fd, buffer_fd);
+        if (!region.empty()) {
+            m_registered.push_back(region);
+        }
+    }
+
+    if (!msg.ParseFromArray(m_rx_buffer.data(), static_cast<int>(size))) {
+        SPH_THROW(RuntimeException, "Failed to deserialize message");
+    }
+}
+
+void UnixTransport::send(int fd, const Seraphim::Message &msg) {
+    // the request has been handled once the response is sent
+    unregister_buffers();
+
+    send_frame(fd, msg, {});
+}
+
+std::vector<std::string>
+UnixTransport::receive(int fd, const std::function<void(const unsigned char *, size_t)> &consume) {
+    std::vector<std::string> regions;
+    std::vector<int> fds;
+    size_t size;
+
+    size = receive_frame(fd, fds);
+
+    for (const auto &buffer_fd : fds) {
+        std::string region = register_buffer(fd, buffer_fd);
+        if (!region.empty()) {
+            regions.push_back(region);
+        }
+    }
+
+    try {
+        consume(m_rx_buffer.data(), size);
+    } catch (...) {
+        release_buffers(fd, regions);
+        throw;
+    }
+
+    return regions;
+}
+
+void UnixTransport::release_buffers(int fd, const std::vector<std::string> &regions) {
+    auto connection = m_mappings.find(fd);
+    if (connection == m_mappings.end()) {
+        return;
+    }
+
+    std::deque<Mapping> &mappings = connection->second;
+    for (const auto &region : regions) {
+        for (auto &mapping : mappings) {
+            if (mapping.users > 0 && region_name(mapping.ino) == region) {
+                if (--mapping.users == 0) {
+                    BufferRegistry::Instance().remove(peer(fd), region);
+                }
+                break;
+            }
+        }
+    }
+
+    // the cache may have grown beyond its size while buffers were in use
+    auto it = mappings.begin();
+    while (mappings.size() > MAX_CACHED_BUFFERS && it != mappings.end()) {
+        if (it->users > 0) {
+            it++;
+            continue;
+        }
+        munmap(it->addr, it->size);
+        ::close(it->fd);
+        it = mappings.erase(it);
+    }
+}
+
+size_t UnixTransport::receive_frame(int fd, std::vector<int> &fds) {
+    MessageHeader msghdr = {};
+    unsigned char control[CONTROL_SIZE];
+    struct iovec iov = {};
+    struct msghdr hdr = {};
+    size_t remaining;
+    ssize_t read;
+
+    // file descriptors are attached to the first byte of a frame, so they arrive with the header
+    iov.iov_base = &msghdr;
+    iov.iov_len = sizeof(msghdr);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control;
+    hdr.msg_controllen = sizeof(control);
+
+    read = m_socket.receive_msg(fd, &hdr, MSG_CMSG_CLOEXEC);
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int buffer_fd;
+            memcpy(&buffer_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            fds.push_back(buffer_fd);
+        }
+    }
+
+    try {
+        if (hdr.msg_flags & MSG_CTRUNC) {
+            SPH_THROW(RuntimeException, "Too many file descriptors attached to message");
+        }
+
+        // the header itself may be split as well
+        remaining = sizeof(msghdr) - static_cast<size_t>(read);
+        while (remaining > 0) {
+            // receive() will throw on error
+            read = m_socket.receive(
+                fd, reinterpret_cast<unsigned char *>(&msghdr) + sizeof(msghdr) - remaining,
+                remaining);
+            remaining -= static_cast<size_t>(read);
+        }
+
+        // the size is announced by the peer, so check it before allocating anything
+        if (msghdr.size > m_max_message_size) {
+            SPH_THROW(RuntimeException, "Message too large");
+        }
+
+        if (m_rx_buffer.size() < msghdr.size) {
+            m_rx_buffer.resize(msghdr.size);
+        }
+
+        remaining = msghdr.size;
+        while (remaining > 0) {
+            // receive() will throw on error
+            read = m_socket.receive(fd, m_rx_buffer.data() + msghdr.size - remaining, remaining);
+            assert(read > 0);
+
+            // calculate the remaining amount of bytes to be read
+            remaining -= static_cast<size_t>(read);
+        }
+    } catch (...) {
+        for (const auto &buffer_fd : fds) {
+            ::close(buffer_fd);
+        }
+        fds.clear();
+        throw;
+    }
+
+    return msghdr.size;
+}
+
+void UnixTransport::send_frame(int fd, const Seraphim::Message &msg, const std::vector<int> &fds) {
+    MessageHeader msghdr = {};
+    unsigned char control[CONTROL_SIZE] = {};
+    struct iovec iov[2] = {};
+    struct msghdr hdr = {};
+    size_t remaining;
+    size_t total;
+    ssize_t sent;
+
+    if (fds.size() > MAX_BUFFERS) {
+        SPH_THROW(RuntimeException, "Too many buffers attached to message");
+    }
+
+    msghdr.size = msg.ByteSizeLong();
+    if (m_tx_buffer.size() < msghdr.size) {
+        m_tx_buffer.resize(msghdr.size);
+    }
+
+    if (!msg.SerializeToArray(m_tx_buffer.data(), static_cast<int>(msghdr.size))) {
+        SPH_THROW(RuntimeException, "Failed to serialize message");
+    }
+
+    // header and payload are sent with a single call
+    iov[0].iov_base = &msghdr;
+    iov[0].iov_len = sizeof(msghdr);
+    iov[1].iov_base = m_tx_buffer.data();
+    iov[1].iov_len = msghdr.size;
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = 2;
+
+    if (!fds.empty()) {
+        hdr.msg_control = control;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    // send_msg() will throw on error
+    sent = m_socket.send_msg(fd, &hdr);
+    assert(sent > 0);
+
+    total = sizeof(msghdr) + msghdr.size;
+    remaining = total - static_cast<size_t>(sent);
+    while (remaining > 0) {
+        size_t offset = total - remaining;
+
+        // the file descriptors were sent along with the first chunk already
+        if (offset < sizeof(msghdr)) {
+            iov[0].iov_base = reinterpret_cast<unsigned char *>(&msghdr) + offset;
+            iov[0].iov_len = sizeof(msghdr) - offset;
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = 2;
+        } else {
+            iov[1].iov_base = m_tx_buffer.data() + offset - sizeof(msghdr);
+            iov[1].iov_len = remaining;
+            hdr.msg_iov = &iov[1];
+            hdr.msg_iovlen = 1;
+        }
+        hdr.msg_control = nullptr;
+        hdr.msg_controllen = 0;
+
+        sent = m_socket.send_msg(fd, &hdr);
+        assert(sent > 0);
+
+        // calculate the remaining amount of bytes to be sent
+        remaining -= static_cast<size_t>(sent);
+    }
+}
+
+unsigned char *UnixTransport::acquire_buffer(size_t size, Seraphim::Types::BufferRef &ref) {
+#ifdef __linux__
+    // prefer the smallest released buffer which is large enough
+    Buffer *match = nullptr;
+    size_t acquired = 0;
+    for (auto &buffer : m_buffers) {
+        if (buffer.acquired) {
+            acquired++;
+        } else if (buffer.size >= size && (!match || buffer.size < match->size)) {
+            match = &buffer;
+        }
+    }
+
+    if (acquired >= MAX_BUFFERS) {
+        return nullptr;
+    }
+
+    if (!match) {
+        // buffers are sealed, so they cannot grow; drop a released one instead
+        if (m_buffers.size() >= MAX_BUFFERS) {
+            for (auto it = m_buffers.begin(); it != m_buffers.end(); it++) {
+                if (!it->acquired) {
+                    munmap(it->addr, it->size);
+                    ::close(it->fd);
+                    m_buffers.erase(it);
+                    break;
+                }
+            }
+        }
+
+        Buffer buffer = {};
+        struct stat buffer_stat;
+        void *addr;
+
+        buffer.fd = memfd_create("seraphim", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (buffer.fd == -1) {
+            return nullptr;
+        }
+
+        if (ftruncate(buffer.fd, static_cast<off_t>(size)) == -1 ||
+            fcntl(buffer.fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1 ||
+            fstat(buffer.fd, &buffer_stat) == -1) {
+            ::close(buffer.fd);
+            return nullptr;
+        }
+
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(buffer.fd);
+            return nullptr;
+        }
+
+        buffer.addr = static_cast<unsigned char *>(addr);
+        buffer.size = size;
+        buffer.region = region_name(static_cast<uint64_t>(buffer_stat.st_ino));
+        m_buffers.push_back(buffer);
+        match = &m_buffers.back();
+    }
+
+    match->acquired = true;
+    ref.set_region(match->region);
+    ref.set_offset(0);
+    ref.set_size(size);
+    return match->addr;
+#else
+    (void)size;
+    (void)ref;
+    return nullptr;
+#endif
+}
+
+void UnixTransport::release_buffer(const Seraphim::Types::BufferRef &ref) {
+    for (auto &buffer : m_buffers) {
+        if (buffer.region == ref.region()) {
+            buffer.acquired = false;
+            return;
+        }
+    }
+}
+
+std::string UnixTransport::register_buffer(int fd, int buffer_fd) {
+#ifdef __linux__
+    struct stat buffer_stat;
+    int seals;
+
+    seals = fcntl(buffer_fd, F_GET_SEALS);
+    if (seals == -1 || !(seals & F_SEAL_SHRINK)) {
+        ::close(buffer_fd);
+        return std::string();
+    }
+
+    if (fstat(buffer_fd, &buffer_stat) == -1 || buffer_stat.st_size <= 0) {
+        ::close(buffer_fd);
+        return std::string();
+    }
+
+    uint64_t ino = static_cast<uint64_t>(buffer_stat.st_ino);
+    size_t size = static_cast<size_t>(buffer_stat.st_size);
+    std::deque<Mapping> &mappings = m_mappings[fd];
+    Mapping mapping = {};
+
+    auto it = mappings.begin();
+    for (; it != mappings.end(); it++) {
+        if (it->ino == ino && it->size == size) {
+            break;
+        }
+    }
+
+    if (it != mappings.end()) {
+        // the cached mapping keeps its own descriptor open, so the inode cannot have been reused
+        mapping = *it;
+        mappings.erase(it);
+        ::close(buffer_fd);
+    } else {
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, buffer_fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(buffer_fd);
+            return std::string();
+        }
+
+        mapping.fd = buffer_fd;
+        mapping.ino = ino;
+        mapping.addr = static_cast<unsigned char *>(addr);
+        mapping.size = size;
+        mapping.users = 0;
+
+        // buffers of requests which are still being handled must stay mapped
+        if (mappings.size() >= MAX_CACHED_BUFFERS) {
+            for (auto unused = mappings.begin(); unused != mappings.end(); unused++) {
+                if (unused->users == 0) {
+                    munmap(unused->addr, unused->size);
+                    ::close(unused->fd);
+                    mappings.erase(unused);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::string region = region_name(ino);
+    if (mapping.users++ == 0) {
+        BufferRegistry::Instance().add(peer(fd), region, mapping.addr, mapping.size);
+    }
+
+    // most recently used mappings are kept at the back
+    mappings.push_back(mapping);
+    return region;
+#else
+    (void)fd;
+    ::close(buffer_fd);
+    return std::string();
+#endif
+}
+
+void UnixTransport::unregister_buffers() {
+    release_buffers(m_registered_fd, m_registered);
+    m_registered_fd = -1;
+    m_registered.clear();
+}
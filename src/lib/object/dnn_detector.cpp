@@ -68,29 +68,59 @@ bool DNNDetector::set_target(Target target) {
 }
 
 bool DNNDetector::predict(const Image &img, std::vector<Prediction> &preds) {
-    cv::Mat mat;
+    std::vector<cv::Mat> mats(1);
+    std::vector<std::vector<Prediction>> batch_preds;
+
+    mats[0] = sph::iop::cv::from_image(img);
+    if (mats[0].empty()) {
+        return false;
+    }
+
+    preds.clear();
+    if (!infer(mats, batch_preds)) {
+        return false;
+    }
+
+    preds = std::move(batch_preds[0]);
+    return true;
+}
+
+bool DNNDetector::predict(const std::vector<CoreImage> &imgs,
+                          std::vector<std::vector<Prediction>> &preds) {
+    std::vector<cv::Mat> mats(imgs.size());
+
+    preds.clear();
+    if (imgs.empty()) {
+        return true;
+    }
+
+    for (size_t i = 0; i < imgs.size(); i++) {
+        mats[i] = sph::iop::cv::from_image(imgs[i]);
+        if (mats[i].empty()) {
+            return false;
+        }
+    }
+
+    return infer(mats, preds);
+}
+
+bool DNNDetector::infer(const std::vector<cv::Mat> &mats,
+                        std::vector<std::vector<Prediction>> &preds) {
     cv::Mat blob;
     std::vector<cv::Mat> outputs;
     std::vector<int> out_layers;
     std::vector<cv::String> out_layer_names;
     std::vector<std::string> out_layer_types;
-    std::vector<int> class_ids;
-    std::vector<float> confidences;
-    std::vector<cv::Rect> boxes;
+    std::vector<std::vector<int>> class_ids(mats.size());
+    std::vector<std::vector<float>> confidences(mats.size());
+    std::vector<std::vector<cv::Rect>> boxes(mats.size());
     std::unique_lock<std::mutex> lock(m_target_mutex);
 
-    mat = sph::iop::cv::from_image(img);
-    if (mat.empty()) {
-        return false;
-    }
-
-    preds.clear();
-
-    // create a 4D blob and feed it to the net
+    // create a 4D (NCHW) blob with one plane per image and feed it to the net
     // in most common cases, RGB images are used for training, but OpenCV always stores images in
     // BGR order, so we set swapRB to "true" by default
-    cv::dnn::blobFromImage(mat, blob, m_blob_params.scalefactor, m_blob_params.size,
-                           m_blob_params.mean, m_blob_params.swap_rb, m_blob_params.crop);
+    cv::dnn::blobFromImages(mats, blob, m_blob_params.scalefactor, m_blob_params.size,
+                            m_blob_params.mean, m_blob_params.swap_rb, m_blob_params.crop);
     m_net.setInput(blob);
 
     // infer
@@ -111,6 +141,12 @@ bool DNNDetector::predict(const Image &img, std::vector<Prediction> &preds) {
         for (size_t k = 0; k < outputs.size(); k++) {
             float *data = reinterpret_cast<float *>(outputs[k].data);
             for (size_t i = 0; i < outputs[k].total(); i += 7) {
+                int batch_id = static_cast<int>(data[i]);
+                if (batch_id < 0 || static_cast<size_t>(batch_id) >= mats.size()) {
+                    continue;
+                }
+
+                const cv::Mat &mat = mats[static_cast<size_t>(batch_id)];
                 float confidence = data[i + 2];
                 int left = static_cast<int>(data[i + 3]);
                 int top = static_cast<int>(data[i + 4]);
@@ -127,9 +163,10 @@ bool DNNDetector::predict(const Image &img, std::vector<Prediction> &preds) {
                     height = bottom - top + 1;
                 }
 
-                class_ids.push_back(static_cast<int>(data[i + 1]));
-                confidences.push_back(confidence);
-                boxes.push_back(cv::Rect(left, top, width, height));
+                class_ids[static_cast<size_t>(batch_id)].push_back(static_cast<int>(data[i + 1]));
+                confidences[static_cast<size_t>(batch_id)].push_back(confidence);
+                boxes[static_cast<size_t>(batch_id)].push_back(
+                    cv::Rect(left, top, width, height));
             }
         }
     } else if (out_layer_types[0] == "Region") {
@@ -137,9 +174,37 @@ bool DNNDetector::predict(const Image &img, std::vector<Prediction> &preds) {
             // Network produces output blob with a shape NxC where N is a number of
             // detected objects and C is a number of classes + 4 where the first 4
             // numbers are [center_x, center_y, width, height]
-            float *data = reinterpret_cast<float *>(outputs[i].data);
-            for (int j = 0; j < outputs[i].rows; ++j, data += outputs[i].cols) {
-                cv::Mat scores = outputs[i].row(j).colRange(5, outputs[i].cols);
+            // for batched input, the rows of all images are stacked in input order, either in a
+            // 2D blob or in a 3D blob with one plane per image
+            cv::Mat output = outputs[i];
+            int batch_size = static_cast<int>(mats.size());
+            int rows;
+            if (output.dims == 3) {
+                if (output.size[0] != batch_size) {
+                    continue;
+                }
+                rows = output.size[1];
+                output = output.reshape(1, output.size[0] * output.size[1]);
+            } else {
+                // rows which cannot be attributed to an image are not trusted at all
+                if (output.rows % batch_size != 0) {
+                    continue;
+                }
+                rows = output.rows / batch_size;
+            }
+            if (rows <= 0 || output.cols < 5) {
+                continue;
+            }
+
+            float *data = reinterpret_cast<float *>(output.data);
+            for (int j = 0; j < output.rows; ++j, data += output.cols) {
+                size_t b = static_cast<size_t>(j / rows);
+                if (b >= mats.size()) {
+                    break;
+                }
+
+                const cv::Mat &mat = mats[b];
+                cv::Mat scores = output.row(j).colRange(5, output.cols);
                 cv::Point class_id_point;
                 double confidence;
                 minMaxLoc(scores, nullptr, &confidence, nullptr, &class_id_point);
@@ -150,30 +215,33 @@ bool DNNDetector::predict(const Image &img, std::vector<Prediction> &preds) {
                 int left = centerX - width / 2;
                 int top = centerY - height / 2;
 
-                class_ids.push_back(class_id_point.x);
-                confidences.push_back(static_cast<float>(confidence));
-                boxes.push_back(cv::Rect(left, top, width, height));
+                class_ids[b].push_back(class_id_point.x);
+                confidences[b].push_back(static_cast<float>(confidence));
+                boxes[b].push_back(cv::Rect(left, top, width, height));
             }
         }
     } else {
         return false;
     }
 
-    // do non maximum suppression (NMS) to filter out objects suppressed by bigger ones
-    std::vector<int> nms_indices;
-    cv::dnn::NMSBoxes(boxes, confidences, 0.0, 0.4f, nms_indices);
-
-    for (size_t i = 0; i < nms_indices.size(); i++) {
-        size_t idx = static_cast<size_t>(nms_indices[i]);
-        Prediction pred = {};
-        pred.class_id = class_ids[idx];
-        pred.confidence = confidences[idx];
-        pred.poly = Polygon<int>(
-            Point2i(boxes[idx].x, boxes[idx].y),
-            Point2i(boxes[idx].x, boxes[idx].y + boxes[idx].height),
-            Point2i(boxes[idx].x + boxes[idx].width, boxes[idx].y),
-            Point2i(boxes[idx].x + boxes[idx].width, boxes[idx].y + boxes[idx].height));
-        preds.push_back(pred);
+    preds.resize(mats.size());
+    for (size_t b = 0; b < mats.size(); b++) {
+        // do non maximum suppression (NMS) to filter out objects suppressed by bigger ones
+        std::vector<int> nms_indices;
+        cv::dnn::NMSBoxes(boxes[b], confidences[b], 0.0, 0.4f, nms_indices);
+
+        preds[b].clear();
+        for (size_t i = 0; i < nms_indices.size(); i++) {
+            size_t idx = static_cast<size_t>(nms_indices[i]);
+            const cv::Rect &box = boxes[b][idx];
+            Prediction pred = {};
+            pred.class_id = class_ids[b][idx];
+            pred.confidence = confidences[b][idx];
+            pred.poly = Polygon<int>(Point2i(box.x, box.y), Point2i(box.x, box.y + box.height),
+                                     Point2i(box.x + box.width, box.y),
+                                     Point2i(box.x + box.width, box.y + box.height));
+            preds[b].push_back(pred);
+        }
     }
 
     return true;
@@ -45,6 +45,26 @@ public:
      * @return Whether prediction was successful.
      */
     virtual bool predict(const sph::Image &img, std::vector<Prediction> &preds) = 0;
+
+    /**
+     * @brief Predict object classes and locations in a batch of images.
+     *        The default implementation calls @ref predict for each image. Detectors which can
+     *        process several images in one pass (e.g. neural networks) should override it.
+     * @param imgs Input images.
+     * @param preds Output vector containing the @ref Prediction instances of each image.
+     * @return Whether prediction was successful for all images.
+     */
+    virtual bool predict(const std::vector<sph::CoreImage> &imgs,
+                         std::vector<std::vector<Prediction>> &preds) {
+        bool ret = true;
+
+        preds.resize(imgs.size());
+        for (size_t i = 0; i < imgs.size(); i++) {
+            ret &= predict(imgs[i], preds[i]);
+        }
+
+        return ret;
+    }
 };
 
 } // namespace object
@@ -46,6 +46,7 @@ public:
     };
 
     void set_blob_parameters(const struct BlobParameters &params) { m_blob_params = params; }
+    const struct BlobParameters &blob_parameters() const { return m_blob_params; }
 
     /**
      * @brief Read a network from a model and a config.
@@ -79,7 +80,22 @@ public:
 
     bool predict(const sph::Image &img, std::vector<Prediction> &preds) override;
 
+    /**
+     * @brief Predict object classes and locations in a batch of images.
+     *        All images are stacked into a single NCHW blob, so the net is only run once.
+     */
+    bool predict(const std::vector<sph::CoreImage> &imgs,
+                 std::vector<std::vector<Prediction>> &preds) override;
+
 private:
+    /**
+     * @brief Run the net on a batch of images and decode the detections of each image.
+     * @param mats Input images, must not be empty.
+     * @param preds Output vector containing the @ref Prediction instances of each image.
+     * @return Whether prediction was successful.
+     */
+    bool infer(const std::vector<cv::Mat> &mats, std::vector<std::vector<Prediction>> &preds);
+
     /// Deep neural network
     cv::dnn::Net m_net;
 
@@ -0,0 +1,60 @@
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <stdexcept>
+
+#include <seraphim/thread_pool.h>
+
+using namespace sph;
+
+TEST_CASE( "ThreadPool runtime behavior", "[ThreadPool]" ) {
+    SECTION( "all jobs are executed before the pool is destroyed" ) {
+        std::atomic<int> count(0);
+
+        {
+            ThreadPool pool(4);
+            REQUIRE( pool.size() == 4 );
+            for (int i = 0; i < 1000; i++) {
+                pool.submit([&]() { count++; });
+            }
+        }
+
+        REQUIRE( count == 1000 );
+    }
+    SECTION( "jobs run in parallel" ) {
+        std::atomic<int> running(0);
+        std::atomic<int> max_running(0);
+
+        {
+            ThreadPool pool(2);
+            for (int i = 0; i < 2; i++) {
+                pool.submit([&]() {
+                    int now = ++running;
+                    int prev = max_running;
+                    while (now > prev && !max_running.compare_exchange_weak(prev, now)) {
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    running--;
+                });
+            }
+        }
+
+        REQUIRE( max_running == 2 );
+    }
+    SECTION( "jobs which throw do not stop the workers" ) {
+        std::atomic<int> count(0);
+
+        {
+            ThreadPool pool(1);
+            pool.submit([]() { throw std::runtime_error("job failed"); });
+            pool.submit([]() { throw 42; });
+            pool.submit([&]() { count++; });
+        }
+
+        REQUIRE( count == 1 );
+    }
+    SECTION( "the default size matches the hardware" ) {
+        ThreadPool pool;
+        REQUIRE( pool.size() >= 1 );
+    }
+}
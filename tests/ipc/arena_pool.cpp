@@ -0,0 +1,62 @@
+#include <catch2/catch.hpp>
+
+#include <Types.pb.h>
+#include <seraphim/ipc/arena_pool.h>
+
+using namespace sph::ipc;
+
+TEST_CASE( "ArenaPool runtime behavior", "[ArenaPool]" ) {
+    ArenaPool pool(4096, 2);
+
+    SECTION( "arenas are recycled" ) {
+        google::protobuf::Arena *first;
+
+        {
+            auto arena = pool.acquire();
+            first = arena.get();
+            google::protobuf::Arena::CreateMessage<Seraphim::Types::Region2D>(arena.get());
+            REQUIRE( arena->SpaceUsed() > 0 );
+        }
+
+        auto arena = pool.acquire();
+        REQUIRE( arena.get() == first );
+        REQUIRE( arena->SpaceUsed() == 0 );
+        REQUIRE( pool.stats().leases == 2 );
+        REQUIRE( pool.stats().bytes_used > 0 );
+    }
+    SECTION( "small requests do not allocate from the heap" ) {
+        uint64_t heap_blocks = pool.stats().heap_blocks;
+
+        for (int i = 0; i < 16; i++) {
+            auto arena = pool.acquire();
+            auto points = google::protobuf::Arena::CreateMessage<Seraphim::Types::PointSet2D>(
+                arena.get());
+            for (int j = 0; j < 8; j++) {
+                points->add_points()->set_x(j);
+            }
+        }
+
+        REQUIRE( pool.stats().heap_blocks == heap_blocks );
+    }
+    SECTION( "large requests are counted" ) {
+        uint64_t heap_blocks = pool.stats().heap_blocks;
+
+        {
+            auto arena = pool.acquire();
+            auto points = google::protobuf::Arena::CreateMessage<Seraphim::Types::PointSet2D>(
+                arena.get());
+            for (int j = 0; j < 1024; j++) {
+                points->add_points()->set_x(j);
+            }
+        }
+
+        REQUIRE( pool.stats().heap_blocks > heap_blocks );
+    }
+    SECTION( "arenas may outlive the pool" ) {
+        auto other = std::unique_ptr<ArenaPool>(new ArenaPool());
+        auto arena = other->acquire();
+
+        other.reset();
+        google::protobuf::Arena::CreateMessage<Seraphim::Types::Region2D>(arena.get());
+    }
+}
@@ -0,0 +1,95 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/async_client.h>
+#include <seraphim/ipc/except.h>
+#include <seraphim/ipc/tcp_transport.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static const uint16_t PORT = 38104;
+
+TEST_CASE( "AsyncClient runtime behavior", "[AsyncClient]" ) {
+    TCPTransport server(net::Socket::Family::INET);
+    auto transport = std::make_shared<TCPTransport>(net::Socket::Family::INET);
+    Seraphim::Message msg;
+
+    REQUIRE( server.bind(PORT) );
+    server.listen(1);
+    server.set_rx_timeout(1000);
+    REQUIRE( transport->connect("127.0.0.1", PORT) );
+    int fd = server.accept(nullptr, nullptr);
+    REQUIRE( fd >= 0 );
+
+    auto client = std::unique_ptr<AsyncClient>(new AsyncClient(transport));
+
+    SECTION( "responses completed out of order are matched by id" ) {
+        std::vector<std::future<Seraphim::Message>> futures;
+        std::vector<Seraphim::Message> requests;
+
+        for (unsigned int i = 0; i < 8; i++) {
+            msg.Clear();
+            msg.mutable_req();
+            futures.emplace_back(client->request(msg));
+            msg.mutable_res()->set_status(static_cast<int>(msg.id()));
+            requests.push_back(msg);
+        }
+        REQUIRE( client->pending() == 8 );
+
+        // every request got its own id
+        for (size_t i = 1; i < requests.size(); i++) {
+            REQUIRE( requests[i].id() != requests[i - 1].id() );
+        }
+
+        for (unsigned int i = 0; i < 8; i++) {
+            server.receive(fd, msg);
+            REQUIRE( msg.id() == requests[i].id() );
+        }
+
+        // respond in reverse order
+        for (auto it = requests.rbegin(); it != requests.rend(); it++) {
+            server.send(fd, *it);
+        }
+
+        for (auto &future : futures) {
+            Seraphim::Message response = future.get();
+            REQUIRE( response.res().status() == static_cast<int>(response.id()) );
+        }
+        REQUIRE( client->pending() == 0 );
+    }
+    SECTION( "callbacks are invoked with the response" ) {
+        std::promise<uint32_t> received;
+        uint32_t id;
+
+        msg.mutable_req();
+        client->request(msg, [&](Seraphim::Message &response) {
+            received.set_value(response.id());
+        });
+        id = msg.id();
+
+        server.receive(fd, msg);
+        server.send(fd, msg);
+        REQUIRE( received.get_future().get() == id );
+    }
+    SECTION( "pending requests fail when the server disconnects" ) {
+        msg.mutable_req();
+        auto future = client->request(msg);
+
+        server.disconnect(fd);
+        REQUIRE_THROWS_AS( future.get(), RuntimeException );
+        REQUIRE_THROWS_AS( client->request(msg), PeerDisconnectedException );
+    }
+    SECTION( "pending requests fail when the client is destroyed" ) {
+        msg.mutable_req();
+        auto future = client->request(msg);
+
+        client.reset();
+        REQUIRE_THROWS_AS( future.get(), RuntimeException );
+    }
+}
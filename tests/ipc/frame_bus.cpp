@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <thread>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/frame_bus.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static const std::string BUS = "/seraphim_frame_bus_tests";
+
+static uint64_t publish(FrameBus &bus, unsigned char value, size_t size) {
+    std::vector<unsigned char> data(size, value);
+    FrameBus::Frame frame = {};
+
+    frame.width = static_cast<uint32_t>(size);
+    frame.height = 1;
+    frame.size = size;
+    return bus.publish(frame, data.data());
+}
+
+TEST_CASE( "FrameBus runtime behavior", "[FrameBus]" ) {
+    FrameBus writer;
+    FrameBus reader;
+    FrameBus::Frame frame = {};
+    std::vector<unsigned char> data;
+
+    REQUIRE( writer.create(BUS, 4096, 4) );
+    REQUIRE( reader.open(BUS) );
+    REQUIRE( reader.frame_size() == 4096 );
+
+    SECTION( "readers time out while there is no new frame" ) {
+        REQUIRE( reader.latest() == 0 );
+        REQUIRE( !reader.next(frame, data, 10) );
+
+        publish(writer, 1, 16);
+        REQUIRE( reader.next(frame, data, 10) );
+        REQUIRE( !reader.next(frame, data, 10) );
+    }
+    SECTION( "every reader gets the newest frame and skips the ones it missed" ) {
+        FrameBus other;
+        REQUIRE( other.open(BUS) );
+
+        REQUIRE( publish(writer, 1, 16) == 1 );
+        REQUIRE( reader.next(frame, data, 0) );
+        REQUIRE( frame.seq == 1 );
+
+        for (unsigned char i = 2; i <= 6; i++) {
+            publish(writer, i, 100 + i);
+        }
+
+        REQUIRE( reader.next(frame, data, 0) );
+        REQUIRE( frame.seq == 6 );
+        REQUIRE( frame.width == 106 );
+        REQUIRE( data == std::vector<unsigned char>(106, 6) );
+        REQUIRE( reader.stats().frames == 2 );
+        REQUIRE( reader.stats().skipped == 4 );
+
+        // independent cursor
+        REQUIRE( other.next(frame, data, 0) );
+        REQUIRE( frame.seq == 6 );
+        REQUIRE( other.stats().skipped == 0 );
+    }
+    SECTION( "frames are read by number as long as their slot was not reused" ) {
+        for (unsigned char i = 1; i <= 5; i++) {
+            publish(writer, i, 8);
+        }
+
+        auto buffer = [&](const FrameBus::Frame &f) {
+            data.resize(f.size);
+            return data.data();
+        };
+        REQUIRE( reader.read(3, frame, buffer) );
+        REQUIRE( data[0] == 3 );
+        REQUIRE( !reader.read(1, frame, buffer) );
+        REQUIRE( !reader.read(6, frame, buffer) );
+    }
+    SECTION( "frames larger than the slots are rejected" ) {
+        REQUIRE_THROWS_AS( publish(writer, 1, 4097), InvalidArgumentException );
+        REQUIRE_THROWS_AS( publish(reader, 1, 16), RuntimeException );
+    }
+    SECTION( "waiting readers are woken up and never see torn frames" ) {
+        std::atomic<bool> done(false);
+        std::thread producer([&]() {
+            for (unsigned int i = 1; i <= 2000; i++) {
+                publish(writer, static_cast<unsigned char>(i), 1024 + i % 2048);
+            }
+            done = true;
+        });
+
+        uint64_t torn = 0;
+        uint64_t first = 0;
+        while (!done || reader.latest() > frame.seq) {
+            if (!reader.next(frame, data, 100)) {
+                continue;
+            }
+            if (first == 0) {
+                first = frame.seq;
+            }
+            auto value = static_cast<unsigned char>(frame.seq);
+            if (data.size() != 1024 + frame.seq % 2048 ||
+                std::count(data.begin(), data.end(), value) != static_cast<long>(data.size())) {
+                torn++;
+            }
+        }
+        producer.join();
+
+        REQUIRE( torn == 0 );
+        REQUIRE( frame.seq == 2000 );
+        // frames published before the first read are not skipped, they were never subscribed to
+        REQUIRE( reader.stats().frames + reader.stats().skipped == 2000 - first + 1 );
+    }
+    SECTION( "readers notice when the writer closes the bus" ) {
+        writer.close();
+        REQUIRE( reader.closed() );
+        REQUIRE_THROWS_AS( reader.next(frame, data, 10), RuntimeException );
+    }
+}
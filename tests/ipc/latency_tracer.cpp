@@ -0,0 +1,112 @@
+#include <catch2/catch.hpp>
+
+#include <seraphim/ipc/latency_tracer.h>
+
+using namespace sph::ipc;
+
+static constexpr int64_t MS = 1000000;
+
+/**
+ * @brief Complete a trace like a server whose clock is ahead by offset.
+ */
+static void serve(Seraphim::Message &msg, int64_t offset, int64_t uplink, int64_t handle) {
+    Seraphim::Trace *trace = msg.mutable_trace();
+
+    trace->set_received(trace->sent() + offset + uplink);
+    trace->set_parse(MS / 10);
+    trace->set_queue(MS);
+    trace->set_handle(handle);
+    trace->set_replied(trace->received() + trace->parse() + trace->queue() + handle);
+}
+
+TEST_CASE( "LatencyHistogram runtime behavior", "[LatencyHistogram]" ) {
+    LatencyHistogram histogram;
+
+    SECTION( "empty histograms report zeros" ) {
+        REQUIRE( histogram.count() == 0 );
+        REQUIRE( histogram.percentile(99) == 0 );
+        REQUIRE( histogram.mean() == 0 );
+    }
+    SECTION( "percentiles are accurate to the sub-bucket width" ) {
+        for (int64_t i = 1; i <= 1000; i++) {
+            histogram.add(i * 1000);
+        }
+
+        REQUIRE( histogram.count() == 1000 );
+        REQUIRE( histogram.max() == 1000 * 1000 );
+        REQUIRE( histogram.mean() == 500500 );
+        REQUIRE( histogram.percentile(50) >= 500 * 1000 );
+        REQUIRE( histogram.percentile(50) <= 500 * 1000 * 17 / 16 );
+        REQUIRE( histogram.percentile(99) >= 990 * 1000 );
+        REQUIRE( histogram.percentile(99) <= 1000 * 1000 );
+        REQUIRE( histogram.percentile(100) == 1000 * 1000 );
+    }
+    SECTION( "histograms of several threads can be merged" ) {
+        LatencyHistogram other;
+        histogram.add(1000);
+        other.add(3000);
+        other.add(5000);
+
+        histogram.merge(other);
+        REQUIRE( histogram.count() == 3 );
+        REQUIRE( histogram.mean() == 3000 );
+        REQUIRE( histogram.max() == 5000 );
+        REQUIRE( histogram.percentile(100) == 5000 );
+    }
+    SECTION( "small and negative values are counted exactly" ) {
+        histogram.add(-5);
+        histogram.add(3);
+        REQUIRE( histogram.percentile(50) == 0 );
+        REQUIRE( histogram.percentile(100) == 3 );
+
+        histogram.reset();
+        REQUIRE( histogram.count() == 0 );
+    }
+}
+
+TEST_CASE( "LatencyTracer runtime behavior", "[LatencyTracer]" ) {
+    LatencyTracer tracer;
+    Seraphim::Message msg;
+
+    SECTION( "traces get distinct ids" ) {
+        Seraphim::Message other;
+        tracer.stamp(msg);
+        tracer.stamp(other);
+        REQUIRE( msg.trace().id() != other.trace().id() );
+        REQUIRE( msg.trace().sent() > 0 );
+    }
+    SECTION( "responses without traces are ignored" ) {
+        REQUIRE( !tracer.record(msg) );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_TOTAL).count() == 0 );
+    }
+    SECTION( "stages are measured across clocks" ) {
+        const int64_t offset = 5000 * MS;
+
+        // asymmetric queueing delays must not disturb the offset estimation
+        for (int64_t i = 0; i < 4; i++) {
+            tracer.stamp(msg, 1000 * MS);
+            msg.mutable_trace()->set_sent(1002 * MS);
+            serve(msg, offset, MS + i * MS, 10 * MS);
+            int64_t received = msg.trace().replied() - offset + MS;
+            REQUIRE( tracer.record(msg, received) );
+        }
+
+        REQUIRE( tracer.clock_offset() == offset );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_CLIENT).max() == 2 * MS );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_UPLINK).percentile(0) >= MS );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_UPLINK).percentile(0) <= MS * 17 / 16 );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_DOWNLINK).max() == MS );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_HANDLE).max() == 10 * MS );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_QUEUE).count() == 4 );
+
+        tracer.reset();
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_TOTAL).count() == 0 );
+        REQUIRE( tracer.clock_offset() == offset );
+    }
+    SECTION( "incomplete traces only yield the client side stages" ) {
+        tracer.stamp(msg);
+        REQUIRE( tracer.record(msg, msg.trace().sent() + MS) );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_TOTAL).count() == 1 );
+        REQUIRE( tracer.histogram(LatencyTracer::STAGE_UPLINK).count() == 0 );
+    }
+}
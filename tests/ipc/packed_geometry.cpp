@@ -0,0 +1,106 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+#include <seraphim/ipc/packed_geometry.h>
+
+using namespace sph::ipc;
+
+namespace {
+struct Point {
+    int x;
+    int y;
+};
+} // namespace
+
+TEST_CASE( "Packed geometry runtime behavior", "[PackedGeometry]" ) {
+    SECTION( "regions are decoded in order" ) {
+        Seraphim::Types::PackedRegions2D packed;
+        std::vector<int32_t> values;
+
+        add_region(packed, 10, 20, 30, 40);
+        add_region(packed, -5, 0, 1, 2);
+        REQUIRE( unpack_regions(packed, [&](int32_t x, int32_t y, int32_t w, int32_t h) {
+            values.insert(values.end(), { x, y, w, h });
+        }) );
+        REQUIRE( values == std::vector<int32_t>({ 10, 20, 30, 40, -5, 0, 1, 2 }) );
+
+        // a truncated region is rejected as a whole
+        packed.mutable_values()->RemoveLast();
+        values.clear();
+        REQUIRE( !unpack_regions(packed, [&](int32_t x, int32_t, int32_t, int32_t) {
+            values.push_back(x);
+        }) );
+        REQUIRE( values.empty() );
+    }
+
+    SECTION( "point sets are decoded in order" ) {
+        Seraphim::Types::PackedPointSets2D packed;
+        std::vector<Point> jaw = { { 100, 200 }, { 102, 210 }, { 99, 190 } };
+        std::vector<Point> extreme = { { INT32_MIN, INT32_MAX }, { INT32_MAX, INT32_MIN } };
+        std::vector<std::vector<Point>> sets(3);
+
+        add_point_set(packed, jaw);
+        add_point_set(packed, std::vector<Point>());
+        add_point_set(packed, extreme);
+        REQUIRE( packed.sizes_size() == 3 );
+        // neighbouring points are stored as differences
+        REQUIRE( packed.coords(2) == 2 );
+        REQUIRE( packed.coords(3) == 10 );
+
+        REQUIRE( unpack_point_sets(packed, [&](size_t set, int32_t x, int32_t y) {
+            sets[set].push_back({ x, y });
+        }) );
+        REQUIRE( sets[0].size() == jaw.size() );
+        for (size_t i = 0; i < jaw.size(); i++) {
+            REQUIRE( sets[0][i].x == jaw[i].x );
+            REQUIRE( sets[0][i].y == jaw[i].y );
+        }
+        REQUIRE( sets[1].empty() );
+        REQUIRE( sets[2].size() == 2 );
+        REQUIRE( sets[2][0].x == INT32_MIN );
+        REQUIRE( sets[2][0].y == INT32_MAX );
+        REQUIRE( sets[2][1].x == INT32_MAX );
+        REQUIRE( sets[2][1].y == INT32_MIN );
+
+        // sets which claim more points than there are coordinates are rejected
+        packed.set_sizes(1, 1);
+        REQUIRE( !is_valid(packed) );
+        REQUIRE( !unpack_point_sets(packed, [](size_t, int32_t, int32_t) {}) );
+    }
+
+    SECTION( "packed encodings are smaller than nested messages" ) {
+        Seraphim::Types::PackedRegions2D packed_regions;
+        Seraphim::Types::PackedPointSets2D packed_sets;
+        Seraphim::Types::PointSet2D set;
+        std::vector<Point> points;
+        std::string nested_regions;
+
+        for (int i = 0; i < 16; i++) {
+            Seraphim::Types::Region2D region;
+            region.set_x(100 + i * 40);
+            region.set_y(200);
+            region.set_w(64);
+            region.set_h(64);
+            // the wire format of a repeated field is the concatenation of its elements
+            std::string element;
+            region.SerializeToString(&element);
+            nested_regions += '\x0a';
+            nested_regions += static_cast<char>(element.size());
+            nested_regions += element;
+            add_region(packed_regions, region.x(), region.y(), region.w(), region.h());
+        }
+        REQUIRE( packed_regions.ByteSizeLong() < nested_regions.size() );
+
+        // landmarks of a face, see Seraphim::Face::FacemarkDetector
+        for (int i = 0; i < 68; i++) {
+            Point point = { 300 + (i * 7) % 50, 400 + (i * 5) % 60 };
+            Seraphim::Types::Point2D *p = set.add_points();
+            p->set_x(point.x);
+            p->set_y(point.y);
+            points.push_back(point);
+        }
+        add_point_set(packed_sets, points);
+        REQUIRE( packed_sets.ByteSizeLong() * 2 < set.ByteSizeLong() );
+    }
+}
@@ -0,0 +1,131 @@
+#include <catch2/catch.hpp>
+
+#include <Types.pb.h>
+#include <seraphim/ipc/request_view.h>
+
+using namespace sph::ipc;
+
+TEST_CASE( "RequestView runtime behavior", "[RequestView]" ) {
+    Seraphim::Types::Image2D img;
+    Seraphim::Message msg;
+    RequestView view;
+    std::string data;
+
+    img.set_width(640);
+    img.set_height(480);
+    img.set_data(std::string(1024, 'x'));
+    msg.set_id(42);
+
+    SECTION( "type ids are FNV-1a hashes of the full type name" ) {
+        REQUIRE( type_id("") == 2166136261u );
+        REQUIRE( type_id("Seraphim.Types.Image2D") ==
+                 type_id(Seraphim::Types::Image2D::descriptor()->full_name()) );
+        REQUIRE( type_id("Seraphim.Types.Image2D") != type_id("Seraphim.Types.Region2D") );
+    }
+    SECTION( "compact requests are located in place" ) {
+        pack_request(img, *msg.mutable_req());
+        REQUIRE( !msg.req().has_inner() );
+        REQUIRE( msg.SerializeToString(&data) );
+
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.id() == 42 );
+        REQUIRE( view.is_request() );
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+
+        // the payload points into the serialized message
+        const uint8_t *begin = reinterpret_cast<const uint8_t *>(data.data());
+        REQUIRE( view.payload() > begin );
+        REQUIRE( view.payload() + view.payload_size() <= begin + data.size() );
+
+        Seraphim::Types::Image2D parsed;
+        REQUIRE( parsed.ParseFromArray(view.payload(), static_cast<int>(view.payload_size())) );
+        REQUIRE( parsed.width() == 640 );
+        REQUIRE( parsed.data() == img.data() );
+    }
+    SECTION( "requests packed into Any are located in place" ) {
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        REQUIRE( msg.SerializeToString(&data) );
+
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.id() == 42 );
+        REQUIRE( view.is_request() );
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+
+        Seraphim::Types::Image2D parsed;
+        REQUIRE( parsed.ParseFromArray(view.payload(), static_cast<int>(view.payload_size())) );
+        REQUIRE( parsed.height() == 480 );
+    }
+    SECTION( "parsed messages can be viewed as well" ) {
+        pack_request(img, *msg.mutable_req());
+        view.parse(msg);
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+        REQUIRE( view.payload_size() == msg.req().payload().size() );
+
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        msg.mutable_req()->clear_type();
+        msg.mutable_req()->clear_payload();
+        view.parse(msg);
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+        REQUIRE( view.payload_size() == msg.req().inner().value().size() );
+    }
+    SECTION( "shedding parameters are located as well" ) {
+        pack_request(img, *msg.mutable_req());
+        msg.mutable_req()->set_supersede(7);
+        msg.mutable_req()->set_deadline(250);
+        REQUIRE( msg.SerializeToString(&data) );
+
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.supersede() == 7 );
+        REQUIRE( view.deadline() == 250 );
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+
+        view.parse(msg);
+        REQUIRE( view.supersede() == 7 );
+        REQUIRE( view.deadline() == 250 );
+
+        msg.mutable_req()->clear_supersede();
+        msg.mutable_req()->clear_deadline();
+        REQUIRE( msg.SerializeToString(&data) );
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.supersede() == 0 );
+        REQUIRE( view.deadline() == 0 );
+    }
+    SECTION( "traces are located as well" ) {
+        Seraphim::Trace trace;
+
+        pack_request(img, *msg.mutable_req());
+        REQUIRE( msg.SerializeToString(&data) );
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( !view.has_trace() );
+        REQUIRE( !view.trace(trace) );
+
+        msg.mutable_trace()->set_id(42);
+        msg.mutable_trace()->set_sent(1000);
+        REQUIRE( msg.SerializeToString(&data) );
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.has_trace() );
+        REQUIRE( view.trace(trace) );
+        REQUIRE( trace.id() == 42 );
+        REQUIRE( trace.sent() == 1000 );
+        REQUIRE( view.type() == type_id("Seraphim.Types.Image2D") );
+
+        trace.Clear();
+        view.parse(msg);
+        REQUIRE( view.trace(trace) );
+        REQUIRE( trace.id() == 42 );
+    }
+    SECTION( "responses are no requests" ) {
+        msg.mutable_res()->set_status(1);
+        REQUIRE( msg.SerializeToString(&data) );
+
+        REQUIRE( view.parse(data.data(), data.size()) );
+        REQUIRE( view.id() == 42 );
+        REQUIRE_FALSE( view.is_request() );
+    }
+    SECTION( "truncated messages are rejected" ) {
+        pack_request(img, *msg.mutable_req());
+        REQUIRE( msg.SerializeToString(&data) );
+
+        REQUIRE_FALSE( view.parse(data.data(), data.size() - 10) );
+    }
+}
@@ -0,0 +1,132 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/ring_buffer.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static void push(RingBuffer &queue, const std::string &str, int timeout = 0) {
+    unsigned char *ptr = queue.reserve(str.size(), timeout);
+    std::memcpy(ptr, str.data(), str.size());
+    queue.commit(str.size());
+}
+
+static std::string pop(RingBuffer &queue, int timeout = 0) {
+    size_t size;
+    const unsigned char *ptr = queue.front(size, timeout);
+    std::string str(reinterpret_cast<const char *>(ptr), size);
+    queue.pop();
+    return str;
+}
+
+TEST_CASE( "RingBuffer runtime behavior", "[RingBuffer]" ) {
+    // use 64 bit elements to guarantee alignment
+    std::vector<uint64_t> memory(RingBuffer::footprint(4, 64) / sizeof(uint64_t));
+    RingBuffer producer;
+    RingBuffer consumer;
+
+    REQUIRE( producer.create(memory.data(), memory.size() * sizeof(uint64_t), 4) );
+    REQUIRE( consumer.open(memory.data()) );
+    REQUIRE( producer.capacity() == 64 );
+    REQUIRE( consumer.capacity() == 64 );
+
+    SECTION( "messages are received in order" ) {
+        push(producer, "one");
+        push(producer, "two");
+        push(producer, "three");
+
+        REQUIRE( pop(consumer) == "one" );
+        REQUIRE( pop(consumer) == "two" );
+        REQUIRE( pop(consumer) == "three" );
+    }
+    SECTION( "the oldest message can be accessed until it is removed" ) {
+        size_t size;
+
+        push(producer, "one");
+        push(producer, "two");
+        REQUIRE( consumer.front(size, 10) == consumer.front(size, 10) );
+        REQUIRE( pop(consumer) == "one" );
+        REQUIRE( pop(consumer) == "two" );
+        REQUIRE_THROWS_AS( pop(consumer, 10), TimeoutException );
+    }
+    SECTION( "empty messages are supported" ) {
+        push(producer, "");
+        REQUIRE( pop(consumer).empty() );
+    }
+    SECTION( "the queue depth limits the number of in-flight messages" ) {
+        for (int i = 0; i < 4; i++) {
+            push(producer, std::to_string(i));
+        }
+
+        REQUIRE_THROWS_AS( push(producer, "4", 10), TimeoutException );
+        REQUIRE( pop(consumer) == "0" );
+        push(producer, "4", 10);
+    }
+    SECTION( "the data area limits the number of in-flight bytes" ) {
+        push(producer, std::string(24, 'a'));
+        push(producer, std::string(24, 'b'));
+
+        REQUIRE_THROWS_AS( push(producer, std::string(24, 'c'), 10), TimeoutException );
+        REQUIRE( pop(consumer) == std::string(24, 'a') );
+
+        // the next message wraps around to the beginning of the data area
+        push(producer, std::string(24, 'c'), 10);
+        REQUIRE( pop(consumer) == std::string(24, 'b') );
+        REQUIRE( pop(consumer) == std::string(24, 'c') );
+    }
+    SECTION( "producers which do not wait are told about free space" ) {
+        for (int i = 0; i < 4; i++) {
+            push(producer, std::to_string(i));
+        }
+
+        REQUIRE( producer.try_reserve(1) == nullptr );
+        REQUIRE( producer.producer_polling() );
+
+        size_t size;
+        consumer.front(size);
+        REQUIRE( consumer.pop() );
+        REQUIRE_FALSE( producer.producer_polling() );
+        REQUIRE( producer.try_reserve(1) != nullptr );
+        producer.commit(1);
+
+        // only the first message after giving up is reported
+        consumer.front(size);
+        REQUIRE_FALSE( consumer.pop() );
+    }
+    SECTION( "messages larger than the data area are rejected" ) {
+        REQUIRE_THROWS_AS( push(producer, std::string(65, 'a')), RuntimeException );
+        REQUIRE_THROWS_AS( producer.try_reserve(65), RuntimeException );
+    }
+    SECTION( "reading from an empty queue times out" ) {
+        REQUIRE_THROWS_AS( pop(consumer, 10), TimeoutException );
+    }
+    SECTION( "a blocking consumer can be interrupted" ) {
+        std::thread thread([&]() { consumer.interrupt(); });
+        REQUIRE_THROWS_AS( pop(consumer), TimeoutException );
+        thread.join();
+    }
+    SECTION( "messages are transferred between threads" ) {
+        constexpr int count = 10000;
+        std::thread thread([&]() {
+            for (int i = 0; i < count; i++) {
+                push(producer, std::string(static_cast<size_t>(i % 50), 'x') + std::to_string(i));
+            }
+        });
+
+        bool in_order = true;
+        for (int i = 0; i < count; i++) {
+            std::string expected =
+                std::string(static_cast<size_t>(i % 50), 'x') + std::to_string(i);
+            if (pop(consumer) != expected) {
+                in_order = false;
+            }
+        }
+        thread.join();
+
+        REQUIRE( in_order );
+    }
+}
@@ -0,0 +1,449 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <seraphim/except.h>
+#include <seraphim/ipc/buffer_registry.h>
+#include <seraphim/ipc/shm_transport.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static const std::string SEGMENT = "seraphim_ipc_tests";
+
+static Seraphim::Message request(unsigned int id) {
+    Seraphim::Message msg;
+    msg.set_id(id);
+    msg.mutable_req();
+    return msg;
+}
+
+static std::chrono::nanoseconds thread_cpu_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+static size_t open_fds() {
+    size_t count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir) {
+        while (readdir(dir)) {
+            count++;
+        }
+        closedir(dir);
+    }
+    return count;
+}
+
+TEST_CASE( "SharedMemoryTransport runtime behavior", "[SharedMemoryTransport]" ) {
+    SharedMemoryTransport server;
+    unsigned int channel;
+
+    REQUIRE( server.create(SEGMENT, 1024 * 1024, 4, 2) );
+    server.set_rx_timeout(100);
+
+    SECTION( "clients are reported when they connect and disconnect" ) {
+        auto client = std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport());
+        REQUIRE( client->open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( channel == 0 );
+
+        client.reset();
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_DISCONNECTED );
+        REQUIRE( channel == 0 );
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+    }
+    SECTION( "the number of clients is limited by the number of channels" ) {
+        SharedMemoryTransport client1;
+        SharedMemoryTransport client2;
+        SharedMemoryTransport client3;
+
+        REQUIRE( client1.open(SEGMENT) );
+        REQUIRE( client2.open(SEGMENT) );
+        REQUIRE_FALSE( client3.open(SEGMENT) );
+    }
+    SECTION( "released channels can be claimed again" ) {
+        uint64_t peer = server.peer(0);
+        auto client = std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport());
+        REQUIRE( client->open(SEGMENT) );
+        client->send(request(1));
+        client.reset();
+
+        // the client was gone before the server noticed it, so there is nothing to report and
+        // its pending request must not be delivered to the next client
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+
+        client = std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport());
+        REQUIRE( client->open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( channel == 0 );
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+
+        // the new client cannot use what the previous one left behind
+        REQUIRE( server.peer(0) != peer );
+    }
+    SECTION( "clients which die without releasing their channel are detected" ) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            SharedMemoryTransport client;
+            // skip the destructor, which would release the channel
+            _exit(client.open(SEGMENT) ? 0 : 1);
+        }
+
+        int status;
+        REQUIRE( waitpid(pid, &status, 0) == pid );
+        REQUIRE( WEXITSTATUS(status) == 0 );
+
+        server.set_rx_timeout(3000);
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_DISCONNECTED );
+        REQUIRE( channel == 0 );
+    }
+    SECTION( "channels of clients which die before opening them are reclaimed" ) {
+        SharedMemoryTransport client;
+
+        // claim all channels like a client would right before crashing
+        int fd = shm_open(SEGMENT.c_str(), O_RDWR, 0);
+        REQUIRE( fd != -1 );
+        void *addr = mmap(nullptr, 1024 * 1024, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        REQUIRE( addr != MAP_FAILED );
+        auto *store = static_cast<SharedMemoryTransport::MessageStore *>(addr);
+        auto *channels = reinterpret_cast<SharedMemoryTransport::MessageStoreChannel *>(
+            static_cast<unsigned char *>(addr) + store->channels);
+        for (uint32_t i = 0; i < store->num_channels; i++) {
+            channels[i].state = SharedMemoryTransport::CHANNEL_CLAIMED;
+        }
+        munmap(addr, 1024 * 1024);
+        REQUIRE_FALSE( client.open(SEGMENT) );
+
+        // nobody holds the channels, so they are free again once the timeout passed
+        auto deadline = std::chrono::steady_clock::now() + SharedMemoryTransport::CLAIM_TIMEOUT +
+                        2 * SharedMemoryTransport::LIVENESS_INTERVAL;
+        bool opened = false;
+        while (!opened && std::chrono::steady_clock::now() < deadline) {
+            REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+            opened = client.open(SEGMENT);
+        }
+        REQUIRE( opened );
+    }
+    SECTION( "responses are delivered to the client that sent the request" ) {
+        SharedMemoryTransport client1;
+        SharedMemoryTransport client2;
+        Seraphim::Message msg;
+
+        REQUIRE( client1.open(SEGMENT) );
+        REQUIRE( client2.open(SEGMENT) );
+        client1.set_rx_timeout(100);
+        client2.set_rx_timeout(100);
+
+        client1.send(request(1));
+        client2.send(request(2));
+        client1.send(request(3));
+
+        for (int i = 0; i < 3; i++) {
+            server.receive(msg);
+            msg.mutable_res()->set_status(static_cast<int>(msg.id()));
+            server.send(msg);
+        }
+
+        client1.receive(msg);
+        REQUIRE( msg.res().status() == 1 );
+        client1.receive(msg);
+        REQUIRE( msg.res().status() == 3 );
+        client2.receive(msg);
+        REQUIRE( msg.res().status() == 2 );
+        REQUIRE_THROWS_AS( client2.receive(msg), TimeoutException );
+    }
+    SECTION( "full response queues do not block the server" ) {
+        SharedMemoryTransport client;
+        Seraphim::Message msg = request(1);
+        msg.mutable_res();
+
+        REQUIRE( client.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        client.set_rx_timeout(100);
+
+        // the queue holds four responses
+        for (int i = 0; i < 4; i++) {
+            REQUIRE( server.try_send(channel, msg) );
+        }
+        REQUIRE_FALSE( server.try_send(channel, msg) );
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+
+        client.receive(msg);
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_WRITABLE );
+        REQUIRE( channel == 0 );
+        REQUIRE( server.try_send(channel, msg) );
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+    }
+    SECTION( "busy clients cannot starve others" ) {
+        SharedMemoryTransport client1;
+        SharedMemoryTransport client2;
+        Seraphim::Message msg;
+
+        REQUIRE( client1.open(SEGMENT) );
+        REQUIRE( client2.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+
+        for (unsigned int i = 0; i < 4; i++) {
+            client1.send(request(i));
+        }
+        client2.send(request(100));
+
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 0 );
+        server.receive(channel, msg);
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 1 );
+        server.receive(channel, msg);
+        REQUIRE( msg.id() == 100 );
+    }
+    SECTION( "requests of paused channels are left in the queue" ) {
+        SharedMemoryTransport client1;
+        SharedMemoryTransport client2;
+        Seraphim::Message msg;
+
+        REQUIRE( client1.open(SEGMENT) );
+        REQUIRE( client2.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+
+        server.pause(0, true);
+        client1.send(request(1));
+        client2.send(request(2));
+
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 1 );
+        server.receive(channel, msg);
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+
+        server.pause(0, false);
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 0 );
+        server.receive(channel, msg);
+        REQUIRE( msg.id() == 1 );
+    }
+    SECTION( "buffers shared by clients can be resolved by the server" ) {
+        SharedMemoryTransport client;
+        Seraphim::Types::BufferRef ref;
+        unsigned char *buffer;
+        unsigned char *resolved;
+
+        REQUIRE( client.open(SEGMENT) );
+        buffer = client.acquire_buffer(5, ref);
+        REQUIRE( buffer != nullptr );
+        REQUIRE( ref.region() == SEGMENT );
+        REQUIRE( ref.size() == 5 );
+        std::memcpy(buffer, "hello", 5);
+
+        uint64_t peer = server.peer(0);
+        resolved = BufferRegistry::Instance().resolve(peer, ref.region(), ref.offset(),
+                                                      ref.size());
+        REQUIRE( resolved != nullptr );
+        REQUIRE( std::memcmp(resolved, "hello", 5) == 0 );
+        REQUIRE( BufferRegistry::Instance().resolve(peer, ref.region(), ref.offset(), 1 << 30) ==
+                 nullptr );
+        REQUIRE( BufferRegistry::Instance().resolve(peer, "unknown", ref.offset(), ref.size()) ==
+                 nullptr );
+
+        // the frame area belongs to the client of the channel
+        REQUIRE( BufferRegistry::Instance().resolve(server.peer(1), ref.region(), ref.offset(),
+                                                    ref.size()) == nullptr );
+        REQUIRE( BufferRegistry::Instance().resolve(0, ref.region(), ref.offset(), ref.size()) ==
+                 nullptr );
+        REQUIRE( BufferRegistry::Instance().resolve(peer, ref.region(), 0, 1) == nullptr );
+
+        // message handlers resolve buffers on behalf of the client whose request they handle
+        REQUIRE( BufferRegistry::current() == 0 );
+        {
+            BufferRegistry::Scope scope(peer);
+            REQUIRE( BufferRegistry::current() == peer );
+        }
+        REQUIRE( BufferRegistry::current() == 0 );
+    }
+    SECTION( "buffer space is reused once it was released" ) {
+        SharedMemoryTransport client;
+        Seraphim::Types::BufferRef ref1;
+        Seraphim::Types::BufferRef ref2;
+        Seraphim::Types::BufferRef ref3;
+
+        // each channel owns roughly 300 KiB of frame space
+        REQUIRE( client.open(SEGMENT) );
+        REQUIRE( client.acquire_buffer(128 * 1024, ref1) != nullptr );
+        REQUIRE( client.acquire_buffer(128 * 1024, ref2) != nullptr );
+        REQUIRE( client.acquire_buffer(128 * 1024, ref3) == nullptr );
+
+        // the second buffer cannot be reused before the first one was released
+        client.release_buffer(ref2);
+        REQUIRE( client.acquire_buffer(128 * 1024, ref3) == nullptr );
+        client.release_buffer(ref1);
+        REQUIRE( client.acquire_buffer(128 * 1024, ref3) != nullptr );
+        REQUIRE( ref3.offset() == ref1.offset() );
+    }
+    SECTION( "messages larger than the queues are streamed in chunks" ) {
+        SharedMemoryTransport client;
+        Seraphim::Types::Image2D img;
+        Seraphim::Message msg;
+        Seraphim::Message response1;
+        Seraphim::Message response2;
+
+        REQUIRE( client.open(SEGMENT) );
+        client.set_rx_timeout(1000);
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+
+        // the message is larger than the whole segment
+        img.set_data(std::string(2 * 1024 * 1024, 'x'));
+        msg = request(1);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        std::thread peer([&]() {
+            client.send(msg);
+            client.send(request(2));
+            client.receive(response1);
+            client.receive(response2);
+        });
+
+        // the server echoes both requests, so the large one is chunked in both directions
+        for (unsigned int i = 1; i <= 2; i++) {
+            Seraphim::Message received;
+            server.receive(received);
+            REQUIRE( received.id() == i );
+            server.send(received);
+        }
+        peer.join();
+
+        Seraphim::Types::Image2D received;
+        REQUIRE( response1.id() == 1 );
+        REQUIRE( response1.req().inner().UnpackTo(&received) );
+        REQUIRE( received.data() == img.data() );
+        REQUIRE( response2.id() == 2 );
+    }
+    SECTION( "chunked requests larger than the limit are skipped" ) {
+        SharedMemoryTransport client;
+        Seraphim::Types::Image2D img;
+        Seraphim::Message msg;
+
+        REQUIRE( client.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        server.set_max_message_size(1024 * 1024);
+
+        img.set_data(std::string(2 * 1024 * 1024, 'x'));
+        msg = request(1);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        std::thread peer([&]() {
+            client.send(msg);
+            client.send(request(2));
+        });
+
+        // only the id is left of the large request, the next one is received as usual
+        Seraphim::Message received;
+        server.receive(channel, received);
+        REQUIRE( received.id() == 1 );
+        REQUIRE( !received.has_req() );
+        server.receive(channel, received);
+        REQUIRE( received.id() == 2 );
+        REQUIRE( received.has_req() );
+        peer.join();
+    }
+    SECTION( "chunked requests which stall do not hold up other clients" ) {
+        SharedMemoryTransport client1;
+        SharedMemoryTransport client2;
+        Seraphim::Types::Image2D img;
+        Seraphim::Message msg;
+        Seraphim::Message received;
+
+        REQUIRE( client1.open(SEGMENT) );
+        REQUIRE( client2.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+
+        // the first client gives up once its queue is full, the rest of the request never comes
+        img.set_data(std::string(2 * 1024 * 1024, 'x'));
+        msg = request(1);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        client1.set_tx_timeout(50);
+        REQUIRE_THROWS_AS( client1.send(msg), TimeoutException );
+        client2.send(request(2));
+
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 1 );
+        REQUIRE( std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50) );
+        server.receive(channel, received);
+        REQUIRE( received.id() == 2 );
+
+        // the next request of the first client replaces the incomplete one
+        client1.send(request(3));
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_REQUEST );
+        REQUIRE( channel == 0 );
+        server.receive(channel, received);
+        REQUIRE( received.id() == 3 );
+    }
+    SECTION( "a blocking server can be interrupted" ) {
+        server.set_rx_timeout(0);
+        std::thread thread([&]() { server.interrupt(); });
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+        thread.join();
+    }
+    SECTION( "idle peers sleep instead of spinning" ) {
+        SharedMemoryTransport client;
+        Seraphim::Message msg;
+
+        REQUIRE( client.open(SEGMENT) );
+        REQUIRE( server.poll(channel) == SharedMemoryTransport::CHANNEL_CONNECTED );
+        client.set_rx_timeout(200);
+        server.set_rx_timeout(200);
+
+        // both sides wait for 200 ms, a busy loop would burn about as much CPU time
+        auto start = thread_cpu_time();
+        REQUIRE_THROWS_AS( client.receive(msg), TimeoutException );
+        REQUIRE_THROWS_AS( server.poll(channel), TimeoutException );
+        REQUIRE( thread_cpu_time() - start < std::chrono::milliseconds(40) );
+    }
+}
+
+TEST_CASE( "SharedMemoryTransport memory placement", "[SharedMemoryTransport]" ) {
+    SharedMemoryTransport server;
+    SharedMemoryTransport client;
+    SharedMemoryTransport::Options options;
+    Seraphim::Message msg;
+
+    SECTION( "pre-faulted segments with huge page hints work like regular ones" ) {
+        options.huge_pages = SharedMemoryTransport::HugePages::TRANSPARENT;
+        options.populate = true;
+        options.numa_node = SharedMemoryTransport::local_numa_node();
+        REQUIRE( server.create(SEGMENT, 4 * 1024 * 1024, 4, 2, options) );
+        server.set_rx_timeout(100);
+
+        REQUIRE( client.open(SEGMENT) );
+        client.set_rx_timeout(100);
+        client.send(request(1));
+        server.receive(msg);
+        REQUIRE( msg.id() == 1 );
+        server.send(msg);
+        client.receive(msg);
+        REQUIRE( msg.id() == 1 );
+    }
+    SECTION( "segments cannot be placed on nodes which do not exist" ) {
+        options.numa_node = 1 << 20;
+        REQUIRE( !server.create(SEGMENT, 1024 * 1024, 4, 2, options) );
+        REQUIRE( !client.open(SEGMENT) );
+    }
+    SECTION( "segments which cannot be set up are not left behind" ) {
+        size_t fds = open_fds();
+
+        // the queues of a channel are too small for this many messages
+        REQUIRE( !server.create(SEGMENT, 64 * 1024, 4096, 2) );
+        REQUIRE( !client.open(SEGMENT) );
+        REQUIRE( open_fds() == fds );
+    }
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Types.pb.h>
+#include <seraphim/except.h>
+#include <seraphim/ipc/except.h>
+#include <seraphim/ipc/net/tcp_connection.h>
+
+using namespace sph;
+using namespace sph::ipc;
+using namespace sph::ipc::net;
+
+TEST_CASE( "TCPConnection runtime behavior", "[TCPConnection]" ) {
+    int fds[2];
+    REQUIRE( socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0 );
+
+    TCPConnection sender(fds[0]);
+    TCPConnection receiver(fds[1]);
+    Seraphim::Message msg;
+
+    SECTION( "reads do not block on non-blocking sockets" ) {
+        REQUIRE( !receiver.read() );
+        REQUIRE( !receiver.pending() );
+        REQUIRE( !receiver.next(msg) );
+    }
+    SECTION( "queued messages are written together and parsed one by one" ) {
+        for (unsigned int i = 0; i < 3; i++) {
+            msg.set_id(i);
+            msg.mutable_req();
+            sender.queue(msg);
+        }
+        REQUIRE( !sender.flushed() );
+        REQUIRE( sender.flush() );
+        REQUIRE( sender.flushed() );
+
+        REQUIRE( receiver.read() );
+        for (unsigned int i = 0; i < 3; i++) {
+            REQUIRE( receiver.pending() );
+            REQUIRE( receiver.next(msg) );
+            REQUIRE( msg.id() == i );
+        }
+        REQUIRE( !receiver.pending() );
+    }
+    SECTION( "data received by other means is framed the same way" ) {
+        msg.set_id(7);
+        msg.mutable_req();
+        sender.queue(msg);
+        msg.set_id(8);
+        sender.queue(msg);
+        REQUIRE( sender.flush() );
+
+        // pass the stream in small chunks, as received into small buffers
+        uint8_t buf[4096];
+        ssize_t ret = ::recv(fds[1], buf, sizeof(buf), 0);
+        REQUIRE( ret > 0 );
+        receiver.append(buf, 3);
+        REQUIRE( !receiver.pending() );
+        for (ssize_t i = 3; i < ret; i += 3) {
+            receiver.append(buf + i, static_cast<size_t>(std::min<ssize_t>(3, ret - i)));
+        }
+
+        REQUIRE( receiver.next(msg) );
+        REQUIRE( msg.id() == 7 );
+        REQUIRE( receiver.next(msg) );
+        REQUIRE( msg.id() == 8 );
+        REQUIRE( !receiver.pending() );
+    }
+    SECTION( "messages larger than the limit are rejected" ) {
+        Seraphim::Types::Image2D img;
+        img.set_data(std::string(2048, 'x'));
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        sender.queue(msg);
+        REQUIRE( sender.flush() );
+
+        receiver.set_max_message_size(1024);
+        REQUIRE( receiver.read() );
+        REQUIRE_THROWS_AS( receiver.read(), RuntimeException );
+
+        sender.set_max_message_size(1024);
+        REQUIRE_THROWS_AS( sender.queue(msg), RuntimeException );
+    }
+    SECTION( "the receive buffer shrinks after large messages" ) {
+        Seraphim::Types::Image2D img;
+        img.set_data(std::string(256 * 1024, 'x'));
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        sender.queue(msg);
+
+        // the socket buffer is smaller than the message
+        while (!receiver.pending()) {
+            sender.flush();
+            receiver.read();
+        }
+        REQUIRE( receiver.rx_capacity() > TCPConnection::RX_BUFFER_SIZE );
+        REQUIRE( receiver.next(msg) );
+        REQUIRE( msg.req().inner().UnpackTo(&img) );
+        REQUIRE( img.data().size() == 256 * 1024 );
+
+        msg.Clear();
+        msg.set_id(9);
+        msg.mutable_req();
+        sender.queue(msg);
+        REQUIRE( sender.flush() );
+        REQUIRE( receiver.read() );
+        REQUIRE( receiver.rx_capacity() == TCPConnection::RX_BUFFER_SIZE );
+        REQUIRE( receiver.next(msg) );
+        REQUIRE( msg.id() == 9 );
+    }
+    SECTION( "disconnected peers are detected" ) {
+        ::close(fds[0]);
+        fds[0] = -1;
+        REQUIRE_THROWS_AS( receiver.read(), PeerDisconnectedException );
+    }
+
+    if (fds[0] != -1) {
+        ::close(fds[0]);
+    }
+    ::close(fds[1]);
+}
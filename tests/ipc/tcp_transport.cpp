@@ -0,0 +1,130 @@
+#include <catch2/catch.hpp>
+#include <netinet/tcp.h>
+#include <thread>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/except.h>
+#include <seraphim/ipc/net/io_uring.h>
+#include <seraphim/ipc/tcp_transport.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static const uint16_t PORT = 38103;
+
+TEST_CASE( "TCPTransport runtime behavior", "[TCPTransport]" ) {
+    TCPTransport server(net::Socket::Family::INET);
+    TCPTransport client(net::Socket::Family::INET);
+    Seraphim::Message msg;
+
+    REQUIRE( server.bind(PORT) );
+    server.listen(1);
+    // accepted connections inherit the timeouts of the listening socket
+    server.set_rx_timeout(100);
+    REQUIRE( client.connect("127.0.0.1", PORT) );
+    client.set_rx_timeout(100);
+    int fd = server.accept(nullptr, nullptr);
+    REQUIRE( fd >= 0 );
+
+    SECTION( "messages are exchanged in both directions" ) {
+        msg.set_id(42);
+        msg.mutable_req();
+        client.send(msg);
+
+        msg.Clear();
+        server.receive(fd, msg);
+        REQUIRE( msg.id() == 42 );
+        REQUIRE( !server.pending(fd) );
+
+        msg.set_id(43);
+        server.send(fd, msg);
+        msg.Clear();
+        client.receive(msg);
+        REQUIRE( msg.id() == 43 );
+    }
+    SECTION( "back-to-back messages are split correctly" ) {
+        for (unsigned int i = 0; i < 16; i++) {
+            msg.set_id(i);
+            msg.mutable_req();
+            client.send(msg);
+        }
+
+        for (unsigned int i = 0; i < 16; i++) {
+            server.receive(fd, msg);
+            REQUIRE( msg.id() == i );
+        }
+        REQUIRE( !server.pending(fd) );
+        REQUIRE_THROWS_AS( server.receive(fd, msg), TimeoutException );
+    }
+    SECTION( "messages larger than the receive buffer are reassembled" ) {
+        Seraphim::Types::Image2D img;
+        Seraphim::Message response;
+
+        img.set_data(std::string(4 * 1024 * 1024, 'x'));
+        msg.set_id(1);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        std::thread sender([&]() {
+            client.send(msg);
+            msg.set_id(2);
+            client.send(msg);
+        });
+        server.receive(fd, response);
+        REQUIRE( response.id() == 1 );
+        server.receive(fd, response);
+        REQUIRE( response.id() == 2 );
+        sender.join();
+
+        Seraphim::Types::Image2D received;
+        REQUIRE( response.req().inner().UnpackTo(&received) );
+        REQUIRE( received.data() == img.data() );
+    }
+    SECTION( "connections accepted by io_uring get the Nagle setting" ) {
+        TCPTransport other(net::Socket::Family::INET);
+        int accepted = -1;
+        int opt_val = 0;
+        socklen_t opt_len = sizeof(opt_val);
+
+        if (!net::IOUring::supported()) {
+            WARN( "io_uring not available, skipping" );
+            server.disconnect(fd);
+            return;
+        }
+
+        // io_uring interrupts blocking calls of the thread which owns the ring with EINTR, so
+        // keep it away from the thread running the other tests
+        std::thread acceptor([&]() {
+            net::IOUring ring;
+            net::IOUring::Completion completion = {};
+            if (!ring.init()) {
+                return;
+            }
+            ring.prep_accept(server.socket().fd(), 1);
+            ring.submit(1, 1000);
+            if (ring.next(completion)) {
+                accepted = completion.res;
+            }
+        });
+        REQUIRE( other.connect("127.0.0.1", PORT) );
+        acceptor.join();
+        REQUIRE( accepted >= 0 );
+
+        // clear the option, so the result does not depend on what the listening socket passed on
+        opt_val = 0;
+        REQUIRE( setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &opt_val, opt_len) == 0 );
+        server.socket().apply_nodelay(accepted);
+        REQUIRE( getsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &opt_val, &opt_len) == 0 );
+        REQUIRE( opt_val != 0 );
+
+        server.socket().set_nodelay(false);
+        server.socket().apply_nodelay(accepted);
+        REQUIRE( getsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, &opt_val, &opt_len) == 0 );
+        REQUIRE( opt_val == 0 );
+        ::close(accepted);
+    }
+    SECTION( "disconnected clients are detected" ) {
+        client.socket().reset(true);
+        REQUIRE_THROWS_AS( server.receive(fd, msg), PeerDisconnectedException );
+    }
+
+    server.disconnect(fd);
+}
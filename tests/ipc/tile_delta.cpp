@@ -0,0 +1,93 @@
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include <seraphim/ipc/tile_delta.h>
+
+using namespace sph::ipc;
+
+TEST_CASE( "TileEncoder runtime behavior", "[TileEncoder]" ) {
+    // odd dimensions, so the tiles at the right and bottom edges are clipped
+    const uint32_t width = 100;
+    const uint32_t height = 70;
+    const size_t bpp = 3;
+    const size_t stride = width * bpp + 4;
+    std::vector<unsigned char> frame(stride * height);
+    std::vector<unsigned char> remote;
+    Seraphim::Types::TileDelta delta;
+    TileEncoder encoder(32);
+
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = static_cast<unsigned char>(i * 7);
+    }
+
+    // the receiver starts out with the full first frame
+    REQUIRE( !encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+    remote = frame;
+
+    SECTION( "hashes depend on every byte and on the byte order" ) {
+        uint64_t hash = tile_hash(frame.data(), 40, 3, stride);
+        REQUIRE( tile_hash(frame.data(), 40, 3, stride) == hash );
+
+        frame[stride + 39] ^= 1;
+        REQUIRE( tile_hash(frame.data(), 40, 3, stride) != hash );
+        frame[stride + 39] ^= 1;
+
+        // swap two 16 byte stripes of a row
+        unsigned char tmp[16];
+        std::memcpy(tmp, frame.data(), 16);
+        std::memcpy(frame.data(), frame.data() + 16, 16);
+        std::memcpy(frame.data() + 16, tmp, 16);
+        REQUIRE( tile_hash(frame.data(), 40, 3, stride) != hash );
+    }
+    SECTION( "unchanged frames produce empty deltas" ) {
+        REQUIRE( encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+        REQUIRE( delta.tiles_size() == 0 );
+        REQUIRE( delta.data().empty() );
+    }
+    SECTION( "only changed tiles are sent and patched" ) {
+        // pixel in the first tile and in the clipped bottom right tile
+        frame[0] ^= 0xFF;
+        frame[(height - 1) * stride + (width - 1) * bpp] ^= 0xFF;
+
+        REQUIRE( encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+        REQUIRE( delta.tile_size() == 32 );
+        REQUIRE( delta.tiles_size() == 2 );
+        REQUIRE( delta.tiles(0) == 0 );
+        REQUIRE( delta.tiles(1) == 11 );
+        REQUIRE( delta.data().size() == (32 * 32 + 4 * 6) * bpp );
+
+        REQUIRE( apply_tile_delta(delta, remote.data(), width, height, stride, bpp) );
+        for (uint32_t y = 0; y < height; y++) {
+            REQUIRE( std::memcmp(&remote[y * stride], &frame[y * stride], width * bpp) == 0 );
+        }
+    }
+    SECTION( "full frames are sent if too many tiles changed" ) {
+        for (auto &byte : frame) {
+            byte++;
+        }
+
+        REQUIRE( !encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+        // the frame is the new reference nevertheless
+        REQUIRE( encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+        REQUIRE( delta.tiles_size() == 0 );
+    }
+    SECTION( "format changes and resets require a full frame" ) {
+        REQUIRE( !encoder.encode(frame.data(), width / 2, height, stride, bpp, delta) );
+        encoder.reset();
+        REQUIRE( !encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+    }
+    SECTION( "deltas which do not fit the frame are rejected" ) {
+        frame[0] ^= 0xFF;
+        REQUIRE( encoder.encode(frame.data(), width, height, stride, bpp, delta) );
+
+        Seraphim::Types::TileDelta bad = delta;
+        bad.mutable_data()->pop_back();
+        REQUIRE( !apply_tile_delta(bad, remote.data(), width, height, stride, bpp) );
+
+        bad = delta;
+        bad.set_tiles(0, 12);
+        REQUIRE( !apply_tile_delta(bad, remote.data(), width, height, stride, bpp) );
+    }
+}
@@ -0,0 +1,173 @@
+#include <arpa/inet.h>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/udp_transport.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static const uint16_t PORT = 38104;
+
+/**
+ * @brief Send a message as a single datagram with a handcrafted header.
+ */
+static void send_raw(net::UDPSocket &socket, uint32_t session, uint32_t seq, uint16_t count,
+                     const Seraphim::Message &msg) {
+    std::string data = msg.SerializeAsString();
+    UDPTransport::FragmentHeader header;
+
+    header.session = htonl(session);
+    header.seq = htonl(seq);
+    header.size = htonl(static_cast<uint32_t>(data.size()));
+    header.offset = 0;
+    header.index = 0;
+    header.count = htons(count);
+
+    data.insert(0, reinterpret_cast<const char *>(&header), sizeof(header));
+    socket.send(data.data(), data.size());
+}
+
+/**
+ * @brief Send a fragment filled with dummy data with a handcrafted header.
+ */
+static void send_fragment(net::UDPSocket &socket, uint32_t seq, uint32_t size, uint32_t offset,
+                          uint16_t index, uint16_t count, size_t length) {
+    std::string data(length, 'x');
+    UDPTransport::FragmentHeader header;
+
+    header.session = htonl(7);
+    header.seq = htonl(seq);
+    header.size = htonl(size);
+    header.offset = htonl(offset);
+    header.index = htons(index);
+    header.count = htons(count);
+
+    data.insert(0, reinterpret_cast<const char *>(&header), sizeof(header));
+    socket.send(data.data(), data.size());
+}
+
+TEST_CASE( "UDPTransport runtime behavior", "[UDPTransport]" ) {
+    UDPTransport server(net::Socket::Family::INET);
+    UDPTransport client(net::Socket::Family::INET);
+    UDPTransport::Endpoint peer;
+    Seraphim::Message msg;
+
+    REQUIRE( server.bind(PORT) );
+    REQUIRE( client.connect("127.0.0.1", PORT) );
+    server.set_rx_timeout(100);
+    client.set_rx_timeout(100);
+
+    SECTION( "messages are exchanged in both directions" ) {
+        msg.set_id(42);
+        msg.mutable_req();
+        client.send(msg);
+
+        msg.Clear();
+        server.receive(msg, peer);
+        REQUIRE( msg.id() == 42 );
+        REQUIRE( !server.pending() );
+
+        // answer at the address the request came from
+        msg.set_id(43);
+        server.send(peer, msg);
+        msg.Clear();
+        client.receive(msg);
+        REQUIRE( msg.id() == 43 );
+
+        REQUIRE( client.stats().messages_sent == 1 );
+        REQUIRE( client.stats().messages_received == 1 );
+        REQUIRE( server.stats().messages_lost == 0 );
+    }
+    SECTION( "messages larger than a datagram are fragmented and reassembled" ) {
+        Seraphim::Types::Image2D img;
+        Seraphim::Message response;
+
+        img.set_data(std::string(64 * 1024, 'x'));
+        img.mutable_data()->back() = 'y';
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        client.send(msg);
+        server.receive(response, peer);
+
+        Seraphim::Types::Image2D received;
+        REQUIRE( response.req().inner().UnpackTo(&received) );
+        REQUIRE( received.data() == img.data() );
+        REQUIRE( server.stats().datagrams_received > 1 );
+        REQUIRE( server.stats().datagrams_received == client.stats().datagrams_sent );
+    }
+    SECTION( "incomplete messages are dropped after the deadline" ) {
+        net::UDPSocket raw(net::Socket::Family::INET);
+        REQUIRE( raw.connect("127.0.0.1", PORT) );
+        server.set_deadline(10);
+
+        // first of three fragments
+        send_fragment(raw, 0, 3000, 0, 0, 3, 1380);
+        REQUIRE( server.read() );
+        REQUIRE( !server.pending() );
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE_THROWS_AS( server.receive(msg, peer), TimeoutException );
+        REQUIRE( server.stats().messages_expired == 1 );
+    }
+    SECTION( "late messages are dropped and gaps are counted as lost" ) {
+        net::UDPSocket raw(net::Socket::Family::INET);
+        REQUIRE( raw.connect("127.0.0.1", PORT) );
+
+        msg.set_id(5);
+        send_raw(raw, 7, 5, 1, msg);
+        msg.set_id(3);
+        send_raw(raw, 7, 3, 1, msg);
+        msg.set_id(7);
+        send_raw(raw, 7, 7, 1, msg);
+
+        server.receive(msg, peer);
+        REQUIRE( msg.id() == 5 );
+        server.receive(msg, peer);
+        REQUIRE( msg.id() == 7 );
+        REQUIRE( server.stats().messages_late == 1 );
+        REQUIRE( server.stats().messages_lost == 1 );
+
+        // a new session starts over
+        msg.set_id(1);
+        send_raw(raw, 8, 0, 1, msg);
+        server.receive(msg, peer);
+        REQUIRE( msg.id() == 1 );
+        REQUIRE( server.stats().messages_late == 1 );
+    }
+    SECTION( "malformed datagrams are discarded" ) {
+        net::UDPSocket raw(net::Socket::Family::INET);
+        REQUIRE( raw.connect("127.0.0.1", PORT) );
+
+        raw.send("abc", 3);
+        msg.set_id(1);
+        send_raw(raw, 7, 0, 0, msg);
+        REQUIRE_THROWS_AS( server.receive(msg, peer), TimeoutException );
+        REQUIRE( server.stats().datagrams_invalid == 2 );
+    }
+    SECTION( "fragments which do not fit their message are discarded" ) {
+        net::UDPSocket raw(net::Socket::Family::INET);
+        REQUIRE( raw.connect("127.0.0.1", PORT) );
+        server.set_max_message_size(64 * 1024);
+
+        // too large
+        send_fragment(raw, 0, 100000, 0, 0, 73, 1380);
+        // more fragments than the size needs
+        send_fragment(raw, 1, 100, 0, 0, 2, 100);
+        // wrong offset
+        send_fragment(raw, 2, 3000, 1000, 1, 3, 1380);
+        // last fragment does not end with the message
+        send_fragment(raw, 3, 3000, 2760, 2, 3, 100);
+        // fragment which is not the last one is not full
+        send_fragment(raw, 4, 3000, 1380, 1, 3, 100);
+
+        REQUIRE( server.read() );
+        while (server.read(false)) {
+        }
+        REQUIRE( server.stats().datagrams_received == 5 );
+        REQUIRE( server.stats().datagrams_invalid == 5 );
+        REQUIRE( !server.pending() );
+    }
+}
@@ -0,0 +1,142 @@
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+
+#include <seraphim/except.h>
+#include <seraphim/ipc/buffer_registry.h>
+#include <seraphim/ipc/except.h>
+#include <seraphim/ipc/unix_transport.h>
+
+using namespace sph;
+using namespace sph::ipc;
+
+static std::string socket_path() {
+    return std::string("/tmp/seraphim_ipc_tests_") + std::to_string(getpid()) + ".sock";
+}
+
+TEST_CASE( "UnixTransport runtime behavior", "[UnixTransport]" ) {
+    UnixTransport server;
+    UnixTransport client;
+    Seraphim::Message msg;
+
+    REQUIRE( server.bind(socket_path()) );
+    server.listen(1);
+    REQUIRE( client.connect(socket_path()) );
+    int fd = server.accept();
+    server.set_rx_timeout(100);
+    client.set_rx_timeout(100);
+
+    SECTION( "messages are exchanged in both directions" ) {
+        msg.set_id(42);
+        msg.mutable_req();
+        client.send(msg);
+
+        msg.Clear();
+        server.receive(fd, msg);
+        REQUIRE( msg.id() == 42 );
+
+        msg.set_id(43);
+        server.send(fd, msg);
+        msg.Clear();
+        client.receive(msg);
+        REQUIRE( msg.id() == 43 );
+    }
+    SECTION( "messages larger than the socket buffer are reassembled" ) {
+        Seraphim::Types::Image2D img;
+        Seraphim::Message response;
+
+        img.set_data(std::string(8 * 1024 * 1024, 'x'));
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        std::thread sender([&]() { client.send(msg); });
+        server.receive(fd, response);
+        sender.join();
+
+        Seraphim::Types::Image2D received;
+        REQUIRE( response.req().inner().UnpackTo(&received) );
+        REQUIRE( received.data() == img.data() );
+    }
+    SECTION( "buffers are shared with the server" ) {
+        Seraphim::Types::BufferRef ref;
+        unsigned char *buffer = client.acquire_buffer(4096, ref);
+        REQUIRE( buffer != nullptr );
+        REQUIRE( ref.size() == 4096 );
+        std::memset(buffer, 0xab, 4096);
+
+        Seraphim::Types::Image2D img;
+        img.mutable_buffer()->CopyFrom(ref);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        client.send(msg);
+        server.receive(fd, msg);
+
+        REQUIRE( msg.req().inner().UnpackTo(&img) );
+        const auto &received = img.buffer();
+        uint64_t peer = server.peer(fd);
+        unsigned char *mapped = BufferRegistry::Instance().resolve(
+            peer, received.region(), received.offset(), received.size());
+        REQUIRE( mapped != nullptr );
+        REQUIRE( mapped != buffer );
+        REQUIRE( mapped[0] == 0xab );
+        REQUIRE( mapped[4095] == 0xab );
+
+        // other clients cannot access the buffer by its name
+        REQUIRE( BufferRegistry::Instance().resolve(BufferRegistry::new_peer(), received.region(),
+                                                    0, 1) == nullptr );
+
+        // the buffer may not be accessed once the response was sent
+        server.send(fd, msg);
+        REQUIRE( BufferRegistry::Instance().resolve(peer, received.region(), 0, 1) == nullptr );
+        client.receive(msg);
+
+        // released buffers are reused
+        client.release_buffer(ref);
+        Seraphim::Types::BufferRef ref2;
+        REQUIRE( client.acquire_buffer(1024, ref2) == buffer );
+        REQUIRE( ref2.region() == ref.region() );
+    }
+    SECTION( "messages larger than the limit are rejected" ) {
+        Seraphim::Types::Image2D img;
+
+        server.set_max_message_size(1024);
+        img.set_data(std::string(2048, 'x'));
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        client.send(msg);
+        REQUIRE_THROWS_AS( server.receive(fd, msg), RuntimeException );
+    }
+    SECTION( "buffers stay registered while requests are handled" ) {
+        Seraphim::Types::BufferRef ref;
+        unsigned char *buffer = client.acquire_buffer(4096, ref);
+        REQUIRE( buffer != nullptr );
+        std::memset(buffer, 0xcd, 4096);
+
+        Seraphim::Types::Image2D img;
+        img.mutable_buffer()->CopyFrom(ref);
+        msg.mutable_req()->mutable_inner()->PackFrom(img);
+        client.send(msg);
+        client.send(msg);
+
+        auto consume = [&](const unsigned char *data, size_t size) {
+            REQUIRE( msg.ParseFromArray(data, static_cast<int>(size)) );
+        };
+        std::vector<std::string> first = server.receive(fd, consume);
+        std::vector<std::string> second = server.receive(fd, consume);
+        REQUIRE( first.size() == 1 );
+        REQUIRE( second == first );
+
+        // the buffer is still referenced by the second request
+        server.release_buffers(fd, first);
+        unsigned char *mapped =
+            BufferRegistry::Instance().resolve(server.peer(fd), first[0], 0, 4096);
+        REQUIRE( mapped != nullptr );
+        REQUIRE( mapped[4095] == 0xcd );
+
+        server.release_buffers(fd, second);
+        REQUIRE( BufferRegistry::Instance().resolve(server.peer(fd), first[0], 0, 1) == nullptr );
+    }
+    SECTION( "disconnected clients are detected" ) {
+        client.socket().reset(true);
+        REQUIRE_THROWS_AS( server.receive(fd, msg), PeerDisconnectedException );
+    }
+
+    server.disconnect(fd);
+}